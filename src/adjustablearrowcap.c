@@ -136,6 +136,8 @@ gdip_adjust_arrowcap_draw (GpGraphics *graphics, GpPen *pen, GpCustomLineCap *cu
 	gdip_cairo_line_to (graphics, (double)w * penwidth, (double)-h * penwidth, TRUE, TRUE);
 	gdip_cairo_line_to (graphics, 0, 0, TRUE, TRUE);
 
+	gdip_graphics_path_modified (graphics, TRUE);
+
 	if (arrowcap->fill_state) {
 		/* FIXME: handle middle_inset */
 		cairo_fill_preserve (graphics->ct);
@@ -48,6 +48,11 @@
 #define GBD_WRITE_OK			(1<<9)
 #define GBD_LOCKED			(1<<10)
 #define GBD_TRUE24BPP			(1<<11)
+#define GBD_IN_PLACE			(1<<12)	/* LockBits: scan0 points into the pixels of the bitmap */
+#define GBD_SHARED_SCAN0		(1<<13)	/* scan0 may be shared with clones, see gdip_bitmap_ensure_writable */
+#define GBD_SURFACE_SCAN0		(1<<14)	/* the cairo surface of the bitmap draws on scan0 directly */
+#define GBD_DECODED			(1<<15)	/* scan0 is unmodified from the frame decoder, so it can be decoded again */
+#define GBD_PROPERTIES_PENDING		(1<<16)	/* the frame decoder has properties to add, see gdip_bitmap_load_properties */
 
 #ifdef WORDS_BIGENDIAN
 #define set_pixel_bgra(pixel,index,b,g,r,a) do { \
@@ -95,6 +100,8 @@ typedef struct {
 	unsigned int	y;			/* LockBits: top coordinate of locked rectangle */
 
 	int		transparent;		/* Index of transparent color (<24bit only) */
+
+	int		property_capacity;	/* Number of properties property has room for (not mirrored in BitmapData) */
 } ActiveBitmapData;
 
 typedef struct {
@@ -103,6 +110,30 @@ typedef struct {
 	GUID		frame_dimension;	/* GUID describing the frame type */
 } FrameData;
 
+/* Decodes the pixels of frames on demand, for codecs that only read the metadata of every frame upfront
+ * (frames not decoded yet have a NULL scan0). Shared by a bitmap and its clones. */
+typedef struct _BitmapFrameDecoder BitmapFrameDecoder;
+struct _BitmapFrameDecoder {
+	int		refcount;
+	/* serializes decode and load_properties, which usually read from a single codec handle */
+#if GLIB_CHECK_VERSION(2,32,0)
+	GMutex		mutex;
+#else
+	GStaticMutex	mutex;
+#endif
+	/* allocates and fills scan0 (and stride) of data, the index-th bitmap of the frame-th frame */
+	GpStatus	(*decode) (BitmapFrameDecoder *decoder, int frame, int index, ActiveBitmapData *data);
+	/* optional, decodes the (single frame) image again at a reduced size of at least width x height. Such a
+	 * decoder describes the pixels as they were loaded, so the bitmap drops it once they are modified */
+	GpStatus	(*decode_scaled) (BitmapFrameDecoder *decoder, UINT width, UINT height, GpImage **image);
+	/* optional, adds the properties of bitmaps the codec flagged GBD_PROPERTIES_PENDING, the first time they are needed */
+	GpStatus	(*load_properties) (BitmapFrameDecoder *decoder, int frame, int index, ActiveBitmapData *data);
+	/* optional, with decode_scaled: a new decoder (holding its only reference) that only adds the properties, so the
+	 * bitmap can let go of what decode_scaled needs once its pixels are modified */
+	BitmapFrameDecoder *	(*properties_only) (BitmapFrameDecoder *decoder);
+	void		(*dispose) (BitmapFrameDecoder *decoder);
+};
+
 typedef struct _Image {
 	/* Image Description */
 	ImageType     	type;			/* Undefined, Bitmap, MetaFile */
@@ -117,8 +148,16 @@ typedef struct _Image {
 	/* Internal fields */
 	int             cairo_format;
 	cairo_surface_t *surface;
+	guint64		generation;		/* bumped by gdip_bitmap_modified whenever the pixels change */
+	BOOL		processed_cached;	/* the processed bitmap cache may hold entries derived from this bitmap */
+	GpRect		surface_dirty;		/* area of the surface drawn on since it was last flushed to scan0 */
+	BitmapFrameDecoder	*decoder;		/* decodes frames on demand, or NULL if all frames are decoded */
+	BOOL		evict_frames;		/* drop the decoded pixels of frames when they stop being active */
+	BOOL		pixels_modified;	/* since loading, so decoder->decode_scaled would decode the wrong ones */
 } GpBitmap;
 
+typedef struct _ProcessedBitmapEntry ProcessedBitmapEntry;
+
 
 void gdip_bitmap_init (GpBitmap *bitmap) GDIP_INTERNAL;
 
@@ -130,6 +169,14 @@ GpStatus gdip_bitmap_dispose (GpBitmap *bitmap) GDIP_INTERNAL;
 GpStatus gdip_bitmap_clone (GpBitmap *bitmap, GpBitmap **clonedbitmap) GDIP_INTERNAL;
 GpStatus gdip_bitmap_setactive (GpBitmap *bitmap, const GUID *dimension, int index) GDIP_INTERNAL;
 GpStatus gdip_bitmapdata_clone (ActiveBitmapData *src, ActiveBitmapData **dest, int count) GDIP_INTERNAL;
+void gdip_bitmapdata_release_scan0 (ActiveBitmapData *data) GDIP_INTERNAL;
+GpStatus gdip_bitmap_ensure_writable (GpBitmap *bitmap) GDIP_INTERNAL;
+void gdip_frame_decoder_init (BitmapFrameDecoder *decoder) GDIP_INTERNAL;
+void gdip_bitmap_set_frame_decoder (GpBitmap *bitmap, BitmapFrameDecoder *decoder) GDIP_INTERNAL;
+GpStatus gdip_bitmap_decode_frame (GpBitmap *bitmap, int frame, int index) GDIP_INTERNAL;
+void gdip_bitmap_release_frame (GpBitmap *bitmap, int frame, int index, BOOL was_decoded) GDIP_INTERNAL;
+GpStatus gdip_bitmap_decode_scaled (GpBitmap *bitmap, UINT width, UINT height, GpBitmap **scaled) GDIP_INTERNAL;
+void gdip_bitmap_load_properties (GpBitmap *bitmap, ActiveBitmapData *data) GDIP_INTERNAL;
 ColorPalette *gdip_palette_clone(ColorPalette *original) GDIP_INTERNAL;
 GpStatus gdip_property_get_short (int offset, void *value, unsigned short *result) GDIP_INTERNAL;
 GpStatus gdip_property_get_long (int offset, void *value, guint32 *result) GDIP_INTERNAL;
@@ -149,14 +196,23 @@ GpStatus gdip_bitmapdata_property_find_id (ActiveBitmapData *bitmap_data, PROPID
 cairo_surface_t* gdip_bitmap_ensure_surface (GpBitmap *bitmap) GDIP_INTERNAL;
 void gdip_bitmap_flush_surface (GpBitmap *bitmap) GDIP_INTERNAL;
 void gdip_bitmap_invalidate_surface (GpBitmap *bitmap) GDIP_INTERNAL;
+void gdip_bitmap_modified (GpBitmap *bitmap) GDIP_INTERNAL;
+void gdip_bitmap_surface_modified (GpBitmap *bitmap, GDIPCONST GpRect *rect) GDIP_INTERNAL;
 GpBitmap* gdip_convert_indexed_to_rgb (GpBitmap *bitmap) GDIP_INTERNAL;
 
 BOOL gdip_bitmap_format_needs_premultiplication (GpBitmap *bitmap) GDIP_INTERNAL;
 BYTE* gdip_bitmap_get_premultiplied_scan0 (GpBitmap *bitmap) GDIP_INTERNAL;
-void gdip_bitmap_get_premultiplied_scan0_inplace (GpBitmap *bitmap, BYTE *premul) GDIP_INTERNAL;
-void gdip_bitmap_get_premultiplied_scan0_reverse (GpBitmap *bitmap, BYTE *premul) GDIP_INTERNAL;
+void gdip_bitmap_get_premultiplied_scan0_inplace (GpBitmap *bitmap, BYTE *premul, GDIPCONST GpRect *rect) GDIP_INTERNAL;
+void gdip_bitmap_get_premultiplied_scan0_reverse (GpBitmap *bitmap, BYTE *premul, GDIPCONST GpRect *rect) GDIP_INTERNAL;
+void gdip_init_premultiply_kernels (void) GDIP_INTERNAL;
+void gdip_init_pixel_row_converters (void) GDIP_INTERNAL;
 
 GpStatus gdip_process_bitmap_attributes (GpBitmap *bitmap, GpImageAttributes* attr, GpBitmap **dest_bitmap) GDIP_INTERNAL;
+GpStatus gdip_process_bitmap_attributes_cached (GpBitmap *bitmap, GpImageAttributes* attr, GpBitmap **dest_bitmap,
+	ProcessedBitmapEntry **entry) GDIP_INTERNAL;
+void gdip_processed_bitmap_release (ProcessedBitmapEntry *entry) GDIP_INTERNAL;
+void gdip_processed_bitmap_cache_purge (GpBitmap *bitmap, GpImageAttributes *attr) GDIP_INTERNAL;
+void gdip_processed_bitmap_cache_clear (void) GDIP_INTERNAL;
 
 ColorPalette* gdip_create_greyscale_palette (int num_colors) GDIP_INTERNAL;
 
@@ -175,6 +231,37 @@ typedef struct {
 GpStatus gdip_init_pixel_stream (StreamingState *state, ActiveBitmapData *data, int x, int y, int w, int h) GDIP_INTERNAL;
 unsigned int gdip_pixel_stream_get_next (StreamingState *state) GDIP_INTERNAL;
 
+/* The memory layout of a row of pixels, as seen by the row converters */
+typedef enum {
+	PixelRowFormatUnsupported = -1,
+	PixelRowFormat1bppIndexed = 0,
+	PixelRowFormat4bppIndexed,
+	PixelRowFormat8bppIndexed,
+	PixelRowFormat16bppRGB555,
+	PixelRowFormat16bppRGB565,
+	PixelRowFormat16bppARGB1555,
+	PixelRowFormat24bppRGB,			/* 3 bytes per pixel, as GDI+ (and the codecs) see it */
+	PixelRowFormat32bppRGB,			/* also 24bpp bitmaps, which Cairo stores as 4 bytes per pixel */
+	PixelRowFormat32bppARGB,
+	PixelRowFormat32bppPARGB,
+	PixelRowFormatCount
+} PixelRowFormat;
+
+typedef struct _PixelRowConversion PixelRowConversion;
+
+typedef void (*PixelRowConverter) (const PixelRowConversion *conversion, const BYTE *src, int src_x, BYTE *dest, int dest_x, int count);
+
+struct _PixelRowConversion {
+	PixelRowFormat		src_format;
+	PixelRowFormat		dest_format;
+	PixelRowConverter	convert;
+	ARGB			lookup[256];	/* palette of an indexed source, already encoded for 32bpp destinations */
+};
+
+PixelRowFormat gdip_get_pixel_row_format (PixelFormat format, BOOL packed) GDIP_INTERNAL;
+GpStatus gdip_init_pixel_row_conversion (PixelRowConversion *conversion, PixelRowFormat src, PixelRowFormat dest, const ColorPalette *palette) GDIP_INTERNAL;
+void gdip_convert_pixel_row (const PixelRowConversion *conversion, const BYTE *src, int src_x, BYTE *dest, int dest_x, int count) GDIP_INTERNAL;
+
 #include "bitmap.h"
 
 #endif
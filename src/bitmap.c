@@ -33,9 +33,22 @@
 #include "general-private.h"
 #include "graphics-private.h"
 #include "metafile-private.h"
+#include "quantize-private.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && ((__GNUC__ >= 5) || defined(__clang__))
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 
 static GpStatus gdip_bitmap_clone_data_rect (ActiveBitmapData *srcData, Rect *srcRect, ActiveBitmapData *destData, Rect *destRect);
+static int gdip_is_pixel_format_conversion_valid (PixelFormat src, PixelFormat dest);
+static GpStatus gdip_bitmap_change_rect_pixel_format (ActiveBitmapData *srcData, const Rect *srcRect, ActiveBitmapData *destData, Rect *destRect);
 
 
 /* The default indexed palettes. This code was generated by a tiny C# program.
@@ -303,7 +316,9 @@ gdip_bitmapdata_property_add_srational(ActiveBitmapData *bitmap_data, PROPID id,
 GpStatus
 gdip_bitmapdata_property_add(ActiveBitmapData *bitmap_data, PROPID id, ULONG length, WORD type, VOID *value)
 {
-	int	property_count;
+	int		property_count;
+	int		capacity;
+	PropertyItem	*property;
 
 	if (bitmap_data == NULL) {
 		return InvalidParameter;
@@ -311,14 +326,15 @@ gdip_bitmapdata_property_add(ActiveBitmapData *bitmap_data, PROPID id, ULONG len
 
 	property_count = bitmap_data->property_count;
 
-	if (bitmap_data->property == NULL) {
-		bitmap_data->property = GdipAlloc(sizeof(PropertyItem));
-	} else {
-		bitmap_data->property = gdip_realloc (bitmap_data->property, sizeof(PropertyItem) * (property_count + 1));
-	}
-	if (bitmap_data->property == NULL) {
-		bitmap_data->property_count = 0;
-		return OutOfMemory;
+	/* images with many properties (e.g. EXIF) would otherwise copy the array again for each of them */
+	if (property_count >= bitmap_data->property_capacity) {
+		capacity = property_count > 0 ? property_count * 2 : 1;
+		property = gdip_realloc (bitmap_data->property, sizeof(PropertyItem) * capacity);
+		if (property == NULL) {
+			return OutOfMemory;
+		}
+		bitmap_data->property = property;
+		bitmap_data->property_capacity = capacity;
 	}
 
 	if ((value != NULL) && (length > 0)) {
@@ -391,6 +407,307 @@ gdip_bitmapdata_property_find_id(ActiveBitmapData *bitmap_data, PROPID id, int *
 	return PropertyNotFound;
 }
 
+/*
+ * Cloning a bitmap doesn't copy its pixels: the clone gets the same scan0, both are flagged GBD_SHARED_SCAN0
+ * and whichever is written to first gets a copy from gdip_bitmap_ensure_writable. The owners of a shared
+ * scan0 are counted here for as long as there are at least two of them, so a scan0 flagged as shared that
+ * has no entry only has a single owner left.
+ */
+#if GLIB_CHECK_VERSION(2,32,0)
+static GMutex shared_scan0_mutex;
+#else
+static GStaticMutex shared_scan0_mutex = G_STATIC_MUTEX_INIT;
+#endif
+static GHashTable *shared_scan0_owners = NULL;
+
+static void
+gdip_shared_scan0_lock (void)
+{
+#if GLIB_CHECK_VERSION(2,32,0)
+	g_mutex_lock (&shared_scan0_mutex);
+#else
+	g_static_mutex_lock (&shared_scan0_mutex);
+#endif
+}
+
+static void
+gdip_shared_scan0_unlock (void)
+{
+#if GLIB_CHECK_VERSION(2,32,0)
+	g_mutex_unlock (&shared_scan0_mutex);
+#else
+	g_static_mutex_unlock (&shared_scan0_mutex);
+#endif
+}
+
+static int
+gdip_shared_scan0_get_owners_locked (BYTE *scan0)
+{
+	int owners = shared_scan0_owners ? GPOINTER_TO_INT (g_hash_table_lookup (shared_scan0_owners, scan0)) : 0;
+	return MAX (owners, 1);
+}
+
+static void
+gdip_shared_scan0_add_owner (BYTE *scan0)
+{
+	gdip_shared_scan0_lock ();
+
+	if (!shared_scan0_owners)
+		shared_scan0_owners = g_hash_table_new (g_direct_hash, g_direct_equal);
+	g_hash_table_insert (shared_scan0_owners, scan0, GINT_TO_POINTER (gdip_shared_scan0_get_owners_locked (scan0) + 1));
+
+	gdip_shared_scan0_unlock ();
+}
+
+/* Returns the number of owners left */
+static int
+gdip_shared_scan0_remove_owner (BYTE *scan0)
+{
+	int owners;
+
+	gdip_shared_scan0_lock ();
+
+	owners = gdip_shared_scan0_get_owners_locked (scan0) - 1;
+	if (owners > 1) {
+		g_hash_table_insert (shared_scan0_owners, scan0, GINT_TO_POINTER (owners));
+	} else if (owners == 1) {
+		g_hash_table_remove (shared_scan0_owners, scan0);
+		if (g_hash_table_size (shared_scan0_owners) == 0) {
+			g_hash_table_destroy (shared_scan0_owners);
+			shared_scan0_owners = NULL;
+		}
+	}
+
+	gdip_shared_scan0_unlock ();
+	return owners;
+}
+
+/* Frees scan0 if it belongs to data and isn't shared with another bitmap */
+void
+gdip_bitmapdata_release_scan0 (ActiveBitmapData *data)
+{
+	if (data->scan0 != NULL && (data->reserved & GBD_OWN_SCAN0) != 0) {
+		if ((data->reserved & GBD_SHARED_SCAN0) == 0 || gdip_shared_scan0_remove_owner (data->scan0) == 0)
+			GdipFree (data->scan0);
+	}
+
+	data->scan0 = NULL;
+	data->reserved &= ~(GBD_OWN_SCAN0 | GBD_SHARED_SCAN0);
+}
+
+/* Must be called before writing to the pixels of the active bitmap data, in case they are shared with a clone */
+GpStatus
+gdip_bitmap_ensure_writable (GpBitmap *bitmap)
+{
+	ActiveBitmapData *data = bitmap->active_bitmap;
+	unsigned long long int size;
+	int owners;
+	BYTE *copy;
+
+	if (!data)
+		return Ok;
+
+	/* once written to, the pixels can't simply be decoded again */
+	data->reserved &= ~GBD_DECODED;
+
+	if ((data->reserved & GBD_SHARED_SCAN0) == 0)
+		return Ok;
+
+	gdip_shared_scan0_lock ();
+	owners = gdip_shared_scan0_get_owners_locked (data->scan0);
+	gdip_shared_scan0_unlock ();
+
+	if (owners > 1) {
+		size = (unsigned long long int) data->stride * data->height;
+		if (size > G_MAXINT32)
+			return OutOfMemory;
+
+		copy = GdipAlloc (size);
+		if (!copy)
+			return OutOfMemory;
+		memcpy (copy, data->scan0, size);
+
+		/* a surface drawing on the shared pixels can't be kept around */
+		if (bitmap->surface && cairo_image_surface_get_data (bitmap->surface) == data->scan0)
+			gdip_bitmap_invalidate_surface (bitmap);
+
+		/* the other owners may have gone away in the meantime */
+		if (gdip_shared_scan0_remove_owner (data->scan0) == 0)
+			GdipFree (data->scan0);
+		data->scan0 = copy;
+	}
+
+	data->reserved &= ~GBD_SHARED_SCAN0;
+	return Ok;
+}
+
+/* Sets up a frame decoder allocated by its codec, the caller holding its only reference */
+void
+gdip_frame_decoder_init (BitmapFrameDecoder *decoder)
+{
+	decoder->refcount = 1;
+#if GLIB_CHECK_VERSION(2,32,0)
+	g_mutex_init (&decoder->mutex);
+#else
+	g_static_mutex_init (&decoder->mutex);
+#endif
+}
+
+static void
+gdip_frame_decoder_lock (BitmapFrameDecoder *decoder)
+{
+#if GLIB_CHECK_VERSION(2,32,0)
+	g_mutex_lock (&decoder->mutex);
+#else
+	g_static_mutex_lock (&decoder->mutex);
+#endif
+}
+
+static void
+gdip_frame_decoder_unlock (BitmapFrameDecoder *decoder)
+{
+#if GLIB_CHECK_VERSION(2,32,0)
+	g_mutex_unlock (&decoder->mutex);
+#else
+	g_static_mutex_unlock (&decoder->mutex);
+#endif
+}
+
+static BitmapFrameDecoder *
+gdip_frame_decoder_ref (BitmapFrameDecoder *decoder)
+{
+	if (decoder)
+		g_atomic_int_inc (&decoder->refcount);
+	return decoder;
+}
+
+static void
+gdip_frame_decoder_unref (BitmapFrameDecoder *decoder)
+{
+	if (!decoder || !g_atomic_int_dec_and_test (&decoder->refcount))
+		return;
+
+#if GLIB_CHECK_VERSION(2,32,0)
+	g_mutex_clear (&decoder->mutex);
+#else
+	g_static_mutex_free (&decoder->mutex);
+#endif
+	decoder->dispose (decoder);
+}
+
+/* The bitmap takes over the reference the caller holds to decoder */
+void
+gdip_bitmap_set_frame_decoder (GpBitmap *bitmap, BitmapFrameDecoder *decoder)
+{
+	gdip_frame_decoder_unref (bitmap->decoder);
+	bitmap->decoder = decoder;
+}
+
+/* Decodes the pixels of a frame left for later by its codec, if not already done */
+GpStatus
+gdip_bitmap_decode_frame (GpBitmap *bitmap, int frame, int index)
+{
+	ActiveBitmapData *data = &bitmap->frames[frame].bitmap[index];
+	GpStatus status;
+
+	if (data->scan0 || !bitmap->decoder)
+		return Ok;
+
+	gdip_frame_decoder_lock (bitmap->decoder);
+	status = bitmap->decoder->decode (bitmap->decoder, frame, index, data);
+	gdip_frame_decoder_unlock (bitmap->decoder);
+	if (status != Ok)
+		return status;
+
+	data->reserved |= GBD_OWN_SCAN0 | GBD_DECODED;
+	return Ok;
+}
+
+/* Drops the pixels gdip_bitmap_decode_frame decoded only for a while (e.g. to save them), unless they were decoded
+ * before (was_decoded), are the active bitmap's, or were modified or locked since */
+void
+gdip_bitmap_release_frame (GpBitmap *bitmap, int frame, int index, BOOL was_decoded)
+{
+	ActiveBitmapData *data = &bitmap->frames[frame].bitmap[index];
+
+	if (was_decoded || data == bitmap->active_bitmap || (data->reserved & (GBD_DECODED | GBD_LOCKED)) != GBD_DECODED)
+		return;
+
+	gdip_bitmapdata_release_scan0 (data);
+	data->reserved &= ~GBD_DECODED;
+}
+
+/* Decodes the (unmodified) bitmap again at a reduced size, of at least width x height, if its codec can.
+ * Returns NotImplemented if it can't */
+GpStatus
+gdip_bitmap_decode_scaled (GpBitmap *bitmap, UINT width, UINT height, GpBitmap **scaled)
+{
+	BitmapFrameDecoder *decoder = bitmap->decoder;
+	GpStatus status;
+
+	if (!decoder || !decoder->decode_scaled || bitmap->pixels_modified)
+		return NotImplemented;
+
+	gdip_frame_decoder_ref (decoder);
+	status = decoder->decode_scaled (decoder, width, height, scaled);
+	gdip_frame_decoder_unref (decoder);
+	return status;
+}
+
+/* Drops a decoder that can only decode the pixels as they were loaded once they were modified. If it still has
+ * properties to add, it is replaced by one that only does that, if its codec can */
+static void
+gdip_bitmap_drop_stale_decoder (GpBitmap *bitmap)
+{
+	BitmapFrameDecoder *replacement;
+	int frame;
+	int index;
+
+	if (!bitmap->pixels_modified || !bitmap->decoder || !bitmap->decoder->decode_scaled)
+		return;
+
+	for (frame = 0; frame < bitmap->num_of_frames; frame++) {
+		for (index = 0; index < bitmap->frames[frame].count; index++) {
+			if (bitmap->frames[frame].bitmap[index].reserved & GBD_PROPERTIES_PENDING) {
+				replacement = bitmap->decoder->properties_only ? bitmap->decoder->properties_only (bitmap->decoder) : NULL;
+				if (replacement)
+					gdip_bitmap_set_frame_decoder (bitmap, replacement);
+				return;
+			}
+		}
+	}
+
+	gdip_bitmap_set_frame_decoder (bitmap, NULL);
+}
+
+/* Adds the properties that codecs left to the frame decoder until they are needed, to data, or to every bitmap of
+ * every frame if data is NULL */
+void
+gdip_bitmap_load_properties (GpBitmap *bitmap, ActiveBitmapData *data)
+{
+	int frame;
+	int index;
+
+	for (frame = 0; frame < bitmap->num_of_frames; frame++) {
+		for (index = 0; index < bitmap->frames[frame].count; index++) {
+			ActiveBitmapData *pending = &bitmap->frames[frame].bitmap[index];
+
+			if ((data && pending != data) || (pending->reserved & GBD_PROPERTIES_PENDING) == 0)
+				continue;
+
+			/* if they can't be read now, they won't be later either */
+			pending->reserved &= ~GBD_PROPERTIES_PENDING;
+			if (bitmap->decoder && bitmap->decoder->load_properties) {
+				gdip_frame_decoder_lock (bitmap->decoder);
+				bitmap->decoder->load_properties (bitmap->decoder, frame, index, pending);
+				gdip_frame_decoder_unlock (bitmap->decoder);
+			}
+		}
+	}
+
+	gdip_bitmap_drop_stale_decoder (bitmap);
+}
+
 GpStatus
 gdip_bitmapdata_clone (ActiveBitmapData *src, ActiveBitmapData **dest, int count)
 {
@@ -416,7 +733,8 @@ gdip_bitmapdata_clone (ActiveBitmapData *src, ActiveBitmapData **dest, int count
 		result[i].height = src[i].height;
 		result[i].stride = src[i].stride;
 		result[i].pixel_format = src[i].pixel_format;
-		result[i].reserved = GBD_OWN_SCAN0;	/* We're duplicating SCAN0, we always own it*/
+		result[i].reserved = GBD_OWN_SCAN0;	/* We're duplicating or sharing SCAN0, we always own it*/
+		result[i].reserved |= src[i].reserved & GBD_PROPERTIES_PENDING;	/* the clone shares the frame decoder */
 		result[i].dpi_horz = src[i].dpi_horz;
 		result[i].dpi_vert = src[i].dpi_vert;
 		result[i].image_flags = src[i].image_flags;
@@ -426,16 +744,23 @@ gdip_bitmapdata_clone (ActiveBitmapData *src, ActiveBitmapData **dest, int count
 		result[i].y = src[i].y;
 		result[i].transparent = src[i].transparent;
 
-		if (src[i].scan0 != NULL) {
+		if (src[i].scan0 != NULL && (src[i].reserved & GBD_OWN_SCAN0) != 0 && (src[i].reserved & GBD_SURFACE_SCAN0) == 0) {
+			/* share the pixels until either bitmap writes to them */
+			gdip_shared_scan0_add_owner (src[i].scan0);
+			src[i].reserved |= GBD_SHARED_SCAN0;
+			result[i].scan0 = src[i].scan0;
+			result[i].reserved |= GBD_SHARED_SCAN0 | (src[i].reserved & GBD_DECODED);
+		} else if (src[i].scan0 != NULL) {
+			/* pixels that aren't ours, or that a surface draws on, can change under the clone */
 			size = (unsigned long long int)src[i].stride * src[i].height;
 			if (size > G_MAXINT32) {
-				GdipFree(result);
-				return OutOfMemory;
+				status = OutOfMemory;
+				goto fail;
 			}
 			result[i].scan0 = GdipAlloc(size);
 			if (result[i].scan0 == NULL) {
-				GdipFree(result);
-				return OutOfMemory;
+				status = OutOfMemory;
+				goto fail;
 			}
 			memcpy(result[i].scan0, src[i].scan0, size);
 		} else {
@@ -445,26 +770,27 @@ gdip_bitmapdata_clone (ActiveBitmapData *src, ActiveBitmapData **dest, int count
 		result[i].palette = gdip_palette_clone (src[i].palette);
 
 		result[i].property_count = src[i].property_count;
+		result[i].property_capacity = src[i].property ? src[i].property_count : 0;
 		status = gdip_propertyitems_clone(src[i].property, &result[i].property, src[i].property_count);
 		if (status != Ok) {
-			int j;
-
-			for (j = 0; j < i; j++) {
-				if (result[j].scan0 != NULL) {
-					GdipFree(result[j].scan0);
-				}
-				if (result[j].property != NULL) {
-					gdip_propertyitems_dispose(result[j].property, result[j].property_count);
-				}
-			}
-
-			GdipFree(result);
-			return status;
+			gdip_bitmapdata_release_scan0 (&result[i]);
+			goto fail;
 		}
 	}
 
 	*dest = result;
 	return Ok;
+
+fail:
+	for (int j = 0; j < i; j++) {
+		gdip_bitmapdata_release_scan0 (&result[j]);
+		if (result[j].property != NULL) {
+			gdip_propertyitems_dispose(result[j].property, result[j].property_count);
+		}
+	}
+
+	GdipFree(result);
+	return status;
 }
 
 static GpStatus
@@ -477,10 +803,7 @@ gdip_bitmapdata_dispose(ActiveBitmapData *bitmap, int count)
 	}
 
 	for (index = 0; index < count; index++) {
-		if ((bitmap[index].scan0 != NULL) && ((bitmap[index].reserved & GBD_OWN_SCAN0) != 0)) {
-			GdipFree(bitmap[index].scan0);
-			bitmap[index].scan0 = NULL;
-		}
+		gdip_bitmapdata_release_scan0 (&bitmap[index]);
 
 		if (bitmap[index].palette != NULL) {
 			GdipFree(bitmap[index].palette);
@@ -580,6 +903,28 @@ gdip_palette_clone (ColorPalette *original)
 	return result;
 }
 
+static GpStatus
+gdip_bitmap_activate (GpBitmap *bitmap, int frame, int index)
+{
+	ActiveBitmapData *previous = bitmap->active_bitmap;
+	GpStatus status;
+
+	status = gdip_bitmap_decode_frame (bitmap, frame, index);
+	if (status != Ok)
+		return status;
+
+	bitmap->active_frame = frame;
+	bitmap->active_bitmap_no = index;
+	bitmap->active_bitmap = &bitmap->frames[frame].bitmap[index];
+
+	/* unmodified pixels can be decoded again if the frame is selected again, unless they are still locked */
+	if (bitmap->evict_frames && bitmap->decoder && previous && previous != bitmap->active_bitmap &&
+		(previous->reserved & (GBD_DECODED | GBD_LOCKED)) == GBD_DECODED)
+		gdip_bitmapdata_release_scan0 (previous);
+
+	return Ok;
+}
+
 GpStatus
 gdip_bitmap_setactive(GpBitmap *bitmap, const GUID *dimension, int index)
 {
@@ -592,6 +937,7 @@ gdip_bitmap_setactive(GpBitmap *bitmap, const GUID *dimension, int index)
 	/* Invalidate the cached surface */
 	gdip_bitmap_flush_surface (bitmap);
 	gdip_bitmap_invalidate_surface (bitmap);
+	gdip_bitmap_modified (bitmap);
 
 	if ((bitmap->num_of_frames == 0) || (bitmap->frames == NULL)) {
 		bitmap->active_frame = 0;
@@ -604,10 +950,7 @@ gdip_bitmap_setactive(GpBitmap *bitmap, const GUID *dimension, int index)
 		if (bitmap->frames[0].count <= index) {
 			return InvalidParameter;
 		}
-		bitmap->active_frame = 0;
-		bitmap->active_bitmap_no = index;
-		bitmap->active_bitmap = &bitmap->frames[0].bitmap[index];
-		return Ok;
+		return gdip_bitmap_activate (bitmap, 0, index);
 	}
 
 	for (i = 0; i < bitmap->num_of_frames; i++) {
@@ -615,10 +958,7 @@ gdip_bitmap_setactive(GpBitmap *bitmap, const GUID *dimension, int index)
 			if (bitmap->frames[i].count <= index) {
 				return Win32Error;
 			}
-			bitmap->active_frame = i;
-			bitmap->active_bitmap_no = index;
-			bitmap->active_bitmap = &bitmap->frames[i].bitmap[index];
-			return Ok;
+			return gdip_bitmap_activate (bitmap, i, index);
 		}
 	}
 
@@ -651,6 +991,13 @@ gdip_bitmap_clone (GpBitmap *bitmap, GpBitmap **clonedbitmap)
 	result->active_bitmap = NULL;
 	result->cairo_format = bitmap->cairo_format;
 	result->surface = NULL;
+	result->generation = 0;
+	result->processed_cached = FALSE;
+	result->surface_dirty.X = result->surface_dirty.Y = 0;
+	result->surface_dirty.Width = result->surface_dirty.Height = 0;
+	result->decoder = gdip_frame_decoder_ref (bitmap->decoder);
+	result->evict_frames = bitmap->evict_frames;
+	result->pixels_modified = bitmap->pixels_modified;
 
 	/* Allocate and copy frames, properties and bitmap data */
 	if (bitmap->frames != NULL) {
@@ -671,7 +1018,7 @@ gdip_bitmap_clone (GpBitmap *bitmap, GpBitmap **clonedbitmap)
 		}
 		result->active_bitmap = &result->frames[result->active_frame].bitmap[result->active_bitmap_no];
 	} else {
-		bitmap->frames = NULL;
+		result->frames = NULL;
 	}
 
 	*clonedbitmap = result;
@@ -731,6 +1078,9 @@ gdip_bitmap_dispose (GpBitmap *bitmap)
 
 	gdip_bitmap_invalidate_surface (bitmap);
 
+	if (bitmap->processed_cached)
+		gdip_processed_bitmap_cache_purge (bitmap, NULL);
+
 	if (bitmap->frames) {
 		int frame;
 		for (frame = 0; frame < bitmap->num_of_frames; frame++) {
@@ -740,6 +1090,7 @@ gdip_bitmap_dispose (GpBitmap *bitmap)
 		bitmap->frames = NULL;
 	}
 
+	gdip_frame_decoder_unref (bitmap->decoder);
 	GdipFree (bitmap);
 	return Ok;
 }
@@ -1122,21 +1473,33 @@ GdipCloneBitmapAreaI (INT x, INT y, INT width, INT height, PixelFormat format,
 		return InvalidParameter;
 	}
 
-	result = gdip_bitmap_new_with_frame(NULL, TRUE);
-	if (result == NULL) {
-		return OutOfMemory;
-	}
+	gdip_bitmap_flush_surface (original);
 
-	result->image_format = original->image_format;
+	if (format != original->active_bitmap->pixel_format && gdip_is_a_supported_pixelformat (format) &&
+		!gdip_is_an_indexed_pixelformat (format) && gdip_is_pixel_format_conversion_valid (original->active_bitmap->pixel_format, format)) {
+		/* the area is converted to the requested format while it is copied */
+		status = GdipCreateBitmapFromScan0 (width, height, 0, format, NULL, &result);
+		if (status != Ok)
+			return status;
 
-	gdip_bitmap_flush_surface (original);
+		status = gdip_bitmap_change_rect_pixel_format (original->active_bitmap, &sr, result->active_bitmap, &dr);
+		if (status != Ok)
+			goto fail;
+	} else {
+		result = gdip_bitmap_new_with_frame (NULL, TRUE);
+		if (result == NULL) {
+			return OutOfMemory;
+		}
 
-	status = gdip_bitmap_clone_data_rect (original->active_bitmap, &sr, result->active_bitmap, &dr);
-	if (status != Ok) {
-		goto fail;
+		status = gdip_bitmap_clone_data_rect (original->active_bitmap, &sr, result->active_bitmap, &dr);
+		if (status != Ok) {
+			goto fail;
+		}
+
+		result->cairo_format = original->cairo_format;
 	}
 
-	result->cairo_format = original->cairo_format;
+	result->image_format = original->image_format;
 
 	// Preserve the resolution values.  See https://bugzilla.xamarin.com/show_bug.cgi?id=44127.
 	result->active_bitmap->dpi_horz = original->active_bitmap->dpi_horz;
@@ -1230,68 +1593,24 @@ gdip_bitmap_clone_data_rect (ActiveBitmapData *srcData, Rect *srcRect, ActiveBit
 			srcData->scan0 + (srcData->stride * srcRect->Y) + (gdip_get_pixel_format_components (srcData->pixel_format) 
 			* srcRect->X), srcData->stride,   destRect->Width * dest_components,  destRect->Height);
 	} else {
-		int src_depth;
-		int src_first_x_bit_index;
-		int width_bits;
-		int src_first_x_bit_offset_into_byte;
-
-		src_depth = gdip_get_pixel_format_depth (srcData->pixel_format);
-
-		/* first, check if the bits are aligned onto a byte boundary */
-		src_first_x_bit_index = srcRect->X * src_depth;
-		width_bits = destRect->Width * src_depth;
-		src_first_x_bit_offset_into_byte = src_first_x_bit_index & 7;
-
-		if (src_first_x_bit_offset_into_byte == 0) {
-			/* the fast path: no mid-byte bit mangling required :-)
-			 * this will always be the case for 8-bit images.
-			 * basically, the source bits are aligned to the destination
-			 * bytes, and it doesn't matter if the width isn't a multiple
-			 * of 8 bits, because the remainder is guaranteed to be
-			 * allocated by the stride, and will be ignored because the
-			 * width will indicate fewer pixels than actually end up being
-			 * copied.
-			 */
-			gdip_copy_strides (
-				destData->scan0, destData->stride,
-				srcData->scan0 + (src_first_x_bit_index / 8) + (srcData->stride * srcRect->Y),
-				srcData->stride, width_bits / 8, destRect->Height);
-		} else {
-			/* the not-so-fast path: no bits are aligned, so the entire image requires bit juggling. */
-
-			BYTE *src_scan;
-			BYTE *src_scan0;
-			BYTE *dest_scan;
-			BYTE *dest_scan0;
-			unsigned short	buffer;
-			int		left_shift;
-			int		x;
-			int		y;
-
-			src_scan0 = srcData->scan0;
-			dest_scan0 = destData->scan0;
-			left_shift = src_first_x_bit_offset_into_byte;
-
-			/* move the src_scan0 up to the first byte with pixel data involved in the copy */
-			src_scan0 += srcRect->Y * srcData->stride;
-			src_scan0 += (src_first_x_bit_offset_into_byte / 8);
-
-			for (y=0; y < destRect->Height; y++) {
-				src_scan = src_scan0 + y * srcData->stride;
-				dest_scan = dest_scan0 + y * destData->stride;
-
-				/* jump-start the packing function. it avoids double-sampling the source bits by
-				 * using buffer as a shift register; bits 8-15 are the current packed dest pixel,
-				 * and some of bits 0-7 are not used, to permit alignment of the pixel data.
-				 */
-				buffer = src_scan[0] << left_shift;
-
-				for (x = 1; x < destRect->Width; x++) {
-					buffer <<= 8;
-					buffer |= src_scan[x] << left_shift;
-					dest_scan[0] = (buffer >> 8);
-				}
-			}
+		/* the pixels of a 1 or 4bpp row don't necessarily start on a byte boundary */
+		PixelRowConversion	conversion;
+		PixelRowFormat		format = gdip_get_pixel_row_format (srcData->pixel_format, FALSE);
+		GpStatus		status;
+		BYTE			*src_scan;
+		BYTE			*dest_scan;
+
+		status = gdip_init_pixel_row_conversion (&conversion, format, format, NULL);
+		if (status != Ok)
+			return status;
+
+		src_scan = srcData->scan0 + srcRect->Y * srcData->stride;
+		dest_scan = destData->scan0;
+
+		for (int y = 0; y < destRect->Height; y++) {
+			gdip_convert_pixel_row (&conversion, src_scan, srcRect->X, dest_scan, 0, destRect->Width);
+			src_scan += srcData->stride;
+			dest_scan += destData->stride;
 		}
 	}
 
@@ -1331,14 +1650,8 @@ gdip_is_pixel_format_conversion_valid (PixelFormat src, PixelFormat dest)
 		return 0;
 	}
 
-	/* These are the RGB formats */
+	/* These are the RGB formats, the row converters handle all of them */
 	if ((src & PixelFormatGDI) && !(src & PixelFormatExtended)) {
-		/* all of these should be supported, but we only report the
-		 * ones we really can do for now */
-		/* We can't handle converting to/from the 565/555/1555 ones */
-		if ((src & 0xff00) == 16 || (dest & 0xff00) == 16) {
-			return 0;
-		}
 		return 1;
 	}
 
@@ -1414,18 +1727,6 @@ gdip_init_pixel_stream (StreamingState *state, ActiveBitmapData *data, int x, in
 	return Ok;
 }
 
-static BOOL
-gdip_pixel_stream_has_next (StreamingState *state)
-{
-	if (state != NULL) {
-		return (state->p >= 0)
-		    || ((state->y < (state->region.Y + state->region.Height))
-		    && (state->x < (state->region.X + state->region.Width)));
-	} else {
-		return FALSE;
-	}
-}
-
 unsigned int /* <-- can be an ARGB or a palette index */
 gdip_pixel_stream_get_next (StreamingState *state)
 {
@@ -1542,224 +1843,732 @@ gdip_pixel_stream_get_next (StreamingState *state)
 	return ret;
 }
 
+/*
+ * Premultiplication kernels
+ *
+ * pre_multiplied_table holds (c * a + 127) / 255, which is exactly ((t + (t >> 8)) >> 8) with
+ * t = c * a + 128, so the vector kernels compute it for whole pixels at a time (the alpha channel is
+ * multiplied by 255, which leaves it as it is). pre_multiplied_table_reverse has no such closed form,
+ * but it leaves opaque and fully transparent pixels alone: the vector kernels copy runs of those and
+ * use the table for everything else. Both give the same bytes as the scalar code.
+ */
+
+typedef void (*PremultiplyRowKernel) (const ARGB *src, ARGB *dest, int count);
+
 static void
-gdip_pixel_stream_set_next (StreamingState *state, unsigned int pixel_value)
+gdip_unpremultiply_row_table (const ARGB *src, ARGB *dest, int count)
 {
-	if (state == NULL) {
-		return;
+	for (int x = 0; x < count; x++) {
+		BYTE r, g, b, a;
+		get_pixel_bgra (src[x], b, g, r, a);
+		if (a < 0xff) {
+			b = pre_multiplied_table_reverse [b][a];
+			g = pre_multiplied_table_reverse [g][a];
+			r = pre_multiplied_table_reverse [r][a];
+			set_pixel_bgra (dest, x * 4, b, g, r, a);
+		} else {
+			dest[x] = src[x];
+		}
 	}
+}
 
-	/* Note: This function does not check whether the end of the region has been hit. This function can
-	 * potentially overrun memory buffers! gdip_pixel_stream_has_next () must be used in conjunction
-	 * with this function.
-	 */
+static void
+gdip_premultiply_row_table (const ARGB *src, ARGB *dest, int count)
+{
+	for (int x = 0; x < count; x++) {
+		BYTE r, g, b, a;
+		get_pixel_bgra (src[x], b, g, r, a);
+		if (a < 0xff) {
+			b = pre_multiplied_table [b][a];
+			g = pre_multiplied_table [g][a];
+			r = pre_multiplied_table [r][a];
+			set_pixel_bgra (dest, x * 4, b, g, r, a);
+		} else {
+			dest[x] = src[x];
+		}
+	}
+}
 
-	if (state->pixels_per_byte == 1) {
-		/* A fast path for 8-bit indexed data: pixels are byte-aligned, so no special packing is required. */
-		*state->scan = pixel_value;
+#if defined(__SSE2__) && G_BYTE_ORDER == G_LITTLE_ENDIAN
+#define GDIP_PREMULTIPLY_SSE2 1
 
-		state->scan++;
-		state->x++;
+static inline __m128i
+gdip_premultiply_pixels_sse2 (__m128i pixels, __m128i zero, __m128i alpha_lanes, __m128i color_lanes)
+{
+	const __m128i bias = _mm_set1_epi16 (128);
+	__m128i lo = _mm_unpacklo_epi8 (pixels, zero);
+	__m128i hi = _mm_unpackhi_epi8 (pixels, zero);
+	__m128i alpha_lo = _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (lo, _MM_SHUFFLE (3, 3, 3, 3)), _MM_SHUFFLE (3, 3, 3, 3));
+	__m128i alpha_hi = _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (hi, _MM_SHUFFLE (3, 3, 3, 3)), _MM_SHUFFLE (3, 3, 3, 3));
 
-		if (state->x >= (state->region.X + state->region.Width)) {
-			state->x = state->region.X;
-			state->y++;
+	alpha_lo = _mm_or_si128 (_mm_and_si128 (alpha_lo, color_lanes), alpha_lanes);
+	alpha_hi = _mm_or_si128 (_mm_and_si128 (alpha_hi, color_lanes), alpha_lanes);
 
-			state->scan = (BYTE*)(state->data->scan0)
-			            + state->y * state->data->stride
-			            + state->x;
-		}
-	} else if (state->pixels_per_byte > 0) {
-		/* We have an indexed format (the RGB formats can't fit a whole pixel into a single byte). */
-		if (state->p < 0) {
-			state->p = 0;
+	lo = _mm_add_epi16 (_mm_mullo_epi16 (lo, alpha_lo), bias);
+	hi = _mm_add_epi16 (_mm_mullo_epi16 (hi, alpha_hi), bias);
+	lo = _mm_srli_epi16 (_mm_add_epi16 (lo, _mm_srli_epi16 (lo, 8)), 8);
+	hi = _mm_srli_epi16 (_mm_add_epi16 (hi, _mm_srli_epi16 (hi, 8)), 8);
 
-			if (state->x == state->region.X) {
-				/* First pixel of the row; check whether it is aligned to the byte or not. */
-				int index_into_byte = state->x & (state->pixels_per_byte - 1);
+	return _mm_packus_epi16 (lo, hi);
+}
 
-				if (index_into_byte == 0) {
-					/* It is aligned; all we need to do is clear the buffer. */
-					state->buffer = 0;
-				}
-				else {
-					/* It is not aligned; the buffer needs to be pre-loaded with those
-					 * pixels that are to the left of the first pixel to be set.
-					 */
-					state->buffer = (*state->scan << (index_into_byte * state->one_pixel_shift));
-					state->p = index_into_byte;
-				}
-			}
-		}
+static void
+gdip_premultiply_row_sse2 (const ARGB *src, ARGB *dest, int count)
+{
+	const __m128i zero = _mm_setzero_si128 ();
+	const __m128i alpha_lanes = _mm_set_epi16 (255, 0, 0, 0, 255, 0, 0, 0);
+	const __m128i color_lanes = _mm_set_epi16 (0, -1, -1, -1, 0, -1, -1, -1);
+	int x = 0;
 
-		state->buffer <<= state->one_pixel_shift;
-		state->buffer |= ((pixel_value & state->one_pixel_mask) << 8);
+	for (; x + 4 <= count; x += 4) {
+		__m128i pixels = _mm_loadu_si128 ((const __m128i *) (src + x));
+		_mm_storeu_si128 ((__m128i *) (dest + x), gdip_premultiply_pixels_sse2 (pixels, zero, alpha_lanes, color_lanes));
+	}
 
-		state->x++;
-		state->p++;
+	gdip_premultiply_row_table (src + x, dest + x, count - x);
+}
 
-		/* Have we hit the end of the buffer? */
-		if (state->p >= state->pixels_per_byte)	{
-			*state->scan = (state->buffer >> 8);
-			state->scan++;
-			state->p = -1;
-		}
+static void
+gdip_unpremultiply_row_sse2 (const ARGB *src, ARGB *dest, int count)
+{
+	const __m128i opaque = _mm_set1_epi32 (0xFF);
+	const __m128i transparent = _mm_setzero_si128 ();
+	int x = 0;
 
-		if (state->x >= (state->region.X + state->region.Width)) {
-			if (state->p >= 0) {
-				int existing_mask = 0;
+	for (; x + 4 <= count; x += 4) {
+		__m128i pixels = _mm_loadu_si128 ((const __m128i *) (src + x));
+		__m128i alpha = _mm_srli_epi32 (pixels, 24);
+		__m128i unchanged = _mm_or_si128 (_mm_cmpeq_epi32 (alpha, opaque), _mm_cmpeq_epi32 (alpha, transparent));
 
-				while (state->p < state->pixels_per_byte) {
-					existing_mask <<= state->one_pixel_shift;
-					existing_mask |= state->one_pixel_mask;
+		if (_mm_movemask_epi8 (unchanged) == 0xFFFF)
+			_mm_storeu_si128 ((__m128i *) (dest + x), pixels);
+		else
+			gdip_unpremultiply_row_table (src + x, dest + x, 4);
+	}
 
-					state->buffer <<= state->one_pixel_shift;
-					state->p++;
-				}
+	gdip_unpremultiply_row_table (src + x, dest + x, count - x);
+}
+#endif
 
-				*state->scan = (*state->scan & existing_mask) | (state->buffer >> 8);
-			}
+#if defined(GDIP_PREMULTIPLY_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+	((__GNUC__ >= 5) || defined(__clang__))
+#define GDIP_PREMULTIPLY_AVX2 1
 
-			state->x = state->region.X;
-			state->y++;
+__attribute__((target("avx2"))) static void
+gdip_premultiply_row_avx2 (const ARGB *src, ARGB *dest, int count)
+{
+	const __m256i zero = _mm256_setzero_si256 ();
+	const __m256i bias = _mm256_set1_epi16 (128);
+	const __m256i alpha_lanes = _mm256_set_epi16 (255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0);
+	const __m256i color_lanes = _mm256_set_epi16 (0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1);
+	int x = 0;
 
-			state->scan = (BYTE*)(state->data->scan0)
-			            + state->y * state->data->stride
-			            + state->x * gdip_get_pixel_format_bpp (state->data->pixel_format) / 8;
+	for (; x + 8 <= count; x += 8) {
+		__m256i pixels = _mm256_loadu_si256 ((const __m256i *) (src + x));
+		__m256i lo = _mm256_unpacklo_epi8 (pixels, zero);
+		__m256i hi = _mm256_unpackhi_epi8 (pixels, zero);
+		__m256i alpha_lo = _mm256_shufflehi_epi16 (_mm256_shufflelo_epi16 (lo, _MM_SHUFFLE (3, 3, 3, 3)), _MM_SHUFFLE (3, 3, 3, 3));
+		__m256i alpha_hi = _mm256_shufflehi_epi16 (_mm256_shufflelo_epi16 (hi, _MM_SHUFFLE (3, 3, 3, 3)), _MM_SHUFFLE (3, 3, 3, 3));
 
-			state->p = -1;
+		alpha_lo = _mm256_or_si256 (_mm256_and_si256 (alpha_lo, color_lanes), alpha_lanes);
+		alpha_hi = _mm256_or_si256 (_mm256_and_si256 (alpha_hi, color_lanes), alpha_lanes);
+
+		lo = _mm256_add_epi16 (_mm256_mullo_epi16 (lo, alpha_lo), bias);
+		hi = _mm256_add_epi16 (_mm256_mullo_epi16 (hi, alpha_hi), bias);
+		lo = _mm256_srli_epi16 (_mm256_add_epi16 (lo, _mm256_srli_epi16 (lo, 8)), 8);
+		hi = _mm256_srli_epi16 (_mm256_add_epi16 (hi, _mm256_srli_epi16 (hi, 8)), 8);
+
+		/* unpack and pack both work within 128-bit lanes, so the pixels stay in order */
+		_mm256_storeu_si256 ((__m256i *) (dest + x), _mm256_packus_epi16 (lo, hi));
+	}
+
+	gdip_premultiply_row_sse2 (src + x, dest + x, count - x);
+}
+
+__attribute__((target("avx2"))) static void
+gdip_unpremultiply_row_avx2 (const ARGB *src, ARGB *dest, int count)
+{
+	const __m256i opaque = _mm256_set1_epi32 (0xFF);
+	const __m256i transparent = _mm256_setzero_si256 ();
+	int x = 0;
+
+	for (; x + 8 <= count; x += 8) {
+		__m256i pixels = _mm256_loadu_si256 ((const __m256i *) (src + x));
+		__m256i alpha = _mm256_srli_epi32 (pixels, 24);
+		__m256i unchanged = _mm256_or_si256 (_mm256_cmpeq_epi32 (alpha, opaque), _mm256_cmpeq_epi32 (alpha, transparent));
+
+		if (_mm256_movemask_epi8 (unchanged) == -1)
+			_mm256_storeu_si256 ((__m256i *) (dest + x), pixels);
+		else
+			gdip_unpremultiply_row_table (src + x, dest + x, 8);
+	}
+
+	gdip_unpremultiply_row_sse2 (src + x, dest + x, count - x);
+}
+#endif
+
+#if defined(__ARM_NEON) && G_BYTE_ORDER == G_LITTLE_ENDIAN
+#define GDIP_PREMULTIPLY_NEON 1
+
+static void
+gdip_premultiply_row_neon (const ARGB *src, ARGB *dest, int count)
+{
+	const uint16x8_t bias = vdupq_n_u16 (128);
+	int x = 0;
+
+	for (; x + 8 <= count; x += 8) {
+		/* b, g, r and a planes of 8 pixels */
+		uint8x8x4_t pixels = vld4_u8 ((const uint8_t *) (src + x));
+
+		for (int i = 0; i < 3; i++) {
+			uint16x8_t t = vaddq_u16 (vmull_u8 (pixels.val[i], pixels.val[3]), bias);
+			pixels.val[i] = vshrn_n_u16 (vaddq_u16 (t, vshrq_n_u16 (t, 8)), 8);
 		}
-	} else {
-		/* We have an RGB format. In the current implementation, these are always stored as
-		 * CAIRO_FORMAT_ARGB. This makes this section very easy to implement. If native
-		 * support for 15- and 16-bit pixel formats needs to be added in the future, though,
-		 * then this is where it needs to be done.
-		 *
-		 * In order to simplify advancing the state->scan pointer, the state->pixels_per_byte
-		 * member is set to the number of bytes per pixel, negated. That is, for 24-bit
-		 * formats, it is set to -3, and for 32-bit formats, it is set to -4.
-		 *
-		 * Note that pixel streams do not support 48- and 64-bit data at this time.
-		 */
 
-		if (state->pixels_per_byte == -4) {
-#if WORDS_BIGENDIAN
-			state->scan [0] = (pixel_value >> 24);
-			state->scan [1] = (pixel_value >> 16);
-			state->scan [2] = (pixel_value >> 8);
-			state->scan [3] = (state->data->pixel_format == PixelFormat32bppRGB) ? 0xFF : pixel_value;
-#else
-			if (state->data->pixel_format == PixelFormat32bppRGB)
-				pixel_value |= 0xFF000000;
-			*(unsigned int *)state->scan = pixel_value;
+		vst4_u8 ((uint8_t *) (dest + x), pixels);
+	}
+
+	gdip_premultiply_row_table (src + x, dest + x, count - x);
+}
+
+static void
+gdip_unpremultiply_row_neon (const ARGB *src, ARGB *dest, int count)
+{
+	int x = 0;
+
+	for (; x + 4 <= count; x += 4) {
+		uint32x4_t pixels = vld1q_u32 (src + x);
+		uint32x4_t alpha = vshrq_n_u32 (pixels, 24);
+		uint32x4_t unchanged = vorrq_u32 (vceqq_u32 (alpha, vdupq_n_u32 (0xFF)), vceqq_u32 (alpha, vdupq_n_u32 (0)));
+
+		if (vget_lane_u64 (vreinterpret_u64_u16 (vmovn_u32 (unchanged)), 0) == G_GUINT64_CONSTANT (0xFFFFFFFFFFFFFFFF))
+			vst1q_u32 (dest + x, pixels);
+		else
+			gdip_unpremultiply_row_table (src + x, dest + x, 4);
+	}
+
+	gdip_unpremultiply_row_table (src + x, dest + x, count - x);
+}
 #endif
-		} else {
-			/* ensure we don't get one byte over our allocated buffer */
-#if WORDS_BIGENDIAN
-			state->scan [0] = (pixel_value >> 24);
-			state->scan [1] = (pixel_value >> 16);
-			state->scan [2] = (pixel_value >> 8);
-#else
-			state->scan [2] = (pixel_value >> 16);
-			state->scan [1] = (pixel_value >> 8);
-			state->scan [0] = pixel_value;
+
+/* the table based kernels work until gdip_init_premultiply_kernels picks the best ones for this CPU */
+static PremultiplyRowKernel gdip_premultiply_row = gdip_premultiply_row_table;
+static PremultiplyRowKernel gdip_unpremultiply_row = gdip_unpremultiply_row_table;
+
+void
+gdip_init_premultiply_kernels (void)
+{
+#if defined(GDIP_PREMULTIPLY_SSE2)
+	gdip_premultiply_row = gdip_premultiply_row_sse2;
+	gdip_unpremultiply_row = gdip_unpremultiply_row_sse2;
+#endif
+#if defined(GDIP_PREMULTIPLY_AVX2)
+	__builtin_cpu_init ();
+	if (__builtin_cpu_supports ("avx2")) {
+		gdip_premultiply_row = gdip_premultiply_row_avx2;
+		gdip_unpremultiply_row = gdip_unpremultiply_row_avx2;
+	}
+#endif
+#if defined(GDIP_PREMULTIPLY_NEON)
+	gdip_premultiply_row = gdip_premultiply_row_neon;
+	gdip_unpremultiply_row = gdip_unpremultiply_row_neon;
+#endif
+}
+
+/* Expands a row of palette indexes, indexes outside of the palette read as opaque black (like GdipBitmapGetPixel) */
+static void
+gdip_indexed_row_to_argb (const BYTE *src, int depth, int x, int count, const ARGB lookup[256], ARGB *dest)
+{
+	int i;
+
+	switch (depth) {
+	case 1:
+		for (i = 0; i < count; i++, x++)
+			dest[i] = lookup[(src[x >> 3] >> (7 - (x & 7))) & 0x01];
+		break;
+	case 4:
+		for (i = 0; i < count; i++, x++)
+			dest[i] = lookup[(src[x >> 1] >> ((x & 1) ? 0 : 4)) & 0x0f];
+		break;
+	default:
+		for (i = 0; i < count; i++)
+			dest[i] = lookup[src[x + i]];
+		break;
+	}
+}
+
+/*
+ * Row converters
+ *
+ * Every row layout has a decoder to non-premultiplied ARGB and, except for the indexed layouts, an
+ * encoder from it. The common pairs of layouts have a converter of their own; any other pair is
+ * converted through a small ARGB buffer, decoding and then encoding a chunk of the row at a time.
+ */
+
+#define PIXEL_ROW_CHUNK	256
+
+static const int pixel_row_format_bits [PixelRowFormatCount] = {
+	1, 4, 8, 16, 16, 16, 24, 32, 32, 32
+};
+
+#define gdip_is_indexed_row_format(format)	((format) <= PixelRowFormat8bppIndexed)
+#define gdip_is_32bpp_row_format(format)	((format) >= PixelRowFormat32bppRGB)
+
+PixelRowFormat
+gdip_get_pixel_row_format (PixelFormat format, BOOL packed)
+{
+	switch (format) {
+	case PixelFormat1bppIndexed:
+		return PixelRowFormat1bppIndexed;
+	case PixelFormat4bppIndexed:
+		return PixelRowFormat4bppIndexed;
+	case PixelFormat8bppIndexed:
+		return PixelRowFormat8bppIndexed;
+	case PixelFormat16bppRGB555:
+		return PixelRowFormat16bppRGB555;
+	case PixelFormat16bppRGB565:
+		return PixelRowFormat16bppRGB565;
+	case PixelFormat16bppARGB1555:
+		return PixelRowFormat16bppARGB1555;
+	case PixelFormat24bppRGB:
+		return packed ? PixelRowFormat24bppRGB : PixelRowFormat32bppRGB;
+	case PixelFormat32bppRGB:
+		return PixelRowFormat32bppRGB;
+	case PixelFormat32bppARGB:
+		return PixelRowFormat32bppARGB;
+	case PixelFormat32bppPARGB:
+		return PixelRowFormat32bppPARGB;
+	default:
+		/* 16bpp grayscale, 48/64bpp and CMYK are never stored in a bitmap */
+		return PixelRowFormatUnsupported;
+	}
+}
+
+/* Decoders: a row of pixels to non-premultiplied ARGB */
+
+static void
+gdip_decode_row_indexed (const PixelRowConversion *conversion, const BYTE *src, int x, ARGB *dest, int count)
+{
+	gdip_indexed_row_to_argb (src, pixel_row_format_bits [conversion->src_format], x, count, conversion->lookup, dest);
+}
+
+static void
+gdip_decode_row_16bppRGB555 (const PixelRowConversion *conversion, const BYTE *src, int x, ARGB *dest, int count)
+{
+	for (int i = 0; i < count; i++)
+		dest[i] = gdip_getpixel_16bppRGB555 ((BYTE *) src, x + i);
+}
+
+static void
+gdip_decode_row_16bppRGB565 (const PixelRowConversion *conversion, const BYTE *src, int x, ARGB *dest, int count)
+{
+	for (int i = 0; i < count; i++)
+		dest[i] = gdip_getpixel_16bppRGB565 ((BYTE *) src, x + i);
+}
+
+static void
+gdip_decode_row_16bppARGB1555 (const PixelRowConversion *conversion, const BYTE *src, int x, ARGB *dest, int count)
+{
+	const WORD *scan = (const WORD *) src + x;
+
+	for (int i = 0; i < count; i++) {
+		ARGB color = gdip_getpixel_16bppRGB555 ((BYTE *) src, x + i);
+		dest[i] = (scan[i] & 0x8000) ? color : (color & 0x00FFFFFF);
+	}
+}
+
+static void
+gdip_decode_row_24bppRGB (const PixelRowConversion *conversion, const BYTE *src, int x, ARGB *dest, int count)
+{
+	const BYTE *scan = src + x * 3;
+
+	for (int i = 0; i < count; i++, scan += 3)
+		dest[i] = scan[0] | (scan[1] << 8) | (scan[2] << 16) | 0xFF000000;
+}
+
+static void
+gdip_decode_row_32bppRGB (const PixelRowConversion *conversion, const BYTE *src, int x, ARGB *dest, int count)
+{
+	const ARGB *scan = (const ARGB *) src + x;
+
+	for (int i = 0; i < count; i++)
+		dest[i] = scan[i] | 0xFF000000;
+}
+
+static void
+gdip_decode_row_32bppARGB (const PixelRowConversion *conversion, const BYTE *src, int x, ARGB *dest, int count)
+{
+	memcpy (dest, (const ARGB *) src + x, count * sizeof (ARGB));
+}
+
+static void
+gdip_decode_row_32bppPARGB (const PixelRowConversion *conversion, const BYTE *src, int x, ARGB *dest, int count)
+{
+	gdip_unpremultiply_row ((const ARGB *) src + x, dest, count);
+}
+
+typedef void (*PixelRowDecoder) (const PixelRowConversion *conversion, const BYTE *src, int x, ARGB *dest, int count);
+
+static const PixelRowDecoder pixel_row_decoders [PixelRowFormatCount] = {
+	gdip_decode_row_indexed,
+	gdip_decode_row_indexed,
+	gdip_decode_row_indexed,
+	gdip_decode_row_16bppRGB555,
+	gdip_decode_row_16bppRGB565,
+	gdip_decode_row_16bppARGB1555,
+	gdip_decode_row_24bppRGB,
+	gdip_decode_row_32bppRGB,
+	gdip_decode_row_32bppARGB,
+	gdip_decode_row_32bppPARGB
+};
+
+/* Encoders: non-premultiplied ARGB to a row of pixels */
+
+static void
+gdip_encode_row_16bppRGB555 (const ARGB *src, BYTE *dest, int x, int count)
+{
+	WORD *scan = (WORD *) dest + x;
+
+	for (int i = 0; i < count; i++) {
+		ARGB color = src[i];
+		scan[i] = ((color >> 9) & 0x7C00) | ((color >> 6) & 0x03E0) | ((color >> 3) & 0x001F);
+	}
+}
+
+static void
+gdip_encode_row_16bppRGB565 (const ARGB *src, BYTE *dest, int x, int count)
+{
+	WORD *scan = (WORD *) dest + x;
+
+	for (int i = 0; i < count; i++) {
+		ARGB color = src[i];
+		scan[i] = ((color >> 8) & 0xF800) | ((color >> 5) & 0x07E0) | ((color >> 3) & 0x001F);
+	}
+}
+
+static void
+gdip_encode_row_16bppARGB1555 (const ARGB *src, BYTE *dest, int x, int count)
+{
+	WORD *scan = (WORD *) dest + x;
+
+	for (int i = 0; i < count; i++) {
+		ARGB color = src[i];
+		scan[i] = ((color >> 16) & 0x8000) | ((color >> 9) & 0x7C00) | ((color >> 6) & 0x03E0) | ((color >> 3) & 0x001F);
+	}
+}
+
+static void
+gdip_encode_row_24bppRGB (const ARGB *src, BYTE *dest, int x, int count)
+{
+	BYTE *scan = dest + x * 3;
+
+	for (int i = 0; i < count; i++, scan += 3) {
+		scan[0] = src[i];
+		scan[1] = src[i] >> 8;
+		scan[2] = src[i] >> 16;
+	}
+}
+
+static void
+gdip_encode_row_32bppRGB (const ARGB *src, BYTE *dest, int x, int count)
+{
+	ARGB *scan = (ARGB *) dest + x;
+
+	for (int i = 0; i < count; i++)
+		scan[i] = src[i] | 0xFF000000;
+}
+
+static void
+gdip_encode_row_32bppARGB (const ARGB *src, BYTE *dest, int x, int count)
+{
+	memmove ((ARGB *) dest + x, src, count * sizeof (ARGB));
+}
+
+static void
+gdip_encode_row_32bppPARGB (const ARGB *src, BYTE *dest, int x, int count)
+{
+	gdip_premultiply_row (src, (ARGB *) dest + x, count);
+}
+
+typedef void (*PixelRowEncoder) (const ARGB *src, BYTE *dest, int x, int count);
+
+static const PixelRowEncoder pixel_row_encoders [PixelRowFormatCount] = {
+	NULL,
+	NULL,
+	NULL,
+	gdip_encode_row_16bppRGB555,
+	gdip_encode_row_16bppRGB565,
+	gdip_encode_row_16bppARGB1555,
+	gdip_encode_row_24bppRGB,
+	gdip_encode_row_32bppRGB,
+	gdip_encode_row_32bppARGB,
+	gdip_encode_row_32bppPARGB
+};
+
+/* Converters */
+
+static void
+gdip_convert_row_generic (const PixelRowConversion *conversion, const BYTE *src, int src_x, BYTE *dest, int dest_x, int count)
+{
+	PixelRowDecoder decode = pixel_row_decoders [conversion->src_format];
+	PixelRowEncoder encode = pixel_row_encoders [conversion->dest_format];
+	ARGB buffer [PIXEL_ROW_CHUNK];
+
+	/* non-premultiplied ARGB is what the decoders produce, so there is no need for the buffer */
+	if (conversion->dest_format == PixelRowFormat32bppARGB) {
+		decode (conversion, src, src_x, (ARGB *) dest + dest_x, count);
+		return;
+	}
+
+	while (count > 0) {
+		int n = MIN (count, PIXEL_ROW_CHUNK);
+
+		decode (conversion, src, src_x, buffer, n);
+		encode (buffer, dest, dest_x, n);
+
+		src_x += n;
+		dest_x += n;
+		count -= n;
+	}
+}
+
+static void
+gdip_convert_row_copy (const PixelRowConversion *conversion, const BYTE *src, int src_x, BYTE *dest, int dest_x, int count)
+{
+	int bytes = pixel_row_format_bits [conversion->src_format] >> 3;
+
+	memmove (dest + dest_x * bytes, src + src_x * bytes, count * bytes);
+}
+
+/* 1 and 4bpp: the pixels of the source and destination rows aren't necessarily aligned on the same bit */
+static void
+gdip_convert_row_copy_packed (const PixelRowConversion *conversion, const BYTE *src, int src_x, BYTE *dest, int dest_x, int count)
+{
+	int bits = pixel_row_format_bits [conversion->src_format];
+	int pixels_per_byte = 8 / bits;
+	int mask = (1 << bits) - 1;
+	int i = 0;
+
+	if ((src_x % pixels_per_byte) == 0 && (dest_x % pixels_per_byte) == 0) {
+		i = count - count % pixels_per_byte;
+		memmove (dest + dest_x / pixels_per_byte, src + src_x / pixels_per_byte, i / pixels_per_byte);
+	}
+
+	for (; i < count; i++) {
+		int s = src_x + i;
+		int d = dest_x + i;
+		int src_shift = (pixels_per_byte - 1 - s % pixels_per_byte) * bits;
+		int dest_shift = (pixels_per_byte - 1 - d % pixels_per_byte) * bits;
+		BYTE *scan = dest + d / pixels_per_byte;
+
+		*scan = (*scan & ~(mask << dest_shift)) | (((src [s / pixels_per_byte] >> src_shift) & mask) << dest_shift);
+	}
+}
+
+/* the palette has already been encoded in the destination format */
+static void
+gdip_convert_row_indexed_to_32bpp (const PixelRowConversion *conversion, const BYTE *src, int src_x, BYTE *dest, int dest_x, int count)
+{
+	gdip_indexed_row_to_argb (src, pixel_row_format_bits [conversion->src_format], src_x, count, conversion->lookup, (ARGB *) dest + dest_x);
+}
+
+/* 24bpp RGB to any of the 32bpp formats; opaque pixels are the same premultiplied or not */
+static void
+gdip_convert_row_24bpp_to_32bpp (const PixelRowConversion *conversion, const BYTE *src, int src_x, BYTE *dest, int dest_x, int count)
+{
+	const BYTE *scan = src + src_x * 3;
+	ARGB *line = (ARGB *) dest + dest_x;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		const BYTE *pixel = scan + i * 3;
+		line[i] = pixel[0] | (pixel[1] << 8) | (pixel[2] << 16) | 0xFF000000;
+	}
+}
+
+/* 32bpp RGB or ARGB to 24bpp RGB, the alpha channel is dropped */
+static void
+gdip_convert_row_32bpp_to_24bpp (const PixelRowConversion *conversion, const BYTE *src, int src_x, BYTE *dest, int dest_x, int count)
+{
+	const ARGB *line = (const ARGB *) src + src_x;
+	BYTE *scan = dest + dest_x * 3;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		BYTE *pixel = scan + i * 3;
+		pixel[0] = line[i];
+		pixel[1] = line[i] >> 8;
+		pixel[2] = line[i] >> 16;
+	}
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && ((__GNUC__ >= 5) || defined(__clang__))
+#define GDIP_CONVERT_SSSE3 1
+
+__attribute__((target("ssse3"))) static void
+gdip_convert_row_24bpp_to_32bpp_ssse3 (const PixelRowConversion *conversion, const BYTE *src, int src_x, BYTE *dest, int dest_x, int count)
+{
+	const BYTE *scan = src + src_x * 3;
+	ARGB *line = (ARGB *) dest + dest_x;
+	const __m128i shuffle = _mm_setr_epi8 (0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m128i alpha = _mm_set1_epi32 ((int) 0xFF000000);
+	int i = 0;
+
+	/* 16 bytes are loaded for the 12 bytes of every 4 pixels, so stop before reading past the row */
+	for (; i + 6 <= count; i += 4) {
+		__m128i pixels = _mm_loadu_si128 ((const __m128i *) (scan + i * 3));
+		_mm_storeu_si128 ((__m128i *) (line + i), _mm_or_si128 (_mm_shuffle_epi8 (pixels, shuffle), alpha));
+	}
+
+	gdip_convert_row_24bpp_to_32bpp (conversion, src, src_x + i, dest, dest_x + i, count - i);
+}
+
+__attribute__((target("ssse3"))) static void
+gdip_convert_row_32bpp_to_24bpp_ssse3 (const PixelRowConversion *conversion, const BYTE *src, int src_x, BYTE *dest, int dest_x, int count)
+{
+	const ARGB *line = (const ARGB *) src + src_x;
+	BYTE *scan = dest + dest_x * 3;
+	const __m128i shuffle = _mm_setr_epi8 (0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	int i = 0;
+
+	/* 16 bytes are stored for the 12 bytes of every 4 pixels, so stop before writing past the row */
+	for (; i + 6 <= count; i += 4) {
+		__m128i pixels = _mm_loadu_si128 ((const __m128i *) (line + i));
+		_mm_storeu_si128 ((__m128i *) (scan + i * 3), _mm_shuffle_epi8 (pixels, shuffle));
+	}
+
+	gdip_convert_row_32bpp_to_24bpp (conversion, src, src_x + i, dest, dest_x + i, count - i);
+}
 #endif
-		}
 
-		state->scan -= state->pixels_per_byte;
-		state->x++;
+/* 32bpp RGB to ARGB or PARGB, ARGB to RGB: only the alpha channel has to be forced */
+static void
+gdip_convert_row_32bpp_opaque (const PixelRowConversion *conversion, const BYTE *src, int src_x, BYTE *dest, int dest_x, int count)
+{
+	const ARGB *line = (const ARGB *) src + src_x;
+	ARGB *scan = (ARGB *) dest + dest_x;
+	int i = 0;
 
-		if (state->x >= (state->region.X + state->region.Width)) {
-			state->x = state->region.X;
-			state->y++;
+#if defined(__SSE2__)
+	const __m128i alpha = _mm_set1_epi32 ((int) 0xFF000000);
 
-			state->scan = (BYTE*)(state->data->scan0)
-			            + state->y * state->data->stride
-			            + state->x * -state->pixels_per_byte;
-		}
+	for (; i + 4 <= count; i += 4) {
+		__m128i pixels = _mm_loadu_si128 ((const __m128i *) (line + i));
+		_mm_storeu_si128 ((__m128i *) (scan + i), _mm_or_si128 (pixels, alpha));
 	}
+#endif
+
+	for (; i < count; i++)
+		scan[i] = line[i] | 0xFF000000;
+}
+
+static void
+gdip_convert_row_premultiply (const PixelRowConversion *conversion, const BYTE *src, int src_x, BYTE *dest, int dest_x, int count)
+{
+	gdip_premultiply_row ((const ARGB *) src + src_x, (ARGB *) dest + dest_x, count);
 }
 
-static BOOL /* <-- TRUE if optimisation was possible and copy done, else FALSE */
-gdip_pixel_stream_copy_optimized (StreamingState *dst_state, StreamingState *src_state)
+static void
+gdip_convert_row_unpremultiply (const PixelRowConversion *conversion, const BYTE *src, int src_x, BYTE *dest, int dest_x, int count)
+{
+	gdip_unpremultiply_row ((const ARGB *) src + src_x, (ARGB *) dest + dest_x, count);
+}
+
+/* The pairs of different, non-indexed, layouts that don't go through the generic converter, some of them replaced by
+ * gdip_init_pixel_row_converters with faster ones this CPU supports */
+static PixelRowConverter pixel_row_converters [PixelRowFormatCount][PixelRowFormatCount] = {
+	[PixelRowFormat24bppRGB] = {
+		[PixelRowFormat32bppRGB] = gdip_convert_row_24bpp_to_32bpp,
+		[PixelRowFormat32bppARGB] = gdip_convert_row_24bpp_to_32bpp,
+		[PixelRowFormat32bppPARGB] = gdip_convert_row_24bpp_to_32bpp,
+	},
+	[PixelRowFormat32bppRGB] = {
+		[PixelRowFormat24bppRGB] = gdip_convert_row_32bpp_to_24bpp,
+		[PixelRowFormat32bppARGB] = gdip_convert_row_32bpp_opaque,
+		[PixelRowFormat32bppPARGB] = gdip_convert_row_32bpp_opaque,
+	},
+	[PixelRowFormat32bppARGB] = {
+		[PixelRowFormat24bppRGB] = gdip_convert_row_32bpp_to_24bpp,
+		[PixelRowFormat32bppRGB] = gdip_convert_row_32bpp_opaque,
+		[PixelRowFormat32bppPARGB] = gdip_convert_row_premultiply,
+	},
+	[PixelRowFormat32bppPARGB] = {
+		[PixelRowFormat32bppARGB] = gdip_convert_row_unpremultiply,
+	},
+};
+
+void
+gdip_init_pixel_row_converters (void)
 {
-	if (src_state == NULL) return FALSE;
-	if (dst_state == NULL) return FALSE;
+#if defined(GDIP_CONVERT_SSSE3)
+	__builtin_cpu_init ();
+	if (__builtin_cpu_supports ("ssse3")) {
+		pixel_row_converters [PixelRowFormat24bppRGB][PixelRowFormat32bppRGB] = gdip_convert_row_24bpp_to_32bpp_ssse3;
+		pixel_row_converters [PixelRowFormat24bppRGB][PixelRowFormat32bppARGB] = gdip_convert_row_24bpp_to_32bpp_ssse3;
+		pixel_row_converters [PixelRowFormat24bppRGB][PixelRowFormat32bppPARGB] = gdip_convert_row_24bpp_to_32bpp_ssse3;
+		pixel_row_converters [PixelRowFormat32bppRGB][PixelRowFormat24bppRGB] = gdip_convert_row_32bpp_to_24bpp_ssse3;
+		pixel_row_converters [PixelRowFormat32bppARGB][PixelRowFormat24bppRGB] = gdip_convert_row_32bpp_to_24bpp_ssse3;
+	}
+#endif
+}
 
-	/* in a first shot we only support copy operations for cases where source and destination storage width is exactly the same */
-	if (src_state->pixels_per_byte != dst_state->pixels_per_byte) return FALSE;
+/*
+ * Prepares the conversion of rows from the src to the dest layout. Indexed sources need their palette,
+ * unless the destination has the same layout; nothing can be converted to an indexed layout.
+ */
+GpStatus
+gdip_init_pixel_row_conversion (PixelRowConversion *conversion, PixelRowFormat src, PixelRowFormat dest, const ColorPalette *palette)
+{
+	if (src == PixelRowFormatUnsupported || dest == PixelRowFormatUnsupported)
+		return NotImplemented;
 
-	//if (src_state->data->pixel_format == PixelFormat32bppRGB) return FALSE;
+	conversion->src_format = src;
+	conversion->dest_format = dest;
 
-	/* if the target is in 32bpp format with only RGB but no alpha then we should forcefully set all alpha bits to 0xff -> optimize this later! */
-	if (dst_state->pixels_per_byte == -4) {
-		if (dst_state->data->pixel_format == PixelFormat32bppRGB) return FALSE;
+	if (src == dest) {
+		if (src == PixelRowFormat32bppRGB) {
+			/* the alpha channel of 32bpp RGB data can hold anything, Cairo needs it to be opaque */
+			conversion->convert = gdip_convert_row_32bpp_opaque;
+		} else if (pixel_row_format_bits [src] < 8) {
+			conversion->convert = gdip_convert_row_copy_packed;
+		} else {
+			conversion->convert = gdip_convert_row_copy;
+		}
+		return Ok;
 	}
 
-	/* optimisation code differs for different bytes per pixel (== pixels per byte) */
-	if (src_state->pixels_per_byte == 1) {
-		/* A fast path for 8-bit indexed data: pixels are byte-aligned, so no special unpacking is required. */
-		return FALSE; /* optimize this later */
-	} else if (src_state->pixels_per_byte > 0) {
-		/* We have an indexed format (the RGB formats can't fit a whole pixel into a single byte). */
-		return FALSE; /* optimize this later */
-	} else if (src_state->pixels_per_byte == 0) {
-		return FALSE; /* unknown format - dont know how to handle; this is a sanity check for crash prevention in the following code */
-	} else {
-		/* We have an RGB format. In the current implementation, these are always stored as
-		 * CAIRO_FORMAT_ARGB. This makes this section very easy to implement. If native
-		 * support for 15- and 16-bit pixel formats needs to be added in the future, though,
-		 * then this is where it needs to be done.
-		 *
-		 * In order to simplify advancing the state->scan pointer, the state->pixels_per_byte
-		 * member is set to the number of bytes per pixel, negated. That is, for 24-bit
-		 * formats, it is set to -3, and for 32-bit formats, it is set to -4.
-		 *
-		 * Note that pixel streams do not support 48- and 64-bit data at this time.
-		 */
-#if WORDS_BIGENDIAN
-		return FALSE; /* optimize this later */
-#else
-		int bytes_per_pixel = -src_state->pixels_per_byte;
-		int bytes_per_line = bytes_per_pixel * src_state->region.Width;
-		int bytes_per_region = bytes_per_line * src_state->region.Height;
+	if (gdip_is_indexed_row_format (dest))
+		return InvalidParameter;
 
-		int src_stride = src_state->data->stride;
-		int dst_stride = dst_state->data->stride;
+	if (gdip_is_indexed_row_format (src)) {
+		if (!palette)
+			return InvalidParameter;
 
-		/* calculate region base addresses (this might resemble the current ..._state->scan value, but we simply dont care) */
-		BYTE* src_region = (BYTE*)(src_state->data->scan0) + src_state->region.Y * src_stride + src_state->region.X * bytes_per_pixel;
-		BYTE* dst_region = (BYTE*)(dst_state->data->scan0) + dst_state->region.Y * dst_stride + dst_state->region.X * bytes_per_pixel;
+		for (int i = 0; i < 256; i++)
+			conversion->lookup[i] = (i < palette->Count) ? palette->Entries[i] : 0xFF000000;
 
-		/* check if thze data at both locations is in a perfectly consecutive arrangement */
-		if ((src_state->region.Width * bytes_per_pixel == src_stride)
-			&& (dst_state->region.Width * bytes_per_pixel == dst_stride)) {
-			memcpy (dst_region, src_region, bytes_per_region);
+		if (gdip_is_32bpp_row_format (dest)) {
+			if (dest != PixelRowFormat32bppARGB)
+				pixel_row_encoders [dest] (conversion->lookup, (BYTE *) conversion->lookup, 0, 256);
+			conversion->convert = gdip_convert_row_indexed_to_32bpp;
 		} else {
-			BYTE *src = src_region;
-			BYTE *dst = dst_region;
-			int lines;
-
-			for (lines = src_state->region.Height; lines; lines--) {
-				memcpy (dst, src, bytes_per_line);
-				src += src_stride;
-				dst += dst_stride;
-			}
+			conversion->convert = gdip_convert_row_generic;
 		}
-		/* all data got copied */
+		return Ok;
+	}
 
-		/* adjust the position index and the scan value to the end of the region */
-		src_state->x = src_state->region.X + src_state->region.Width;
-		src_state->y = src_state->region.Y + src_state->region.Height;
-		src_state->scan += src_state->region.Y * src_stride;
+	conversion->convert = pixel_row_converters [src][dest];
+	if (!conversion->convert)
+		conversion->convert = gdip_convert_row_generic;
 
-		dst_state->x = dst_state->region.X + dst_state->region.Width;
-		dst_state->y = dst_state->region.Y + dst_state->region.Height;
-		dst_state->scan += dst_state->region.Y * dst_stride;
-#endif
-	}
+	return Ok;
+}
 
-	return TRUE;
+/* Converts count pixels, starting at pixel src_x of the src row, to the dest row starting at pixel dest_x */
+void
+gdip_convert_pixel_row (const PixelRowConversion *conversion, const BYTE *src, int src_x, BYTE *dest, int dest_x, int count)
+{
+	conversion->convert (conversion, src, src_x, dest, dest_x, count);
 }
 
 /**
@@ -1779,10 +2588,11 @@ gdip_bitmap_change_rect_pixel_format (ActiveBitmapData *srcData, const Rect *src
 {
 	PixelFormat	srcFormat;
 	PixelFormat	destFormat;
-	StreamingState	srcStream;
-	StreamingState	destStream;
+	PixelRowConversion	conversion;
 	Rect		effectiveDestRect;
 	GpStatus	status;
+	BYTE		*src;
+	BYTE		*dest;
 
 	srcFormat = srcData->pixel_format;
 	destFormat = destData->pixel_format;
@@ -1790,11 +2600,15 @@ gdip_bitmap_change_rect_pixel_format (ActiveBitmapData *srcData, const Rect *src
 	if (!gdip_is_pixel_format_conversion_valid (srcFormat, destFormat))
 		return InvalidParameter;
 
-	if (!destData->scan0)
+	if (!srcData->scan0 || !destData->scan0)
+		return InvalidParameter;
+
+	/* Check that the srcRect lies fully within the srcData buffer. */
+	if ((srcRect->X < 0) || (srcRect->Y < 0) || (srcRect->X + srcRect->Width > srcData->width) || (srcRect->Y + srcRect->Height > srcData->height))
 		return InvalidParameter;
 
 	/* Check that the destRect lies fully within the destData buffer. */
-	if ((destRect->X + destRect->Width > destData->width) || (destRect->Y + destRect->Height > destData->height))
+	if ((destRect->X < 0) || (destRect->Y < 0) || (destRect->X + destRect->Width > destData->width) || (destRect->Y + destRect->Height > destData->height))
 		return InvalidParameter;
 
 	effectiveDestRect = *destRect;
@@ -1807,42 +2621,58 @@ gdip_bitmap_change_rect_pixel_format (ActiveBitmapData *srcData, const Rect *src
 		effectiveDestRect.Height = srcRect->Height;
 	}
 
-	/* Fire up the pixel streams. */
-	status = gdip_init_pixel_stream (&srcStream, srcData, srcRect->X, srcRect->Y, srcRect->Width, srcRect->Height);
-
-	if (status != Ok) {
+	status = gdip_init_pixel_row_conversion (&conversion,
+		gdip_get_pixel_row_format (srcFormat, (srcData->reserved & GBD_TRUE24BPP) != 0),
+		gdip_get_pixel_row_format (destFormat, (destData->reserved & GBD_TRUE24BPP) != 0),
+		srcData->palette);
+	if (status != Ok)
 		return status;
-	}
 
-	status = gdip_init_pixel_stream (&destStream, destData, effectiveDestRect.X, effectiveDestRect.Y, effectiveDestRect.Width, effectiveDestRect.Height);
+	/* Move the data, a row at a time */
+	src = (BYTE *) srcData->scan0 + srcRect->Y * srcData->stride;
+	dest = (BYTE *) destData->scan0 + effectiveDestRect.Y * destData->stride;
 
-	if (status != Ok) {
-		return status;
+	for (int y = 0; y < effectiveDestRect.Height; y++) {
+		gdip_convert_pixel_row (&conversion, src, srcRect->X, dest, effectiveDestRect.X, effectiveDestRect.Width);
+		src += srcData->stride;
+		dest += destData->stride;
 	}
 
-	/* Move the data; special path going from indexed to not-indexed */
-	if ((srcFormat & PixelFormatIndexed) && !(destFormat & PixelFormatIndexed)) {
-		int	pixel;
+	return Ok;
+}
+
+/* LockBits can hand out a pointer into scan0 when the locked pixels are stored exactly as requested */
+static BOOL
+gdip_bitmap_can_lock_in_place (GpBitmap *bitmap, GDIPCONST Rect *rect, UINT flags, PixelFormat format)
+{
+	PixelRowFormat	row_format;
 
-		while (gdip_pixel_stream_has_next (&srcStream)) {
-			pixel = gdip_pixel_stream_get_next (&srcStream);
+	if (format != bitmap->active_bitmap->pixel_format || (flags & ImageLockModeUserInputBuf) != 0)
+		return FALSE;
 
-			/* Look up the pixel in the palette and get the ARGB value */
-			pixel = srcData->palette->Entries[pixel];
-#if G_BYTE_ORDER != G_LITTLE_ENDIAN
-			pixel = GUINT32_FROM_LE (pixel);
-#endif
-			gdip_pixel_stream_set_next (&destStream, pixel);
-		}
-	} else {
-		if (!gdip_pixel_stream_copy_optimized (&destStream, &srcStream)) {
-			while (gdip_pixel_stream_has_next (&srcStream)) {
-				gdip_pixel_stream_set_next (&destStream, gdip_pixel_stream_get_next (&srcStream));
-			}
-		}
+	/* even a read only lock can be written through, which would change the clones sharing the pixels */
+	if (bitmap->active_bitmap->reserved & GBD_SHARED_SCAN0)
+		return FALSE;
+
+	switch (format) {
+	case PixelFormat24bppRGB:
+		/* stored with 4 bytes per pixel for Cairo, but locked with 3 */
+		return FALSE;
+	case PixelFormat32bppARGB:
+		/* writes would have to be premultiplied into the surface */
+		if (bitmap->surface)
+			return FALSE;
+		break;
+	default:
+		break;
 	}
 
-	return Ok;
+	row_format = gdip_get_pixel_row_format (format, TRUE);
+	if (row_format == PixelRowFormatUnsupported)
+		return FALSE;
+
+	/* indexed rows can only be handed out from a byte boundary */
+	return (rect->X * pixel_row_format_bits [row_format]) % 8 == 0;
 }
 
 GpStatus WINGDIPAPI
@@ -1888,6 +2718,12 @@ GdipBitmapLockBits (GpBitmap *bitmap, GDIPCONST GpRect *rect, UINT flags, PixelF
 	if (!gdip_is_a_supported_pixelformat (format))
 		return InvalidParameter;
 
+	if ((flags & ImageLockModeWrite) != 0) {
+		status = gdip_bitmap_ensure_writable (bitmap);
+		if (status != Ok)
+			return status;
+	}
+
 	/* Common stuff */
 	if ((flags & ImageLockModeWrite) != 0) {
 		dest_data->reserved |= GBD_WRITE_OK;
@@ -1910,13 +2746,18 @@ GdipBitmapLockBits (GpBitmap *bitmap, GDIPCONST GpRect *rect, UINT flags, PixelF
 	dest_data->pixel_format = format;
 	dest_data->palette = NULL;
 
-	if (format != PixelFormat24bppRGB && format == src_data->pixel_format && (flags & ImageLockModeUserInputBuf) == 0) {
-		// No conversion needed, just read the bits directly.
-		dest_data->reserved &= ~GBD_OWN_SCAN0;
+	if (gdip_bitmap_can_lock_in_place (bitmap, &src_rect, flags, format)) {
+		// No conversion needed, hand out the bits directly.
+		dest_data->reserved &= ~(GBD_OWN_SCAN0 | GBD_TRUE24BPP);
+		dest_data->reserved |= GBD_IN_PLACE;
 		dest_data->stride = src_data->stride;
-		dest_data->scan0 = src_data->scan0;
+		dest_data->scan0 = (BYTE *) src_data->scan0 + (size_t) src_rect.Y * src_data->stride +
+			((size_t) src_rect.X * pixel_row_format_bits [gdip_get_pixel_row_format (format, TRUE)] >> 3);
+		gdip_bitmap_flush_surface (bitmap);
+		return Ok;
 	}
 	else {
+		dest_data->reserved &= ~GBD_IN_PLACE;
 		int		dest_pixel_format_bpp;
 
 		switch (format) {
@@ -1998,11 +2839,26 @@ GdipBitmapUnlockBits (GpBitmap *bitmap, BitmapData *lockedBitmapData)
 	}
 
 	/* We need to copy the locked data back to the root data's Scan0 if the image was writeable */
-	if ((src_data->reserved & GBD_WRITE_OK) != 0) {
+	if ((src_data->reserved & GBD_IN_PLACE) != 0) {
+		/* it was written in place */
+		if ((src_data->reserved & GBD_WRITE_OK) != 0) {
+			/* 32bppRGB pixels can be written with any alpha, but are drawn (by an ARGB32 surface) as opaque */
+			if (src_data->pixel_format == PixelFormat32bppRGB) {
+				for (int y = 0; y < src_data->height; y++) {
+					ARGB *row = (ARGB *) (src_data->scan0 + (size_t) y * src_data->stride);
+					for (int x = 0; x < src_data->width; x++)
+						row[x] |= 0xFF000000;
+				}
+			}
+			gdip_bitmap_modified (bitmap);
+		}
+		status = Ok;
+	} else if ((src_data->reserved & GBD_WRITE_OK) != 0) {
 		Rect src_rect = { 0, 0, src_data->width, src_data->height };
 		Rect dest_rect = { src_data->x, src_data->y, src_data->width, src_data->height };
 
 		status = gdip_bitmap_change_rect_pixel_format (src_data, &src_rect, dest_data, &dest_rect);
+		gdip_bitmap_modified (bitmap);
 	} else {
 		status = Ok;
 	}
@@ -2018,19 +2874,41 @@ GdipBitmapUnlockBits (GpBitmap *bitmap, BitmapData *lockedBitmapData)
 		src_data->palette = NULL;
 	}
 
-	if (bitmap->surface != NULL) {
+	/* Only the locked rectangle can have been written to, so only it needs premultiplying again */
+	if (bitmap->surface != NULL && (src_data->reserved & GBD_WRITE_OK) != 0) {
 		BYTE *surface_scan0 = cairo_image_surface_get_data (bitmap->surface);
 		if (surface_scan0 != bitmap->active_bitmap->scan0) {
-			gdip_bitmap_get_premultiplied_scan0_inplace (bitmap, surface_scan0);
+			Rect locked_rect = { src_data->x, src_data->y, src_data->width, src_data->height };
+			gdip_bitmap_get_premultiplied_scan0_inplace (bitmap, surface_scan0, &locked_rect);
 		}
 	}
 
-	src_data->reserved &= ~GBD_LOCKED;
+	src_data->reserved &= ~(GBD_LOCKED | GBD_IN_PLACE);
 	dest_data->reserved &= ~GBD_LOCKED;
 
 	return status;
 }
 
+/*
+ * libgdiplus extension: tells whether GdipBitmapLockBits handed out a pointer into the pixels of the bitmap
+ * (so that nothing was copied or converted, neither when locking nor when unlocking) rather than a copy.
+ */
+GpStatus WINGDIPAPI
+GdipBitmapIsLockedInPlace_linux (GDIPCONST BitmapData *lockedBitmapData, BOOL *inPlace)
+{
+	const ActiveBitmapData	*data;
+
+	if (!lockedBitmapData || !inPlace)
+		return InvalidParameter;
+
+	data = (const ActiveBitmapData *) lockedBitmapData;
+	if ((data->reserved & GBD_LOCKED) == 0)
+		return WrongState;
+
+	*inPlace = (data->reserved & GBD_IN_PLACE) != 0;
+	return Ok;
+}
+
 GpStatus WINGDIPAPI
 GdipBitmapSetPixel (GpBitmap *bitmap, INT x, INT y, ARGB color)
 {
@@ -2049,11 +2927,16 @@ GdipBitmapSetPixel (GpBitmap *bitmap, INT x, INT y, ARGB color)
 		return WrongState;
 	if (x < 0 || x >= data->width || y < 0 || y >= data->height)
 		return InvalidParameter;
+	if (gdip_bitmap_ensure_writable (bitmap) != Ok)
+		return OutOfMemory;
 
 	if (bitmap->surface != NULL && gdip_bitmap_format_needs_premultiplication(bitmap)) {
+		Rect pixel_rect = { x, y, 1, 1 };
+		gdip_bitmap_surface_modified (bitmap, &pixel_rect);
 		v = (BYTE*)(cairo_image_surface_get_data (bitmap->surface)) + y * data->stride;
 		pixel_format = PixelFormat32bppPARGB;
 	} else {
+		gdip_bitmap_modified (bitmap);
 		v = (BYTE*)(data->scan0) + y * data->stride;
 		pixel_format = data->pixel_format;
 	}
@@ -2105,81 +2988,241 @@ GdipBitmapGetPixel (GpBitmap *bitmap, INT x, INT y, ARGB *color)
 		if (x < 0 || x >= data->width || y < 0 || y >= data->height)
 			return InvalidParameter;
 
-		StreamingState	pixel_stream;
-		GpStatus	status;
-		unsigned int	palette_index;
+		StreamingState	pixel_stream;
+		GpStatus	status;
+		unsigned int	palette_index;
+
+		if (!data->palette)
+			return InvalidParameter;
+
+		status = gdip_init_pixel_stream (&pixel_stream, data, x, y, 1, 1);
+		if (status != Ok)
+			return status;
+
+		palette_index = gdip_pixel_stream_get_next (&pixel_stream);
+
+		if (palette_index >= data->palette->Count) {
+			*color = 0xFF000000;
+		} else {
+			*color = data->palette->Entries[palette_index];
+		}
+	} else {
+		if (data->reserved & GBD_LOCKED)
+			return WrongState;
+		if (x < 0 || x >= data->width || y < 0 || y >= data->height)
+			return InvalidParameter;
+
+		BYTE *v;
+		PixelFormat pixel_format;
+
+		if (bitmap->surface != NULL && gdip_bitmap_format_needs_premultiplication(bitmap)) {
+			v = (BYTE*)(cairo_image_surface_get_data (bitmap->surface)) + y * data->stride;
+			pixel_format = PixelFormat32bppPARGB;
+		} else {
+			v = (BYTE*)(data->scan0) + y * data->stride;
+			pixel_format = data->pixel_format;
+		}
+
+		switch (pixel_format) {
+		case PixelFormat16bppGrayScale:
+			return InvalidParameter;
+		case PixelFormat32bppARGB: {
+			ARGB *scan = (ARGB *)v;
+			*color = scan[x];
+			break;
+		}
+		case PixelFormat32bppPARGB: {
+			ARGB *scan = (ARGB *)v;
+			BYTE r, g, b, a;
+			get_pixel_bgra (scan[x], b, g, r, a);
+			if (a < 0xff) {
+				b = pre_multiplied_table_reverse [b][a];
+				g = pre_multiplied_table_reverse [g][a];
+				r = pre_multiplied_table_reverse [r][a];
+				set_pixel_bgra(color, 0, b, g, r, a);
+			} else {
+				*color = scan[x];
+			}
+			break;
+		}
+		case PixelFormat24bppRGB:
+		case PixelFormat32bppRGB: {
+			ARGB *scan = (ARGB *)v;
+			*color = scan[x] | 0xFF000000;
+			break;
+		}
+		case PixelFormat16bppARGB1555:
+		case PixelFormat16bppRGB555:
+			*color = gdip_getpixel_16bppRGB555 (v, x);
+			break;
+		case PixelFormat16bppRGB565:
+			*color = gdip_getpixel_16bppRGB565 (v, x);
+			break;
+		default:
+			return NotImplemented;
+		}
+	} 
+	
+	return Ok;
+}
+
+static GpStatus
+gdip_bitmap_pixels_rect (ActiveBitmapData *data, GDIPCONST GpRect *rect, INT stride, Rect *region)
+{
+	if (rect) {
+		if ((rect->X < 0) || (rect->Y < 0) || (rect->Width <= 0) || (rect->Height <= 0))
+			return InvalidParameter;
+
+		if ((rect->Width > (INT) data->width - rect->X) || (rect->Height > (INT) data->height - rect->Y))
+			return InvalidParameter;
+
+		*region = *rect;
+	} else {
+		region->X = 0;
+		region->Y = 0;
+		region->Width = data->width;
+		region->Height = data->height;
+	}
+
+	if (stride < 0 || stride / (INT) sizeof (ARGB) < region->Width)
+		return InvalidParameter;
+
+	return Ok;
+}
+
+/*
+ * libgdiplus extension: reads a whole rectangle of pixels (all of the bitmap if rect is NULL) as
+ * non-premultiplied ARGB values, like calling GdipBitmapGetPixel on every pixel. The pixels are
+ * converted a row at a time. stride is the distance, in bytes, between two rows of pixels.
+ */
+GpStatus WINGDIPAPI
+GdipBitmapGetPixels_linux (GpBitmap *bitmap, GDIPCONST GpRect *rect, INT stride, ARGB *pixels)
+{
+	ActiveBitmapData	*data;
+	PixelRowConversion	conversion;
+	PixelRowFormat	src_format;
+	GpStatus	status;
+	Rect		region;
+	BYTE		*src;
+	BYTE		*dest;
+	int		y;
+
+	if (!bitmap || !bitmap->active_bitmap || !pixels)
+		return InvalidParameter;
+
+	data = bitmap->active_bitmap;
+	status = gdip_bitmap_pixels_rect (data, rect, stride, &region);
+	if (status != Ok)
+		return status;
+
+	if (gdip_is_an_indexed_pixelformat (data->pixel_format)) {
+		if (!data->palette)
+			return InvalidParameter;
+
+		src = (BYTE *) data->scan0;
+		src_format = gdip_get_pixel_row_format (data->pixel_format, FALSE);
+	} else {
+		if (data->reserved & GBD_LOCKED)
+			return WrongState;
+		if (data->pixel_format == PixelFormat16bppGrayScale)
+			return InvalidParameter;
+
+		if (bitmap->surface != NULL && gdip_bitmap_format_needs_premultiplication (bitmap)) {
+			src = cairo_image_surface_get_data (bitmap->surface);
+			src_format = PixelRowFormat32bppPARGB;
+		} else {
+			src = (BYTE *) data->scan0;
+			src_format = gdip_get_pixel_row_format (data->pixel_format, FALSE);
+		}
+	}
+
+	status = gdip_init_pixel_row_conversion (&conversion, src_format, PixelRowFormat32bppARGB, data->palette);
+	if (status != Ok)
+		return status;
+
+	src += region.Y * data->stride;
+	dest = (BYTE *) pixels;
+
+	for (y = 0; y < region.Height; y++) {
+		gdip_convert_pixel_row (&conversion, src, region.X, dest, 0, region.Width);
+		src += data->stride;
+		dest += stride;
+	}
+
+	return Ok;
+}
+
+/*
+ * libgdiplus extension: writes a whole rectangle of non-premultiplied ARGB pixels (all of the bitmap
+ * if rect is NULL), like calling GdipBitmapSetPixel on every pixel but a row at a time.
+ */
+GpStatus WINGDIPAPI
+GdipBitmapSetPixels_linux (GpBitmap *bitmap, GDIPCONST GpRect *rect, INT stride, GDIPCONST ARGB *pixels)
+{
+	ActiveBitmapData	*data;
+	PixelRowConversion	conversion;
+	PixelRowFormat	dest_format;
+	GpStatus	status;
+	Rect		region;
+	const BYTE	*src;
+	BYTE		*dest;
+	int		y;
+
+	if (!bitmap || !bitmap->active_bitmap || !pixels)
+		return InvalidParameter;
+
+	data = bitmap->active_bitmap;
+
+	if (gdip_is_an_indexed_pixelformat (data->pixel_format))
+		return InvalidParameter;
+	if (data->reserved & GBD_LOCKED)
+		return WrongState;
 
-		if (!data->palette)
-			return InvalidParameter;
+	status = gdip_bitmap_pixels_rect (data, rect, stride, &region);
+	if (status != Ok)
+		return status;
 
-		status = gdip_init_pixel_stream (&pixel_stream, data, x, y, 1, 1);
-		if (status != Ok)
-			return status;
+	switch (data->pixel_format) {
+	case PixelFormat24bppRGB:
+	case PixelFormat32bppRGB:
+	case PixelFormat32bppARGB:
+	case PixelFormat32bppPARGB:
+		break;
+	case PixelFormat16bppGrayScale:
+		return InvalidParameter;
+	default:
+		return NotImplemented;
+	}
 
-		palette_index = gdip_pixel_stream_get_next (&pixel_stream);
+	status = gdip_bitmap_ensure_writable (bitmap);
+	if (status != Ok)
+		return status;
 
-		if (palette_index >= data->palette->Count) {
-			*color = 0xFF000000;
-		} else {
-			*color = data->palette->Entries[palette_index];
-		}
+	if (bitmap->surface != NULL && gdip_bitmap_format_needs_premultiplication (bitmap)) {
+		dest = cairo_image_surface_get_data (bitmap->surface);
+		dest_format = PixelRowFormat32bppPARGB;
 	} else {
-		if (data->reserved & GBD_LOCKED)
-			return WrongState;
-		if (x < 0 || x >= data->width || y < 0 || y >= data->height)
-			return InvalidParameter;
+		dest = (BYTE *) data->scan0;
+		dest_format = gdip_get_pixel_row_format (data->pixel_format, FALSE);
+	}
 
-		BYTE *v;
-		PixelFormat pixel_format;
+	status = gdip_init_pixel_row_conversion (&conversion, PixelRowFormat32bppARGB, dest_format, NULL);
+	if (status != Ok)
+		return status;
 
-		if (bitmap->surface != NULL && gdip_bitmap_format_needs_premultiplication(bitmap)) {
-			v = (BYTE*)(cairo_image_surface_get_data (bitmap->surface)) + y * data->stride;
-			pixel_format = PixelFormat32bppPARGB;
-		} else {
-			v = (BYTE*)(data->scan0) + y * data->stride;
-			pixel_format = data->pixel_format;
-		}
+	if (bitmap->surface != NULL && gdip_bitmap_format_needs_premultiplication (bitmap))
+		gdip_bitmap_surface_modified (bitmap, &region);
+	else
+		gdip_bitmap_modified (bitmap);
+
+	src = (const BYTE *) pixels;
+	dest += region.Y * data->stride;
+	for (y = 0; y < region.Height; y++) {
+		gdip_convert_pixel_row (&conversion, src, 0, dest, region.X, region.Width);
+		src += stride;
+		dest += data->stride;
+	}
 
-		switch (pixel_format) {
-		case PixelFormat16bppGrayScale:
-			return InvalidParameter;
-		case PixelFormat32bppARGB: {
-			ARGB *scan = (ARGB *)v;
-			*color = scan[x];
-			break;
-		}
-		case PixelFormat32bppPARGB: {
-			ARGB *scan = (ARGB *)v;
-			BYTE r, g, b, a;
-			get_pixel_bgra (scan[x], b, g, r, a);
-			if (a < 0xff) {
-				b = pre_multiplied_table_reverse [b][a];
-				g = pre_multiplied_table_reverse [g][a];
-				r = pre_multiplied_table_reverse [r][a];
-				set_pixel_bgra(color, 0, b, g, r, a);
-			} else {
-				*color = scan[x];
-			}
-			break;
-		}
-		case PixelFormat24bppRGB:
-		case PixelFormat32bppRGB: {
-			ARGB *scan = (ARGB *)v;
-			*color = scan[x] | 0xFF000000;
-			break;
-		}
-		case PixelFormat16bppARGB1555:
-		case PixelFormat16bppRGB555:
-			*color = gdip_getpixel_16bppRGB555 (v, x);
-			break;
-		case PixelFormat16bppRGB565:
-			*color = gdip_getpixel_16bppRGB565 (v, x);
-			break;
-		default:
-			return NotImplemented;
-		}
-	} 
-	
 	return Ok;
 }
 
@@ -2231,8 +3274,10 @@ gdip_bitmap_ensure_surface (GpBitmap *bitmap)
 	} else {
 		bitmap->surface = cairo_image_surface_create_for_data ((BYTE*)data->scan0, format, 
 			data->width, data->height, data->stride);
+		data->reserved |= GBD_SURFACE_SCAN0;
 	}
 
+	bitmap->surface_dirty.Width = bitmap->surface_dirty.Height = 0;
 	return bitmap->surface;
 }
 
@@ -2240,10 +3285,15 @@ void gdip_bitmap_flush_surface (GpBitmap *bitmap)
 {
 	if (bitmap->surface != NULL) {
 		BYTE *surface_scan0 = cairo_image_surface_get_data (bitmap->surface);
-		if (surface_scan0 != bitmap->active_bitmap->scan0) {
-			// The surface had to be premultiplied, we need to reverse the transition
-			gdip_bitmap_get_premultiplied_scan0_reverse (bitmap, surface_scan0);
+		if (surface_scan0 != bitmap->active_bitmap->scan0 && bitmap->surface_dirty.Width > 0 && bitmap->surface_dirty.Height > 0) {
+			// The surface had to be premultiplied, we need to reverse the transition where it was drawn on
+			if (gdip_bitmap_ensure_writable (bitmap) != Ok) {
+				g_warning ("gdip_bitmap_flush_surface: Unable to copy the shared bitmap data");
+				return;
+			}
+			gdip_bitmap_get_premultiplied_scan0_reverse (bitmap, surface_scan0, &bitmap->surface_dirty);
 		}
+		bitmap->surface_dirty.Width = bitmap->surface_dirty.Height = 0;
 	}
 }
 
@@ -2253,43 +3303,95 @@ void gdip_bitmap_invalidate_surface (GpBitmap *bitmap)
 		BYTE *surface_scan0 = cairo_image_surface_get_data (bitmap->surface);
 		cairo_surface_destroy (bitmap->surface);
 		bitmap->surface = NULL;
+		bitmap->surface_dirty.Width = bitmap->surface_dirty.Height = 0;
+		bitmap->active_bitmap->reserved &= ~GBD_SURFACE_SCAN0;
 		if (surface_scan0 != bitmap->active_bitmap->scan0) {
 			GdipFree (surface_scan0);
 		}
 	}
 }
 
+/* Called whenever the pixels of the bitmap change, so that copies derived from them (e.g. by
+ * gdip_process_bitmap_attributes_cached) are no longer considered up to date */
+void
+gdip_bitmap_modified (GpBitmap *bitmap)
+{
+	bitmap->generation++;
+
+	/* what it would decode are the pixels we just lost, but the properties it has to add are still valid, and are
+	 * only parsed if they are asked for */
+	if (bitmap->decoder && bitmap->decoder->decode_scaled) {
+		bitmap->pixels_modified = TRUE;
+		gdip_bitmap_drop_stale_decoder (bitmap);
+	}
+}
+
+/* Called whenever the surface of the bitmap is drawn on; rect (NULL for all of the bitmap) is added to the
+ * area that gdip_bitmap_flush_surface has to copy back to scan0 */
+void
+gdip_bitmap_surface_modified (GpBitmap *bitmap, GDIPCONST GpRect *rect)
+{
+	ActiveBitmapData *data = bitmap->active_bitmap;
+	GpRect *dirty = &bitmap->surface_dirty;
+	int left, top, right, bottom;
+
+	gdip_bitmap_modified (bitmap);
+
+	if (!bitmap->surface || !data)
+		return;
+
+	if (rect) {
+		left = MAX (rect->X, 0);
+		top = MAX (rect->Y, 0);
+		right = MIN ((gint64) rect->X + rect->Width, data->width);
+		bottom = MIN ((gint64) rect->Y + rect->Height, data->height);
+	} else {
+		left = top = 0;
+		right = data->width;
+		bottom = data->height;
+	}
+
+	if (left >= right || top >= bottom)
+		return;
+
+	if (dirty->Width > 0 && dirty->Height > 0) {
+		left = MIN (left, dirty->X);
+		top = MIN (top, dirty->Y);
+		right = MAX (right, dirty->X + dirty->Width);
+		bottom = MAX (bottom, dirty->Y + dirty->Height);
+	}
+
+	dirty->X = left;
+	dirty->Y = top;
+	dirty->Width = right - left;
+	dirty->Height = bottom - top;
+}
+
 BOOL
 gdip_bitmap_format_needs_premultiplication (GpBitmap *bitmap)
 {
 	return (bitmap->active_bitmap->pixel_format == PixelFormat32bppARGB);
 }
 
+/* Converts the pixels inside rect (all of the bitmap if NULL) from src to dest, which share the bitmap stride */
 static void
-gdip_bitmap_get_premultiplied_scan0_internal (GpBitmap *bitmap, BYTE *src, BYTE *dest, const BYTE pre_multiplied_table[256][256])
+gdip_bitmap_get_premultiplied_scan0_internal (GpBitmap *bitmap, BYTE *src, BYTE *dest, PremultiplyRowKernel kernel, GDIPCONST GpRect *rect)
 {
 	ActiveBitmapData *data = bitmap->active_bitmap;
-	BYTE *source = src;
-	BYTE *target = dest;
-	int y, x;
-	for (y = 0; y < data->height; y++) {
-		ARGB *sp = (ARGB*) source;
-		ARGB *tp = (ARGB*) target;
-		for (x = 0; x < data->width; x++) {
-			BYTE r, g, b, a;
-			get_pixel_bgra (*sp, b, g, r, a);
-
-			if (a < 0xff) {
-				b = pre_multiplied_table [b][a];
-				g = pre_multiplied_table [g][a];
-				r = pre_multiplied_table [r][a];
-				set_pixel_bgra (tp, 0, b, g, r, a);
-			} else {
-				*tp = *sp;
-			}
-			sp++;
-			tp++;
-		}
+	GpRect all = { 0, 0, data->width, data->height };
+	size_t offset;
+	BYTE *source;
+	BYTE *target;
+	int y;
+
+	if (!rect)
+		rect = &all;
+
+	offset = (size_t) rect->Y * data->stride + (size_t) rect->X * sizeof (ARGB);
+	source = src + offset;
+	target = dest + offset;
+	for (y = 0; y < rect->Height; y++) {
+		kernel ((ARGB*) source, (ARGB*) target, rect->Width);
 		source += data->stride;
 		target += data->stride;
 	}
@@ -2306,20 +3408,20 @@ gdip_bitmap_get_premultiplied_scan0 (GpBitmap *bitmap)
 	if (!premul)
 		return NULL;
 
-	gdip_bitmap_get_premultiplied_scan0_internal (bitmap, (BYTE*)data->scan0, premul, pre_multiplied_table);
+	gdip_bitmap_get_premultiplied_scan0_internal (bitmap, (BYTE*)data->scan0, premul, gdip_premultiply_row, NULL);
 	return premul;
 }
 
 void
-gdip_bitmap_get_premultiplied_scan0_inplace (GpBitmap *bitmap, BYTE *premul)
+gdip_bitmap_get_premultiplied_scan0_inplace (GpBitmap *bitmap, BYTE *premul, GDIPCONST GpRect *rect)
 {
-	gdip_bitmap_get_premultiplied_scan0_internal (bitmap, (BYTE*)bitmap->active_bitmap->scan0, premul, pre_multiplied_table);
+	gdip_bitmap_get_premultiplied_scan0_internal (bitmap, (BYTE*)bitmap->active_bitmap->scan0, premul, gdip_premultiply_row, rect);
 }
 
 void
-gdip_bitmap_get_premultiplied_scan0_reverse (GpBitmap *bitmap, BYTE *premul)
+gdip_bitmap_get_premultiplied_scan0_reverse (GpBitmap *bitmap, BYTE *premul, GDIPCONST GpRect *rect)
 {
-	gdip_bitmap_get_premultiplied_scan0_internal (bitmap, premul, (BYTE*)bitmap->active_bitmap->scan0, pre_multiplied_table_reverse);
+	gdip_bitmap_get_premultiplied_scan0_internal (bitmap, premul, (BYTE*)bitmap->active_bitmap->scan0, gdip_unpremultiply_row, rect);
 }
 
 GpBitmap *
@@ -2477,3 +3579,287 @@ gdip_create_greyscale_palette (int num_colors)
 	}
 	return palette;
 }
+
+/* Sets palette (which has room for palette->Count entries) to one of the fixed palettes, or to the best one for the
+ * ARGB pixels; with transparent, the first entry is a transparent color */
+static GpStatus
+gdip_initialize_palette (ColorPalette *palette, PaletteType type, INT colors, BOOL transparent, const BYTE *pixels, int width, int height, int stride)
+{
+	/* levels of red, green and blue of the halftone palettes */
+	static const BYTE halftone_levels [][3] = {
+		[PaletteTypeFixedHalftone8] = { 2, 2, 2 },
+		[PaletteTypeFixedHalftone27] = { 3, 3, 3 },
+		[PaletteTypeFixedHalftone64] = { 4, 4, 4 },
+		[PaletteTypeFixedHalftone125] = { 5, 5, 5 },
+		[PaletteTypeFixedHalftone216] = { 6, 6, 6 },
+		[PaletteTypeFixedHalftone252] = { 6, 7, 6 },
+		[PaletteTypeFixedHalftone256] = { 8, 8, 4 },
+	};
+	const BYTE *levels;
+	UINT count;
+	int first = transparent ? 1 : 0;
+	int r, g, b;
+
+	switch (type) {
+	case PaletteTypeCustom:
+		return Ok;
+
+	case PaletteTypeOptimal:
+		if (!pixels || colors <= 0)
+			return InvalidParameter;
+
+		colors = MIN (colors, 256);
+		if (palette->Count < (UINT) colors)
+			return InsufficientBuffer;
+
+		return gdip_quantize_palette (pixels, width, height, stride, colors, transparent, palette);
+
+	case PaletteTypeFixedBW:
+		if (palette->Count < (UINT) first + 2)
+			return InsufficientBuffer;
+
+		palette->Flags = PaletteFlagsGrayScale;
+		palette->Entries [first] = 0xFF000000;
+		palette->Entries [first + 1] = 0xFFFFFFFF;
+		count = first + 2;
+		break;
+
+	case PaletteTypeFixedHalftone8:
+	case PaletteTypeFixedHalftone27:
+	case PaletteTypeFixedHalftone64:
+	case PaletteTypeFixedHalftone125:
+	case PaletteTypeFixedHalftone216:
+	case PaletteTypeFixedHalftone252:
+	case PaletteTypeFixedHalftone256:
+		levels = halftone_levels [type];
+		count = first + levels [0] * levels [1] * levels [2];
+		if (count > 256)
+			return InvalidParameter;
+		if (palette->Count < count)
+			return InsufficientBuffer;
+
+		palette->Flags = PaletteFlagsHalftone;
+		count = first;
+		for (r = 0; r < levels [0]; r++) {
+			for (g = 0; g < levels [1]; g++) {
+				for (b = 0; b < levels [2]; b++) {
+					palette->Entries [count++] = 0xFF000000 | ((r * 255 / (levels [0] - 1)) << 16) |
+						((g * 255 / (levels [1] - 1)) << 8) | (b * 255 / (levels [2] - 1));
+				}
+			}
+		}
+		break;
+
+	default:
+		return InvalidParameter;
+	}
+
+	if (transparent) {
+		palette->Entries [0] = 0x00000000;
+		palette->Flags |= PaletteFlagsHasAlpha;
+	}
+	palette->Count = count;
+	return Ok;
+}
+
+/* Reads all of the active bitmap as ARGB pixels, rows of width * 4 bytes */
+static GpStatus
+gdip_bitmap_get_argb_pixels (GpBitmap *bitmap, BYTE **pixels)
+{
+	ActiveBitmapData *data = bitmap->active_bitmap;
+	unsigned long long int size;
+	GpStatus status;
+
+	size = (unsigned long long int) data->width * data->height * sizeof (ARGB);
+	if (size > G_MAXINT32)
+		return OutOfMemory;
+
+	*pixels = GdipAlloc (size);
+	if (!*pixels)
+		return OutOfMemory;
+
+	gdip_bitmap_flush_surface (bitmap);
+	status = GdipBitmapGetPixels_linux (bitmap, NULL, data->width * sizeof (ARGB), (ARGB *) *pixels);
+	if (status != Ok) {
+		GdipFree (*pixels);
+		*pixels = NULL;
+	}
+
+	return status;
+}
+
+/*
+ * Sets palette to the fixed palette of the given type, or (PaletteTypeOptimal) to the (up to) optimalColors colors
+ * that best represent the active frame of bitmap. palette->Count must be the number of entries palette has room for,
+ * it is set to the number of entries used. With useTransparentColor, the first entry is a transparent color.
+ */
+GpStatus WINGDIPAPI
+GdipInitializePalette (ColorPalette *palette, PaletteType paletteType, INT optimalColors, BOOL useTransparentColor, GpBitmap *bitmap)
+{
+	GpStatus status;
+	BYTE *pixels;
+
+	if (!palette)
+		return InvalidParameter;
+
+	if (paletteType != PaletteTypeOptimal)
+		return gdip_initialize_palette (palette, paletteType, optimalColors, useTransparentColor, NULL, 0, 0, 0);
+
+	if (!bitmap || !bitmap->active_bitmap)
+		return InvalidParameter;
+
+	status = gdip_bitmap_get_argb_pixels (bitmap, &pixels);
+	if (status != Ok)
+		return status;
+
+	status = gdip_initialize_palette (palette, paletteType, optimalColors, useTransparentColor, pixels,
+		bitmap->active_bitmap->width, bitmap->active_bitmap->height, bitmap->active_bitmap->width * sizeof (ARGB));
+	GdipFree (pixels);
+	return status;
+}
+
+/*
+ * Converts the pixels of the active frame of bitmap to format. Indexed formats use palette, or if it is NULL the palette
+ * of the given type (computed from the pixels for PaletteTypeOptimal, with a transparent entry if alphaThresholdPercent
+ * isn't 0), and may be dithered. Pixels with less than alphaThresholdPercent alpha get the transparent entry, if any.
+ */
+GpStatus WINGDIPAPI
+GdipBitmapConvertFormat (GpBitmap *bitmap, PixelFormat format, DitherType ditherType, PaletteType paletteType, ColorPalette *palette,
+	REAL alphaThresholdPercent)
+{
+	ActiveBitmapData *data;
+	PixelRowConversion conversion;
+	ColorPalette *new_palette;
+	unsigned long long int size;
+	GpStatus status;
+	BYTE *pixels;
+	BYTE *scan0;
+	int stride;
+	int depth;
+	int y;
+
+	if (!bitmap || !bitmap->active_bitmap)
+		return InvalidParameter;
+	if (ditherType < DitherTypeNone || ditherType >= DitherTypeMax || alphaThresholdPercent < 0 || alphaThresholdPercent > 100)
+		return InvalidParameter;
+	if (!gdip_is_a_supported_pixelformat (format))
+		return InvalidParameter;
+
+	data = bitmap->active_bitmap;
+	if (data->reserved & GBD_LOCKED)
+		return WrongState;
+
+	if (format == data->pixel_format && !gdip_is_an_indexed_pixelformat (format))
+		return Ok;
+
+	if (gdip_is_an_indexed_pixelformat (format)) {
+		depth = gdip_get_pixel_format_depth (format);
+		stride = (depth * data->width + 7) / 8;
+	} else {
+		depth = 0;
+		stride = gdip_get_pixel_format_components (format) * gdip_get_pixel_format_depth (format) * data->width / 8;
+	}
+	gdip_align_stride (stride);
+
+	size = (unsigned long long int) stride * data->height;
+	if (size > G_MAXINT32)
+		return OutOfMemory;
+
+	status = gdip_bitmap_get_argb_pixels (bitmap, &pixels);
+	if (status != Ok)
+		return status;
+
+	new_palette = NULL;
+	scan0 = gdip_calloc (1, size);
+	if (!scan0) {
+		status = OutOfMemory;
+		goto error;
+	}
+
+	if (depth) {
+		if (palette) {
+			if (palette->Count == 0 || palette->Count > (1U << depth)) {
+				status = InvalidParameter;
+				goto error;
+			}
+
+			new_palette = gdip_palette_clone (palette);
+			if (!new_palette) {
+				status = OutOfMemory;
+				goto error;
+			}
+		} else {
+			if (paletteType == PaletteTypeCustom) {
+				status = InvalidParameter;
+				goto error;
+			}
+
+			new_palette = GdipAlloc (sizeof (ColorPalette) + 255 * sizeof (ARGB));
+			if (!new_palette) {
+				status = OutOfMemory;
+				goto error;
+			}
+
+			new_palette->Count = 1 << depth;
+			status = gdip_initialize_palette (new_palette, paletteType, 1 << depth, alphaThresholdPercent > 0,
+				pixels, data->width, data->height, data->width * sizeof (ARGB));
+			if (status != Ok)
+				goto error;
+		}
+
+		status = gdip_quantize_pixels (pixels, data->width, data->height, data->width * sizeof (ARGB), new_palette, ditherType,
+			(int) (alphaThresholdPercent * 255 / 100 + 0.5f), scan0, stride, depth);
+		if (status != Ok)
+			goto error;
+	} else {
+		status = gdip_init_pixel_row_conversion (&conversion, PixelRowFormat32bppARGB, gdip_get_pixel_row_format (format, FALSE), NULL);
+		if (status != Ok)
+			goto error;
+
+		for (y = 0; y < data->height; y++)
+			gdip_convert_pixel_row (&conversion, pixels + (size_t) y * data->width * sizeof (ARGB), 0, scan0 + (size_t) y * stride, 0, data->width);
+	}
+
+	GdipFree (pixels);
+
+	gdip_bitmap_invalidate_surface (bitmap);
+	gdip_bitmapdata_release_scan0 (data);
+	data->scan0 = scan0;
+	data->stride = stride;
+	data->pixel_format = format;
+	data->reserved = (data->reserved | GBD_OWN_SCAN0) & ~GBD_DECODED;
+
+	if (data->palette)
+		GdipFree (data->palette);
+	data->palette = new_palette;
+
+	if ((format & PixelFormatAlpha) || (new_palette && (new_palette->Flags & PaletteFlagsHasAlpha)))
+		data->image_flags |= ImageFlagsHasAlpha;
+	else
+		data->image_flags &= ~ImageFlagsHasAlpha;
+
+	switch (format) {
+	case PixelFormat1bppIndexed:
+		bitmap->cairo_format = CAIRO_FORMAT_A1;
+		break;
+	case PixelFormat4bppIndexed:
+	case PixelFormat8bppIndexed:
+		bitmap->cairo_format = CAIRO_FORMAT_A8;
+		break;
+	case PixelFormat24bppRGB:
+		bitmap->cairo_format = CAIRO_FORMAT_RGB24;
+		break;
+	default:
+		bitmap->cairo_format = CAIRO_FORMAT_ARGB32;
+		break;
+	}
+
+	gdip_bitmap_modified (bitmap);
+	return Ok;
+
+error:
+	GdipFree (new_palette);
+	GdipFree (scan0);
+	GdipFree (pixels);
+	return status;
+}
@@ -53,11 +53,22 @@ GpStatus WINGDIPAPI GdipBitmapUnlockBits (GpBitmap *bitmap, BitmapData *lockedBi
 GpStatus WINGDIPAPI GdipBitmapSetPixel (GpBitmap *bitmap, INT x, INT y, ARGB color);
 GpStatus WINGDIPAPI GdipBitmapGetPixel (GpBitmap *bitmap, INT x, INT y, ARGB *color);
 
+/* libgdiplus extensions: bulk versions of GdipBitmapGetPixel and GdipBitmapSetPixel */
+GpStatus WINGDIPAPI GdipBitmapGetPixels_linux (GpBitmap *bitmap, GDIPCONST Rect *rect, INT stride, ARGB *pixels);
+GpStatus WINGDIPAPI GdipBitmapSetPixels_linux (GpBitmap *bitmap, GDIPCONST Rect *rect, INT stride, GDIPCONST ARGB *pixels);
+
+/* libgdiplus extension: whether GdipBitmapLockBits handed out the pixels of the bitmap without copying them */
+GpStatus WINGDIPAPI GdipBitmapIsLockedInPlace_linux (GDIPCONST BitmapData *lockedBitmapData, BOOL *inPlace);
+
 GpStatus WINGDIPAPI GdipCloneBitmapArea (REAL x, REAL y, REAL width, REAL height, PixelFormat format, GpBitmap *srcBitmap, GpBitmap **dstBitmap);
 GpStatus WINGDIPAPI GdipCloneBitmapAreaI (INT x, INT y, INT width, INT height, PixelFormat format, GpBitmap *srcBitmap, GpBitmap **dstBitmap);
 
 GpStatus WINGDIPAPI GdipBitmapSetResolution (GpBitmap *bitmap, REAL xdpi, REAL ydpi);
 
+GpStatus WINGDIPAPI GdipInitializePalette (ColorPalette *palette, PaletteType paletteType, INT optimalColors, BOOL useTransparentColor, GpBitmap *bitmap);
+GpStatus WINGDIPAPI GdipBitmapConvertFormat (GpBitmap *bitmap, PixelFormat format, DitherType ditherType, PaletteType paletteType, ColorPalette *palette,
+	REAL alphaThresholdPercent);
+
 
 /* missing API
 	GdipCreateBitmapFromDirectDrawSurface
@@ -1047,65 +1047,59 @@ gdip_readbmp_palette (void *pointer, ImageSource source, const BITMAPV5HEADER *b
 static GpStatus
 gdip_read_bmp_scans (void *pointer, BYTE *pixels, BOOL upsidedown, PixelFormat format, INT srcStride, INT destStride, INT width, INT height, ImageSource source)
 {
-	BYTE *scan = (BYTE *) GdipAlloc (srcStride);
-	if (!scan)
-		return OutOfMemory;
+	PixelRowConversion conversion;
+	BOOL indexed = gdip_is_an_indexed_pixelformat (format);
+
+	/* Anything but the indexed formats is expanded to 32bpp ARGB */
+	if (!indexed) {
+		switch (format) {
+			case PixelFormat16bppRGB555:
+			case PixelFormat16bppRGB565:
+			case PixelFormat24bppRGB:
+			case PixelFormat32bppRGB:
+				break;
+			default:
+				return NotImplemented;
+		}
+
+		GpStatus status = gdip_init_pixel_row_conversion (&conversion, gdip_get_pixel_row_format (format, TRUE), PixelRowFormat32bppARGB, NULL);
+		if (status != Ok)
+			return status;
+	}
+
+	/* In memory (e.g. a mapped file) the rows are converted from where they are, instead of being copied first */
+	MemorySource *ms = (source == Memory) ? (MemorySource *) pointer : NULL;
+	BYTE *scan = NULL;
+	if (!ms) {
+		scan = (BYTE *) GdipAlloc (srcStride);
+		if (!scan)
+			return OutOfMemory;
+	}
 
 	for (int y = 0; y < height; y++) {
 		int currentLine = upsidedown ? height - y - 1 : y;
-		int size_read = gdip_read_bmp_data (pointer, scan, srcStride, source);
-		if (size_read < srcStride) {
-			GdipFree (scan);
-			return OutOfMemory;
-		}
+		BYTE *srcScan;
+		if (ms) {
+			if (ms->size - ms->pos < srcStride)
+				return OutOfMemory;
 
-		BYTE *destScan = pixels + currentLine * destStride;
-		switch (format) {
-			case PixelFormat1bppIndexed:
-			case PixelFormat4bppIndexed:
-			case PixelFormat8bppIndexed:
-				memcpy (destScan, scan, srcStride);
-				continue;
-			case PixelFormat16bppRGB555: {
-				for (int x = 0; x < width; x++) {
-					ARGB argb = gdip_getpixel_16bppRGB555 (scan, x);
-
-					BYTE a = (argb & 0xFF000000) >> 24;
-					BYTE r = (argb & 0x00FF0000) >> 16;
-					BYTE g = (argb & 0x0000FF00) >> 8;
-					BYTE b = (argb & 0x000000FF);
-					gdip_setpixel_32bppARGB (destScan, x, a, r, g, b);
-				}
-				continue;
-			}
-			case PixelFormat16bppRGB565: {
-				for (int x = 0; x < width; x++) {
-					ARGB argb = gdip_getpixel_16bppRGB565 (scan, x);
-
-					BYTE a = (argb & 0xFF000000) >> 24;
-					BYTE r = (argb & 0x00FF0000) >> 16;
-					BYTE g = (argb & 0x0000FF00) >> 8;
-					BYTE b = (argb & 0x000000FF);
-					gdip_setpixel_32bppARGB (destScan, x, a, r, g, b);
-				}
-				continue;
-			}
-			case PixelFormat24bppRGB: {
-				for (int x = 0; x < width; x++) {
-					gdip_setpixel_32bppARGB (destScan, x, 0xFF, scan[x * 3 + 2], scan[x * 3 + 1], scan[x * 3]);
-				}
-				continue;
-			}
-			case PixelFormat32bppRGB: {
-				for (int x = 0; x < width; x++) {
-					gdip_setpixel_32bppARGB (destScan, x, 0xFF, scan[x * 4 + 2], scan[x * 4 + 1], scan[x * 4]);
-				}
-				continue;
+			srcScan = ms->ptr + ms->pos;
+			ms->pos += srcStride;
+		} else {
+			int size_read = gdip_read_bmp_data (pointer, scan, srcStride, source);
+			if (size_read < srcStride) {
+				GdipFree (scan);
+				return OutOfMemory;
 			}
-			default:
-				GdipFree(scan);
-				return NotImplemented;
+
+			srcScan = scan;
 		}
+
+		BYTE *destScan = pixels + currentLine * destStride;
+		if (indexed)
+			memcpy (destScan, srcScan, srcStride);
+		else
+			gdip_convert_pixel_row (&conversion, srcScan, 0, destScan, 0, width);
 	}
 
 	GdipFree(scan);
@@ -1232,8 +1226,8 @@ BitmapFileHeaderFromLE (BITMAPFILEHEADER *bitmapFileHeader)
 #endif
 }
 
-static GpStatus 
-gdip_read_bmp_image_from_file_stream (void *pointer, GpImage **image, ImageSource source)
+static GpStatus
+gdip_read_bmp_file_header (void *pointer, ImageSource source)
 {
 	BITMAPFILEHEADER bmfh;
 	int size_read;
@@ -1248,9 +1242,52 @@ gdip_read_bmp_image_from_file_stream (void *pointer, GpImage **image, ImageSourc
 		return UnknownImageFormat;
 	}
 
+	return Ok;
+}
+
+static GpStatus 
+gdip_read_bmp_image_from_file_stream (void *pointer, GpImage **image, ImageSource source)
+{
+	GpStatus status;
+
+	status = gdip_read_bmp_file_header (pointer, source);
+	if (status != Ok) {
+		return status;
+	}
+
 	return gdip_read_bmp_image (pointer, image, source);
 }
 
+/* Reads what gdip_read_bmp_image_from_file_stream would give the image, but none of its palette or pixels */
+static GpStatus
+gdip_read_bmp_image_info_from_file_stream (void *pointer, GpImageInfo *info, ImageSource source)
+{
+	BITMAPV5HEADER bmi;
+	PixelFormat	originalFormat;
+	BOOL		upsidedown = TRUE;
+	GpStatus	status;
+
+	status = gdip_read_bmp_file_header (pointer, source);
+	if (status != Ok)
+		return status;
+
+	status = gdip_read_BITMAPINFOHEADER (pointer, source, &bmi, &upsidedown);
+	if (status != Ok)
+		return status;
+
+	status = gdip_get_bmp_pixelformat (&bmi, &originalFormat, &info->PixelFormat);
+	if (status != Ok)
+		return status;
+
+	info->Width = bmi.bV5Width;
+	info->Height = bmi.bV5Height;
+	info->FrameCount = 1;
+	/* like the loaded image, which doesn't use bV5XPelsPerMeter and bV5YPelsPerMeter either */
+	info->DpiX = 0;
+	info->DpiY = 0;
+	return Ok;
+}
+
 GpStatus 
 gdip_load_bmp_image_from_file (FILE *fp, GpImage **image)
 {
@@ -1263,6 +1300,24 @@ gdip_load_bmp_image_from_stream_delegate (dstream_t *loader, GpImage **image)
 	return gdip_read_bmp_image_from_file_stream ((void*)loader, image, DStream);
 }
 
+GpStatus
+gdip_load_bmp_image_from_memory (MemorySource *ms, GpImage **image)
+{
+	return gdip_read_bmp_image_from_file_stream ((void*)ms, image, Memory);
+}
+
+GpStatus
+gdip_read_bmp_image_info_from_file (FILE *fp, GpImageInfo *info)
+{
+	return gdip_read_bmp_image_info_from_file_stream ((void*)fp, info, File);
+}
+
+GpStatus
+gdip_read_bmp_image_info_from_stream_delegate (dstream_t *loader, GpImageInfo *info)
+{
+	return gdip_read_bmp_image_info_from_file_stream ((void*)loader, info, DStream);
+}
+
 int 
 gdip_read_bmp_data (void *pointer, BYTE *data, int size, ImageSource source)
 {
@@ -61,6 +61,9 @@ typedef struct {
 GpStatus gdip_read_bmp_image (void *pointer, GpImage **image, ImageSource source) GDIP_INTERNAL;
 GpStatus gdip_load_bmp_image_from_file (FILE *fp, GpImage **image) GDIP_INTERNAL;
 GpStatus gdip_load_bmp_image_from_stream_delegate (dstream_t *loader, GpImage **image) GDIP_INTERNAL;
+GpStatus gdip_load_bmp_image_from_memory (MemorySource *ms, GpImage **image) GDIP_INTERNAL;
+GpStatus gdip_read_bmp_image_info_from_file (FILE *fp, GpImageInfo *info) GDIP_INTERNAL;
+GpStatus gdip_read_bmp_image_info_from_stream_delegate (dstream_t *loader, GpImageInfo *info) GDIP_INTERNAL;
 
 GpStatus gdip_save_bmp_image_to_file (FILE *fp, GpImage *image) GDIP_INTERNAL;
 GpStatus gdip_save_bmp_image_to_stream_delegate (PutBytesDelegate putBytesFunc, GpImage *image) GDIP_INTERNAL;
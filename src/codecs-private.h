@@ -68,5 +68,13 @@ extern GUID GdipEncoderTransformation;
 extern GUID GdipEncoderQuality;
 extern GUID GdipEncoderLuminanceTable;
 extern GUID GdipEncoderChrominanceTable;
+extern GUID GdipEncoderPngCompressionLevel;
+extern GUID GdipEncoderPngCompressionStrategy;
+extern GUID GdipEncoderPngFilter;
+extern GUID GdipEncoderPngPreset;
+extern GUID GdipEncoderPngThreads;
+extern GUID GdipEncoderGifQuantizer;
+extern GUID GdipEncoderGifDither;
+extern GUID GdipEncoderGifDeltaFrames;
 
 #endif
@@ -252,6 +252,7 @@ gdip_custom_linecap_draw (GpGraphics *graphics, GpPen *pen, GpCustomLineCap *cus
 		}
 
 		gdip_pen_setup (graphics, pen);
+		gdip_graphics_path_modified (graphics, TRUE);
 		cairo_stroke (graphics->ct);
 		gdip_cairo_set_matrix (graphics, graphics->copy_of_ctm);
 	}
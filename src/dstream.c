@@ -21,6 +21,16 @@
 #include "gdiplus-private.h"
 #include "dstream.h"
 
+/*
+ * Every refill of the buffer is a call into the (managed) GetBytesDelegate, so the buffer adapts to the stream: it
+ * starts with the whole stream when its size is known and small, grows while the buffered data is read sequentially,
+ * and shrinks again when it is skipped over. Reads larger than a refill go straight to the caller's buffer, and skips
+ * past the buffer use the SeekDelegate, unless the stream turns out not to be seekable.
+ */
+#define DSTREAM_INITIAL_CHUNK	65536
+#define DSTREAM_MIN_CHUNK	8192
+#define DSTREAM_MAX_CHUNK	(1024 * 1024)
+
 struct _dstream_pvt {
 	GetBytesDelegate read;
 	SeekDelegate seek;
@@ -30,17 +40,18 @@ struct _dstream_pvt {
 	int position;
 	int used;
 
-	/* EXIF APP1 buffer */
-	BYTE *exif_buffer;
-	unsigned int exif_datasize;
-	BOOL keep_exif_buffer;
+	int chunk;		/* how much the next refill asks for */
+	long remaining;		/* how much the stream has left, if known, else -1 */
+	BOOL sequential;	/* whether the data of the last refill was all read */
+	BOOL seekable;
 };
 
 /* dstream_t */
 dstream_t *
-dstream_input_new (GetBytesDelegate read, SeekDelegate seek)
+dstream_input_new (GetBytesDelegate read, SeekDelegate seek, SizeDelegate size)
 {
 	dstream_t *st;
+	long length;
 
 	st = GdipAlloc (sizeof (dstream_t));
 	if (st == NULL)
@@ -55,6 +66,18 @@ dstream_input_new (GetBytesDelegate read, SeekDelegate seek)
 	memset (st->pvt, 0, sizeof (dstream_private));
 	st->pvt->read = read;
 	st->pvt->seek = seek;
+	st->pvt->seekable = seek != NULL;
+	st->pvt->chunk = DSTREAM_INITIAL_CHUNK;
+	st->pvt->remaining = -1;
+
+	/* the size is only a hint, it is the length of the whole stream which needn't start where we do */
+	length = size ? size () : -1;
+	if (length > 0) {
+		st->pvt->remaining = length;
+		if (length <= DSTREAM_MAX_CHUNK)
+			st->pvt->chunk = MAX (length, DSTREAM_MIN_CHUNK);
+	}
+
 	return st;
 }
 
@@ -66,9 +89,7 @@ dstream_free (dstream_t *st)
 
 		if (loader->buffer)
 			GdipFree (loader->buffer);
-		if (loader->exif_buffer)
-			GdipFree (loader->exif_buffer);
-		memset (loader, 0, sizeof (dstream_t));
+		memset (loader, 0, sizeof (dstream_private));
 		GdipFree (loader);
 		GdipFree (st);
 	}
@@ -87,44 +108,58 @@ read_from_buffer (dstream_private *loader, void *buffer, int size)
 	return nbytes;
 }
 
+/* Reads as much as the delegate gives us, up to size bytes */
+static int
+read_from_delegate (dstream_private *loader, BYTE *buffer, int size)
+{
+	int offset = 0;
+	int nbytes;
+
+	do {
+		nbytes = loader->read (buffer + offset, size - offset, 0);
+		if (nbytes > 0)
+			offset += nbytes;
+	} while (nbytes > 0 && offset < size);
+
+	if (loader->remaining >= 0)
+		loader->remaining = MAX (loader->remaining - offset, 0);
+
+	return offset;
+}
+
 static void
 fill_buffer (dstream_private *loader)
 {
-	int offset;
 	int nbytes = loader->used - loader->position;
+	int chunk;
 
 	if (nbytes > 0)
 		return;
 
-	if (loader->allocated == 0) {
-		loader->allocated = 65536;
-		loader->buffer = GdipAlloc (loader->allocated);
+	/* a reader that goes through all of the data gets more of it at once */
+	if (loader->sequential)
+		loader->chunk = MIN (loader->chunk * 2, DSTREAM_MAX_CHUNK);
+
+	chunk = loader->chunk;
+	if (loader->remaining >= 0)
+		chunk = MIN (chunk, MAX (loader->remaining, DSTREAM_MIN_CHUNK));
+
+	if (loader->allocated < chunk) {
+		/* nothing in the buffer is needed anymore */
+		GdipFree (loader->buffer);
+		loader->buffer = GdipAlloc (chunk);
 		if (loader->buffer == NULL) {
-			/* what? */
+			loader->allocated = 0;
 			return;
 		}
+		loader->allocated = chunk;
 	}
 
-	offset = 0;
-	do {
-		nbytes = loader->read (loader->buffer + offset, loader->allocated - offset, 0);
-		if (nbytes > 0)
-			offset += nbytes;
-	} while (nbytes > 0 && ((loader->allocated - offset) > 0));
-
-	if (offset != 0) {
+	nbytes = read_from_delegate (loader, loader->buffer, chunk);
+	if (nbytes != 0) {
 		loader->position = 0;
-		loader->used = offset;
-	}
-
-	/* First chunk read */
-	if (nbytes > 0 && loader->keep_exif_buffer && loader->exif_buffer == NULL) {
-		loader->exif_buffer = GdipAlloc (offset);
-		if (!loader->exif_buffer)
-			return;
-
-		loader->exif_datasize = offset;
-		memcpy (loader->exif_buffer, loader->buffer, offset);
+		loader->used = nbytes;
+		loader->sequential = TRUE;
 	}
 }
 
@@ -136,12 +171,24 @@ dstream_read (dstream_t *st, BYTE *buffer, int size, char peek)
 	dstream_private *loader = st->pvt;
 
 	offset = 0;
-	do {
-		fill_buffer (loader);
+	while (size > 0) {
+		if (loader->used == loader->position) {
+			/* large reads don't need to go through the buffer */
+			if (size >= loader->chunk) {
+				offset += read_from_delegate (loader, buffer + offset, size);
+				break;
+			}
+
+			fill_buffer (loader);
+		}
+
 		nbytes = read_from_buffer (loader, buffer + offset, size);
+		if (nbytes == 0)
+			break;
+
 		offset += nbytes;
 		size -= nbytes;
-	} while (size > 0 && nbytes > 0);
+	}
 
 	return offset;
 }
@@ -150,50 +197,39 @@ void
 dstream_skip (dstream_t *st, int nbytes)
 {
 	dstream_private *loader = st->pvt;
+	int remain = loader->used - loader->position;
 
-	if (loader->seek != NULL) {
-		loader->seek (nbytes, SEEK_CUR);
-	} else {
-		int remain = loader->used - loader->position;
-		if (remain > 0) {
-			if (nbytes >= remain) {
-				nbytes -= remain;
-				loader->used = 0;
-				loader->position = 0;
-			} else {
-				loader->position += nbytes;
-				nbytes = 0;
-			}
-		}
-
-		/* 'read' ignores reads into a NULL buffer */
-		while (nbytes > 0) {
-			nbytes -= loader->read (NULL, nbytes, 0);
-		}
+	if (nbytes <= remain) {
+		loader->position += nbytes;
+		return;
 	}
 
-	/* Invalidate buffer */
+	/* the rest of the buffer was read for nothing, the next refills read less */
+	nbytes -= remain;
 	loader->used = 0;
 	loader->position = 0;
-}
+	loader->sequential = FALSE;
+	loader->chunk = MAX (loader->chunk / 2, DSTREAM_MIN_CHUNK);
 
-void
-dstream_keep_exif_buffer (dstream_t *st)
-{
-	dstream_private *loader = st->pvt;
-	loader->keep_exif_buffer = TRUE;
-}
+	if (loader->seekable) {
+		if (loader->seek (nbytes, SEEK_CUR) >= 0) {
+			if (loader->remaining >= 0)
+				loader->remaining = MAX (loader->remaining - nbytes, 0);
+			return;
+		}
 
-void
-dstream_get_exif_buffer (dstream_t *st, BYTE **ptr, unsigned int *length)
-{
-	dstream_private *loader = st->pvt;
+		/* not seekable after all, don't try again */
+		loader->seekable = FALSE;
+	}
+
+	/* 'read' ignores reads into a NULL buffer */
+	while (nbytes > 0) {
+		int skipped = loader->read (NULL, nbytes, 0);
+		if (skipped <= 0)
+			break;
 
-	if (loader->keep_exif_buffer) {
-		*ptr = loader->exif_buffer;
-		*length = loader->exif_datasize;
-	} else {
-		*ptr = NULL;
-		*length = 0;
+		nbytes -= skipped;
+		if (loader->remaining >= 0)
+			loader->remaining = MAX (loader->remaining - skipped, 0);
 	}
 }
@@ -125,6 +125,60 @@ typedef enum {
 	EncoderValueColorTypeRGB = 25
 } EncoderValue;
 
+/*
+ * libgdiplus extension, the PNG encoder also accepts these (LONG) parameters:
+ * - compression level {9F7B053E-77BB-40F6-915B-A671EF1F8F06}: zlib level, from 0 (none) to 9 (smallest)
+ * - compression strategy {AD698DD9-4BA5-476C-9D92-17AB8B703968}: one of the PngStrategy values
+ * - filter {044E4F64-B6EA-479E-A73F-E65D50D3FA1F}: PngFilter values, or-ed together to let the
+ *   encoder pick the best one of them for every row
+ * - preset {6D26E9D1-3F28-49F7-956C-CF65AE2AA532}: one of the PngEncoderPreset values, which the
+ *   other parameters override
+ * - threads {EC8EBA92-579A-4282-8DE1-8973EC6C5FF5}: 1 (the default) compresses the image data on the
+ *   calling thread, 0 uses one thread per processor and larger values up to that many threads. With
+ *   more than one thread the rows are compressed in independent chunks of about 256KiB, each primed
+ *   with the 32KiB before it. The file is a regular PNG; its compressed data is usually less than
+ *   0.1% larger (5 bytes per chunk for the flush, plus the matches that can't cross a chunk), which
+ *   writing one IDAT chunk per chunk instead of one per 8KiB tends to make up for
+ */
+typedef enum {
+	PngStrategyDefault	= 0,
+	PngStrategyFiltered	= 1,
+	PngStrategyHuffmanOnly	= 2,
+	PngStrategyRle		= 3,
+	PngStrategyFixed	= 4
+} PngStrategy;
+
+typedef enum {
+	PngFilterNone		= 0x08,
+	PngFilterSub		= 0x10,
+	PngFilterUp		= 0x20,
+	PngFilterAverage	= 0x40,
+	PngFilterPaeth		= 0x80
+} PngFilter;
+
+typedef enum {
+	PngEncoderPresetDefault	= 0,	/* libpng's default level and filters */
+	PngEncoderPresetFast	= 1,	/* zlib level 1, Sub and Up filters */
+	PngEncoderPresetSmallest	= 2	/* zlib level 9, all filters */
+} PngEncoderPreset;
+
+/*
+ * libgdiplus extension, the GIF encoder also accepts these (LONG) parameters, used for the frames
+ * that aren't indexed already:
+ * - quantizer {DBDDF270-E1AA-42F2-AD64-B614A18554B9}: one of the GifQuantizer values
+ * - dither {B15738A4-EB0D-49E6-B956-4B0C42FDD771}: DitherTypeNone (the default), DitherTypeOrdered4x4,
+ *   DitherTypeOrdered8x8, DitherTypeOrdered16x16 or DitherTypeErrorDiffusion. Dithering needs (and
+ *   so selects) GifQuantizerKMeans
+ * - delta frames {4FB3682B-756D-49B6-BC79-2A5A26586863}: 1 writes the frames of an animation after
+ *   the first one as the rectangle that changed, with the unchanged pixels in it transparent, and
+ *   uses the global color table for them when it has all their colors. 0 (the default) writes every
+ *   frame in full. Pixels with zero alpha are transparent either way
+ */
+typedef enum {
+	GifQuantizerMedianCut	= 0,	/* giflib's median cut, the default */
+	GifQuantizerKMeans	= 1	/* median cut refined by k-means, using all the processors */
+} GifQuantizer;
+
 typedef enum {
 	FontStyleRegular	= 0,
 	FontStyleBold		= 1,
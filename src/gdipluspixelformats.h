@@ -93,7 +93,7 @@ IsCanonicalPixelFormat(PixelFormat pixfmt)
    return (pixfmt & PixelFormatCanonical) != 0;
 }
 
-#if (GDIPVER >= 0x0110)
+/* GDI+ 1.1, always available with libgdiplus (see GdipInitializePalette and GdipBitmapConvertFormat) */
 typedef enum {
 	PaletteTypeCustom = 0,
 	PaletteTypeOptimal = 1,
@@ -119,8 +119,7 @@ typedef enum {
 	DitherTypeDualSpiral8x8 = 8,
 	DitherTypeErrorDiffusion = 9,
 	DitherTypeMax = 10
-}
-#endif //(GDIPVER >= 0x0110)
+} DitherType;
 
 typedef enum {
 	PaletteFlagsHasAlpha    = 0x0001,
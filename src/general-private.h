@@ -143,6 +143,15 @@ void* gdip_calloc (size_t nelem, size_t elsize) GDIP_INTERNAL;
 /* checksums */
 DWORD gdip_crc32 (const BYTE *buf, size_t size) GDIP_INTERNAL;
 
+/* threads */
+/* never start more threads than this, the codecs using them keep some state (e.g. a buffer) per worker */
+#define GDIP_MAX_WORKERS	16
+
+typedef GpStatus (*GdipParallelFunc) (int worker, int index, void *data);
+int gdip_get_worker_count (void) GDIP_INTERNAL;
+GpStatus gdip_parallel_for (int count, int workers, GdipParallelFunc func, void *data) GDIP_INTERNAL;
+void gdip_parallel_shutdown (void) GDIP_INTERNAL;
+
 #include "general.h"
 
 #endif
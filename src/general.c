@@ -29,6 +29,7 @@
 #include "general-private.h"
 #include "codecs-private.h"
 #include "graphics-private.h"
+#include "bitmap-private.h"
 #include "font-private.h"
 #include "stringformat-private.h"
 #include "carbon-private.h"
@@ -64,6 +65,9 @@ GdiplusStartup (ULONG_PTR *token, const GdiplusStartupInput *input, GdiplusStart
 	if (status != Ok)
 		return status;
 
+	gdip_init_premultiply_kernels ();
+	gdip_init_pixel_row_converters ();
+
 	FcInit ();
 
 	/* A fontconfig instance which didn't find a configfile is unbelievably
@@ -136,6 +140,8 @@ WINGDIPAPI GdiplusShutdown (ULONG_PTR token)
 	if (gdiplusInitialized) {
 		releaseCodecList ();
 		gdip_font_clear_pattern_cache ();
+		gdip_processed_bitmap_cache_clear ();
+		gdip_parallel_shutdown ();
 		gdip_delete_system_fonts ();
 		gdip_delete_generic_stringformats ();
 #if HAVE_FCFINI
@@ -816,3 +822,205 @@ gdip_crc32 (const BYTE *buf, size_t size)
 
 	return crc;
 }
+
+int
+gdip_get_worker_count (void)
+{
+#if GLIB_CHECK_VERSION(2,36,0)
+	return CLAMP (g_get_num_processors (), 1, GDIP_MAX_WORKERS);
+#else
+	return 1;
+#endif
+}
+
+typedef struct {
+	GdipParallelFunc	func;
+	void			*data;
+	int			count;
+	volatile gint		next;
+	volatile gint		status;
+#if GLIB_CHECK_VERSION(2,36,0)
+	volatile gint		refcount;	/* the caller and every task pushed to the pool */
+	GMutex			mutex;
+	GCond			cond;
+	int			active;		/* pooled workers that are running */
+	BOOL			closed;		/* pooled workers that didn't start yet won't */
+#endif
+} ParallelJob;
+
+typedef struct {
+	ParallelJob		*job;
+	int			worker;
+} ParallelWorker;
+
+static void
+gdip_parallel_worker (ParallelWorker *worker)
+{
+	ParallelJob *job = worker->job;
+	GpStatus status;
+	int index;
+
+	while (g_atomic_int_get (&job->status) == Ok) {
+		index = g_atomic_int_add (&job->next, 1);
+		if (index >= job->count)
+			break;
+
+		status = job->func (worker->worker, index, job->data);
+		if (status != Ok)
+			g_atomic_int_compare_and_exchange (&job->status, Ok, status);
+	}
+}
+
+#if GLIB_CHECK_VERSION(2,36,0)
+/*
+ * The workers other than the calling thread run on a pool of threads, created the first time it is needed and freed by
+ * GdiplusShutdown, so a parallel loop doesn't start and join threads every time.
+ */
+static GMutex parallel_pool_mutex;
+static GThreadPool *parallel_pool = NULL;
+
+static void
+gdip_parallel_job_unref (ParallelJob *job)
+{
+	if (!g_atomic_int_dec_and_test (&job->refcount))
+		return;
+
+	g_mutex_clear (&job->mutex);
+	g_cond_clear (&job->cond);
+	GdipFree (job);
+}
+
+static void
+gdip_parallel_pool_func (gpointer data, gpointer user_data)
+{
+	ParallelWorker *worker = (ParallelWorker *) data;
+	ParallelJob *job = worker->job;
+	BOOL run;
+
+	/* a task that only starts once the caller did all the work has nothing left to do */
+	g_mutex_lock (&job->mutex);
+	run = !job->closed;
+	if (run)
+		job->active++;
+	g_mutex_unlock (&job->mutex);
+
+	if (run) {
+		gdip_parallel_worker (worker);
+
+		g_mutex_lock (&job->mutex);
+		if (--job->active == 0)
+			g_cond_signal (&job->cond);
+		g_mutex_unlock (&job->mutex);
+	}
+
+	gdip_parallel_job_unref (job);
+}
+
+static GThreadPool *
+gdip_get_parallel_pool (void)
+{
+	GThreadPool *pool;
+
+	g_mutex_lock (&parallel_pool_mutex);
+	if (!parallel_pool) {
+		/* exclusive, so its threads stay around between loops */
+		parallel_pool = g_thread_pool_new (gdip_parallel_pool_func, NULL, MAX (gdip_get_worker_count () - 1, 1), TRUE,
+			NULL);
+	}
+	pool = parallel_pool;
+	g_mutex_unlock (&parallel_pool_mutex);
+
+	return pool;
+}
+#endif
+
+void
+gdip_parallel_shutdown (void)
+{
+#if GLIB_CHECK_VERSION(2,36,0)
+	g_mutex_lock (&parallel_pool_mutex);
+	if (parallel_pool) {
+		/* the queued tasks still run, to release their jobs */
+		g_thread_pool_free (parallel_pool, FALSE, TRUE);
+		parallel_pool = NULL;
+	}
+	g_mutex_unlock (&parallel_pool_mutex);
+#endif
+}
+
+/*
+ * Calls func for every index in [0, count), from (at most) the given number of workers, and returns once all calls
+ * are done. The worker given to func is in [0, workers) and a worker only runs one call at a time, so func can keep
+ * per-worker state. Worker 0 is the calling thread. Stops at the first failure, and returns its status.
+ */
+GpStatus
+gdip_parallel_for (int count, int workers, GdipParallelFunc func, void *data)
+{
+	ParallelJob job;
+	ParallelWorker main_worker;
+#if GLIB_CHECK_VERSION(2,36,0)
+	ParallelJob *shared;
+	ParallelWorker *pooled;
+	GThreadPool *pool;
+	GpStatus status;
+	int i;
+#endif
+
+	workers = MIN (workers, count);
+#if GLIB_CHECK_VERSION(2,36,0)
+	/* the job outlives this call when some of its tasks are still queued, so it's allocated along with its workers */
+	pool = workers > 1 ? gdip_get_parallel_pool () : NULL;
+	shared = pool ? GdipAlloc (sizeof (ParallelJob) + sizeof (ParallelWorker) * workers) : NULL;
+	if (shared) {
+		shared->func = func;
+		shared->data = data;
+		shared->count = count;
+		shared->next = 0;
+		shared->status = Ok;
+		shared->refcount = 1;
+		g_mutex_init (&shared->mutex);
+		g_cond_init (&shared->cond);
+		shared->active = 0;
+		shared->closed = FALSE;
+
+		/* if the pool can't take them the calling thread does all the work */
+		pooled = (ParallelWorker *) (shared + 1);
+		for (i = 0; i < workers; i++) {
+			pooled[i].job = shared;
+			pooled[i].worker = i;
+			if (i == 0)
+				continue;
+
+			g_atomic_int_inc (&shared->refcount);
+			if (!g_thread_pool_push (pool, &pooled[i], NULL)) {
+				g_atomic_int_add (&shared->refcount, -1);
+				break;
+			}
+		}
+
+		gdip_parallel_worker (&pooled[0]);
+
+		g_mutex_lock (&shared->mutex);
+		shared->closed = TRUE;
+		while (shared->active > 0)
+			g_cond_wait (&shared->cond, &shared->mutex);
+		g_mutex_unlock (&shared->mutex);
+
+		status = g_atomic_int_get (&shared->status);
+		gdip_parallel_job_unref (shared);
+		return status;
+	}
+#endif
+
+	job.func = func;
+	job.data = data;
+	job.count = count;
+	job.next = 0;
+	job.status = Ok;
+
+	main_worker.job = &job;
+	main_worker.worker = 0;
+
+	gdip_parallel_worker (&main_worker);
+	return job.status;
+}
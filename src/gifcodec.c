@@ -29,6 +29,7 @@
 #include "config.h"
 #include "codecs-private.h"
 #include "gifcodec.h"
+#include "quantize-private.h"
 
 GUID gdip_gif_image_format_guid = {0xb96b3cb0U, 0x0728U, 0x11d3U, {0x9d, 0x7b, 0x00, 0x00, 0xf8, 0x1e, 0xf3, 0x2e}};
 
@@ -416,6 +417,42 @@ typedef struct
 	
 } gif_callback_data;
 
+/* The whole file, which the frames are decoded from when they get selected */
+typedef struct
+{
+	BYTE	*data;
+	size_t	size;
+	size_t	position;
+} GifMemoryStream;
+
+typedef struct
+{
+	size_t	offset;		/* of its image descriptor in the file */
+	int	transparent;	/* index of the transparent color, or -1 */
+	BOOL	over_previous;	/* drawn over the previous frame instead of a blank one */
+} GifFrameInfo;
+
+typedef struct
+{
+	int	frame;		/* -1 if unused */
+	BYTE	*pixels;
+	guint64	last_used;
+} GifComposedFrame;
+
+/* Playing an animation composes every frame over the previous one, which is kept at hand for that */
+#define GIF_COMPOSED_FRAME_CACHE_SIZE	4
+
+typedef struct
+{
+	BitmapFrameDecoder	base;
+	GifMemoryStream	stream;
+	int		height;
+	int		stride;
+	GifFrameInfo	*frames;
+	GifComposedFrame	cache [GIF_COMPOSED_FRAME_CACHE_SIZE];	/* least recently used one goes first */
+	guint64		clock;
+} GifFrameDecoder;
+
 /* Codecinfo related data*/
 static ImageCodecInfo gif_codec;
 static const WCHAR gif_codecname[] = {'B', 'u', 'i','l', 't', '-','i', 'n', ' ', 'G', 'I', 'F', ' ', 'C', 
@@ -464,6 +501,61 @@ gdip_gif_inputfunc (GifFileType *gif, GifByteType *data, int len)
 	return read;
 }
 
+static int
+gdip_gif_memoryinputfunc (GifFileType *gif, GifByteType *data, int len)
+{
+	GifMemoryStream *stream = (GifMemoryStream*) gif->UserData;
+
+	if ((size_t) len > stream->size - stream->position)
+		len = stream->size - stream->position;
+
+	memcpy (data, stream->data + stream->position, len);
+	stream->position += len;
+	return len;
+}
+
+/* Reads the rest of the file or stream into memory */
+static GpStatus
+gdip_gif_read_all (void *stream, BOOL from_file, GifMemoryStream *memory)
+{
+	size_t	capacity = 65536;
+	BYTE	*data;
+	int	read;
+
+	memory->data = GdipAlloc (capacity);
+	memory->size = 0;
+	memory->position = 0;
+	if (!memory->data)
+		return OutOfMemory;
+
+	for (;;) {
+		if (memory->size == capacity) {
+			if (capacity > G_MAXINT32 / 2)
+				goto error;
+
+			capacity *= 2;
+			data = gdip_realloc (memory->data, capacity);
+			if (!data)
+				goto error;
+			memory->data = data;
+		}
+
+		if (from_file)
+			read = fread (memory->data + memory->size, 1, capacity - memory->size, (FILE*) stream);
+		else
+			read = ((gif_callback_data*) stream)->getBytesFunc (memory->data + memory->size, capacity - memory->size, 0);
+		if (read <= 0)
+			return Ok;
+
+		memory->size += read;
+	}
+
+error:
+	GdipFree (memory->data);
+	memory->data = NULL;
+	return OutOfMemory;
+}
+
 /*
    This is the DGifSlurp and AddExtensionBlock code courtesy of giflib, 
    It's modified to not dump comments after the image block, since those 
@@ -526,18 +618,30 @@ FreeExtensionMono(SavedImage *Image)
     #define SIZE_MAX     UINTPTR_MAX
 #endif
 
+/*
+   Like DGifSlurp, but the compressed pixels of the images are skipped rather than decoded. Where the image
+   descriptor of each one starts in stream is returned in Offsets instead, for gdip_gif_decoder_draw.
+*/
 static int
-DGifSlurpMono(GifFileType * GifFile, SavedImage *TrailingExtensions)
+DGifScanMono(GifFileType * GifFile, SavedImage *TrailingExtensions, GifMemoryStream *stream, size_t **Offsets)
 {
 	int		ImageSize;
 	int		Function;
+	int		CodeSize;
 	GifRecordType	RecordType;
 	SavedImage	*sp;
 	GifByteType	*ExtData;
+	GifByteType	*CodeBlock;
 	SavedImage	temp_save;
+	size_t		RecordOffset;
+	size_t		*offsets;
+	size_t		*grown;
+	int		capacity;
 
 	temp_save.ExtensionBlocks = NULL;
 	temp_save.ExtensionBlockCount = 0;
+	offsets = NULL;
+	capacity = 0;
 
 	if (TrailingExtensions != NULL) {
 		TrailingExtensions->ExtensionBlocks = NULL;
@@ -547,6 +651,7 @@ DGifSlurpMono(GifFileType * GifFile, SavedImage *TrailingExtensions)
 	sp = NULL;
 
 	do {
+		RecordOffset = stream->position;
 		if (DGifGetRecordType(GifFile, &RecordType) == GIF_ERROR) {
 			goto error;
 		}
@@ -558,7 +663,7 @@ DGifSlurpMono(GifFileType * GifFile, SavedImage *TrailingExtensions)
 				}
 
 				sp = &GifFile->SavedImages[GifFile->ImageCount - 1];
-				/* Allocate memory for the image */
+				/* Check the size of the image */
 				if (sp->ImageDesc.Width < 0 && sp->ImageDesc.Height < 0 && sp->ImageDesc.Width > (INT_MAX / sp->ImageDesc.Height)) {
 					goto error;
 				}
@@ -568,30 +673,26 @@ DGifSlurpMono(GifFileType * GifFile, SavedImage *TrailingExtensions)
 					goto error;
 				}
 
-				sp->RasterBits = (BYTE *) GdipAlloc (ImageSize * sizeof(GifPixelType));
-				if (sp->RasterBits == NULL) {
+				if (GifFile->ImageCount > capacity) {
+					capacity = capacity ? capacity * 2 : 16;
+					grown = (size_t *) gdip_realloc (offsets, capacity * sizeof (size_t));
+					if (grown == NULL) {
+						goto error;
+					}
+					offsets = grown;
+				}
+				offsets[GifFile->ImageCount - 1] = RecordOffset;
+
+				/* The pixels are only decoded once the frame gets selected */
+				if (DGifGetCode(GifFile, &CodeSize, &CodeBlock) == GIF_ERROR) {
 					goto error;
 				}
 
-				if (sp->ImageDesc.Interlace) {
-					int i, j;
-					/* 
-					* The way an interlaced image should be read - 
-					* offsets and jumps...
-					*/
-					int InterlacedOffset[] = { 0, 4, 2, 1 };
-					int InterlacedJumps[] = { 8, 8, 4, 2 };
-					/* Need to perform 4 passes on the image */
-					for (i = 0; i < 4; i++) {
-						for (j = InterlacedOffset[i]; j < sp->ImageDesc.Height; j += InterlacedJumps[i]) {
-							if (DGifGetLine(GifFile, sp->RasterBits + j * sp->ImageDesc.Width, sp->ImageDesc.Width) == GIF_ERROR)
-								goto error;
-						}
+				while (CodeBlock != NULL) {
+					if (DGifGetCodeNext(GifFile, &CodeBlock) == GIF_ERROR) {
+						goto error;
 					}
 				}
-				else if (DGifGetLine(GifFile, sp->RasterBits, ImageSize) == GIF_ERROR) {
-					goto error;
-				}
 
 				if (temp_save.ExtensionBlocks) {
 					sp->ExtensionBlocks = temp_save.ExtensionBlocks;
@@ -605,7 +706,7 @@ DGifSlurpMono(GifFileType * GifFile, SavedImage *TrailingExtensions)
 
 			case EXTENSION_RECORD_TYPE: {
 				if (DGifGetExtension(GifFile, &Function, &ExtData) == GIF_ERROR) {
-					return (GIF_ERROR);
+					goto error;
 				}
 
 				while (ExtData != NULL) {
@@ -648,20 +749,248 @@ DGifSlurpMono(GifFileType * GifFile, SavedImage *TrailingExtensions)
 		FreeExtensionMono (&temp_save);
 	}
 
+	*Offsets = offsets;
 	return (GIF_OK);
 
 error:
 	FreeExtensionMono (&temp_save);
+	GdipFree (offsets);
 	return GIF_ERROR;
 }
 
+/* Decodes frame index of the file over canvas, which holds what the frame is drawn over */
+static GpStatus
+gdip_gif_decoder_draw (GifFrameDecoder *decoder, int index, BYTE *canvas)
+{
+	static const int interlaced_offset[] = { 0, 4, 2, 1 };
+	static const int interlaced_jumps[] = { 8, 8, 4, 2 };
+	GifFrameInfo	*info = &decoder->frames [index];
+	GifFileType	*gif;
+	GifImageDesc	*img_desc;
+	BYTE		*line;
+	BYTE		*row;
+	GifRecordType	record_type;
+	GpStatus	status;
+	int		pass;
+	int		y;
+	int		x;
+
+	decoder->stream.position = 0;
+#if GIFLIB_MAJOR >= 5
+	gif = DGifOpen (&decoder->stream, &gdip_gif_memoryinputfunc, NULL);
+#else
+	gif = DGifOpen (&decoder->stream, &gdip_gif_memoryinputfunc);
+#endif
+	if (gif == NULL)
+		return OutOfMemory;
+
+	status = OutOfMemory;
+	line = NULL;
+
+	decoder->stream.position = info->offset;
+	if (DGifGetRecordType (gif, &record_type) == GIF_ERROR || record_type != IMAGE_DESC_RECORD_TYPE)
+		goto done;
+	if (DGifGetImageDesc (gif) == GIF_ERROR)
+		goto done;
+
+	/* the image was checked against the screen size on load */
+	img_desc = &gif->Image;
+	if (info->over_previous) {
+		line = GdipAlloc (img_desc->Width);
+		if (line == NULL)
+			goto done;
+	}
+
+	for (pass = img_desc->Interlace ? 0 : 3; pass < 4; pass++) {
+		for (y = img_desc->Interlace ? interlaced_offset [pass] : 0; y < img_desc->Height; y += img_desc->Interlace ? interlaced_jumps [pass] : 1) {
+			row = canvas + (img_desc->Top + y) * decoder->stride + img_desc->Left;
+			if (DGifGetLine (gif, line ? line : row, img_desc->Width) == GIF_ERROR)
+				goto done;
+
+			if (line) {
+				for (x = 0; x < img_desc->Width; x++) {
+					if (line [x] != info->transparent)
+						row [x] = line [x];
+				}
+			}
+		}
+	}
+
+	status = Ok;
+
+done:
+	GdipFree (line);
+#if (GIFLIB_MAJOR > 5) || ((GIFLIB_MAJOR == 5) && (GIFLIB_MINOR >= 1))
+	DGifCloseFile (gif, NULL);
+#else
+	DGifCloseFile (gif);
+#endif
+	return status;
+}
+
+static GifComposedFrame *
+gdip_gif_decoder_find (GifFrameDecoder *decoder, int index)
+{
+	int i;
+
+	for (i = 0; i < GIF_COMPOSED_FRAME_CACHE_SIZE; i++) {
+		if (decoder->cache [i].frame == index)
+			return &decoder->cache [i];
+	}
+
+	return NULL;
+}
+
+/* Keeps a copy of the composed frame index, in place of the least recently used one */
+static void
+gdip_gif_decoder_keep (GifFrameDecoder *decoder, int index, BYTE *canvas)
+{
+	GifComposedFrame	*entry;
+	int			i;
+
+	entry = &decoder->cache [0];
+	for (i = 1; i < GIF_COMPOSED_FRAME_CACHE_SIZE; i++) {
+		if (decoder->cache [i].last_used < entry->last_used)
+			entry = &decoder->cache [i];
+	}
+
+	if (entry->pixels == NULL) {
+		entry->pixels = GdipAlloc ((size_t) decoder->stride * decoder->height);
+		/* the cache only saves work, the frame is still there */
+		if (entry->pixels == NULL)
+			return;
+	}
+
+	memcpy (entry->pixels, canvas, (size_t) decoder->stride * decoder->height);
+	entry->frame = index;
+	entry->last_used = ++decoder->clock;
+}
+
+/* The composed pixels of frame index, if the cache or its (unmodified) bitmap still has them */
+static BYTE *
+gdip_gif_decoder_composed (GifFrameDecoder *decoder, int index, ActiveBitmapData *data)
+{
+	GifComposedFrame *composed;
+
+	composed = gdip_gif_decoder_find (decoder, index);
+	if (composed != NULL) {
+		composed->last_used = ++decoder->clock;
+		return composed->pixels;
+	}
+
+	if (data->scan0 != NULL && (data->reserved & (GBD_DECODED | GBD_LOCKED)) == GBD_DECODED)
+		return data->scan0;
+
+	return NULL;
+}
+
+static GpStatus
+gdip_gif_decoder_decode (BitmapFrameDecoder *base, int frame, int index, ActiveBitmapData *data)
+{
+	GifFrameDecoder		*decoder = (GifFrameDecoder *) base;
+	/* data is the index-th of the bitmaps of the frame */
+	ActiveBitmapData	*bitmaps = data - index;
+	GifComposedFrame	*composed;
+	size_t			size = (size_t) decoder->stride * decoder->height;
+	BYTE			*canvas;
+	BYTE			*previous;
+	GpStatus		status;
+	int			first;
+	int			i;
+
+	canvas = GdipAlloc (size);
+	if (canvas == NULL)
+		return OutOfMemory;
+
+	composed = gdip_gif_decoder_find (decoder, index);
+	if (composed != NULL) {
+		composed->last_used = ++decoder->clock;
+		memcpy (canvas, composed->pixels, size);
+		goto done;
+	}
+
+	/* Go back to the last frame that doesn't need the one before it, or whose one before we still have */
+	previous = NULL;
+	first = index;
+	while (first > 0 && decoder->frames [first].over_previous) {
+		previous = gdip_gif_decoder_composed (decoder, first - 1, &bitmaps [first - 1]);
+		if (previous != NULL)
+			break;
+		first--;
+	}
+
+	if (previous != NULL)
+		memcpy (canvas, previous, size);
+	else
+		memset (canvas, 0, size);
+
+	for (i = first; i <= index; i++) {
+		status = gdip_gif_decoder_draw (decoder, i, canvas);
+		if (status != Ok) {
+			GdipFree (canvas);
+			return status;
+		}
+		/* the frame asked for ends up in scan0, only the ones it was drawn over are worth keeping */
+		if (i < index)
+			gdip_gif_decoder_keep (decoder, i, canvas);
+	}
+
+done:
+	data->scan0 = canvas;
+	data->stride = decoder->stride;
+	return Ok;
+}
+
+static void
+gdip_gif_decoder_dispose (BitmapFrameDecoder *base)
+{
+	GifFrameDecoder *decoder = (GifFrameDecoder *) base;
+	int i;
+
+	for (i = 0; i < GIF_COMPOSED_FRAME_CACHE_SIZE; i++)
+		GdipFree (decoder->cache [i].pixels);
+
+	GdipFree (decoder->frames);
+	GdipFree (decoder->stream.data);
+	GdipFree (decoder);
+}
+
+/* Takes over the file in memory and the frames */
+static GifFrameDecoder *
+gdip_gif_decoder_new (GifMemoryStream *stream, GifFrameInfo *frames, int stride, int height)
+{
+	GifFrameDecoder *decoder;
+	int i;
+
+	decoder = GdipAlloc (sizeof (GifFrameDecoder));
+	if (decoder == NULL)
+		return NULL;
+
+	gdip_frame_decoder_init (&decoder->base);
+	decoder->base.decode = gdip_gif_decoder_decode;
+	decoder->base.decode_scaled = NULL;
+	decoder->base.load_properties = NULL;
+	decoder->base.properties_only = NULL;
+	decoder->base.dispose = gdip_gif_decoder_dispose;
+	decoder->stream = *stream;
+	decoder->frames = frames;
+	decoder->stride = stride;
+	decoder->height = height;
+	decoder->clock = 0;
+	for (i = 0; i < GIF_COMPOSED_FRAME_CACHE_SIZE; i++) {
+		decoder->cache [i].frame = -1;
+		decoder->cache [i].pixels = NULL;
+		decoder->cache [i].last_used = 0;
+	}
+
+	return decoder;
+}
+
 static GpStatus 
 gdip_load_gif_image (void *stream, GpImage **image, BOOL from_file)
 {
 	GpStatus status;
 	GifFileType	*gif;
-	BYTE		*readptr;
-	BYTE		*writeptr;
 	int		i;
 	int		l;
 	int		num_of_images;
@@ -681,8 +1010,15 @@ gdip_load_gif_image (void *stream, GpImage **image, BOOL from_file)
 	int		screen_width;
 	int		screen_height;
 	GifImageDesc	*img_desc;
+	GifMemoryStream	memory;
+	size_t		*offsets;
+	GifFrameInfo	*frames;
+	GifFrameDecoder	*decoder;
 
 	status = Ok;
+	gif = NULL;
+	offsets = NULL;
+	frames = NULL;
 	disposal = 0;
 	last_disposal = 0;
 	loop_value = 0;
@@ -690,27 +1026,24 @@ gdip_load_gif_image (void *stream, GpImage **image, BOOL from_file)
 	result = NULL;
 	loop_counter = FALSE;
 
-	if (from_file) {
-#if GIFLIB_MAJOR >= 5
-		gif = DGifOpen(stream, &gdip_gif_fileinputfunc, NULL);
-#else
-		gif = DGifOpen(stream, &gdip_gif_fileinputfunc);
-#endif
-	} else {
+	/* Frames are decoded when they get selected, so keep the file at hand */
+	status = gdip_gif_read_all (stream, from_file, &memory);
+	if (status != Ok)
+		goto error;
+
 #if GIFLIB_MAJOR >= 5
-		gif = DGifOpen (stream, &gdip_gif_inputfunc, NULL);
+	gif = DGifOpen (&memory, &gdip_gif_memoryinputfunc, NULL);
 #else
-		gif = DGifOpen (stream, &gdip_gif_inputfunc);
+	gif = DGifOpen (&memory, &gdip_gif_memoryinputfunc);
 #endif
-	}
 	
 	if (gif == NULL) {
 		status = OutOfMemory;
 		goto error;
 	}
 
-	/* Read the image */
-	if (DGifSlurpMono (gif, &global_extensions) != GIF_OK) {
+	/* Read the image, without its pixels */
+	if (DGifScanMono (gif, &global_extensions, &memory, &offsets) != GIF_OK) {
 		status = OutOfMemory;
 		goto error;
 	}
@@ -725,6 +1058,10 @@ gdip_load_gif_image (void *stream, GpImage **image, BOOL from_file)
 	screen_height = gif->SHeight;
 	animated = FALSE;
 	num_of_images = gif->ImageCount;
+	if (num_of_images == 0) {
+		status = OutOfMemory;
+		goto error;
+	}
 
 	for (i = 0; i < num_of_images; i++) {
 		for (l = 0; l < gif->SavedImages[i].ExtensionBlockCount; l++) {
@@ -810,6 +1147,12 @@ gdip_load_gif_image (void *stream, GpImage **image, BOOL from_file)
 
 	result->cairo_format = CAIRO_FORMAT_A8;
 
+	frames = GdipAlloc (sizeof (GifFrameInfo) * num_of_images);
+	if (!frames) {
+		status = OutOfMemory;
+		goto error;
+	}
+
 	/* create our bitmaps */
 	for (i = 0; i < num_of_images; i++) {
 
@@ -963,63 +1306,53 @@ gdip_load_gif_image (void *stream, GpImage **image, BOOL from_file)
 			goto error;
 		}
 
-		bitmap_data->scan0 = GdipAlloc (size);
-		if (!bitmap_data->scan0) {
-			status = OutOfMemory;
-			goto error;
-		}
-
-		bitmap_data->reserved = GBD_OWN_SCAN0;
 		bitmap_data->image_flags = ImageFlagsReadOnly | ImageFlagsHasRealPixelSize | ImageFlagsHasRealDPI | ImageFlagsColorSpaceRGB;
 		if (bitmap_data->transparent < 0)
 			bitmap_data->image_flags |= ImageFlagsHasAlpha;
 
 		bitmap_data->dpi_horz = gdip_get_display_dpi ();
 		bitmap_data->dpi_vert = bitmap_data->dpi_horz;
-	
-		readptr = (BYTE*) si.RasterBits;
-		writeptr = bitmap_data->scan0;
-
-		for (l = 0; l < bitmap_data->height; l++) {
-			if (l >= img_desc->Top && l - img_desc->Top < img_desc->Height) {
-				/* Ignore 'disposal' 0 (don't care) and 4, 5, 6, 7 (undocumented) */
-				if (i == 0 || transparent_index == -1 || (last_disposal != 1 && last_disposal != 3)) {
-					writeptr += img_desc->Left;
-					memcpy (writeptr, readptr, img_desc->Width);
-					writeptr -= img_desc->Left;
-					writeptr += bitmap_data->stride;
-					readptr += img_desc->Width;
-				} else {
-					int ridx, widx;
-					ActiveBitmapData *last_bitmap;
-
-					last_bitmap = &frame->bitmap [i - 1];
-					if (l == img_desc->Top) {
-						/* Copy the previous bitmap as the base for this one */
-						/* TODO: This will be wrong if each image has a different palette */
-						/* There's a comment up there too */
-						memcpy (bitmap_data->scan0, last_bitmap->scan0,
-							size);
-					}
 
-					for (ridx = 0, widx = bitmap_data->left; ridx < img_desc->Width; widx++, ridx++) {
-						BYTE bt = readptr [ridx];
-						if (bt == transparent_index)
-							continue;
-						writeptr [widx] = bt;
-					}
-					readptr += img_desc->Width;
-					writeptr += bitmap_data->stride;
-				}
-			} else {
-				writeptr += bitmap_data->stride;
-			}
-		}
+		/* Ignore 'disposal' 0 (don't care) and 4, 5, 6, 7 (undocumented) */
+		/* TODO: This will be wrong if each image has a different palette */
+		frames[i].offset = offsets[i];
+		frames[i].transparent = transparent_index;
+		frames[i].over_previous = i > 0 && transparent_index != -1 && (last_disposal == 1 || last_disposal == 3);
+
 		last_disposal = disposal;
 		disposal = 0;
 	}
 
-	gdip_bitmap_setactive(result, dimension, 0);
+	GdipFree (offsets);
+	offsets = NULL;
+
+	decoder = gdip_gif_decoder_new (&memory, frames, bitmap_data->stride, screen_height);
+	if (!decoder) {
+		status = OutOfMemory;
+		goto error;
+	}
+	/* from now on the decoder owns the file in memory and the frames */
+	memory.data = NULL;
+	frames = NULL;
+
+	gdip_bitmap_set_frame_decoder (result, &decoder->base);
+
+	if (num_of_images == 1) {
+		/* A single frame is decoded right away, so neither the file nor the decoder have to be kept around */
+		status = gdip_bitmap_decode_frame (result, 0, 0);
+		gdip_bitmap_set_frame_decoder (result, NULL);
+		if (status != Ok)
+			goto error;
+		/* and nothing could decode its pixels again */
+		bitmap_data->reserved &= ~GBD_DECODED;
+	} else {
+		/* Only keep the pixels of the active frame, and the few composed frames the decoder caches */
+		result->evict_frames = TRUE;
+	}
+
+	status = gdip_bitmap_setactive (result, dimension, 0);
+	if (status != Ok)
+		goto error;
 
 	if (global_palette != NULL) {
 		GdipFree(global_palette);
@@ -1039,6 +1372,10 @@ error:
 		GdipFree(global_palette);
 	}
 
+	GdipFree (frames);
+	GdipFree (offsets);
+	GdipFree (memory.data);
+
 	if (result != NULL) {
 		gdip_bitmap_dispose (result);
 	}
@@ -1073,6 +1410,114 @@ gdip_load_gif_image_from_stream_delegate (GetBytesDelegate getBytesFunc, SeekDel
 	return gdip_load_gif_image (&gif_data, image, FALSE);	
 }
 
+/*
+ * Walks the records of the image, skipping over the compressed pixels of each frame instead of decoding them,
+ * to count its frames and check them as gdip_load_gif_image does.
+ */
+static GpStatus
+gdip_read_gif_image_info (void *stream, GpImageInfo *info, BOOL from_file)
+{
+	GpStatus	status;
+	GifFileType	*gif;
+	GifRecordType	record_type;
+	GifImageDesc	*img_desc;
+	GifByteType	*block;
+	int		code_size;
+	int		function;
+
+	if (from_file) {
+#if GIFLIB_MAJOR >= 5
+		gif = DGifOpen(stream, &gdip_gif_fileinputfunc, NULL);
+#else
+		gif = DGifOpen(stream, &gdip_gif_fileinputfunc);
+#endif
+	} else {
+#if GIFLIB_MAJOR >= 5
+		gif = DGifOpen (stream, &gdip_gif_inputfunc, NULL);
+#else
+		gif = DGifOpen (stream, &gdip_gif_inputfunc);
+#endif
+	}
+
+	if (gif == NULL)
+		return OutOfMemory;
+
+	status = OutOfMemory;
+
+	do {
+		if (DGifGetRecordType (gif, &record_type) == GIF_ERROR)
+			goto error;
+
+		switch (record_type) {
+		case IMAGE_DESC_RECORD_TYPE:
+			if (DGifGetImageDesc (gif) == GIF_ERROR)
+				goto error;
+
+			img_desc = &gif->SavedImages[gif->ImageCount - 1].ImageDesc;
+			if (img_desc->Top < 0 || img_desc->Height <= 0 ||
+			    img_desc->Left < 0 || img_desc->Width <= 0 ||
+			    (img_desc->Width + img_desc->Left) > gif->SWidth ||
+			    (img_desc->Height + img_desc->Top) > gif->SHeight) {
+				goto error;
+			}
+
+			if (DGifGetCode (gif, &code_size, &block) == GIF_ERROR)
+				goto error;
+			while (block != NULL) {
+				if (DGifGetCodeNext (gif, &block) == GIF_ERROR)
+					goto error;
+			}
+			break;
+		case EXTENSION_RECORD_TYPE:
+			if (DGifGetExtension (gif, &function, &block) == GIF_ERROR)
+				goto error;
+			while (block != NULL) {
+				if (DGifGetExtensionNext (gif, &block) == GIF_ERROR)
+					goto error;
+			}
+			break;
+		default:
+			break;
+		}
+	} while (record_type != TERMINATE_RECORD_TYPE);
+
+	/* The gif file must contain at least one image block. */
+	if (gif->ImageCount == 0)
+		goto error;
+
+	info->Width = gif->SWidth;
+	info->Height = gif->SHeight;
+	info->PixelFormat = PixelFormat8bppIndexed;
+	info->FrameCount = gif->ImageCount;
+	info->DpiX = info->DpiY = gdip_get_display_dpi ();
+	status = Ok;
+
+error:
+#if (GIFLIB_MAJOR > 5) || ((GIFLIB_MAJOR == 5) && (GIFLIB_MINOR >= 1))
+	DGifCloseFile (gif, NULL);
+#else
+	DGifCloseFile (gif);
+#endif
+	return status;
+}
+
+GpStatus
+gdip_read_gif_image_info_from_file (FILE *fp, GpImageInfo *info)
+{
+	return gdip_read_gif_image_info (fp, info, TRUE);
+}
+
+GpStatus
+gdip_read_gif_image_info_from_stream_delegate (GetBytesDelegate getBytesFunc, SeekDelegate seekFunc, GpImageInfo *info)
+{
+	gif_callback_data gif_data;
+
+	gif_data.getBytesFunc = getBytesFunc;
+	gif_data.seekFunc = seekFunc;
+
+	return gdip_read_gif_image_info (&gif_data, info, FALSE);
+}
+
 /* Write callback function for the gif libbrary*/
 static int 
 gdip_gif_outputfunc (GifFileType *gif,  const GifByteType *data, int len) 
@@ -1084,8 +1529,572 @@ gdip_gif_outputfunc (GifFileType *gif,  const GifByteType *data, int len)
 	return written;
 }
 
+/* Reads the value of a (single valued) encoder parameter, if present */
+static GpStatus
+gdip_gif_get_encoder_parameter (GDIPCONST EncoderParameters *params, const GUID *guid, int *value)
+{
+	const EncoderParameter *param = gdip_find_encoder_parameter (params, guid);
+
+	if (!param)
+		return Ok;
+
+	if (param->NumberOfValues != 1 || !param->Value)
+		return InvalidParameter;
+
+	switch (param->Type) {
+	case EncoderParameterValueTypeLong:
+		*value = *(LONG *) param->Value;
+		return Ok;
+	case EncoderParameterValueTypeShort:
+		*value = *(short *) param->Value;
+		return Ok;
+	case EncoderParameterValueTypeByte:
+		*value = *(BYTE *) param->Value;
+		return Ok;
+	default:
+		return InvalidParameter;
+	}
+}
+
+/* Gets the quantizer and the dithering to use for the frames that aren't indexed, and whether to write the frames of
+ * animations as deltas, from the encoder parameters */
+static GpStatus
+gdip_gif_get_encoder_settings (GDIPCONST EncoderParameters *params, int *quantizer, int *dither, int *delta)
+{
+	GpStatus status;
+
+	*quantizer = GifQuantizerMedianCut;
+	*dither = DitherTypeNone;
+	*delta = 0;
+
+	if (!params)
+		return Ok;
+
+	status = gdip_gif_get_encoder_parameter (params, &GdipEncoderGifQuantizer, quantizer);
+	if (status != Ok)
+		return status;
+	if (*quantizer != GifQuantizerMedianCut && *quantizer != GifQuantizerKMeans)
+		return InvalidParameter;
+
+	status = gdip_gif_get_encoder_parameter (params, &GdipEncoderGifDither, dither);
+	if (status != Ok)
+		return status;
+
+	switch (*dither) {
+	case DitherTypeNone:
+		break;
+	case DitherTypeOrdered4x4:
+	case DitherTypeOrdered8x8:
+	case DitherTypeOrdered16x16:
+	case DitherTypeErrorDiffusion:
+		*quantizer = GifQuantizerKMeans;
+		break;
+	default:
+		return InvalidParameter;
+	}
+
+	status = gdip_gif_get_encoder_parameter (params, &GdipEncoderGifDeltaFrames, delta);
+	if (status != Ok)
+		return status;
+	if (*delta != 0 && *delta != 1)
+		return InvalidParameter;
+
+	return Ok;
+}
+
+/* Writes the extensions that follow the screen descriptor: the loop count of animations and the comment */
+static void
+gdip_gif_put_screen_extensions (GifFileType *fp, ActiveBitmapData *bitmap_data, BOOL animated)
+{
+	int index;
+
+	/* An animated image must have the application extension */
+	if (animated) {
+		/* Store the LoopCount extension */
+		if (gdip_bitmapdata_property_find_id(bitmap_data, PropertyTagLoopCount, &index) == Ok) {
+			BYTE Buffer[3];
+			BYTE *ptr = bitmap_data->property[index].value;
+			Buffer[0] = 1;
+			Buffer[1] = ptr[0];
+			Buffer[2] = ptr[1];
+#if GIFLIB_MAJOR >= 5
+			EGifPutExtensionLeader(fp, APPLICATION_EXT_FUNC_CODE);
+			EGifPutExtensionBlock(fp, 11, "NETSCAPE2.0");
+			EGifPutExtensionBlock(fp, 3, Buffer);
+			EGifPutExtensionTrailer(fp);
+#else
+			EGifPutExtensionFirst(fp, APPLICATION_EXT_FUNC_CODE, 11, "NETSCAPE2.0"); 
+			EGifPutExtensionLast(fp, APPLICATION_EXT_FUNC_CODE, 3, Buffer); 
+#endif
+		}
+	}
+
+	if (gdip_bitmapdata_property_find_id(bitmap_data, PropertyTagExifUserComment, &index) == Ok) {
+		EGifPutComment(fp, (const char *)bitmap_data->property[index].value);
+	}
+}
+
+/* Gets the (little endian) delay of a frame for its graphic control extension */
+static void
+gdip_gif_get_frame_delay (ActiveBitmapData *bitmap_data, BYTE *delay)
+{
+	BYTE *ptr;
+	int index;
+
+	if (gdip_bitmapdata_property_find_id(bitmap_data, PropertyTagFrameDelay, &index) == Ok) {
+		ptr = bitmap_data->property[index].value;
+		delay[0] = ptr[0];
+		delay[1] = ptr[1];
+	} else {
+		delay[0] = 0;
+		delay[1] = 0;
+	}
+}
+
+/*
+ * Delta frames: every frame of an animation is compared to what the previous frames left on the canvas (they are all
+ * written with "do not dispose"), and only the bounding rectangle of the pixels that changed is written. In it, the
+ * unchanged pixels get a transparent index, which also makes runs that LZW compresses well. The rectangle uses the
+ * global color table (the one of the first frame) when that has all of its colors, else its own colors: the palette
+ * of an indexed frame, or those the quantizer finds for the changed pixels only.
+ */
+
+typedef struct {
+	GifColorType	colors[256];
+	int		count;			/* number of colors, including the transparent one */
+	int		transparent;		/* index of the transparent color, -1 if there is none */
+} GifDeltaPalette;
+
+/* Gets the (non premultiplied) ARGB pixels of a frame */
+static GpStatus
+gdip_gif_get_frame_pixels (ActiveBitmapData *bitmap_data, ARGB *pixels)
+{
+	PixelRowConversion conversion;
+	GpStatus status;
+	int y;
+
+	status = gdip_init_pixel_row_conversion (&conversion, gdip_get_pixel_row_format (bitmap_data->pixel_format, FALSE),
+		PixelRowFormat32bppARGB, bitmap_data->palette);
+	if (status != Ok)
+		return status;
+
+	for (y = 0; y < bitmap_data->height; y++) {
+		gdip_convert_pixel_row (&conversion, bitmap_data->scan0 + (size_t) y * bitmap_data->stride, 0,
+			(BYTE *) (pixels + (size_t) y * bitmap_data->width), 0, bitmap_data->width);
+	}
+
+	return Ok;
+}
+
+/* Whether a pixel of the frame changes the canvas: it isn't transparent and differs from what is there */
+#define gdip_gif_pixel_changed(current, previous)	(((current) >> 24) != 0 && (((previous) >> 24) == 0 || (((current) ^ (previous)) & 0xFFFFFF) != 0))
+
+/* Finds the bounding rectangle of the pixels that change the canvas, FALSE if there are none */
+static BOOL
+gdip_gif_find_changed_rect (const ARGB *current, const ARGB *previous, int width, int height, Rect *rect)
+{
+	int left = width, right = -1, top = -1, bottom = -1;
+	const ARGB *c, *p;
+	int first, last;
+	int y;
+
+	for (y = 0; y < height; y++) {
+		c = current + (size_t) y * width;
+		p = previous + (size_t) y * width;
+
+		for (first = 0; first < width; first++) {
+			if (gdip_gif_pixel_changed (c[first], p[first]))
+				break;
+		}
+		if (first == width)
+			continue;
+		left = MIN (left, first);
+
+		/* only the pixels right of the rectangle so far can widen it */
+		for (last = width - 1; last > MAX (right, first); last--) {
+			if (gdip_gif_pixel_changed (c[last], p[last]))
+				break;
+		}
+		right = MAX (right, last);
+
+		if (top < 0)
+			top = y;
+		bottom = y;
+	}
+
+	if (top < 0)
+		return FALSE;
+
+	rect->X = left;
+	rect->Y = top;
+	rect->Width = right - left + 1;
+	rect->Height = bottom - top + 1;
+	return TRUE;
+}
+
+/* Maps the opaque pixels to the exact colors of palette and the others to its transparent index, FALSE if it doesn't
+ * have all of them */
+static BOOL
+gdip_gif_map_exact (const ARGB *pixels, int count, const GifDeltaPalette *palette, GifByteType *indices)
+{
+	ARGB keys[256];
+	BYTE values[256];
+	ARGB key, last = 0;
+	int entries = 0;
+	int low, high, middle;
+	int i, j;
+
+	/* sorted colors of the palette, for a binary search */
+	for (i = 0; i < palette->count; i++) {
+		if (i == palette->transparent)
+			continue;
+
+		key = (palette->colors[i].Red << 16) | (palette->colors[i].Green << 8) | palette->colors[i].Blue;
+		for (j = entries; j > 0 && keys[j - 1] > key; j--)
+			;
+		if (j > 0 && keys[j - 1] == key)
+			continue;
+
+		memmove (keys + j + 1, keys + j, (entries - j) * sizeof (ARGB));
+		memmove (values + j + 1, values + j, entries - j);
+		keys[j] = key;
+		values[j] = i;
+		entries++;
+	}
+
+	middle = -1;
+	for (i = 0; i < count; i++) {
+		if ((pixels[i] >> 24) == 0) {
+			if (palette->transparent < 0)
+				return FALSE;
+
+			indices[i] = palette->transparent;
+			continue;
+		}
+
+		key = pixels[i] & 0xFFFFFF;
+		if (middle < 0 || key != last) {
+			low = 0;
+			high = entries - 1;
+			middle = -1;
+			while (low <= high) {
+				j = (low + high) / 2;
+				if (keys[j] < key) {
+					low = j + 1;
+				} else if (keys[j] > key) {
+					high = j - 1;
+				} else {
+					middle = j;
+					break;
+				}
+			}
+
+			if (middle < 0)
+				return FALSE;
+			last = key;
+		}
+
+		indices[i] = values[middle];
+	}
+
+	return TRUE;
+}
+
+/* Gets the colors of an indexed frame, with room for a transparent index */
+static void
+gdip_gif_get_frame_palette (ActiveBitmapData *bitmap_data, GifDeltaPalette *palette)
+{
+	ARGB color;
+	int i;
+
+	palette->count = MIN (bitmap_data->palette->Count, 256);
+	for (i = 0; i < palette->count; i++) {
+		color = bitmap_data->palette->Entries[i];
+		palette->colors[i].Red = (color >> 16) & 0xFF;
+		palette->colors[i].Green = (color >> 8) & 0xFF;
+		palette->colors[i].Blue = color & 0xFF;
+	}
+
+	if (palette->count < 256) {
+		palette->transparent = palette->count;
+		palette->colors[palette->count].Red = palette->colors[palette->count].Green = palette->colors[palette->count].Blue = 0;
+		palette->count++;
+	} else {
+		palette->transparent = -1;
+	}
+}
+
+/* Quantizes the opaque pixels to at most 255 colors, the others get the transparent index */
+static GpStatus
+gdip_gif_quantize_pixels (const ARGB *pixels, int width, int height, int quantizer, int dither, GifDeltaPalette *palette,
+	GifByteType *indices)
+{
+	ColorPalette *quantized;
+	GifByteType *red = NULL;
+	GifByteType *green = NULL;
+	GifByteType *blue = NULL;
+	GifByteType *opaque = NULL;
+	GpStatus status = Ok;
+	int count = width * height;
+	int opaque_count;
+	int i, j;
+
+	if (quantizer == GifQuantizerKMeans) {
+		quantized = GdipAlloc (sizeof (ColorPalette) + 255 * sizeof (ARGB));
+		if (!quantized)
+			return OutOfMemory;
+
+		status = gdip_quantize_palette ((const BYTE *) pixels, width, height, width * sizeof (ARGB), 256, TRUE, quantized);
+		if (status == Ok) {
+			status = gdip_quantize_pixels ((const BYTE *) pixels, width, height, width * sizeof (ARGB), quantized, dither, 1,
+				indices, width, 8);
+		}
+
+		if (status == Ok) {
+			palette->count = quantized->Count;
+			palette->transparent = 0;
+			for (i = 0; i < palette->count; i++) {
+				palette->colors[i].Red = (quantized->Entries[i] >> 16) & 0xFF;
+				palette->colors[i].Green = (quantized->Entries[i] >> 8) & 0xFF;
+				palette->colors[i].Blue = quantized->Entries[i] & 0xFF;
+			}
+		}
+
+		GdipFree (quantized);
+		return status;
+	}
+
+	/* giflib's median cut, on the opaque pixels only */
+	opaque_count = 0;
+	for (i = 0; i < count; i++) {
+		if ((pixels[i] >> 24) != 0)
+			opaque_count++;
+	}
+
+	palette->count = 0;
+	if (opaque_count > 0) {
+		red = GdipAlloc (opaque_count);
+		green = GdipAlloc (opaque_count);
+		blue = GdipAlloc (opaque_count);
+		opaque = GdipAlloc (opaque_count);
+		if (!red || !green || !blue || !opaque) {
+			status = OutOfMemory;
+			goto error;
+		}
+
+		for (i = 0, j = 0; i < count; i++) {
+			if ((pixels[i] >> 24) != 0) {
+				red[j] = (pixels[i] >> 16) & 0xFF;
+				green[j] = (pixels[i] >> 8) & 0xFF;
+				blue[j] = pixels[i] & 0xFF;
+				j++;
+			}
+		}
+
+		palette->count = 255;
+		if (LibgdiplusGifQuantizeBuffer (opaque_count, 1, &palette->count, red, green, blue, opaque, palette->colors) == GIF_ERROR) {
+			status = GenericError;
+			goto error;
+		}
+	}
+
+	palette->transparent = palette->count;
+	palette->colors[palette->count].Red = palette->colors[palette->count].Green = palette->colors[palette->count].Blue = 0;
+	palette->count++;
+
+	for (i = 0, j = 0; i < count; i++)
+		indices[i] = (pixels[i] >> 24) != 0 ? opaque[j++] : palette->transparent;
+
+error:
+	GdipFree (red);
+	GdipFree (green);
+	GdipFree (blue);
+	GdipFree (opaque);
+	return status;
+}
+
+/* Writes the frames of an animation (all of the same size) as delta frames */
+static GpStatus
+gdip_save_gif_delta_frames (GifFileType *fp, GpImage *image, int quantizer, int dither)
+{
+	FrameData *frame = &image->frames[0];
+	ActiveBitmapData *bitmap_data;
+	GifDeltaPalette global;
+	GifDeltaPalette local;
+	GifDeltaPalette *palette;
+	ColorMapObject *cmap = NULL;
+	ARGB *current = NULL;
+	ARGB *previous = NULL;
+	ARGB *changed = NULL;
+	GifByteType *indices = NULL;
+	unsigned long long int size;
+	int width = frame->bitmap[0].width;
+	int height = frame->bitmap[0].height;
+	GpStatus status;
+	BYTE buffer[4];
+	Rect rect;
+	BOOL mapped;
+	BOOL was_decoded;
+	ARGB *c, *p, *d;
+	int x, y, k;
+
+	size = (unsigned long long int) width * height * sizeof (ARGB);
+	if (size > G_MAXINT32)
+		return OutOfMemory;
+
+	current = GdipAlloc (size);
+	previous = gdip_calloc (1, size);
+	changed = GdipAlloc (size);
+	indices = GdipAlloc (size / sizeof (ARGB));
+	if (!current || !previous || !changed || !indices) {
+		status = OutOfMemory;
+		goto error;
+	}
+
+	for (k = 0; k < frame->count; k++) {
+		/* frames decoded only to be saved are dropped once their pixels are copied */
+		was_decoded = frame->bitmap[k].scan0 != NULL;
+		status = gdip_bitmap_decode_frame (image, 0, k);
+		if (status != Ok)
+			goto error;
+
+		bitmap_data = &frame->bitmap[k];
+		gdip_bitmap_load_properties (image, bitmap_data);
+
+		status = gdip_gif_get_frame_pixels (bitmap_data, current);
+		gdip_bitmap_release_frame (image, 0, k, was_decoded);
+		if (status != Ok)
+			goto error;
+
+		if (!gdip_gif_find_changed_rect (current, previous, width, height, &rect)) {
+			/* nothing changed, a transparent pixel keeps the delay */
+			rect.X = rect.Y = 0;
+			rect.Width = rect.Height = 1;
+		}
+
+		/* the changed pixels of the rectangle, the others are transparent; and what the canvas becomes */
+		for (y = 0; y < rect.Height; y++) {
+			c = current + (size_t) (rect.Y + y) * width + rect.X;
+			p = previous + (size_t) (rect.Y + y) * width + rect.X;
+			d = changed + (size_t) y * rect.Width;
+			for (x = 0; x < rect.Width; x++) {
+				if (gdip_gif_pixel_changed (c[x], p[x])) {
+					d[x] = c[x] | 0xFF000000;
+					p[x] = d[x];
+				} else {
+					d[x] = 0;
+				}
+			}
+		}
+
+		if (k > 0 && gdip_gif_map_exact (changed, rect.Width * rect.Height, &global, indices)) {
+			palette = &global;
+		} else {
+			palette = &local;
+			mapped = FALSE;
+			if (gdip_is_an_indexed_pixelformat (bitmap_data->pixel_format) && bitmap_data->palette) {
+				gdip_gif_get_frame_palette (bitmap_data, palette);
+				mapped = gdip_gif_map_exact (changed, rect.Width * rect.Height, palette, indices);
+			}
+
+			if (!mapped) {
+				status = gdip_gif_quantize_pixels (changed, rect.Width, rect.Height, quantizer, dither, palette, indices);
+				if (status != Ok)
+					goto error;
+			}
+		}
+
+#if GIFLIB_MAJOR >= 5
+		cmap = GifMakeMapObject (1 << GifBitSize (palette->count), NULL);
+#else
+		cmap = MakeMapObject (1 << BitSize (palette->count), NULL);
+#endif
+		if (!cmap) {
+			status = OutOfMemory;
+			goto error;
+		}
+		memcpy (cmap->Colors, palette->colors, palette->count * sizeof (GifColorType));
+
+		if (k == 0) {
+			/* the first frame defines the global color table */
+			global = local;
+			palette = &global;
+			if (EGifPutScreenDesc (fp, width, height, cmap->BitsPerPixel, 0, cmap) == GIF_ERROR) {
+				status = GenericError;
+				goto error;
+			}
+
+			gdip_gif_put_screen_extensions (fp, bitmap_data, TRUE);
+		}
+
+		buffer[0] = 0x04;		/* 0000 0100 = do not dispose */
+		if (palette->transparent >= 0) {
+			buffer[0] |= 0x01;	/* 0000 0001 = transparent */
+		}
+		gdip_gif_get_frame_delay (bitmap_data, buffer + 1);
+		buffer[3] = palette->transparent >= 0 ? palette->transparent : 0;
+		EGifPutExtension (fp, GRAPHICS_EXT_FUNC_CODE, 4, buffer);
+
+		/* This call will leak GifFile->Image.ColorMap */
+		if (EGifPutImageDesc (fp, rect.X, rect.Y, rect.Width, rect.Height, FALSE,
+				palette == &global ? NULL : cmap) == GIF_ERROR) {
+			status = GenericError;
+			goto error;
+		}
+
+		for (y = 0; y < rect.Height; y++) {
+			if (EGifPutLine (fp, indices + (size_t) y * rect.Width, rect.Width) == GIF_ERROR) {
+				status = GenericError;
+				goto error;
+			}
+		}
+
+#if GIFLIB_MAJOR >= 5
+		GifFreeMapObject (cmap);
+#else
+		FreeMapObject (cmap);
+#endif
+		cmap = NULL;
+	}
+
+	status = Ok;
+
+error:
+	if (cmap) {
+#if GIFLIB_MAJOR >= 5
+		GifFreeMapObject (cmap);
+#else
+		FreeMapObject (cmap);
+#endif
+	}
+
+	GdipFree (current);
+	GdipFree (previous);
+	GdipFree (changed);
+	GdipFree (indices);
+	return status;
+}
+
+/* Whether the frames of image can be written as delta frames: an animation of frames of the same size */
+static BOOL
+gdip_gif_can_save_delta_frames (GpImage *image)
+{
+	FrameData *frame = &image->frames[0];
+	int k;
+
+	if (image->num_of_frames != 1 || frame->count < 2 || memcmp (&frame->frame_dimension, &gdip_image_frameDimension_time_guid, sizeof (GUID)) != 0)
+		return FALSE;
+
+	for (k = 1; k < frame->count; k++) {
+		if (frame->bitmap[k].width != frame->bitmap[0].width || frame->bitmap[k].height != frame->bitmap[0].height)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
 static GpStatus 
-gdip_save_gif_image (void *stream, GpImage *image, BOOL from_file)
+gdip_save_gif_image (void *stream, GpImage *image, BOOL from_file, GDIPCONST EncoderParameters *params)
 {
 	GpStatus status;
 	GifFileType	*fp;
@@ -1103,16 +2112,24 @@ gdip_save_gif_image (void *stream, GpImage *image, BOOL from_file)
 	int		k;
 	BYTE		*v;
 	int		c;
-	int		index;
 	BOOL		animated;
 	int		frame;
 	ActiveBitmapData	*bitmap_data;
 	unsigned long long int		pixbuf_size;
+	ColorPalette	*palette = NULL;
+	int		quantizer;
+	int		dither;
+	int		delta;
+	BOOL		was_decoded;
 
 	if (!stream) {
 		return InvalidParameter;
 	}
 
+	status = gdip_gif_get_encoder_settings (params, &quantizer, &dither, &delta);
+	if (status != Ok)
+		return status;
+
 	if (from_file) {
 #if GIFLIB_MAJOR >= 5
 		fp = EGifOpenFileName (stream, 0, NULL);
@@ -1136,13 +2153,27 @@ gdip_save_gif_image (void *stream, GpImage *image, BOOL from_file)
 	blue = NULL;
 	pixbuf_org = NULL;
 
+	if (delta && gdip_gif_can_save_delta_frames (image)) {
+		status = gdip_save_gif_delta_frames (fp, image, quantizer, dither);
+		if (status != Ok)
+			goto error;
+		goto done;
+	}
+
 	for (frame = 0; frame < image->num_of_frames; frame++) {
 		animated = FALSE;
 		if (memcmp(&image->frames[frame].frame_dimension, &gdip_image_frameDimension_time_guid, sizeof(GUID)) == 0) {
 			animated = TRUE;
 		}
 		for (k = 0; k < image->frames[frame].count; k++) {
+			/* frames decoded only to be saved are dropped once written */
+			was_decoded = image->frames[frame].bitmap[k].scan0 != NULL;
+			status = gdip_bitmap_decode_frame (image, frame, k);
+			if (status != Ok) {
+				goto error;
+			}
 			bitmap_data = &image->frames[frame].bitmap[k];
+			gdip_bitmap_load_properties (image, bitmap_data);
 
 			pixbuf_size = (unsigned long long int)bitmap_data->width * bitmap_data->height * sizeof(GifByteType);
 
@@ -1269,39 +2300,69 @@ gdip_save_gif_image (void *stream, GpImage *image, BOOL from_file)
 #else
 				cmap  = MakeMapObject (cmap_size, 0);
 #endif
-				red = GdipAlloc(pixbuf_size);
-				green = GdipAlloc(pixbuf_size);
-				blue = GdipAlloc(pixbuf_size);
-				pixbuf = GdipAlloc(pixbuf_size);
-				if ((red == NULL) || (green == NULL) || (blue == NULL) || (pixbuf == NULL)) {
-					status = OutOfMemory;
-					goto error;
-				}
+				if (quantizer == GifQuantizerKMeans) {
+					pixbuf = GdipAlloc (pixbuf_size);
+					pixbuf_org = pixbuf;
+					palette = GdipAlloc (sizeof (ColorPalette) + (cmap_size - 1) * sizeof (ARGB));
+					if (!pixbuf || !palette) {
+						status = OutOfMemory;
+						goto error;
+					}
 
-				pixbuf_org = pixbuf;
-				red_ptr = red;
-				green_ptr = green;
-				blue_ptr = blue;
+					status = gdip_quantize_palette (bitmap_data->scan0, bitmap_data->width, bitmap_data->height,
+						bitmap_data->stride, cmap_size, FALSE, palette);
+					if (status != Ok)
+						goto error;
+
+					status = gdip_quantize_pixels (bitmap_data->scan0, bitmap_data->width, bitmap_data->height,
+						bitmap_data->stride, palette, dither, 0, pixbuf, bitmap_data->width, 8);
+					if (status != Ok)
+						goto error;
+
+					cmap_size = palette->Count;
+					for (c = 0; c < cmap_size; c++) {
+						cmap->Colors[c].Red = (palette->Entries[c] >> 16) & 0xFF;
+						cmap->Colors[c].Green = (palette->Entries[c] >> 8) & 0xFF;
+						cmap->Colors[c].Blue = palette->Entries[c] & 0xFF;
+					}
+
+					GdipFree (palette);
+					palette = NULL;
+				} else {
+					red = GdipAlloc(pixbuf_size);
+					green = GdipAlloc(pixbuf_size);
+					blue = GdipAlloc(pixbuf_size);
+					pixbuf = GdipAlloc(pixbuf_size);
+					if ((red == NULL) || (green == NULL) || (blue == NULL) || (pixbuf == NULL)) {
+						status = OutOfMemory;
+						goto error;
+					}
 
-				for (y = 0; y < bitmap_data->height; y++) {
-					v = bitmap_data->scan0 + y * bitmap_data->stride;
-					for (x = 0; x < bitmap_data->width; x++) {
+					pixbuf_org = pixbuf;
+					red_ptr = red;
+					green_ptr = green;
+					blue_ptr = blue;
+
+					for (y = 0; y < bitmap_data->height; y++) {
+						v = bitmap_data->scan0 + y * bitmap_data->stride;
+						for (x = 0; x < bitmap_data->width; x++) {
 #ifdef WORDS_BIGENDIAN
-						*red_ptr++ =   v[1];
-						*green_ptr++ = v[2];
-						*blue_ptr++ =  v[3];
+							*red_ptr++ =   v[1];
+							*green_ptr++ = v[2];
+							*blue_ptr++ =  v[3];
 #else
-						*red_ptr++ =   v[2];
-						*green_ptr++ = v[1];
-						*blue_ptr++ =  v[0];
+							*red_ptr++ =   v[2];
+							*green_ptr++ = v[1];
+							*blue_ptr++ =  v[0];
 #endif
 
-						v += 4;
+							v += 4;
+						}
+					}
+					if (LibgdiplusGifQuantizeBuffer(bitmap_data->width, bitmap_data->height, &cmap_size, red,  green, blue, pixbuf, cmap->Colors) == GIF_ERROR) {
+						status = GenericError;
+						goto error;
 					}
-				}
-				if (LibgdiplusGifQuantizeBuffer(bitmap_data->width, bitmap_data->height, &cmap_size, red,  green, blue, pixbuf, cmap->Colors) == GIF_ERROR) {
-					status = GenericError;
-					goto error;
 				}
 			}
 
@@ -1319,30 +2380,7 @@ gdip_save_gif_image (void *stream, GpImage *image, BOOL from_file)
 					goto error;
 				}
 
-				/* An animated image must have the application extension */
-				if (animated) {
-					/* Store the LoopCount extension */
-					if (gdip_bitmapdata_property_find_id(bitmap_data, PropertyTagLoopCount, &index) == Ok) {
-						BYTE Buffer[3];
-						BYTE *ptr = bitmap_data->property[index].value;
-						Buffer[0] = 1;
-						Buffer[1] = ptr[0];
-						Buffer[2] = ptr[1];
-#if GIFLIB_MAJOR >= 5
-						EGifPutExtensionLeader(fp, APPLICATION_EXT_FUNC_CODE);
-						EGifPutExtensionBlock(fp, 11, "NETSCAPE2.0");
-						EGifPutExtensionBlock(fp, 3, Buffer);
-						EGifPutExtensionTrailer(fp);
-#else
-						EGifPutExtensionFirst(fp, APPLICATION_EXT_FUNC_CODE, 11, "NETSCAPE2.0"); 
-						EGifPutExtensionLast(fp, APPLICATION_EXT_FUNC_CODE, 3, Buffer); 
-#endif
-					}
-				}
-
-				if (gdip_bitmapdata_property_find_id(bitmap_data, PropertyTagExifUserComment, &index) == Ok) {
-					EGifPutComment(fp, (const char *)bitmap_data->property[index].value);
-				}
+				gdip_gif_put_screen_extensions (fp, bitmap_data, animated);
 			}
 
 			/* Every image has a control extension specifying the time delay */
@@ -1355,16 +2393,7 @@ gdip_save_gif_image (void *stream, GpImage *image, BOOL from_file)
 					buffer[0] |= 0x01;	/* 0000 0001 = transparent */
 				}
 
-				if (gdip_bitmapdata_property_find_id(bitmap_data, PropertyTagFrameDelay, &index) == Ok) {
-					BYTE *ptr;
-
-					ptr = bitmap_data->property[index].value;
-					buffer[1] = ptr[0];
-					buffer[2] = ptr[1];
-				} else {
-					buffer[1] = 0;
-					buffer[2] = 0;
-				}
+				gdip_gif_get_frame_delay (bitmap_data, buffer + 1);
 
 				if (bitmap_data->transparent < 0) {
 					buffer[3] = (bitmap_data->transparent + 1) * -1;
@@ -1413,9 +2442,12 @@ gdip_save_gif_image (void *stream, GpImage *image, BOOL from_file)
 			green = NULL;
 			blue = NULL;
 			pixbuf_org = NULL;
+
+			gdip_bitmap_release_frame (image, frame, k, was_decoded);
 		}
 	}
 
+done:
 #if (GIFLIB_MAJOR > 5) || ((GIFLIB_MAJOR == 5) && (GIFLIB_MINOR >= 1))
 	EGifCloseFile (fp, NULL);
 #else
@@ -1449,19 +2481,20 @@ error:
 		GdipFree (pixbuf_org);
 	}
 
+	GdipFree (palette);
 	return status;
 }
 
 GpStatus 
-gdip_save_gif_image_to_file (BYTE *filename, GpImage *image)
+gdip_save_gif_image_to_file (BYTE *filename, GpImage *image, GDIPCONST EncoderParameters *params)
 {
-	return gdip_save_gif_image ((void *)filename, image, TRUE);
+	return gdip_save_gif_image ((void *)filename, image, TRUE, params);
 }
 
 GpStatus
 gdip_save_gif_image_to_stream_delegate (PutBytesDelegate putBytesFunc, GpImage *image, GDIPCONST EncoderParameters *params)
 {
-	return gdip_save_gif_image ( (void *)putBytesFunc, image, FALSE);
+	return gdip_save_gif_image ( (void *)putBytesFunc, image, FALSE, params);
 }
 
 #else
@@ -1484,7 +2517,7 @@ gdip_load_gif_image_from_file (FILE *fp, GpImage **image)
 }
 
 GpStatus 
-gdip_save_gif_image_to_file (BYTE *filename, GpImage *image)
+gdip_save_gif_image_to_file (BYTE *filename, GpImage *image, GDIPCONST EncoderParameters *params)
 {
 	return UnknownImageFormat;
 }
@@ -1502,6 +2535,18 @@ gdip_load_gif_image_from_stream_delegate (GetBytesDelegate getBytesFunc, SeekDel
 	return UnknownImageFormat;
 }
 
+GpStatus
+gdip_read_gif_image_info_from_file (FILE *fp, GpImageInfo *info)
+{
+	return UnknownImageFormat;
+}
+
+GpStatus
+gdip_read_gif_image_info_from_stream_delegate (GetBytesDelegate getBytesFunc, SeekDelegate seekFunc, GpImageInfo *info)
+{
+	return UnknownImageFormat;
+}
+
 #endif
 
 GpStatus
@@ -1512,7 +2557,7 @@ gdip_fill_encoder_parameter_list_gif (EncoderParameters *buffer, UINT size)
 	if (!buffer || size != sizeof (GifEncoderParameters))
 		return InvalidParameter;
 	
-	gifBuffer->count = 2;
+	gifBuffer->count = 5;
 
 	gifBuffer->imageItems.Guid = GdipEncoderImageItems;
 	gifBuffer->imageItems.NumberOfValues = 0;
@@ -1525,5 +2570,28 @@ gdip_fill_encoder_parameter_list_gif (EncoderParameters *buffer, UINT size)
 	gifBuffer->saveFlagValue = EncoderValueMultiFrame;
 	gifBuffer->saveFlag.Value = &gifBuffer->saveFlagValue;
 
+	gifBuffer->quantizer.Guid = GdipEncoderGifQuantizer;
+	gifBuffer->quantizer.NumberOfValues = 2;
+	gifBuffer->quantizer.Type = EncoderParameterValueTypeLong;
+	gifBuffer->quantizerData[0] = GifQuantizerMedianCut;
+	gifBuffer->quantizerData[1] = GifQuantizerKMeans;
+	gifBuffer->quantizer.Value = &gifBuffer->quantizerData;
+
+	gifBuffer->dither.Guid = GdipEncoderGifDither;
+	gifBuffer->dither.NumberOfValues = 5;
+	gifBuffer->dither.Type = EncoderParameterValueTypeLong;
+	gifBuffer->ditherData[0] = DitherTypeNone;
+	gifBuffer->ditherData[1] = DitherTypeOrdered4x4;
+	gifBuffer->ditherData[2] = DitherTypeOrdered8x8;
+	gifBuffer->ditherData[3] = DitherTypeOrdered16x16;
+	gifBuffer->ditherData[4] = DitherTypeErrorDiffusion;
+	gifBuffer->dither.Value = &gifBuffer->ditherData;
+
+	gifBuffer->deltaFrames.Guid = GdipEncoderGifDeltaFrames;
+	gifBuffer->deltaFrames.NumberOfValues = 1;
+	gifBuffer->deltaFrames.Type = EncoderParameterValueTypeLong;
+	gifBuffer->deltaFramesValue = 1;
+	gifBuffer->deltaFrames.Value = &gifBuffer->deltaFramesValue;
+
 	return Ok;
 }
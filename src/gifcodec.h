@@ -19,7 +19,12 @@ GpStatus gdip_load_gif_image_from_file (FILE *fp, GpImage **image) GDIP_INTERNAL
 GpStatus gdip_load_gif_image_from_stream_delegate (GetBytesDelegate getBytesFunc, SeekDelegate seekFunc, 
 	GpImage **image) GDIP_INTERNAL;
 					   
-GpStatus gdip_save_gif_image_to_file (unsigned char *filename, GpImage *image) GDIP_INTERNAL;
+GpStatus gdip_read_gif_image_info_from_file (FILE *fp, GpImageInfo *info) GDIP_INTERNAL;
+
+GpStatus gdip_read_gif_image_info_from_stream_delegate (GetBytesDelegate getBytesFunc, SeekDelegate seekFunc,
+	GpImageInfo *info) GDIP_INTERNAL;
+
+GpStatus gdip_save_gif_image_to_file (unsigned char *filename, GpImage *image, GDIPCONST EncoderParameters *params) GDIP_INTERNAL;
 
 GpStatus gdip_save_gif_image_to_stream_delegate (PutBytesDelegate putBytesFunc, GpImage *image, 
 	GDIPCONST EncoderParameters *params) GDIP_INTERNAL;
@@ -33,7 +38,13 @@ typedef struct
   UINT count;
   EncoderParameter imageItems;
   EncoderParameter saveFlag;
+  EncoderParameter quantizer;
+  EncoderParameter dither;
+  EncoderParameter deltaFrames;
   LONG saveFlagValue;
+  LONG quantizerData[2];
+  LONG ditherData[5];
+  LONG deltaFramesValue;
 } GifEncoderParameters;
 
 #endif /* _GIFCODEC_H */
@@ -38,6 +38,7 @@ fill_graphics_with_brush (GpGraphics *graphics, GpBrush *brush, BOOL stroke)
 {
 	/* We do brush setup just before filling. */
 	gdip_brush_setup (graphics, brush);
+	gdip_graphics_path_modified (graphics, stroke);
 
 	/* don't stroke if scaled (since the pen thickness will be scaled too!) */
 	if (stroke && !gdip_is_scaled (graphics)) {
@@ -64,6 +65,7 @@ stroke_graphics_with_pen (GpGraphics *graphics, GpPen *pen)
 {
 	/* We do pen setup just before stroking. */
 	gdip_pen_setup (graphics, pen);
+	gdip_graphics_path_modified (graphics, TRUE);
 	cairo_stroke (graphics->ct);
 
 	/* Set the matrix back to graphics->copy_of_ctm for other functions.
@@ -735,6 +737,7 @@ cairo_FillRegion (GpGraphics *graphics, GpBrush *brush, GpRegion *region)
 		gdip_brush_setup (graphics, brush);
 
 		cairo_close_path (graphics->ct);
+		gdip_graphics_rect_modified (graphics, region->bitmap->X, region->bitmap->Y, region->bitmap->Width, region->bitmap->Height);
 		cairo_mask_surface (graphics->ct, mask_surface, region->bitmap->X, region->bitmap->Y);
 		cairo_fill (graphics->ct);
 
@@ -771,6 +774,7 @@ cairo_GraphicsClear (GpGraphics *graphics, ARGB color)
 	cairo_set_source_rgba (graphics->ct, red / 255, green / 255, blue / 255, alpha / 255);
 	cairo_set_operator (graphics->ct, CAIRO_OPERATOR_SOURCE);
 	cairo_paint (graphics->ct);
+	gdip_graphics_image_modified (graphics);
 
 	/* Restore the color/alpha/pattern settings */
 	cairo_restore (graphics->ct);
@@ -163,6 +163,9 @@ GpStatus gdip_calculate_overall_clipping (GpGraphics *graphics) GDIP_INTERNAL;
 
 GpGraphics* gdip_graphics_new (cairo_surface_t *surface) GDIP_INTERNAL;
 GpGraphics* gdip_metafile_graphics_new (GpMetafile *metafile) GDIP_INTERNAL;
+void gdip_graphics_image_modified (GpGraphics *graphics) GDIP_INTERNAL;
+void gdip_graphics_path_modified (GpGraphics *graphics, BOOL stroke) GDIP_INTERNAL;
+void gdip_graphics_rect_modified (GpGraphics *graphics, double x, double y, double width, double height) GDIP_INTERNAL;
 
 BOOL gdip_is_scaled (GpGraphics *graphics) GDIP_INTERNAL;
 
@@ -216,6 +216,136 @@ gdip_metafile_graphics_new (GpMetafile *metafile)
 	return result;
 }
 
+/* Called after drawing, since drawing on a graphics created from a bitmap changes its pixels */
+void
+gdip_graphics_image_modified (GpGraphics *graphics)
+{
+	if (graphics->image)
+		gdip_bitmap_surface_modified ((GpBitmap *) graphics->image, NULL);
+}
+
+/* Marks the device pixels covered by the user space box (x1, y1) - (x2, y2) as modified */
+static void
+gdip_graphics_box_modified (GpGraphics *graphics, double x1, double y1, double x2, double y2)
+{
+	GpBitmap *bitmap = (GpBitmap *) graphics->image;
+	double cx1, cy1, cx2, cy2;
+	double px[4], py[4];
+	double left, top, right, bottom;
+	GpRect rect;
+	int i;
+
+	if (!bitmap || !bitmap->active_bitmap)
+		return;
+
+	cairo_clip_extents (graphics->ct, &cx1, &cy1, &cx2, &cy2);
+	switch (cairo_get_operator (graphics->ct)) {
+	case CAIRO_OPERATOR_IN:
+	case CAIRO_OPERATOR_OUT:
+	case CAIRO_OPERATOR_DEST_IN:
+	case CAIRO_OPERATOR_DEST_ATOP:
+		/* unbounded operators change everything inside the clip */
+		x1 = cx1;
+		y1 = cy1;
+		x2 = cx2;
+		y2 = cy2;
+		break;
+	default:
+		x1 = MAX (x1, cx1);
+		y1 = MAX (y1, cy1);
+		x2 = MIN (x2, cx2);
+		y2 = MIN (y2, cy2);
+		break;
+	}
+
+	if (!(x1 < x2 && y1 < y2)) {
+		gdip_bitmap_modified (bitmap);
+		return;
+	}
+
+	px[0] = x1; py[0] = y1;
+	px[1] = x2; py[1] = y1;
+	px[2] = x1; py[2] = y2;
+	px[3] = x2; py[3] = y2;
+	for (i = 0; i < 4; i++)
+		cairo_user_to_device (graphics->ct, &px[i], &py[i]);
+
+	left = right = px[0];
+	top = bottom = py[0];
+	for (i = 1; i < 4; i++) {
+		left = MIN (left, px[i]);
+		right = MAX (right, px[i]);
+		top = MIN (top, py[i]);
+		bottom = MAX (bottom, py[i]);
+	}
+
+	/* one more pixel on each side for antialiasing, and clamp before converting to int */
+	left = MAX (floor (left) - 1, 0);
+	top = MAX (floor (top) - 1, 0);
+	right = MIN (ceil (right) + 1, bitmap->active_bitmap->width);
+	bottom = MIN (ceil (bottom) + 1, bitmap->active_bitmap->height);
+	if (!(left < right && top < bottom)) {
+		gdip_bitmap_modified (bitmap);
+		return;
+	}
+
+	rect.X = (int) left;
+	rect.Y = (int) top;
+	rect.Width = (int) right - rect.X;
+	rect.Height = (int) bottom - rect.Y;
+	gdip_bitmap_surface_modified (bitmap, &rect);
+}
+
+/* Called before filling (and, if stroke is set, stroking) the current path of the graphics */
+void
+gdip_graphics_path_modified (GpGraphics *graphics, BOOL stroke)
+{
+	double x1, y1, x2, y2;
+	double sx1, sy1, sx2, sy2;
+
+	if (!graphics->image)
+		return;
+
+	cairo_fill_extents (graphics->ct, &x1, &y1, &x2, &y2);
+	if (stroke) {
+		cairo_stroke_extents (graphics->ct, &sx1, &sy1, &sx2, &sy2);
+		if (sx1 < sx2 && sy1 < sy2) {
+			if (x1 < x2 && y1 < y2) {
+				x1 = MIN (x1, sx1);
+				y1 = MIN (y1, sy1);
+				x2 = MAX (x2, sx2);
+				y2 = MAX (y2, sy2);
+			} else {
+				x1 = sx1;
+				y1 = sy1;
+				x2 = sx2;
+				y2 = sy2;
+			}
+		}
+	}
+
+	gdip_graphics_box_modified (graphics, x1, y1, x2, y2);
+}
+
+/* Called before painting a source that only covers the given user space rectangle */
+void
+gdip_graphics_rect_modified (GpGraphics *graphics, double x, double y, double width, double height)
+{
+	double x1, y1, x2, y2;
+
+	if (!graphics->image)
+		return;
+
+	/* painting with anything but OVER replaces the destination outside the source too */
+	if (cairo_get_operator (graphics->ct) != CAIRO_OPERATOR_OVER) {
+		cairo_clip_extents (graphics->ct, &x1, &y1, &x2, &y2);
+		gdip_graphics_box_modified (graphics, x1, y1, x2, y2);
+		return;
+	}
+
+	gdip_graphics_box_modified (graphics, x, y, x + width, y + height);
+}
+
 // coverity[+alloc : arg-*1]
 GpStatus WINGDIPAPI
 GdipCreateFromHDC (HDC hdc, GpGraphics **graphics)
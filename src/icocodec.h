@@ -45,6 +45,8 @@ GpStatus gdip_load_ico_image_from_file (FILE *fp, GpImage **image) GDIP_INTERNAL
 
 GpStatus gdip_load_ico_image_from_stream_delegate (dstream_t *loader, GpImage **image) GDIP_INTERNAL;
 
+GpStatus gdip_load_ico_image_from_memory (MemorySource *ms, GpImage **image) GDIP_INTERNAL;
+
 /* no save functions as the ICO "codec" is a decoder only */
 
 ImageCodecInfo* gdip_getcodecinfo_ico () GDIP_INTERNAL;
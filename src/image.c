@@ -46,6 +46,11 @@
 #include "emfcodec.h"
 #include "wmfcodec.h"
 
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 /*
  * format guids
  */
@@ -72,6 +77,16 @@ GUID GdipEncoderTransformation = {0x8D0EB2D1U, 0x0A58EU, 0x4EA8U, {0x0AA, 0x14,
 GUID GdipEncoderQuality = {0x1D5BE4B5U, 0x0FA4AU, 0x452DU, {0x9C, 0x0DD, 0x5D, 0x0B3, 0x51, 0x5, 0x0E7, 0x0EB}};
 GUID GdipEncoderLuminanceTable = {0x0EDB33BCEU, 0x266U, 0x4A77U, {0x0B9, 0x4, 0x27, 0x21, 0x60, 0x99, 0x0E7, 0x17}};
 GUID GdipEncoderChrominanceTable = {0x0F2E455DCU, 0x9B3U, 0x4316U, {0x82, 0x60, 0x67, 0x6A, 0x0DA, 0x32, 0x48, 0x1C}};
+/* libgdiplus extensions, see PngEncoderPreset */
+GUID GdipEncoderPngCompressionLevel = {0x9F7B053EU, 0x77BBU, 0x40F6U, {0x91, 0x5B, 0xA6, 0x71, 0xEF, 0x1F, 0x8F, 0x06}};
+GUID GdipEncoderPngCompressionStrategy = {0xAD698DD9U, 0x4BA5U, 0x476CU, {0x9D, 0x92, 0x17, 0xAB, 0x8B, 0x70, 0x39, 0x68}};
+GUID GdipEncoderPngFilter = {0x044E4F64U, 0xB6EAU, 0x479EU, {0xA7, 0x3F, 0xE6, 0x5D, 0x50, 0xD3, 0xFA, 0x1F}};
+GUID GdipEncoderPngPreset = {0x6D26E9D1U, 0x3F28U, 0x49F7U, {0x95, 0x6C, 0xCF, 0x65, 0xAE, 0x2A, 0xA5, 0x32}};
+GUID GdipEncoderPngThreads = {0xEC8EBA92U, 0x579AU, 0x4282U, {0x8D, 0xE1, 0x89, 0x73, 0xEC, 0x6C, 0x5F, 0xF5}};
+/* libgdiplus extensions, see GifQuantizer */
+GUID GdipEncoderGifQuantizer = {0xDBDDF270U, 0xE1AAU, 0x42F2U, {0xAD, 0x64, 0xB6, 0x14, 0xA1, 0x85, 0x54, 0xB9}};
+GUID GdipEncoderGifDither = {0xB15738A4U, 0xEB0DU, 0x49E6U, {0xB9, 0x56, 0x4B, 0x0C, 0x42, 0xFD, 0xD7, 0x71}};
+GUID GdipEncoderGifDeltaFrames = {0x4FB3682BU, 0x756DU, 0x49B6U, {0xBC, 0x79, 0x2A, 0x5A, 0x26, 0x58, 0x68, 0x63}};
 
 #define DECODERS_SUPPORTED 8
 #define ENCODERS_SUPPORTED 5
@@ -207,6 +222,9 @@ gdip_flip_x (GpImage *image)
 	int	i;
 	int	j;
 	
+	if (gdip_bitmap_ensure_writable (image) != Ok)
+		return OutOfMemory;
+
 	stride = image->active_bitmap->stride;
 	width = image->active_bitmap->width;
 	height = image->active_bitmap->height;
@@ -241,6 +259,9 @@ gdip_flip_y (GpImage *image)
 	int	height;
 	int	i;
 	
+	if (gdip_bitmap_ensure_writable (image) != Ok)
+		return OutOfMemory;
+
 	stride = image->active_bitmap->stride;
 	height = image->active_bitmap->height;
 	line = GdipAlloc (stride);
@@ -317,6 +338,10 @@ GdipGetImageGraphicsContext (GpImage *image, GpGraphics **graphics)
 		return OutOfMemory;
 	}
 
+	/* the graphics draws on the pixels, so they can't stay shared with a clone */
+	if (gdip_bitmap_ensure_writable (image) != Ok)
+		return OutOfMemory;
+
 	if (gdip_bitmap_ensure_surface (image) == NULL)
 		return OutOfMemory;
 	
@@ -450,6 +475,10 @@ GdipDrawImageRect (GpGraphics *graphics, GpImage *image, REAL x, REAL y, REAL wi
 
 	cairo_pattern_set_filter (pattern, gdip_get_cairo_filter (graphics->interpolation));
 
+	/* the filter may reach one source pixel beyond the image */
+	gdip_graphics_rect_modified (graphics, x - (double) width / image->active_bitmap->width, y - (double) height / image->active_bitmap->height,
+		width + 2.0 * width / image->active_bitmap->width, height + 2.0 * height / image->active_bitmap->height);
+
 	cairo_get_matrix (graphics->ct, &orig_matrix);
 	cairo_translate (graphics->ct, x, y);
 
@@ -544,6 +573,8 @@ GdipDrawImagePoints (GpGraphics *graphics, GpImage *image, GDIPCONST GpPointF *d
 	cairo_get_matrix(graphics->ct, &orig_matrix);
 	gdip_cairo_set_matrix (graphics, matrix);
 	cairo_set_source_surface (graphics->ct, image->surface, 0, 0);
+	/* the filter may reach one source pixel beyond the image */
+	gdip_graphics_rect_modified (graphics, -1, -1, image->active_bitmap->width + 2, image->active_bitmap->height + 2);
 	
 	cairo_paint (graphics->ct);	
 	cairo_set_source(graphics->ct, org_pattern);
@@ -603,6 +634,7 @@ GdipDrawImageRectRect (GpGraphics *graphics, GpImage *image,
 	cairo_pattern_t	*orig;
 	cairo_matrix_t	mat;
 	GpBitmap *preprocessed_image = NULL;
+	ProcessedBitmapEntry *processed_entry = NULL;
 	
 	if (!graphics)
 		return InvalidParameter;
@@ -627,21 +659,7 @@ GdipDrawImageRectRect (GpGraphics *graphics, GpImage *image,
 		return InvalidParameter;
 	}
 
-	if (image->type == ImageTypeBitmap) {
-		if (gdip_is_an_indexed_pixelformat (image->active_bitmap->pixel_format)) {
-			GpBitmap *rgb_bitmap = gdip_convert_indexed_to_rgb (image);
-			if (!rgb_bitmap)
-				return OutOfMemory;
-
-			status = GdipDrawImageRectRect (graphics, rgb_bitmap,
-				dstx, dsty, dstwidth, dstheight,
-				srcx, srcy, srcwidth, srcheight,
-				srcUnit, imageAttributes, callback, callbackData);
-			GdipDisposeImage (rgb_bitmap);
-
-			return status;
-		}
-	} else {
+	if (image->type != ImageTypeBitmap) {
 		/* metafile support */
 		return NotImplemented;
 	}
@@ -663,12 +681,19 @@ GdipDrawImageRectRect (GpGraphics *graphics, GpImage *image,
 		return Ok;
 	}
 
-	status = gdip_process_bitmap_attributes (image, (GpImageAttributes *) imageAttributes, &preprocessed_image);
+	/* the processed copy (if any) is kept in a cache, and indexed images come out of it already converted to RGB */
+	status = gdip_process_bitmap_attributes_cached (image, (GpImageAttributes *) imageAttributes, &preprocessed_image, &processed_entry);
 	if (status != Ok) {
 		return status;
 	}
 	if (preprocessed_image == NULL) {
-		preprocessed_image = (GpBitmap *) image;
+		if (gdip_is_an_indexed_pixelformat (image->active_bitmap->pixel_format)) {
+			preprocessed_image = gdip_convert_indexed_to_rgb (image);
+			if (!preprocessed_image)
+				return OutOfMemory;
+		} else {
+			preprocessed_image = (GpBitmap *) image;
+		}
 	}
 
 	cairo_matrix_init (&mat, 1, 0, 0, 1, 0, 0);
@@ -698,13 +723,13 @@ GdipDrawImageRectRect (GpGraphics *graphics, GpImage *image,
 			status = gdip_bitmap_clone (preprocessed_image, &imgflipX);
 			if (status != Ok) {
 				gdip_bitmap_dispose(imgflipX);
-				return status;
+				goto cleanup;
 			}
 
 			status = gdip_flip_x (imgflipX);
 			if (status != Ok) {
 				gdip_bitmap_dispose (imgflipX);
-				return status;
+				goto cleanup;
 			}
 
 			gdip_bitmap_ensure_surface (imgflipX);
@@ -715,14 +740,14 @@ GdipDrawImageRectRect (GpGraphics *graphics, GpImage *image,
 			if (status != Ok) {
 				gdip_bitmap_dispose(imgflipX);
 				gdip_bitmap_dispose(imgflipY);
-				return status;
+				goto cleanup;
 			}
 
 			status = gdip_flip_y (imgflipY);
 			if (status != Ok) {
 				gdip_bitmap_dispose (imgflipX);
 				gdip_bitmap_dispose (imgflipY);
-				return status;
+				goto cleanup;
 			}
 
 			gdip_bitmap_ensure_surface (imgflipY);			
@@ -734,7 +759,7 @@ GdipDrawImageRectRect (GpGraphics *graphics, GpImage *image,
 				gdip_bitmap_dispose(imgflipX);
 				gdip_bitmap_dispose(imgflipY);
 				gdip_bitmap_dispose(imgflipXY);
-				return status;
+				goto cleanup;
 			}
 
 			status = gdip_flip_x (imgflipXY);
@@ -742,7 +767,7 @@ GdipDrawImageRectRect (GpGraphics *graphics, GpImage *image,
 				gdip_bitmap_dispose(imgflipX);
 				gdip_bitmap_dispose(imgflipY);
 				gdip_bitmap_dispose(imgflipXY);
-				return status;
+				goto cleanup;
 			}
 
 			status = gdip_flip_y (imgflipXY);
@@ -750,7 +775,7 @@ GdipDrawImageRectRect (GpGraphics *graphics, GpImage *image,
 				gdip_bitmap_dispose(imgflipX);
 				gdip_bitmap_dispose(imgflipY);
 				gdip_bitmap_dispose(imgflipXY);
-				return status;
+				goto cleanup;
 			}
 
 			gdip_bitmap_ensure_surface (imgflipXY);			
@@ -786,6 +811,7 @@ GdipDrawImageRectRect (GpGraphics *graphics, GpImage *image,
 
 				cairo_set_source (graphics->ct, pattern);
 				cairo_rectangle (graphics->ct, dstx + posx, dsty + posy, img_width, img_height);
+				gdip_graphics_path_modified (graphics, FALSE);
 				cairo_fill (graphics->ct);
 
 				cairo_set_source (graphics->ct, orig);
@@ -842,6 +868,7 @@ GdipDrawImageRectRect (GpGraphics *graphics, GpImage *image,
 
 		cairo_set_source (graphics->ct, pattern);
 		cairo_rectangle (graphics->ct, dstx, dsty, dstwidth, dstheight);
+		gdip_graphics_path_modified (graphics, FALSE);
 		cairo_fill (graphics->ct);
 		
 		cairo_set_source (graphics->ct, orig);
@@ -853,11 +880,16 @@ GdipDrawImageRectRect (GpGraphics *graphics, GpImage *image,
 		cairo_pattern_destroy (filter);
 	}
 
-	if (preprocessed_image != image) {
+	status = Ok;
+
+cleanup:
+	if (processed_entry) {
+		gdip_processed_bitmap_release (processed_entry);
+	} else if (preprocessed_image != image) {
 		GdipDisposeImage ((GpImage *) preprocessed_image);
 	}
 	
-	return Ok;
+	return status;
 }
 
 GpStatus WINGDIPAPI
@@ -991,9 +1023,128 @@ GdipSaveImageToStream (GpImage *image, void *stream, GDIPCONST CLSID *encoderCLS
 	return NotImplemented; /* GdipSaveImageToStream - not supported */
 }
 
-/* coverity[+alloc : arg-*1] */
-GpStatus WINGDIPAPI 
-GdipLoadImageFromFile (GDIPCONST WCHAR *file, GpImage **image)
+/* Codecs that can only decode all of the image leave it to this to cut region out of it */
+static GpStatus
+gdip_crop_loaded_image (GDIPCONST Rect *region, GpImage **image)
+{
+	GpBitmap *cropped;
+	GpStatus status;
+
+	if ((*image)->type != ImageTypeBitmap) {
+		status = NotImplemented;
+	} else {
+		status = GdipCloneBitmapAreaI (region->X, region->Y, region->Width, region->Height,
+			(*image)->active_bitmap->pixel_format, (GpBitmap *) *image, &cropped);
+	}
+
+	GdipDisposeImage (*image);
+	*image = status == Ok ? (GpImage *) cropped : NULL;
+	return status;
+}
+
+static GpStatus
+gdip_get_image_format_guid (ImageFormat image_format, GUID *format)
+{
+	switch (image_format) {
+	case BMP:
+		memcpy (format, &gdip_bmp_image_format_guid, sizeof (GUID));
+		break;
+	case TIF:
+		memcpy (format, &gdip_tif_image_format_guid, sizeof (GUID));
+		break;
+	case GIF:
+		memcpy (format, &gdip_gif_image_format_guid, sizeof (GUID));
+		break;
+	case PNG:
+		memcpy (format, &gdip_png_image_format_guid, sizeof (GUID));
+		break;
+	case JPEG:
+		memcpy (format, &gdip_jpg_image_format_guid, sizeof (GUID));
+		break;
+	case EXIF:
+		memcpy (format, &gdip_exif_image_format_guid, sizeof (GUID));
+		break;
+	case WMF:
+		memcpy (format, &gdip_wmf_image_format_guid, sizeof (GUID));
+		break;
+	case EMF:
+		memcpy (format, &gdip_emf_image_format_guid, sizeof (GUID));
+		break;
+	case MEMBMP:
+		memcpy (format, &gdip_membmp_image_format_guid, sizeof (GUID));
+		break;
+	case ICON:
+		memcpy (format, &gdip_ico_image_format_guid, sizeof (GUID));
+		break;
+	default:
+		return InvalidParameter;
+	}
+	return Ok;
+}
+
+/* For the codecs without a way of reading only the header (metafiles and icons): what the loaded image reports */
+static GpStatus
+gdip_get_loaded_image_info (GpImage *image, GpImageInfo *info)
+{
+	if (image->type == ImageTypeBitmap && !image->active_bitmap)
+		gdip_bitmap_setactive (image, NULL, 0);
+
+	GdipGetImageWidth (image, &info->Width);
+	GdipGetImageHeight (image, &info->Height);
+	GdipGetImagePixelFormat (image, &info->PixelFormat);
+	GdipGetImageHorizontalResolution (image, &info->DpiX);
+	GdipGetImageVerticalResolution (image, &info->DpiY);
+	info->FrameCount = (image->num_of_frames > 0) ? image->frames[0].count : 1;
+
+	GdipDisposeImage (image);
+	return Ok;
+}
+
+/* Smaller files are read through stdio, mapping them costs more than it saves */
+#define IMAGE_FILE_MAP_MIN_SIZE	(64 * 1024)
+
+/*
+ * Maps the regular file behind fp read-only, so that the codecs able to decode from memory read it in place instead
+ * of copying it through stdio's buffer (and, for TIFF, libtiff reads the strips from the mapping). Returns FALSE if
+ * it can't, the file is then read as usual. Like any mapping, the file must not be truncated while it's decoded.
+ */
+static BOOL
+gdip_map_image_file (FILE *fp, MemorySource *ms)
+{
+#ifdef HAVE_SYS_MMAN_H
+	struct stat	st;
+	void		*data;
+
+	if (fstat (fileno (fp), &st) != 0 || !S_ISREG (st.st_mode))
+		return FALSE;
+
+	/* MemorySource uses int offsets, so we limit ourselves to 2GB */
+	if (st.st_size < IMAGE_FILE_MAP_MIN_SIZE || st.st_size > G_MAXINT32)
+		return FALSE;
+
+	data = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno (fp), 0);
+	if (data == MAP_FAILED)
+		return FALSE;
+
+	ms->ptr = (BYTE *) data;
+	ms->size = (int) st.st_size;
+	ms->pos = 0;
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
+static void
+gdip_unmap_image_file (MemorySource *ms)
+{
+#ifdef HAVE_SYS_MMAN_H
+	munmap (ms->ptr, ms->size);
+#endif
+}
+
+static GpStatus
+gdip_load_image_from_file (GDIPCONST WCHAR *file, UINT width, UINT height, GDIPCONST Rect *region, GpImage **image)
 {
 	FILE		*fp = NULL;
 	GpImage		*result = NULL;
@@ -1002,6 +1153,8 @@ GdipLoadImageFromFile (GDIPCONST WCHAR *file, GpImage **image)
 	char		*file_name = NULL;
 	char		format_peek[MAX_CODEC_SIG_LENGTH];
 	int		format_peek_sz;
+	MemorySource	ms;
+	BOOL		mapped;
 
 	if (!gdiplusInitialized)
 		return GdiplusNotInitialized;
@@ -1024,25 +1177,54 @@ GdipLoadImageFromFile (GDIPCONST WCHAR *file, GpImage **image)
 	format_peek_sz = fread (format_peek, 1, MAX_CODEC_SIG_LENGTH, fp);
 	format = get_image_format (format_peek, format_peek_sz, &public_format);
 	fseek (fp, 0, SEEK_SET);
+
+	/* the codecs able to decode from memory read the file through a mapping of it */
+	switch (format) {
+	case BMP:
+	case TIF:
+	case PNG:
+	case JPEG:
+	case ICON:
+		mapped = gdip_map_image_file (fp, &ms);
+		break;
+	default:
+		mapped = FALSE;
+		break;
+	}
 	
 	switch (format) {
 	case BMP:
-		status = gdip_load_bmp_image_from_file (fp, &result);
+		if (mapped)
+			status = gdip_load_bmp_image_from_memory (&ms, &result);
+		else
+			status = gdip_load_bmp_image_from_file (fp, &result);
 		break;
 	case TIF:
-		status = gdip_load_tiff_image_from_file (fp, &result);
+		if (mapped)
+			status = gdip_load_tiff_image_from_memory (&ms, &result);
+		else
+			status = gdip_load_tiff_image_from_file (fp, &result);
 		break;
 	case GIF:
 		status = gdip_load_gif_image_from_file (fp, &result);
 		break;
 	case PNG:
-		status = gdip_load_png_image_from_file (fp, &result);
+		if (mapped)
+			status = gdip_load_png_image_from_memory (&ms, &result);
+		else
+			status = gdip_load_png_image_from_file (fp, &result);
 		break;
 	case JPEG:
-		status = gdip_load_jpeg_image_from_file (fp, file_name, &result);
+		if (mapped)
+			status = gdip_load_jpeg_image_from_memory (&ms, width, height, region, &result);
+		else
+			status = gdip_load_jpeg_image_from_file (fp, width, height, region, &result);
 		break;
 	case ICON:
-		status = gdip_load_ico_image_from_file (fp, &result);
+		if (mapped)
+			status = gdip_load_ico_image_from_memory (&ms, &result);
+		else
+			status = gdip_load_ico_image_from_file (fp, &result);
 		break;
 	case WMF:
 		status = gdip_load_wmf_image_from_file (fp, &result);
@@ -1060,7 +1242,10 @@ GdipLoadImageFromFile (GDIPCONST WCHAR *file, GpImage **image)
 
 	if (result && (status == Ok))
 		result->image_format = public_format;
-	
+
+	/* none of the codecs keep pointers into the file: what they keep of it (e.g. the pages of a TIFF) is copied */
+	if (mapped)
+		gdip_unmap_image_file (&ms);
 	fclose (fp);
 	GdipFree (file_name);
 	
@@ -1071,10 +1256,129 @@ GdipLoadImageFromFile (GDIPCONST WCHAR *file, GpImage **image)
 		/* If the codec didn't set the active bitmap we will */
 		gdip_bitmap_setactive (result, NULL, 0);
 	}
+
+	if (status == Ok && region && format != JPEG)
+		status = gdip_crop_loaded_image (region, image);
 	
 	return status;
 }
 
+/* coverity[+alloc : arg-*1] */
+GpStatus WINGDIPAPI 
+GdipLoadImageFromFile (GDIPCONST WCHAR *file, GpImage **image)
+{
+	return gdip_load_image_from_file (file, 0, 0, NULL, image);
+}
+
+/*
+ * libgdiplus extension: loads the image like GdipLoadImageFromFile, except that codecs able to decode a smaller
+ * version of it much faster (JPEG, at 1/2, 1/4 or 1/8 of its size) return the smallest one that is still at least
+ * width x height. Meant for images that are only going to be shown, or saved, at a small size (e.g. thumbnails).
+ */
+/* coverity[+alloc : arg-*1] */
+GpStatus WINGDIPAPI
+GdipLoadImageFromFileScaled_linux (GDIPCONST WCHAR *file, UINT width, UINT height, GpImage **image)
+{
+	if (!width || !height)
+		return InvalidParameter;
+
+	return gdip_load_image_from_file (file, width, height, NULL, image);
+}
+
+/*
+ * libgdiplus extension: loads only the part of the image in region (in pixels). Codecs able to decode just that
+ * part (JPEG) never hold the rest of the image in memory, which makes it suitable for cutting tiles out of very
+ * large images. Others load all of the image and return a copy of the region of its active frame.
+ */
+/* coverity[+alloc : arg-*1] */
+GpStatus WINGDIPAPI
+GdipLoadImageFromFileRegion_linux (GDIPCONST WCHAR *file, GDIPCONST GpRect *region, GpImage **image)
+{
+	if (!region || region->X < 0 || region->Y < 0 || region->Width <= 0 || region->Height <= 0)
+		return InvalidParameter;
+
+	return gdip_load_image_from_file (file, 0, 0, region, image);
+}
+
+/*
+ * libgdiplus extension: reads the size, pixel format, resolution and number of frames the image would report once
+ * loaded, from the headers only. BMP, JPEG, PNG, GIF and TIFF images never have their pixels decoded (or even
+ * allocated), which makes it much cheaper than loading them when only that is needed. Other images are loaded.
+ */
+GpStatus WINGDIPAPI
+GdipGetImageInfoFromFile_linux (GDIPCONST WCHAR *file, GpImageInfo *info)
+{
+	FILE		*fp = NULL;
+	GpImage		*image = NULL;
+	GpStatus	status = Ok;
+	ImageFormat	format, public_format;
+	char		*file_name = NULL;
+	char		format_peek[MAX_CODEC_SIG_LENGTH];
+	int		format_peek_sz;
+
+	if (!gdiplusInitialized)
+		return GdiplusNotInitialized;
+
+	if (!info || !file)
+		return InvalidParameter;
+
+	file_name = (char *) utf16_to_utf8 ((const gunichar2 *)file, -1);
+	if (!file_name)
+		return InvalidParameter;
+
+	fp = fopen (file_name, "rb");
+	if (!fp) {
+		GdipFree (file_name);
+		return OutOfMemory;
+	}
+
+	format_peek_sz = fread (format_peek, 1, MAX_CODEC_SIG_LENGTH, fp);
+	format = get_image_format (format_peek, format_peek_sz, &public_format);
+	fseek (fp, 0, SEEK_SET);
+
+	switch (format) {
+	case BMP:
+		status = gdip_read_bmp_image_info_from_file (fp, info);
+		break;
+	case TIF:
+		status = gdip_read_tiff_image_info_from_file (fp, info);
+		break;
+	case GIF:
+		status = gdip_read_gif_image_info_from_file (fp, info);
+		break;
+	case PNG:
+		status = gdip_read_png_image_info_from_file (fp, info);
+		break;
+	case JPEG:
+		status = gdip_read_jpeg_image_info_from_file (fp, info);
+		break;
+	case ICON:
+		status = gdip_load_ico_image_from_file (fp, &image);
+		break;
+	case WMF:
+		status = gdip_load_wmf_image_from_file (fp, &image);
+		break;
+	case EMF:
+		status = gdip_load_emf_image_from_file (fp, &image);
+		break;
+	case EXIF:
+		status = NotImplemented;
+		break;
+	default:
+		status = OutOfMemory;
+		break;
+	}
+
+	if (image && (status == Ok))
+		status = gdip_get_loaded_image_info (image, info);
+	if (status == Ok)
+		gdip_get_image_format_guid (public_format, &info->RawFormat);
+
+	fclose (fp);
+	GdipFree (file_name);
+	return status;
+}
+
 /* Note: use only for encoders (there's more decoders than encoders) */
 static ImageFormat 
 gdip_get_imageformat_from_codec_clsid (CLSID *encoderCLSID)
@@ -1132,7 +1436,7 @@ GdipSaveImageToFile (GpImage *image, GDIPCONST WCHAR *file, GDIPCONST CLSID *enc
 	gdip_bitmap_flush_surface (image);
 	
 	if (format == GIF) { /* gif library has to open the file itself*/
-		status = gdip_save_gif_image_to_file ((BYTE*)file_name, image);
+		status = gdip_save_gif_image_to_file ((BYTE*)file_name, image, params);
 		GdipFree (file_name);
 		return status;
 	} else if (format == TIF) { 
@@ -1336,41 +1640,7 @@ GdipGetImageRawFormat (GpImage *image, GUID *format)
 	if (!image || !format)
 		return InvalidParameter;
 	
-	switch (image->image_format) {
-	case BMP:
-		memcpy (format, &gdip_bmp_image_format_guid, sizeof (GUID));
-		break;
-	case TIF:
-		memcpy (format, &gdip_tif_image_format_guid, sizeof (GUID));
-		break;
-	case GIF:
-		memcpy (format, &gdip_gif_image_format_guid, sizeof (GUID));
-		break;
-	case PNG:
-		memcpy (format, &gdip_png_image_format_guid, sizeof (GUID));
-		break;
-	case JPEG:
-		memcpy (format, &gdip_jpg_image_format_guid, sizeof (GUID));
-		break;
-	case EXIF:
-		memcpy (format, &gdip_exif_image_format_guid, sizeof (GUID));
-		break;
-	case WMF:
-		memcpy (format, &gdip_wmf_image_format_guid, sizeof (GUID));
-		break;
-	case EMF:
-		memcpy (format, &gdip_emf_image_format_guid, sizeof (GUID));
-		break;
-	case MEMBMP:
-		memcpy (format, &gdip_membmp_image_format_guid, sizeof (GUID));
-		break;
-	case ICON:
-		memcpy (format, &gdip_ico_image_format_guid, sizeof (GUID));
-		break;
-	default:
-		return InvalidParameter;
-		}
-	return Ok;
+	return gdip_get_image_format_guid (image->image_format, format);
 }
 
 GpStatus WINGDIPAPI 
@@ -1495,6 +1765,23 @@ GdipImageSelectActiveFrame (GpImage *image, GDIPCONST GUID *dimensionGUID, UINT
 	}
 }
 
+/*
+ * libgdiplus extension: codecs may only decode the pixels of a frame (e.g. a page of a multi-page TIFF) when it
+ * is selected. With evict set, those pixels are dropped again as soon as another frame is selected, unless
+ * they were modified, so that going through the pages of a large document doesn't keep all of them in memory.
+ */
+GpStatus WINGDIPAPI
+GdipImageSetFrameEviction_linux (GpImage *image, BOOL evict)
+{
+	if (!image)
+		return InvalidParameter;
+
+	if (image->type == ImageTypeBitmap)
+		image->evict_frames = evict;
+
+	return Ok;
+}
+
 static GpStatus
 gdip_rotate_orthogonal_flip_x (GpImage *image, int angle, BOOL flip_x)
 {
@@ -1615,17 +1902,17 @@ gdip_rotate_orthogonal_flip_x (GpImage *image, int angle, BOOL flip_x)
 	image->active_bitmap->height = target_height;
 	image->active_bitmap->width = target_width;
 
-	if ((image->active_bitmap->reserved & GBD_OWN_SCAN0) != 0) {
-		GdipFree(image->active_bitmap->scan0);
+	/* a surface drawing on the old scan0 has to go before it does */
+	if (isSurfaceSource == 0) {
+		gdip_bitmap_flush_surface (image);
+		gdip_bitmap_invalidate_surface (image);
 	}
 
+	gdip_bitmapdata_release_scan0 (image->active_bitmap);
 	image->active_bitmap->scan0 = rotated;
 	image->active_bitmap->reserved |= GBD_OWN_SCAN0;
 
-	if (isSurfaceSource == 0) {
-		gdip_bitmap_flush_surface (image);
-		gdip_bitmap_invalidate_surface (image);
-	} else {
+	if (isSurfaceSource != 0) {
 		/* recalculate surface from rotated scan0 */
 		cairo_surface_destroy(image->surface);
 		image->surface = NULL;
@@ -1799,10 +2086,7 @@ gdip_rotate_flip_packed_indexed (GpImage *image, PixelFormat pixel_format, int a
 	image->active_bitmap->height = target_height;
 	image->active_bitmap->width = target_width;
 
-	if ((image->active_bitmap->reserved & GBD_OWN_SCAN0) != 0) {
-		GdipFree(image->active_bitmap->scan0);
-	}
-
+	gdip_bitmapdata_release_scan0 (image->active_bitmap);
 	image->active_bitmap->scan0 = rotated;
 	image->active_bitmap->reserved |= GBD_OWN_SCAN0;	
 
@@ -1827,6 +2111,7 @@ GdipImageRotateFlip (GpImage *image, RotateFlipType type)
 	if (image->type != ImageTypeBitmap)
 		return NotImplemented;
 
+	gdip_bitmap_modified (image);
 	angle = flip_x = 0;
 
 	switch (type) {
@@ -1933,6 +2218,7 @@ GdipSetImagePalette (GpImage *image, GDIPCONST ColorPalette *palette)
 	}
 
 	memcpy (image->active_bitmap->palette, palette, size);
+	gdip_bitmap_modified (image);
 	return Ok;
 }
 
@@ -1966,6 +2252,7 @@ GdipGetPropertyCount (GpImage *image, UINT *propertyNumber)
 
 	switch (image->type) {
 	case ImageTypeBitmap:
+		gdip_bitmap_load_properties (image, image->active_bitmap);
 		*propertyNumber = image->active_bitmap->property_count;
 		break;
 	case ImageTypeMetafile:
@@ -1989,6 +2276,8 @@ GdipGetPropertyIdList (GpImage *image, UINT propertyNumber, PROPID *list)
 	if (image->type != ImageTypeBitmap)
 		return NotImplemented;
 
+	gdip_bitmap_load_properties (image, image->active_bitmap);
+
 	if (propertyNumber != image->active_bitmap->property_count)
 		return InvalidParameter;
 
@@ -2011,6 +2300,8 @@ GdipGetPropertyItemSize (GpImage *image, PROPID propID, UINT *size)
 	if (image->type != ImageTypeBitmap)
 		return NotImplemented;
 
+	gdip_bitmap_load_properties (image, image->active_bitmap);
+
 	if (gdip_bitmapdata_property_find_id(image->active_bitmap, propID, &index) != Ok) {
 		return PropertyNotFound;
 	}
@@ -2032,6 +2323,8 @@ GdipGetPropertyItem (GpImage *image, PROPID propID, UINT size, PropertyItem *buf
 	if (image->type != ImageTypeBitmap)
 		return NotImplemented;
 
+	gdip_bitmap_load_properties (image, image->active_bitmap);
+
 	if (gdip_bitmapdata_property_find_id(image->active_bitmap, propID, &index) != Ok) {
 		return PropertyNotFound;
 	}
@@ -2060,6 +2353,8 @@ GdipGetPropertySize (GpImage *image, UINT *totalBufferSize, UINT *numProperties)
 	if (image->type != ImageTypeBitmap)
 		return NotImplemented;
 
+	gdip_bitmap_load_properties (image, image->active_bitmap);
+
 	*numProperties = image->active_bitmap->property_count;
 
 	size = image->active_bitmap->property_count * sizeof(PropertyItem);
@@ -2081,6 +2376,8 @@ GdipRemovePropertyItem (GpImage *image, PROPID propID)
 	if (image->type != ImageTypeBitmap)
 		return NotImplemented;
 
+	gdip_bitmap_load_properties (image, image->active_bitmap);
+
 	return gdip_bitmapdata_property_remove_id(image->active_bitmap, propID);
 }
 
@@ -2096,6 +2393,8 @@ GdipSetPropertyItem(GpImage *image, GDIPCONST PropertyItem *item)
 	if (image->type != ImageTypeBitmap)
 		return NotImplemented;
 
+	gdip_bitmap_load_properties (image, image->active_bitmap);
+
 	switch(image->image_format) {
 		case BMP:
 		case TIF:
@@ -2241,14 +2540,10 @@ gdip_get_pixel_format_components(PixelFormat pixfmt)
 	return 0;
 }
 
-GpStatus WINGDIPAPI
-GdipLoadImageFromDelegate_linux (GetHeaderDelegate getHeaderFunc,
-								 GetBytesDelegate getBytesFunc,
-								 PutBytesDelegate putBytesFunc,
-								 SeekDelegate seekFunc,
-								 CloseDelegate closeFunc,
-								 SizeDelegate sizeFunc,
-								 GpImage **image)
+static GpStatus
+gdip_load_image_from_delegate (GetHeaderDelegate getHeaderFunc, GetBytesDelegate getBytesFunc, PutBytesDelegate putBytesFunc,
+	SeekDelegate seekFunc, CloseDelegate closeFunc, SizeDelegate sizeFunc, UINT width, UINT height, GDIPCONST Rect *region,
+	GpImage **image)
 {
 	GpImage *result = 0;
 	GpStatus status = 0;
@@ -2263,14 +2558,14 @@ GdipLoadImageFromDelegate_linux (GetHeaderDelegate getHeaderFunc,
 	
 	switch (format) {
 	case JPEG:
-		loader = dstream_input_new (getBytesFunc, seekFunc);
-		status = gdip_load_jpeg_image_from_stream_delegate (loader, &result);
+		loader = dstream_input_new (getBytesFunc, seekFunc, sizeFunc);
+		status = gdip_load_jpeg_image_from_stream_delegate (loader, width, height, region, &result);
 		break;
 	case PNG:
 		status = gdip_load_png_image_from_stream_delegate (getBytesFunc, seekFunc, &result);
 		break;
 	case BMP:
-		loader = dstream_input_new (getBytesFunc, seekFunc);
+		loader = dstream_input_new (getBytesFunc, seekFunc, sizeFunc);
 		status = gdip_load_bmp_image_from_stream_delegate (loader, &result);
 		break;
 	case TIF:
@@ -2281,15 +2576,15 @@ GdipLoadImageFromDelegate_linux (GetHeaderDelegate getHeaderFunc,
 		status = gdip_load_gif_image_from_stream_delegate (getBytesFunc, seekFunc, &result);
 		break;
 	case ICON:
-		loader = dstream_input_new (getBytesFunc, seekFunc);
+		loader = dstream_input_new (getBytesFunc, seekFunc, sizeFunc);
 		status = gdip_load_ico_image_from_stream_delegate (loader, &result);
 		break;
 	case EMF:
-		loader = dstream_input_new (getBytesFunc, seekFunc);
+		loader = dstream_input_new (getBytesFunc, seekFunc, sizeFunc);
 		status = gdip_load_emf_image_from_stream_delegate (loader, &result);
 		break;
 	case WMF:
-		loader = dstream_input_new (getBytesFunc, seekFunc);
+		loader = dstream_input_new (getBytesFunc, seekFunc, sizeFunc);
 		status = gdip_load_wmf_image_from_stream_delegate (loader, &result);
 		break;
 	default:
@@ -2309,10 +2604,112 @@ GdipLoadImageFromDelegate_linux (GetHeaderDelegate getHeaderFunc,
 		/* If the codec didn't set the active bitmap we will */
 		gdip_bitmap_setactive(result, NULL, 0);
 	}
+
+	if (status == Ok && region && format != JPEG)
+		status = gdip_crop_loaded_image (region, image);
 	
 	return status;
 }
 
+GpStatus WINGDIPAPI
+GdipLoadImageFromDelegate_linux (GetHeaderDelegate getHeaderFunc,
+								 GetBytesDelegate getBytesFunc,
+								 PutBytesDelegate putBytesFunc,
+								 SeekDelegate seekFunc,
+								 CloseDelegate closeFunc,
+								 SizeDelegate sizeFunc,
+								 GpImage **image)
+{
+	return gdip_load_image_from_delegate (getHeaderFunc, getBytesFunc, putBytesFunc, seekFunc, closeFunc, sizeFunc, 0, 0, NULL, image);
+}
+
+/* libgdiplus extension: GdipLoadImageFromDelegate_linux, scaled down like GdipLoadImageFromFileScaled_linux does */
+GpStatus WINGDIPAPI
+GdipLoadImageFromDelegateScaled_linux (GetHeaderDelegate getHeaderFunc, GetBytesDelegate getBytesFunc, PutBytesDelegate putBytesFunc,
+	SeekDelegate seekFunc, CloseDelegate closeFunc, SizeDelegate sizeFunc, UINT width, UINT height, GpImage **image)
+{
+	if (!width || !height)
+		return InvalidParameter;
+
+	return gdip_load_image_from_delegate (getHeaderFunc, getBytesFunc, putBytesFunc, seekFunc, closeFunc, sizeFunc, width, height, NULL, image);
+}
+
+/* libgdiplus extension: GdipLoadImageFromDelegate_linux, for the part of the image in region like GdipLoadImageFromFileRegion_linux */
+GpStatus WINGDIPAPI
+GdipLoadImageFromDelegateRegion_linux (GetHeaderDelegate getHeaderFunc, GetBytesDelegate getBytesFunc, PutBytesDelegate putBytesFunc,
+	SeekDelegate seekFunc, CloseDelegate closeFunc, SizeDelegate sizeFunc, GDIPCONST GpRect *region, GpImage **image)
+{
+	if (!region || region->X < 0 || region->Y < 0 || region->Width <= 0 || region->Height <= 0)
+		return InvalidParameter;
+
+	return gdip_load_image_from_delegate (getHeaderFunc, getBytesFunc, putBytesFunc, seekFunc, closeFunc, sizeFunc, 0, 0, region, image);
+}
+
+/* libgdiplus extension: GdipGetImageInfoFromFile_linux, for the image GdipLoadImageFromDelegate_linux would load */
+GpStatus WINGDIPAPI
+GdipGetImageInfoFromDelegate_linux (GetHeaderDelegate getHeaderFunc, GetBytesDelegate getBytesFunc, PutBytesDelegate putBytesFunc,
+	SeekDelegate seekFunc, CloseDelegate closeFunc, SizeDelegate sizeFunc, GpImageInfo *info)
+{
+	GpImage *image = NULL;
+	GpStatus status = 0;
+	ImageFormat format, public_format;
+	dstream_t *loader = NULL;
+
+	BYTE format_peek[MAX_CODEC_SIG_LENGTH];
+	int format_peek_sz;
+
+	if (!info)
+		return InvalidParameter;
+
+	format_peek_sz = getHeaderFunc (format_peek, MAX_CODEC_SIG_LENGTH);
+	format = get_image_format ((char *)format_peek, format_peek_sz, &public_format);
+
+	switch (format) {
+	case JPEG:
+		loader = dstream_input_new (getBytesFunc, seekFunc, NULL);
+		status = gdip_read_jpeg_image_info_from_stream_delegate (loader, info);
+		break;
+	case PNG:
+		status = gdip_read_png_image_info_from_stream_delegate (getBytesFunc, seekFunc, info);
+		break;
+	case BMP:
+		loader = dstream_input_new (getBytesFunc, seekFunc, NULL);
+		status = gdip_read_bmp_image_info_from_stream_delegate (loader, info);
+		break;
+	case TIF:
+		status = gdip_read_tiff_image_info_from_stream_delegate (getBytesFunc, putBytesFunc,
+			seekFunc, closeFunc, sizeFunc, info);
+		break;
+	case GIF:
+		status = gdip_read_gif_image_info_from_stream_delegate (getBytesFunc, seekFunc, info);
+		break;
+	case ICON:
+		loader = dstream_input_new (getBytesFunc, seekFunc, NULL);
+		status = gdip_load_ico_image_from_stream_delegate (loader, &image);
+		break;
+	case EMF:
+		loader = dstream_input_new (getBytesFunc, seekFunc, NULL);
+		status = gdip_load_emf_image_from_stream_delegate (loader, &image);
+		break;
+	case WMF:
+		loader = dstream_input_new (getBytesFunc, seekFunc, NULL);
+		status = gdip_load_wmf_image_from_stream_delegate (loader, &image);
+		break;
+	default:
+		/* NotImplemented looks better but this matchs MS behavior */
+		status = InvalidParameter;
+		break;
+	}
+
+	if (image && (status == Ok))
+		status = gdip_get_loaded_image_info (image, info);
+	if (status == Ok)
+		gdip_get_image_format_guid (public_format, &info->RawFormat);
+
+	dstream_free (loader);
+	return status;
+}
+
 GpStatus WINGDIPAPI
 GdipSaveImageToDelegate_linux (GpImage *image, GetBytesDelegate getBytesFunc, PutBytesDelegate putBytesFunc,
 	SeekDelegate seekFunc, CloseDelegate closeFunc, SizeDelegate sizeFunc, GDIPCONST CLSID *encoderCLSID,
@@ -2499,6 +2896,8 @@ GdipGetAllPropertyItems (GpImage *image, UINT totalBufferSize, UINT numPropertie
 	if (image->type != ImageTypeBitmap)
 		return NotImplemented;
 
+	gdip_bitmap_load_properties (image, image->active_bitmap);
+
 	if (numProperties != image->active_bitmap->property_count) {
 		return InvalidParameter;
 	}
@@ -2613,6 +3012,8 @@ GdipGetImageThumbnail (GpImage *image, UINT thumbWidth, UINT thumbHeight, GpImag
 	GpStatus status;
 	PixelFormat format;
 	GpImage *result;
+	GpImage *source = image;
+	GpImage *scaled = NULL;
 	GpGraphics *graphics;
 
 	if (!image || !thumbImage)
@@ -2644,7 +3045,15 @@ GdipGetImageThumbnail (GpImage *image, UINT thumbWidth, UINT thumbHeight, GpImag
 		return status;
 	}
 
-	status = GdipDrawImageRectI (graphics, image, 0, 0, thumbWidth, thumbHeight);
+	/* an (unmodified) JPEG decoded again at a fraction of its size is a lot cheaper to scale than all of its pixels */
+	if (image->type == ImageTypeBitmap && thumbWidth * 2 <= image->active_bitmap->width && thumbHeight * 2 <= image->active_bitmap->height &&
+		gdip_bitmap_decode_scaled (image, thumbWidth, thumbHeight, &scaled) == Ok) {
+		source = scaled;
+	}
+
+	status = GdipDrawImageRectI (graphics, source, 0, 0, thumbWidth, thumbHeight);
+	if (scaled)
+		GdipDisposeImage (scaled);
 	if (status != Ok) {
 		GdipDisposeImage (result);
 		GdipDeleteGraphics (graphics);
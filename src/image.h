@@ -43,9 +43,31 @@ typedef int (*PutBytesDelegate) (BYTE*, int);
 typedef void (*CloseDelegate) ();
 typedef long (*SizeDelegate) ();
 
+/* libgdiplus extension: what GdipGetImageInfoFromFile_linux reads from the header of an image */
+typedef struct {
+	GUID		RawFormat;	/* as GdipGetImageRawFormat */
+	UINT		Width;
+	UINT		Height;
+	PixelFormat	PixelFormat;	/* of the first frame, once loaded */
+	UINT		FrameCount;	/* pages of TIFF images, frames of GIF images, otherwise 1 */
+	REAL		DpiX;
+	REAL		DpiY;
+} GpImageInfo;
+
 GpStatus WINGDIPAPI GdipLoadImageFromDelegate_linux (GetHeaderDelegate getHeaderFunc, GetBytesDelegate getBytesFunc,
 	PutBytesDelegate putBytesFunc, SeekDelegate seekFunc, CloseDelegate closeFunc, SizeDelegate sizeFunc, GpImage **image);
 
+GpStatus WINGDIPAPI GdipLoadImageFromDelegateScaled_linux (GetHeaderDelegate getHeaderFunc, GetBytesDelegate getBytesFunc,
+	PutBytesDelegate putBytesFunc, SeekDelegate seekFunc, CloseDelegate closeFunc, SizeDelegate sizeFunc, UINT width, UINT height,
+	GpImage **image);
+
+GpStatus WINGDIPAPI GdipLoadImageFromDelegateRegion_linux (GetHeaderDelegate getHeaderFunc, GetBytesDelegate getBytesFunc,
+	PutBytesDelegate putBytesFunc, SeekDelegate seekFunc, CloseDelegate closeFunc, SizeDelegate sizeFunc, GDIPCONST GpRect *region,
+	GpImage **image);
+
+GpStatus WINGDIPAPI GdipGetImageInfoFromDelegate_linux (GetHeaderDelegate getHeaderFunc, GetBytesDelegate getBytesFunc,
+	PutBytesDelegate putBytesFunc, SeekDelegate seekFunc, CloseDelegate closeFunc, SizeDelegate sizeFunc, GpImageInfo *info);
+
 GpStatus WINGDIPAPI GdipSaveImageToDelegate_linux (GpImage *image, GetBytesDelegate getBytesFunc, PutBytesDelegate putBytesFunc,
 	SeekDelegate seekFunc, CloseDelegate closeFunc, SizeDelegate sizeFunc, GDIPCONST CLSID *encoderCLSID,
 	GDIPCONST EncoderParameters *params);
@@ -57,6 +79,15 @@ GpStatus WINGDIPAPI GdipLoadImageFromFile (GDIPCONST WCHAR *file, GpImage **imag
 GpStatus WINGDIPAPI GdipLoadImageFromStreamICM (void /*IStream*/ *stream, GpImage **image);
 GpStatus WINGDIPAPI GdipLoadImageFromFileICM (GDIPCONST WCHAR* filename, GpImage **image);
 
+/* libgdiplus extension: may decode a smaller version of the image, that is still at least width x height */
+GpStatus WINGDIPAPI GdipLoadImageFromFileScaled_linux (GDIPCONST WCHAR *file, UINT width, UINT height, GpImage **image);
+
+/* libgdiplus extension: loads only the part of the image in region, without decoding the rest of it if possible */
+GpStatus WINGDIPAPI GdipLoadImageFromFileRegion_linux (GDIPCONST WCHAR *file, GDIPCONST GpRect *region, GpImage **image);
+
+/* libgdiplus extension: reads what the image would report once loaded, without decoding (or allocating) its pixels */
+GpStatus WINGDIPAPI GdipGetImageInfoFromFile_linux (GDIPCONST WCHAR *file, GpImageInfo *info);
+
 GpStatus WINGDIPAPI GdipSaveImageToFile (GpImage *image, GDIPCONST WCHAR *file, GDIPCONST CLSID *clsidEncoder, GDIPCONST EncoderParameters *encoderParams); 
 GpStatus WINGDIPAPI GdipSaveImageToStream (GpImage *image, void /*IStream*/ *stream, GDIPCONST CLSID *clsidEncoder, GDIPCONST EncoderParameters *encoderParams);
 GpStatus WINGDIPAPI GdipSaveAdd (GpImage *image, GDIPCONST EncoderParameters* encoderParams);
@@ -79,6 +110,10 @@ GpStatus WINGDIPAPI GdipImageGetFrameDimensionsCount (GpImage *image, UINT *coun
 GpStatus WINGDIPAPI GdipImageGetFrameDimensionsList (GpImage *image, GUID *dimensionGUID, UINT count);
 GpStatus WINGDIPAPI GdipImageGetFrameCount (GpImage *image, GDIPCONST GUID *dimensionGUID, UINT* count); 
 GpStatus WINGDIPAPI GdipImageSelectActiveFrame (GpImage *image, GDIPCONST GUID *dimensionGUID, UINT frameIndex);
+
+/* libgdiplus extension: drop the pixels of frames decoded on demand once another frame is selected */
+GpStatus WINGDIPAPI GdipImageSetFrameEviction_linux (GpImage *image, BOOL evict);
+
 GpStatus WINGDIPAPI GdipImageRotateFlip (GpImage *image, RotateFlipType rfType);
 GpStatus WINGDIPAPI GdipGetImageGraphicsContext (GpImage *image, GpGraphics **graphics);
 GpStatus WINGDIPAPI GdipGetImagePalette (GpImage *image, ColorPalette *palette, INT size);
@@ -53,6 +53,8 @@ typedef struct {
 	ImageAttributeFlags flags;
 	ColorMap *colormap;
 	int colormap_elem;
+	int *colormap_index;		/* open addressing hash of oldColor -> colormap entry, -1 if empty */
+	unsigned int colormap_index_mask;
 	float gamma_correction;
 	ARGB key_colorlow;
 	ARGB key_colorhigh;
@@ -60,6 +62,8 @@ typedef struct {
 	ColorMatrix *graymatrix;
 	ColorMatrixFlags colormatrix_flags;
 	float threshold; // Not implemented.
+	BYTE gamma_table[256];		/* channel lookup table, built by GdipSetImageAttributesGamma */
+	BYTE threshold_table[256];	/* channel lookup table, built by GdipSetImageAttributesThreshold */
 	ColorChannelFlags outputchannel_flags; // Not implemented.
 	char *colorprofile_filename; // Not implemented.
 } GpImageAttribute;
@@ -73,6 +77,9 @@ typedef struct _ImageAttributes {
 	/* Globals */
 	WrapMode wrapmode;
 	ARGB color;
+	/* Internal fields */
+	guint64 generation;		/* bumped by every setter, used to key the processed bitmap cache */
+	BOOL processed_cached;		/* the processed bitmap cache may hold entries using these attributes */
 } ImageAttributes;
 
 #include "imageattributes.h"
@@ -28,12 +28,18 @@
 #include "bitmap-private.h"
 #include "general-private.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 static void
 gdip_init_image_attribute (GpImageAttribute* attr)
 {
 	attr->flags = 0;
 	attr->colormap = NULL;
 	attr->colormap_elem = 0;
+	attr->colormap_index = NULL;
+	attr->colormap_index_mask = 0;
 	attr->gamma_correction = 0.0f;
 	attr->key_colorlow = 0;
 	attr->key_colorhigh = 0;
@@ -53,6 +59,11 @@ gdip_dispose_image_attribute (GpImageAttribute* attr)
 		attr->colormap = NULL;
 	}
 
+	if (attr->colormap_index) {
+		GdipFree (attr->colormap_index);
+		attr->colormap_index = NULL;
+	}
+
 	if (attr->colormatrix) {
 		GdipFree (attr->colormatrix);
 		attr->colormatrix = NULL;
@@ -72,6 +83,7 @@ gdip_dispose_image_attribute (GpImageAttribute* attr)
 static GpStatus
 gdip_clone_image_attribute(const GpImageAttribute* attr, GpImageAttribute* clone)
 {
+	/* the embedded tables were already copied along with the rest of GpImageAttributes */
 	if (attr->colormap && attr->colormap_elem > 0) {
 		clone->colormap = GdipAlloc(sizeof(ColorMap) * attr->colormap_elem);
 
@@ -83,6 +95,18 @@ gdip_clone_image_attribute(const GpImageAttribute* attr, GpImageAttribute* clone
 		memcpy(clone->colormap, attr->colormap, sizeof(ColorMap) * attr->colormap_elem);
 	}
 
+	if (attr->colormap_index) {
+		size_t size = sizeof (int) * (attr->colormap_index_mask + 1);
+
+		clone->colormap_index = GdipAlloc (size);
+		if (!clone->colormap_index) {
+			gdip_dispose_image_attribute (clone);
+			return OutOfMemory;
+		}
+
+		memcpy (clone->colormap_index, attr->colormap_index, size);
+	}
+
 	if (attr->colormatrix) {
 		clone->colormatrix = GdipAlloc(sizeof(ColorMatrix));
 
@@ -116,6 +140,79 @@ gdip_clone_image_attribute(const GpImageAttribute* attr, GpImageAttribute* clone
 	return Ok;
 }
 
+static inline unsigned int
+gdip_colormap_hash (ARGB color)
+{
+	/* Fibonacci hashing, the high bits are the best mixed */
+	guint32 hash = color * 2654435761u;
+	return hash ^ (hash >> 16);
+}
+
+/*
+ * Index the remap table by oldColor. When a color appears more than once the first entry wins,
+ * like the linear search used to do.
+ */
+static int *
+gdip_build_colormap_index (const ColorMap *map, int count, unsigned int *mask)
+{
+	unsigned int size = 16;
+	int *index;
+
+	while (size < (unsigned int) count * 2)
+		size <<= 1;
+
+	index = GdipAlloc (sizeof (int) * size);
+	if (!index)
+		return NULL;
+
+	memset (index, 0xff, sizeof (int) * size);
+
+	for (int i = 0; i < count; i++) {
+		unsigned int slot = gdip_colormap_hash (map[i].oldColor.Argb) & (size - 1);
+
+		while (index[slot] >= 0 && map[index[slot]].oldColor.Argb != map[i].oldColor.Argb)
+			slot = (slot + 1) & (size - 1);
+
+		if (index[slot] < 0)
+			index[slot] = i;
+	}
+
+	*mask = size - 1;
+	return index;
+}
+
+static inline const ColorMap *
+gdip_colormap_find (const GpImageAttribute *attr, ARGB color)
+{
+	unsigned int slot = gdip_colormap_hash (color) & attr->colormap_index_mask;
+	int i;
+
+	while ((i = attr->colormap_index[slot]) >= 0) {
+		if (attr->colormap[i].oldColor.Argb == color)
+			return &attr->colormap[i];
+
+		slot = (slot + 1) & attr->colormap_index_mask;
+	}
+
+	return NULL;
+}
+
+static void
+gdip_build_gamma_table (GpImageAttribute *attr, float gamma)
+{
+	for (int i = 0; i < 256; i++)
+		attr->gamma_table[i] = (int) roundf (powf (i / 255.0, gamma) * 255.0);
+}
+
+static void
+gdip_build_threshold_table (GpImageAttribute *attr, float threshold)
+{
+	BYTE cutoff = (BYTE) round (threshold * 255.0);
+
+	for (int i = 0; i < 256; i++)
+		attr->threshold_table[i] = i > cutoff ? 255 : 0;
+}
+
 static GpImageAttribute*
 gdip_get_image_attribute (GpImageAttributes* attr, ColorAdjustType type)
 {
@@ -135,15 +232,333 @@ gdip_get_image_attribute (GpImageAttributes* attr, ColorAdjustType type)
 	}
 }
 
+/*
+ * The image attributes are applied by a small pipeline: the enabled stages are selected once per
+ * call and then run, in the same order as GDI+, over each scanline of the 32bpp destination.
+ * Every stage reproduces the pixel semantics of GdipBitmapGetPixel/GdipBitmapSetPixel for the
+ * destination format, so the result is identical to processing the whole image one stage at a time.
+ */
+typedef struct _ImageAttributesPipeline ImageAttributesPipeline;
+typedef void (*ImageAttributesStage) (const ImageAttributesPipeline *pipeline, ARGB *scan, int width);
+
+#define IMAGE_ATTRIBUTES_MAX_STAGES	6
+
+struct _ImageAttributesPipeline {
+	PixelFormat		format;
+	int			count;
+	ImageAttributesStage	stages[IMAGE_ATTRIBUTES_MAX_STAGES];
+	const GpImageAttribute	*colormap;
+	const GpImageAttribute	*gamma;
+	const GpImageAttribute	*threshold;
+	const GpImageAttribute	*cmatrix;
+	BYTE			cutoff;
+	ColorChannelFlags	channel;
+	ARGB			key_low;
+	ARGB			key_high;
+	ARGB			key_pixel;
+	BOOL			premultiplied;
+};
+
+/* same as GdipBitmapGetPixel for a pixel in a 32bpp scanline */
+static inline ARGB
+gdip_attributes_get_pixel (PixelFormat format, ARGB pixel)
+{
+	BYTE r, g, b, a;
+
+	switch (format) {
+	case PixelFormat32bppPARGB:
+		get_pixel_bgra (pixel, b, g, r, a);
+		if (a == 0xff)
+			return pixel;
+
+		b = pre_multiplied_table_reverse [b][a];
+		g = pre_multiplied_table_reverse [g][a];
+		r = pre_multiplied_table_reverse [r][a];
+		return MAKE_ARGB_ARGB (a, r, g, b);
+	case PixelFormat24bppRGB:
+	case PixelFormat32bppRGB:
+		return pixel | 0xFF000000;
+	default:
+		return pixel;
+	}
+}
+
+/* same as GdipBitmapSetPixel for a pixel in a 32bpp scanline */
+static inline ARGB
+gdip_attributes_set_pixel (PixelFormat format, ARGB color)
+{
+	BYTE r, g, b, a;
+
+	switch (format) {
+	case PixelFormat32bppPARGB:
+		get_pixel_bgra (color, b, g, r, a);
+		if (a == 0xff)
+			return color;
+
+		b = pre_multiplied_table [b][a];
+		g = pre_multiplied_table [g][a];
+		r = pre_multiplied_table [r][a];
+		return MAKE_ARGB_ARGB (a, r, g, b);
+	case PixelFormat24bppRGB:
+	case PixelFormat32bppRGB:
+		return color | 0xFF000000;
+	default:
+		return color;
+	}
+}
+
+static void
+gdip_attributes_stage_colormap (const ImageAttributesPipeline *pipeline, ARGB *scan, int width)
+{
+	const GpImageAttribute *colormap = pipeline->colormap;
+	PixelFormat format = pipeline->format;
+	const ColorMap *entry;
+
+	if (format == PixelFormat32bppARGB) {
+		/* exact match on the stored pixels, remembering the last hit since colors come in runs */
+		ARGB last_color = 0;
+		ARGB last_pixel = 0;
+		BOOL last_valid = FALSE;
+
+		for (int x = 0; x < width; x++) {
+			if (last_valid && scan[x] == last_color) {
+				scan[x] = last_pixel;
+				continue;
+			}
+
+			entry = gdip_colormap_find (colormap, scan[x]);
+			if (entry) {
+				last_color = scan[x];
+				last_pixel = entry->newColor.Argb;
+				last_valid = TRUE;
+				scan[x] = last_pixel;
+			}
+		}
+		return;
+	}
+
+	for (int x = 0; x < width; x++) {
+		entry = gdip_colormap_find (colormap, gdip_attributes_get_pixel (format, scan[x]));
+		if (entry)
+			scan[x] = gdip_attributes_set_pixel (format, entry->newColor.Argb);
+	}
+}
+
+static void
+gdip_attributes_stage_gamma (const ImageAttributesPipeline *pipeline, ARGB *scan, int width)
+{
+	const BYTE *table = pipeline->gamma->gamma_table;
+
+	for (int x = 0; x < width; x++) {
+		BYTE r, g, b, a;
+		ARGB color = gdip_attributes_get_pixel (pipeline->format, scan[x]);
+
+		get_pixel_bgra (color, b, g, r, a);
+
+		r = table[r];
+		g = table[g];
+		b = table[b];
+
+		scan[x] = gdip_attributes_set_pixel (pipeline->format, MAKE_ARGB_ARGB (a, r, g, b));
+	}
+}
+
+static void
+gdip_attributes_stage_threshold (const ImageAttributesPipeline *pipeline, ARGB *scan, int width)
+{
+	const BYTE *table = pipeline->threshold->threshold_table;
+	BYTE cutoff = pipeline->cutoff;
+	int x = 0;
+
+#if defined(__SSE2__)
+	/* Without premultiplication the stage is a plain per-byte compare, 4 pixels at a time */
+	if (pipeline->format != PixelFormat32bppPARGB) {
+		const __m128i bias = _mm_set1_epi8 ((char) 0x80);
+		const __m128i limit = _mm_set1_epi8 ((char) (cutoff ^ 0x80));
+		const __m128i alpha = _mm_set1_epi32 ((int) ALPHA_MASK);
+		const __m128i force = (pipeline->format == PixelFormat32bppARGB) ? _mm_setzero_si128 () : alpha;
+
+		for (; x + 4 <= width; x += 4) {
+			__m128i pixels = _mm_loadu_si128 ((const __m128i *) (scan + x));
+			__m128i above = _mm_cmpgt_epi8 (_mm_xor_si128 (pixels, bias), limit);
+
+			pixels = _mm_or_si128 (_mm_and_si128 (pixels, alpha), _mm_andnot_si128 (alpha, above));
+			_mm_storeu_si128 ((__m128i *) (scan + x), _mm_or_si128 (pixels, force));
+		}
+	}
+#endif
+
+	for (; x < width; x++) {
+		BYTE r, g, b, a;
+		ARGB color = gdip_attributes_get_pixel (pipeline->format, scan[x]);
+
+		get_pixel_bgra (color, b, g, r, a);
+
+		r = table[r];
+		g = table[g];
+		b = table[b];
+
+		scan[x] = gdip_attributes_set_pixel (pipeline->format, MAKE_ARGB_ARGB (a, r, g, b));
+	}
+}
+
+static void
+gdip_attributes_stage_output_channel (const ImageAttributesPipeline *pipeline, ARGB *scan, int width)
+{
+	for (int x = 0; x < width; x++) {
+		BYTE r, g, b, a, C, M, Y, K;
+		ARGB color = gdip_attributes_get_pixel (pipeline->format, scan[x]);
+
+		get_pixel_bgra (color, b, g, r, a);
+
+		C = 255 - r;
+		M = 255 - g;
+		Y = 255 - b;
+		K = min (min (C, M), Y);
+
+		/* correct complementary color lever based on k */
+		C -= K;
+		M -= K;
+		Y -= K;
+
+		switch (pipeline->channel) {
+		case ColorChannelFlagsC:
+			r = g = b = C;
+			break;
+		case ColorChannelFlagsM:
+			r = g = b = M;
+			break;
+		case ColorChannelFlagsY:
+			r = g = b = Y;
+			break;
+		default:
+			r = g = b = K;
+			break;
+		}
+
+		scan[x] = gdip_attributes_set_pixel (pipeline->format, MAKE_ARGB_ARGB (a, r, g, b));
+	}
+}
+
+/* FIXME: This will convert pixels which have a color in [key_colorlow, key_colorhey] to transparent pixels.
+          However, GdipDrawImageRectRect in image.c uses cairo_fill to draw these transparent pixels onto
+          the target surface. This method will not copy the transparency value; rather, it will ignore
+          transparent values. */
+static void
+gdip_attributes_stage_color_keys (const ImageAttributesPipeline *pipeline, ARGB *scan, int width)
+{
+	for (int x = 0; x < width; x++) {
+		ARGB color = gdip_attributes_get_pixel (pipeline->format, scan[x]) & ~ALPHA_MASK;
+
+		if (color >= pipeline->key_low && color <= pipeline->key_high)
+			scan[x] = pipeline->key_pixel;
+	}
+}
+
+/*
+ * Computes the four channel sums of the color matrix. The SSE2 version evaluates the four columns
+ * in parallel, with the same operation order (and thus the same float rounding) as the scalar one.
+ */
+static inline void
+gdip_attributes_color_matrix_multiply (const ColorMatrix *cm, BYTE r, BYTE g, BYTE b, BYTE a, int result[4])
+{
+#if defined(__SSE2__) && defined(FLT_EVAL_METHOD) && (FLT_EVAL_METHOD == 0)
+	__m128 sum;
+
+	sum = _mm_mul_ps (_mm_set1_ps ((float) r), _mm_loadu_ps (cm->m[0]));
+	sum = _mm_add_ps (sum, _mm_mul_ps (_mm_set1_ps ((float) g), _mm_loadu_ps (cm->m[1])));
+	sum = _mm_add_ps (sum, _mm_mul_ps (_mm_set1_ps ((float) b), _mm_loadu_ps (cm->m[2])));
+	sum = _mm_add_ps (sum, _mm_mul_ps (_mm_set1_ps ((float) a), _mm_loadu_ps (cm->m[3])));
+	sum = _mm_add_ps (sum, _mm_mul_ps (_mm_set1_ps (255.0f), _mm_loadu_ps (cm->m[4])));
+	_mm_storeu_si128 ((__m128i *) result, _mm_cvttps_epi32 (sum));
+#else
+	for (int i = 0; i < 4; i++)
+		result[i] = (r * cm->m[0][i] + g * cm->m[1][i] + b * cm->m[2][i] + a * cm->m[3][i] + (255 * cm->m[4][i]));
+#endif
+}
+
+static void
+gdip_attributes_stage_color_matrix (const ImageAttributesPipeline *pipeline, ARGB *scan, int width)
+{
+	const GpImageAttribute *cmatrix = pipeline->cmatrix;
+	ColorMatrixFlags flags = cmatrix->colormatrix_flags;
+	BOOL premultiplied = pipeline->premultiplied;
+
+	for (int x = 0; x < width; x++) {
+		const ColorMatrix *cm;
+		BYTE r, g, b, a;
+		int channels[4];
+		int r_new, g_new, b_new, a_new;
+
+		get_pixel_bgra (scan[x], b, g, r, a);
+
+		/* by default the matrix applies to all colors, including grays */
+		if ((flags != ColorMatrixFlagsDefault) && (b == g) && (b == r)) {
+			/* does not apply */
+			if (flags == ColorMatrixFlagsSkipGrays)
+				continue;
+
+			/* ColorMatrixFlagsAltGray */
+			cm = cmatrix->graymatrix;
+		} else {
+			cm = cmatrix->colormatrix;
+		}
+
+		gdip_attributes_color_matrix_multiply (cm, r, g, b, a, channels);
+
+		a_new = channels[3];
+		if (a_new == 0 && premultiplied) {
+			/* 100% transparency, don't waste time computing other values (pre-mul will always be 0) */
+			scan[x] = 0;
+			continue;
+		}
+
+		r_new = channels[0];
+		g_new = channels[1];
+		b_new = channels[2];
+
+		if (premultiplied && a != (BYTE) a_new && a < 0xff && a != 0) {
+			/* reverse previous pre-multiplication if necessary */
+			r_new = r_new * 255 / a;
+			g_new = g_new * 255 / a;
+			b_new = b_new * 255 / a;
+		}
+
+		r = (r_new > 0xff) ? 0xff : (BYTE) r_new;
+		g = (g_new > 0xff) ? 0xff : (BYTE) g_new;
+		b = (b_new > 0xff) ? 0xff : (BYTE) b_new;
+
+		/* remember that Cairo use pre-multiplied alpha, e.g. 50% red == 0x80800000 not 0x80ff0000 */
+		if (premultiplied && a != (BYTE) a_new && a_new < 0xff) {
+			/* apply new pre-multiplication */
+			a = (BYTE) a_new;
+			r = pre_multiplied_table [r][a];
+			g = pre_multiplied_table [g][a];
+			b = pre_multiplied_table [b][a];
+		} else {
+			a = (BYTE) a_new;
+		}
+
+		scan[x] = MAKE_ARGB_ARGB (a, r, g, b);
+	}
+}
+
+static BOOL
+gdip_attributes_stage_enabled (const GpImageAttribute *attr, ImageAttributeFlags flag)
+{
+	return !(attr->flags & ImageAttributeFlagsNoOp) && (attr->flags & flag);
+}
+
 GpStatus
 gdip_process_bitmap_attributes (GpBitmap *bitmap, GpImageAttributes* attr, GpBitmap **dest_bitmap)
 {
 	GpStatus status;
 	GpImageAttribute *imgattr, *def;
 	GpImageAttribute *colormap, *gamma, *trans, *cmatrix, *treshold, *cmyk;
-	GpBitmap *bmpdest = NULL;
-	ARGB color;
-	BYTE *color_p = (BYTE*) &color;
+	GpBitmap *bmpdest;
+	ActiveBitmapData *data;
+	ImageAttributesPipeline pipeline;
+	BYTE *scan0;
 
 	*dest_bitmap = NULL;
 	if (!bitmap || !attr)
@@ -151,49 +566,60 @@ gdip_process_bitmap_attributes (GpBitmap *bitmap, GpImageAttributes* attr, GpBit
 
 	imgattr = gdip_get_image_attribute (attr, ColorAdjustTypeBitmap);
 	def = gdip_get_image_attribute (attr, ColorAdjustTypeDefault);
-	if (imgattr->flags & ImageAttributeFlagsColorRemapTableEnabled) {
-		colormap = imgattr;
-	} else {
-		colormap = def;
+	colormap = (imgattr->flags & ImageAttributeFlagsColorRemapTableEnabled) ? imgattr : def;
+	gamma = (imgattr->flags & ImageAttributeFlagsGammaEnabled) ? imgattr : def;
+	treshold = (imgattr->flags & ImageAttributeFlagsThresholdEnabled) ? imgattr : def;
+	trans = (imgattr->flags & ImageAttributeFlagsColorKeysEnabled) ? imgattr : def;
+	cmatrix = ((imgattr->flags & ImageAttributeFlagsColorMatrixEnabled) && imgattr->colormatrix) ? imgattr : def;
+	cmyk = (imgattr->flags & ImageAttributeFlagsOutputChannelEnabled) ? imgattr : def;
+
+	/* Select the stages, in the order GDI+ applies them */
+	memset (&pipeline, 0, sizeof (ImageAttributesPipeline));
+
+	if (gdip_attributes_stage_enabled (colormap, ImageAttributeFlagsColorRemapTableEnabled)) {
+		pipeline.colormap = colormap;
+		pipeline.stages[pipeline.count++] = gdip_attributes_stage_colormap;
 	}
 
-	if (imgattr->flags & ImageAttributeFlagsGammaEnabled) {
-		gamma = imgattr;
-	} else {
-		gamma = def;
+	if (gdip_attributes_stage_enabled (gamma, ImageAttributeFlagsGammaEnabled)) {
+		pipeline.gamma = gamma;
+		pipeline.stages[pipeline.count++] = gdip_attributes_stage_gamma;
 	}
 
-	if (imgattr->flags & ImageAttributeFlagsThresholdEnabled) {
-		treshold = imgattr;
-	} else {
-		treshold = def;
+	if (gdip_attributes_stage_enabled (treshold, ImageAttributeFlagsThresholdEnabled)) {
+		pipeline.threshold = treshold;
+		pipeline.cutoff = (BYTE) round (treshold->threshold * 255.0);
+		pipeline.stages[pipeline.count++] = gdip_attributes_stage_threshold;
 	}
 
-	if (imgattr->flags & ImageAttributeFlagsColorKeysEnabled) {
-		trans = imgattr;
-	} else {
-		trans = def;
-	}
+	if (gdip_attributes_stage_enabled (cmyk, ImageAttributeFlagsOutputChannelEnabled)) {
+		if (cmyk->outputchannel_flags >= ColorChannelFlagsLast)
+			return InvalidParameter;
 
-	if (imgattr->flags & ImageAttributeFlagsColorMatrixEnabled && imgattr->colormatrix) {
-		cmatrix = imgattr;
-	} else {
-		cmatrix = def;
+		pipeline.channel = cmyk->outputchannel_flags;
+		pipeline.stages[pipeline.count++] = gdip_attributes_stage_output_channel;
 	}
 
-	if (imgattr->flags & ImageAttributeFlagsOutputChannelEnabled) {
-		cmyk = imgattr;
+	if (gdip_attributes_stage_enabled (trans, ImageAttributeFlagsColorKeysEnabled)) {
+		pipeline.key_low = trans->key_colorlow & ~ALPHA_MASK;
+		pipeline.key_high = trans->key_colorhigh & ~ALPHA_MASK;
+		pipeline.stages[pipeline.count++] = gdip_attributes_stage_color_keys;
 	}
-	else {
-		cmyk = def;
+
+	if (gdip_attributes_stage_enabled (cmatrix, ImageAttributeFlagsColorMatrixEnabled) && cmatrix->colormatrix) {
+		pipeline.cmatrix = cmatrix;
+		pipeline.stages[pipeline.count++] = gdip_attributes_stage_color_matrix;
 	}
 
-	if ((!(colormap->flags & ImageAttributeFlagsNoOp) && (colormap->flags & ImageAttributeFlagsColorRemapTableEnabled))
-		|| (!(gamma->flags & ImageAttributeFlagsNoOp) && (gamma->flags & ImageAttributeFlagsGammaEnabled))
-		|| (!(trans->flags & ImageAttributeFlagsNoOp) && (trans->flags & ImageAttributeFlagsColorKeysEnabled))
-		|| (!(cmatrix->flags & ImageAttributeFlagsNoOp) && (cmatrix->flags & ImageAttributeFlagsColorMatrixEnabled) && cmatrix->colormatrix != NULL)
-		|| (!(treshold->flags & ImageAttributeFlagsNoOp) && (treshold->flags & ImageAttributeFlagsThresholdEnabled))
-		|| (!(cmyk->flags & ImageAttributeFlagsNoOp) && (cmyk->flags & ImageAttributeFlagsOutputChannelEnabled))) {
+	if (pipeline.count == 0)
+		return Ok;
+
+	if (gdip_is_an_indexed_pixelformat (bitmap->active_bitmap->pixel_format)) {
+		/* the stages work on colors, so process an RGB copy of indexed images */
+		bmpdest = gdip_convert_indexed_to_rgb (bitmap);
+		if (!bmpdest)
+			return OutOfMemory;
+	} else {
 		bmpdest = gdip_bitmap_new_with_frame (NULL, FALSE);
 		if (!bmpdest)
 			return OutOfMemory;
@@ -208,223 +634,326 @@ gdip_process_bitmap_attributes (GpBitmap *bitmap, GpImageAttributes* attr, GpBit
 
 		bmpdest->frames[0].count = 1;
 		gdip_bitmap_setactive (bmpdest, NULL, 0);
-		*dest_bitmap = bmpdest;
+	}
+	*dest_bitmap = bmpdest;
+
+	data = bmpdest->active_bitmap;
+	switch (data->pixel_format) {
+	case PixelFormat24bppRGB:
+	case PixelFormat32bppRGB:
+	case PixelFormat32bppARGB:
+	case PixelFormat32bppPARGB:
+		break;
+	default:
+		/* only the 32bpp (cairo) layouts can be processed; other formats are drawn unmodified */
+		return Ok;
 	}
 
-	/*
-		We use get/set pixel instead of direct buffer manipulation because it's a good way of keeping the pixel
-		logic in a single place
-	*/
-
-	/* Color mapping */
-	if (!(colormap->flags & ImageAttributeFlagsNoOp) && colormap->flags & ImageAttributeFlagsColorRemapTableEnabled) {
-		for (int y = 0; y <bitmap->active_bitmap->height; y++) {
-			for (int x = 0; x <bitmap->active_bitmap->width; x++) {
-				ColorMap* clrmap = colormap->colormap;
+	/* bmpdest may still share its pixels with bitmap */
+	if (gdip_bitmap_ensure_writable (bmpdest) != Ok) {
+		gdip_bitmap_dispose (bmpdest);
+		*dest_bitmap = NULL;
+		return OutOfMemory;
+	}
 
-				GdipBitmapGetPixel (bmpdest, x, y, &color);
+	pipeline.format = data->pixel_format;
+	pipeline.premultiplied = !gdip_bitmap_format_needs_premultiplication (bmpdest);
+	pipeline.key_pixel = gdip_attributes_set_pixel (pipeline.format, 0x00FFFFFF /* transparent white */);
 
-				for (int cnt = 0; cnt < colormap->colormap_elem; cnt++, clrmap++) {
+	scan0 = (BYTE *) data->scan0;
+	for (int y = 0; y < data->height; y++) {
+		ARGB *scan = (ARGB *) (scan0 + y * data->stride);
 
-					if (color == clrmap->oldColor.Argb) {
-						color = clrmap->newColor.Argb;
-						GdipBitmapSetPixel (bmpdest, x, y, color);
-						break;
-					}
-				}
-			}
-		}
+		for (int i = 0; i < pipeline.count; i++)
+			pipeline.stages[i] (&pipeline, scan, data->width);
 	}
 
-	/* Gamma correction */
-	if (!(gamma->flags & ImageAttributeFlagsNoOp) && gamma->flags & ImageAttributeFlagsGammaEnabled) {
-		for (int y = 0; y < bitmap->active_bitmap->height; y++) {
-			for (int x = 0; x < bitmap->active_bitmap->width; x++) {
+	return Ok;
+}
+
+/*
+ * Cache of the bitmaps created by gdip_process_bitmap_attributes, so that drawing the same bitmap with
+ * the same attributes over and over doesn't reprocess every pixel each time. Entries are keyed by the
+ * source bitmap and attributes along with their generations, which are bumped on every change, so stale
+ * entries simply stop matching and age out. The least recently used entries are evicted once the
+ * processed bitmaps take more than processed_cache_budget bytes. Entries handed out to a caller are
+ * reference counted and only freed once released, even if evicted in the meantime.
+ */
+struct _ProcessedBitmapEntry {
+	GpBitmap *source;
+	guint64 source_generation;
+	GpImageAttributes *attributes;
+	guint64 attributes_generation;
+	GpBitmap *processed;
+	size_t size;
+	int users;
+	BOOL cached;
+	ProcessedBitmapEntry *prev;
+	ProcessedBitmapEntry *next;
+};
+
+#define PROCESSED_CACHE_DEFAULT_BUDGET	(32 * 1024 * 1024)
+
+#if GLIB_CHECK_VERSION(2,32,0)
+static GMutex processed_cache_mutex;
+#else
+static GStaticMutex processed_cache_mutex = G_STATIC_MUTEX_INIT;
+#endif
+static GHashTable *processed_cache_hashtable = NULL;
+static ProcessedBitmapEntry *processed_cache_head = NULL;	/* most recently used */
+static ProcessedBitmapEntry *processed_cache_tail = NULL;	/* least recently used */
+static size_t processed_cache_size = 0;
+static size_t processed_cache_budget = PROCESSED_CACHE_DEFAULT_BUDGET;
+static UINT processed_cache_count = 0;
+static UINT processed_cache_hits = 0;
+static UINT processed_cache_misses = 0;
 
-				BYTE r,g,b,a;
+static void
+gdip_processed_cache_lock (void)
+{
+#if GLIB_CHECK_VERSION(2,32,0)
+	g_mutex_lock (&processed_cache_mutex);
+#else
+	g_static_mutex_lock (&processed_cache_mutex);
+#endif
+}
 
-				GdipBitmapGetPixel (bmpdest, x, y, &color);
+static void
+gdip_processed_cache_unlock (void)
+{
+#if GLIB_CHECK_VERSION(2,32,0)
+	g_mutex_unlock (&processed_cache_mutex);
+#else
+	g_static_mutex_unlock (&processed_cache_mutex);
+#endif
+}
 
-				a = (color & 0xff000000) >> 24;
-				r = (color & 0x00ff0000) >> 16;
-				g = (color & 0x0000ff00) >> 8;
-				b = (color & 0x000000ff);
+static guint
+gdip_processed_entry_hash (gconstpointer key)
+{
+	const ProcessedBitmapEntry *entry = (const ProcessedBitmapEntry *) key;
 
-				r = (int) roundf(powf(r / 255.0, gamma->gamma_correction) * 255.0);
-				g = (int) roundf(powf(g / 255.0, gamma->gamma_correction) * 255.0);
-				b = (int) roundf(powf(b / 255.0, gamma->gamma_correction) * 255.0);
+	return g_direct_hash (entry->source) ^ (g_direct_hash (entry->attributes) * 31) ^
+		(guint) entry->source_generation ^ ((guint) entry->attributes_generation << 16);
+}
 
-				color = ((guint32)a << 24) | (r << 16) | (g  << 8) | b;
-				GdipBitmapSetPixel (bmpdest, x, y, color);
-			}
-		}
+static gboolean
+gdip_processed_entry_equal (gconstpointer a, gconstpointer b)
+{
+	const ProcessedBitmapEntry *x = (const ProcessedBitmapEntry *) a;
+	const ProcessedBitmapEntry *y = (const ProcessedBitmapEntry *) b;
 
-	}
+	return x->source == y->source && x->source_generation == y->source_generation &&
+		x->attributes == y->attributes && x->attributes_generation == y->attributes_generation;
+}
 
-	/* Treshold correction */
-	if (!(treshold->flags & ImageAttributeFlagsNoOp) && treshold->flags & ImageAttributeFlagsThresholdEnabled) {
-		BYTE cutoff = (BYTE)round(treshold->threshold * 255.0);
+static void
+gdip_processed_cache_link (ProcessedBitmapEntry *entry)
+{
+	entry->prev = NULL;
+	entry->next = processed_cache_head;
+	if (processed_cache_head)
+		processed_cache_head->prev = entry;
+	processed_cache_head = entry;
+	if (!processed_cache_tail)
+		processed_cache_tail = entry;
+}
 
-		for (int y = 0; y < bitmap->active_bitmap->height; y++) {
-			for (int x = 0; x < bitmap->active_bitmap->width; x++) {
+static void
+gdip_processed_cache_unlink (ProcessedBitmapEntry *entry)
+{
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		processed_cache_head = entry->next;
 
-				BYTE r, g, b, a;
+	if (entry->next)
+		entry->next->prev = entry->prev;
+	else
+		processed_cache_tail = entry->prev;
 
-				GdipBitmapGetPixel(bmpdest, x, y, &color);
+	entry->prev = entry->next = NULL;
+}
 
-				a = (color & 0xff000000) >> 24;
-				r = (color & 0x00ff0000) >> 16;
-				g = (color & 0x0000ff00) >> 8;
-				b = (color & 0x000000ff);
+/* Removes the entry from the cache. Unused entries are queued on the doomed list so that they can be
+ * freed once the lock is released (disposing a bitmap may need to purge the cache). */
+static void
+gdip_processed_cache_remove (ProcessedBitmapEntry *entry, ProcessedBitmapEntry **doomed)
+{
+	g_hash_table_remove (processed_cache_hashtable, entry);
+	gdip_processed_cache_unlink (entry);
+	processed_cache_size -= entry->size;
+	processed_cache_count--;
+	entry->cached = FALSE;
+
+	if (entry->users == 0) {
+		entry->next = *doomed;
+		*doomed = entry;
+	}
+}
 
-				r = r > cutoff ? 255 : 0;
-				g = g > cutoff ? 255 : 0;
-				b = b > cutoff ? 255 : 0;
+static void
+gdip_processed_cache_trim (ProcessedBitmapEntry **doomed)
+{
+	while (processed_cache_tail && processed_cache_size > processed_cache_budget)
+		gdip_processed_cache_remove (processed_cache_tail, doomed);
+}
 
-				color = ((guint32)a << 24) | (r << 16) | (g << 8) | b;
-				GdipBitmapSetPixel(bmpdest, x, y, color);
-			}
-		}
+static void
+gdip_processed_cache_free (ProcessedBitmapEntry *doomed)
+{
+	while (doomed) {
+		ProcessedBitmapEntry *next = doomed->next;
+
+		gdip_bitmap_dispose (doomed->processed);
+		GdipFree (doomed);
+		doomed = next;
 	}
+}
 
-	/* CMYK calculation */
-	if (!(cmyk->flags & ImageAttributeFlagsNoOp) && cmyk->flags & ImageAttributeFlagsOutputChannelEnabled) {
-		for (int y = 0; y < bitmap->active_bitmap->height; y++) {
-			for (int x = 0; x < bitmap->active_bitmap->width; x++) {
-
-				BYTE r, g, b, a, C, M, Y, K;
-
-				GdipBitmapGetPixel(bmpdest, x, y, &color);
-
-				a = (color & 0xff000000) >> 24;
-				r = (color & 0x00ff0000) >> 16;
-				g = (color & 0x0000ff00) >> 8;
-				b = (color & 0x000000ff);
-
-				C = 255 - r;
-				M = 255 - g;
-				Y = 255 - b;
-				K = min(min(C, M), Y);
-				
-				/* correct complementary color lever based on k */
-				C -= K;
-				M -= K;
-				Y -= K;
-
-				switch (cmyk->outputchannel_flags) {
-				case ColorChannelFlagsC:
-					r = g = b = C;
-					break;
-				case ColorChannelFlagsM:
-					r = g = b = M;
-					break;
-				case ColorChannelFlagsY:
-					r = g = b = Y;
-					break;
-				case ColorChannelFlagsK:
-					r = g = b = K;
-					break;
-				default:
-					return InvalidParameter;
-				}
-
-				color = ((guint32)a << 24) | (r << 16) | (g << 8) | b;
-				GdipBitmapSetPixel(bmpdest, x, y, color);
-			}
-		}
+/*
+ * Same as gdip_process_bitmap_attributes but the processed bitmap is looked up in (or added to) the cache.
+ * When a processed bitmap is returned, so is the entry owning it, which must be given back with
+ * gdip_processed_bitmap_release instead of disposing the bitmap.
+ */
+GpStatus
+gdip_process_bitmap_attributes_cached (GpBitmap *bitmap, GpImageAttributes* attr, GpBitmap **dest_bitmap, ProcessedBitmapEntry **entry)
+{
+	GpStatus status;
+	ProcessedBitmapEntry key, *result;
+	ProcessedBitmapEntry *doomed = NULL;
+	GpBitmap *processed;
+
+	*dest_bitmap = NULL;
+	*entry = NULL;
+	if (!bitmap || !attr)
+		return Ok;
+
+	/* the caller can change pixels it owns (GdipCreateBitmapFromScan0) without us knowing, so they are never cached */
+	if (bitmap->active_bitmap && (bitmap->active_bitmap->reserved & GBD_OWN_SCAN0) == 0)
+		return gdip_process_bitmap_attributes (bitmap, attr, dest_bitmap);
+
+	key.source = bitmap;
+	key.source_generation = bitmap->generation;
+	key.attributes = attr;
+	key.attributes_generation = attr->generation;
+
+	gdip_processed_cache_lock ();
+	result = processed_cache_hashtable ? (ProcessedBitmapEntry *) g_hash_table_lookup (processed_cache_hashtable, &key) : NULL;
+	if (result) {
+		processed_cache_hits++;
+		result->users++;
+		gdip_processed_cache_unlink (result);
+		gdip_processed_cache_link (result);
+		gdip_processed_cache_unlock ();
+
+		*dest_bitmap = result->processed;
+		*entry = result;
+		return Ok;
 	}
+	processed_cache_misses++;
+	gdip_processed_cache_unlock ();
 
-	/* Apply transparency range */
-	/* FIXME: This will convert pixels which have a color in [key_colorlow, key_colorhey] to transparent pixels.
-	          However, GdipDrawImageRectRect in image.c uses cairo_fill to draw these transparent pixels onto
-			  the target surface. This method will not copy the transparency value; rather, it will ignore
-			  transparent values. */
-	if (!(trans->flags & ImageAttributeFlagsNoOp) && trans->flags & ImageAttributeFlagsColorKeysEnabled) {
-		for (int y = 0; y < bitmap->active_bitmap->height; y++) {
-			for (int x = 0; x < bitmap->active_bitmap->width; x++) {
-
-				GdipBitmapGetPixel (bmpdest, x, y, &color);
-				color &= ~ALPHA_MASK;
-				
-				if (color >= (trans->key_colorlow & ~ALPHA_MASK) && color <= (trans->key_colorhigh & ~ALPHA_MASK)) {
-					GdipBitmapSetPixel (bmpdest, x, y, 0x00FFFFFF /* transparent white */);
-				}
-			}
-		}
+	status = gdip_process_bitmap_attributes (bitmap, attr, &processed);
+	if (status != Ok || !processed)
+		return status;
+
+	result = (ProcessedBitmapEntry *) GdipAlloc (sizeof (ProcessedBitmapEntry));
+	if (!result) {
+		gdip_bitmap_dispose (processed);
+		return OutOfMemory;
 	}
 
-	/* Apply Color Matrix */
-	if (!(cmatrix->flags & ImageAttributeFlagsNoOp) && (cmatrix->flags & ImageAttributeFlagsColorMatrixEnabled) && cmatrix->colormatrix != NULL) {
-		ActiveBitmapData *data = bmpdest->active_bitmap;
-		BYTE *v = ((BYTE*)data->scan0);
-		ARGB *scan;
-		ColorMatrixFlags flags = cmatrix->colormatrix_flags;
-		ColorMatrix *cm;
-		BOOL bmpdest_is_premultiplied = !gdip_bitmap_format_needs_premultiplication (bmpdest);
-
-		for (int y = 0; y < data->height; y++) {
-			scan = (ARGB*) v;
-			for (int x = 0; x < data->width; x++) {
-				BYTE r,g,b,a;
-				int r_new,g_new,b_new,a_new;
-
-				get_pixel_bgra (*scan, b, g, r, a);
-
-				/* by default the matrix applies to all colors, including grays */
-				if ((flags != ColorMatrixFlagsDefault) && (b == g) && (b == r)) {
-					if (flags == ColorMatrixFlagsSkipGrays) {
-						/* does not apply */
-						scan++;
-						continue;
-					}
-					/* ColorMatrixFlagsAltGray */
-					cm = cmatrix->graymatrix;
-				} else {
-					cm = cmatrix->colormatrix;
-				}
-
-				a_new = (r * cm->m[0][3] + g * cm->m[1][3] + b * cm->m[2][3] + a * cm->m[3][3] + (255 * cm->m[4][3]));
-				if (a_new == 0 && bmpdest_is_premultiplied) {
-					/* 100% transparency, don't waste time computing other values (pre-mul will always be 0) */
-					*scan++ = 0;
-				} else {
-					r_new = (r * cm->m[0][0] + g * cm->m[1][0] + b * cm->m[2][0] + a * cm->m[3][0] + (255 * cm->m[4][0]));
-					g_new = (r * cm->m[0][1] + g * cm->m[1][1] + b * cm->m[2][1] + a * cm->m[3][1] + (255 * cm->m[4][1]));
-					b_new = (r * cm->m[0][2] + g * cm->m[1][2] + b * cm->m[2][2] + a * cm->m[3][2] + (255 * cm->m[4][2]));
-
-					if (bmpdest_is_premultiplied && a != (BYTE) a_new && a < 0xff && a != 0) {
-						/* reverse previous pre-multiplication if necessary */
-						r_new = r_new * 255 / a;
-						g_new = g_new * 255 / a;
-						b_new = b_new * 255 / a;
-					}
-
-					r = (r_new > 0xff) ? 0xff : (BYTE) r_new;
-					g = (g_new > 0xff) ? 0xff : (BYTE) g_new;
-					b = (b_new > 0xff) ? 0xff : (BYTE) b_new;
-
-					/* remember that Cairo use pre-multiplied alpha, e.g. 50% red == 0x80800000 not 0x80ff0000 */
-					if (bmpdest_is_premultiplied && a != (BYTE) a_new && a_new < 0xff) {
-						/* apply new pre-multiplication */
-						a = (BYTE) a_new;
-						r = pre_multiplied_table [r][a];
-						g = pre_multiplied_table [g][a];
-						b = pre_multiplied_table [b][a];
-					} else {
-						a = (BYTE) a_new;
-					}
-
-					set_pixel_bgra (color_p, 0, b, g, r, a);
-					*scan++ = color;
-				}
-			}
-			v += data->stride;
+	*result = key;
+	result->processed = processed;
+	result->size = (size_t) processed->active_bitmap->stride * processed->active_bitmap->height;
+	result->users = 1;
+	result->cached = FALSE;
+	result->prev = result->next = NULL;
+
+	/* entries that don't fit in the budget are still handed out, and freed once released */
+	gdip_processed_cache_lock ();
+	if (result->size <= processed_cache_budget) {
+		if (!processed_cache_hashtable)
+			processed_cache_hashtable = g_hash_table_new (gdip_processed_entry_hash, gdip_processed_entry_equal);
+
+		/* another thread may have processed the same bitmap in the meantime */
+		if (!g_hash_table_lookup (processed_cache_hashtable, result)) {
+			g_hash_table_insert (processed_cache_hashtable, result, result);
+			gdip_processed_cache_link (result);
+			processed_cache_size += result->size;
+			processed_cache_count++;
+			result->cached = TRUE;
+			bitmap->processed_cached = TRUE;
+			attr->processed_cached = TRUE;
+			gdip_processed_cache_trim (&doomed);
 		}
 	}
+	gdip_processed_cache_unlock ();
+	gdip_processed_cache_free (doomed);
 
+	*dest_bitmap = processed;
+	*entry = result;
 	return Ok;
 }
 
+void
+gdip_processed_bitmap_release (ProcessedBitmapEntry *entry)
+{
+	BOOL unused;
+
+	if (!entry)
+		return;
+
+	gdip_processed_cache_lock ();
+	entry->users--;
+	unused = !entry->cached && entry->users == 0;
+	gdip_processed_cache_unlock ();
+
+	if (unused) {
+		gdip_bitmap_dispose (entry->processed);
+		GdipFree (entry);
+	}
+}
+
+/* Drops every entry created from the bitmap or the attributes, called when either is disposed */
+void
+gdip_processed_bitmap_cache_purge (GpBitmap *bitmap, GpImageAttributes *attr)
+{
+	ProcessedBitmapEntry *entry, *next;
+	ProcessedBitmapEntry *doomed = NULL;
+
+	gdip_processed_cache_lock ();
+	for (entry = processed_cache_head; entry; entry = next) {
+		next = entry->next;
+		if ((bitmap && entry->source == bitmap) || (attr && entry->attributes == attr))
+			gdip_processed_cache_remove (entry, &doomed);
+	}
+	gdip_processed_cache_unlock ();
+
+	gdip_processed_cache_free (doomed);
+}
+
+void
+gdip_processed_bitmap_cache_clear (void)
+{
+	ProcessedBitmapEntry *doomed = NULL;
+
+	gdip_processed_cache_lock ();
+	while (processed_cache_head)
+		gdip_processed_cache_remove (processed_cache_head, &doomed);
+
+	if (processed_cache_hashtable) {
+		g_hash_table_destroy (processed_cache_hashtable);
+		processed_cache_hashtable = NULL;
+	}
+	processed_cache_hits = 0;
+	processed_cache_misses = 0;
+	gdip_processed_cache_unlock ();
+
+	gdip_processed_cache_free (doomed);
+}
+
 /* coverity[+alloc : arg-*0] */
 GpStatus WINGDIPAPI
 GdipCreateImageAttributes (GpImageAttributes **imageattr)
@@ -450,6 +979,8 @@ GdipCreateImageAttributes (GpImageAttributes **imageattr)
 	gdip_init_image_attribute (&result->text);
 	result->color = 0x00000000;
 	result->wrapmode = WrapModeClamp;
+	result->generation = 0;
+	result->processed_cached = FALSE;
 
 	*imageattr = result;
 	return Ok;
@@ -471,6 +1002,7 @@ GdipCloneImageAttributes (GDIPCONST GpImageAttributes *imageattr, GpImageAttribu
 	}
 
 	memcpy (result, imageattr, sizeof (GpImageAttributes));
+	result->processed_cached = FALSE;
 
 	GpStatus ret = Ok;
 	ret = gdip_clone_image_attribute(&imageattr->def, &result->def);
@@ -519,6 +1051,9 @@ GdipDisposeImageAttributes (GpImageAttributes *imageattr)
 	if (!imageattr)
 		return InvalidParameter;
 
+	if (imageattr->processed_cached)
+		gdip_processed_bitmap_cache_purge (NULL, imageattr);
+
 	gdip_dispose_image_attribute (&imageattr->def);
 	gdip_dispose_image_attribute (&imageattr->bitmap);
 	gdip_dispose_image_attribute (&imageattr->brush);
@@ -542,6 +1077,8 @@ GdipSetImageAttributesToIdentity (GpImageAttributes *imageattr, ColorAdjustType
 	if (!imgattr)
 		return InvalidParameter;
 
+	imageattr->generation++;
+
 	gdip_dispose_image_attribute (imgattr);
 	gdip_init_image_attribute (imgattr);
 	return Ok;
@@ -560,6 +1097,8 @@ GdipResetImageAttributes (GpImageAttributes *imageattr, ColorAdjustType type)
 	if (!imgattr)
 		return InvalidParameter;
 
+	imageattr->generation++;
+
 	gdip_dispose_image_attribute (imgattr);
 	gdip_init_image_attribute (imgattr);
 	return Ok;
@@ -578,8 +1117,11 @@ GdipSetImageAttributesThreshold ( GpImageAttributes *imageattr, ColorAdjustType
 	if (!imgattr)
 		return InvalidParameter;
 
+	imageattr->generation++;
+
 	if (enableFlag) {
 		imgattr->threshold = threshold;
+		gdip_build_threshold_table (imgattr, threshold);
 		imgattr->flags |= ImageAttributeFlagsThresholdEnabled;
 	}
 	else
@@ -602,11 +1144,14 @@ GdipSetImageAttributesGamma (GpImageAttributes *imageattr, ColorAdjustType type,
 	if (!imgattr)
 		return InvalidParameter;
 
+	imageattr->generation++;
+
 	if (enableFlag) {
 		if (gamma <= 0)
 			return InvalidParameter;
 
 		imgattr->gamma_correction = gamma;
+		gdip_build_gamma_table (imgattr, gamma);
 		imgattr->flags |= ImageAttributeFlagsGammaEnabled;
 	}
 	else
@@ -628,6 +1173,8 @@ GdipSetImageAttributesNoOp (GpImageAttributes *imageattr, ColorAdjustType type,
 	if (!imgattr)
 		return InvalidParameter;
 
+	imageattr->generation++;
+
 	if (enableFlag)
 		imgattr->flags |= ImageAttributeFlagsNoOp;
 	else
@@ -650,6 +1197,8 @@ GdipSetImageAttributesColorKeys (GpImageAttributes *imageattr, ColorAdjustType t
 	if (!imgattr)
 		return InvalidParameter;
 
+	imageattr->generation++;
+
 	if (enableFlag) {
 		BYTE rLow = (colorLow >> 16) & 0xFF;
 		BYTE gLow = (colorLow >> 8) & 0xFF;
@@ -685,6 +1234,8 @@ GdipSetImageAttributesOutputChannelColorProfile (GpImageAttributes *imageattr, C
 	if (!imgattr)
 		return InvalidParameter;
 
+	imageattr->generation++;
+
 	if (enableFlag) {
 		if (!colorProfileFilename)
 			return Win32Error;
@@ -727,6 +1278,8 @@ GdipSetImageAttributesRemapTable (GpImageAttributes *imageattr, ColorAdjustType
 	if (!imgattr)
 		return InvalidParameter;
 
+	imageattr->generation++;
+
 	if (enableFlag) {
 		if (mapSize == 0 || !map)
 			return InvalidParameter;
@@ -737,12 +1290,23 @@ GdipSetImageAttributesRemapTable (GpImageAttributes *imageattr, ColorAdjustType
 		if (!newColorMap)
 			return OutOfMemory;
 
+		unsigned int indexMask;
+		int *newIndex = gdip_build_colormap_index (map, mapSize, &indexMask);
+		if (!newIndex) {
+			GdipFree (newColorMap);
+			return OutOfMemory;
+		}
+
 		if (imgattr->colormap)
 			GdipFree (imgattr->colormap);
+		if (imgattr->colormap_index)
+			GdipFree (imgattr->colormap_index);
 
 		imgattr->colormap = newColorMap;
 		memcpy (imgattr->colormap, map, size);
 		imgattr->colormap_elem = mapSize;
+		imgattr->colormap_index = newIndex;
+		imgattr->colormap_index_mask = indexMask;
 		imgattr->flags |= ImageAttributeFlagsColorRemapTableEnabled;
 	} else
 		imgattr->flags &= ~ImageAttributeFlagsColorRemapTableEnabled;
@@ -801,6 +1365,8 @@ GdipSetImageAttributesColorMatrix (GpImageAttributes *imageattr, ColorAdjustType
 	if (!imgattr)
 		return InvalidParameter;
 
+	imageattr->generation++;
+
 	if (enableFlag) {
 		if (!colorMatrix || flags > ColorMatrixFlagsAltGray || flags < ColorMatrixFlagsDefault) {
 			return InvalidParameter;
@@ -849,6 +1415,8 @@ GdipSetImageAttributesOutputChannel (GpImageAttributes *imageattr, ColorAdjustTy
 	if (!imgattr)
 		return InvalidParameter;
 
+	imageattr->generation++;
+
 	if (enableFlag) {
 		if (channelFlags >= ColorChannelFlagsLast)
 			return InvalidParameter;
@@ -870,3 +1438,44 @@ GdipSetImageAttributesCachedBackground (GpImageAttributes *imageattr, BOOL enabl
 	// This has no effect in GDI+.
 	return Ok;
 }
+
+/* libgdiplus extensions to control the cache of bitmaps processed by GdipDrawImage* */
+
+GpStatus WINGDIPAPI
+GdipSetImageAttributesCacheSize_linux (UINT maxBytes)
+{
+	ProcessedBitmapEntry *doomed = NULL;
+
+	gdip_processed_cache_lock ();
+	processed_cache_budget = maxBytes;
+	gdip_processed_cache_trim (&doomed);
+	gdip_processed_cache_unlock ();
+
+	gdip_processed_cache_free (doomed);
+	return Ok;
+}
+
+GpStatus WINGDIPAPI
+GdipGetImageAttributesCacheSize_linux (UINT *maxBytes)
+{
+	if (!maxBytes)
+		return InvalidParameter;
+
+	*maxBytes = processed_cache_budget;
+	return Ok;
+}
+
+GpStatus WINGDIPAPI
+GdipGetImageAttributesCacheStatistics_linux (UINT *hits, UINT *misses, UINT *count, UINT *bytes)
+{
+	if (!hits || !misses || !count || !bytes)
+		return InvalidParameter;
+
+	gdip_processed_cache_lock ();
+	*hits = processed_cache_hits;
+	*misses = processed_cache_misses;
+	*count = processed_cache_count;
+	*bytes = processed_cache_size;
+	gdip_processed_cache_unlock ();
+	return Ok;
+}
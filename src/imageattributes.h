@@ -60,4 +60,9 @@ GpStatus WINGDIPAPI GdipSetImageAttributesWrapMode (GpImageAttributes *imageattr
 GpStatus WINGDIPAPI GdipSetImageAttributesICMMode (GpImageAttributes *imageAttr, BOOL on);
 GpStatus WINGDIPAPI GdipSetImageAttributesCachedBackground (GpImageAttributes *imageattr, BOOL enableFlag);
 
+/* libgdiplus extensions: the bitmaps processed when drawing with attributes are cached, up to maxBytes (0 disables the cache) */
+GpStatus WINGDIPAPI GdipSetImageAttributesCacheSize_linux (UINT maxBytes);
+GpStatus WINGDIPAPI GdipGetImageAttributesCacheSize_linux (UINT *maxBytes);
+GpStatus WINGDIPAPI GdipGetImageAttributesCacheStatistics_linux (UINT *hits, UINT *misses, UINT *count, UINT *bytes);
+
 #endif
@@ -39,6 +39,12 @@ GUID gdip_jpg_image_format_guid = {0xb96b3caeU, 0x0728U, 0x11d3U, {0x9d, 0x7b, 0
 #undef HAVE_STDLIB_H
 #include <jpeglib.h>
 #include "dstream.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 #ifdef HAVE_LIBEXIF
 #include <libexif/exif-data.h>
 #include <libexif/exif-content.h>
@@ -117,6 +123,34 @@ struct gdip_jpeg_error_mgr {
 };
 typedef struct gdip_jpeg_error_mgr *gdip_jpeg_error_mgr_ptr;
 
+/* Large images keep their compressed data, until their pixels are modified, so that GdipGetImageThumbnail can decode
+ * them again scaled down */
+#define JPEG_KEEP_SOURCE_MIN_PIXELS	(1024 * 1024)
+
+/* What the source managers read, if enabled (the decompressor's client_data), and the EXIF data of the image */
+typedef struct {
+	BOOL		enabled;
+	BYTE		*data;
+	size_t		size;
+	size_t		capacity;
+	BYTE		*exif;
+	unsigned int	exif_size;
+} JpegSourceRecord;
+
+/* Keeps the compressed data of large images, and the EXIF data (only parsed when its properties are asked for) */
+typedef struct {
+	BitmapFrameDecoder	base;
+	BYTE			*data;
+	size_t			size;
+	BYTE			*exif;
+	unsigned int		exif_size;
+} JpegFrameDecoder;
+
+static const JOCTET gdip_jpeg_eoi[] = { (JOCTET) 0xFF, (JOCTET) JPEG_EOI };
+
+static GpStatus gdip_load_jpeg_image_internal (struct jpeg_source_mgr *src, UINT width, UINT height, GDIPCONST Rect *region,
+	JpegSourceRecord *record, GpImage **image);
+
 
 static void
 _gdip_jpeg_error_exit (j_common_ptr cinfo)
@@ -150,6 +184,85 @@ _gdip_source_dummy_init (j_decompress_ptr cinfo)
 	/* nothing */
 }
 
+static BOOL
+_gdip_source_recording (j_decompress_ptr cinfo)
+{
+	JpegSourceRecord *record = (JpegSourceRecord *) cinfo->client_data;
+
+	return record && record->enabled;
+}
+
+/* Appends what the source manager just filled its buffer with to the record, if enabled */
+static void
+_gdip_source_record (j_decompress_ptr cinfo)
+{
+	JpegSourceRecord *record = (JpegSourceRecord *) cinfo->client_data;
+	size_t size = cinfo->src->bytes_in_buffer;
+	size_t capacity;
+	BYTE *data;
+
+	if (!record || !record->enabled)
+		return;
+
+	if (record->size + size > record->capacity) {
+		capacity = MAX (record->capacity * 2, record->size + size);
+		data = capacity <= G_MAXINT32 ? gdip_realloc (record->data, capacity) : NULL;
+		if (!data) {
+			/* not worth failing the load for */
+			record->enabled = FALSE;
+			return;
+		}
+		record->data = data;
+		record->capacity = capacity;
+	}
+
+	memcpy (record->data + record->size, cinfo->src->next_input_byte, size);
+	record->size += size;
+}
+
+/* Skips by reading, so that the record doesn't miss the skipped data */
+static void
+_gdip_source_read_input_data (j_decompress_ptr cinfo, long skipbytes)
+{
+	struct jpeg_source_mgr *src = cinfo->src;
+
+	if (skipbytes <= 0)
+		return;
+
+	while (skipbytes > (long) src->bytes_in_buffer) {
+		skipbytes -= (long) src->bytes_in_buffer;
+		(void) src->fill_input_buffer (cinfo);
+	}
+
+	src->next_input_byte += (size_t) skipbytes;
+	src->bytes_in_buffer -= (size_t) skipbytes;
+}
+
+static BOOL
+_gdip_source_memory_fill_input_buffer (j_decompress_ptr cinfo)
+{
+	/* all the data was there from the start, so the image is truncated: insert a fake EOI marker like the others */
+	cinfo->src->next_input_byte = gdip_jpeg_eoi;
+	cinfo->src->bytes_in_buffer = sizeof (gdip_jpeg_eoi);
+
+	return TRUE;
+}
+
+static void
+_gdip_source_memory_skip_input_data (j_decompress_ptr cinfo, long skipbytes)
+{
+	struct jpeg_source_mgr *src = cinfo->src;
+
+	if (skipbytes > 0) {
+		if (skipbytes > (long) src->bytes_in_buffer) {
+			(void) _gdip_source_memory_fill_input_buffer (cinfo);
+		} else {
+			src->next_input_byte += (size_t) skipbytes;
+			src->bytes_in_buffer -= (size_t) skipbytes;
+		}
+	}
+}
+
 static BOOL
 _gdip_source_stdio_fill_input_buffer (j_decompress_ptr cinfo)
 {
@@ -169,6 +282,7 @@ _gdip_source_stdio_fill_input_buffer (j_decompress_ptr cinfo)
 
 	src->parent.next_input_byte = src->buf;
 	src->parent.bytes_in_buffer = nb;
+	_gdip_source_record (cinfo);
 
 	return TRUE;
 }
@@ -178,7 +292,9 @@ _gdip_source_stdio_skip_input_data (j_decompress_ptr cinfo, long skipbytes)
 {
 	gdip_stdio_jpeg_source_mgr_ptr src = (gdip_stdio_jpeg_source_mgr_ptr) cinfo->src;
 
-	if (skipbytes > 0) {
+	if (_gdip_source_recording (cinfo)) {
+		_gdip_source_read_input_data (cinfo, skipbytes);
+	} else if (skipbytes > 0) {
 		if (skipbytes > (long) src->parent.bytes_in_buffer) {
 			skipbytes -= (long) src->parent.bytes_in_buffer;
 			fseek (src->infp, skipbytes, SEEK_CUR);
@@ -210,6 +326,7 @@ _gdip_source_stream_fill_input_buffer (j_decompress_ptr cinfo)
 
 	src->parent.next_input_byte = src->buf;
 	src->parent.bytes_in_buffer = nb;
+	_gdip_source_record (cinfo);
 
 	return TRUE;
 }
@@ -220,7 +337,9 @@ _gdip_source_stream_skip_input_data (j_decompress_ptr cinfo, long skipbytes)
 	gdip_stream_jpeg_source_mgr_ptr src = (gdip_stream_jpeg_source_mgr_ptr) cinfo->src;
 	dstream_t *loader = src->loader;
 
-	if (skipbytes > 0) {
+	if (_gdip_source_recording (cinfo)) {
+		_gdip_source_read_input_data (cinfo, skipbytes);
+	} else if (skipbytes > 0) {
 		if (skipbytes > (long) src->parent.bytes_in_buffer) {
 			skipbytes -= (long) src->parent.bytes_in_buffer;
 			dstream_skip (loader, skipbytes);
@@ -238,6 +357,19 @@ _gdip_source_dummy_term (j_decompress_ptr cinfo)
 	/* nothing */
 }
 
+/* Reads size bytes from data, which are all there from the start */
+static void
+_gdip_source_memory_init (struct jpeg_source_mgr *src, const BYTE *data, size_t size)
+{
+	src->init_source = _gdip_source_dummy_init;
+	src->fill_input_buffer = (boolean(*)(j_decompress_ptr))_gdip_source_memory_fill_input_buffer;
+	src->skip_input_data = _gdip_source_memory_skip_input_data;
+	src->resync_to_restart = jpeg_resync_to_restart;
+	src->term_source = _gdip_source_dummy_term;
+	src->bytes_in_buffer = size;
+	src->next_input_byte = data;
+}
+
 static void
 _gdip_dest_stream_init (j_compress_ptr cinfo)
 {
@@ -267,8 +399,230 @@ _gdip_dest_stream_term (j_compress_ptr cinfo)
 	dest->putBytesFunc (dest->buf, JPEG_BUFFER_SIZE - dest->parent.free_in_buffer);
 }
 
+/*
+ * Converts a row of CMYK pixels, as libjpeg returns them, to opaque BGRA in place. Adobe Photoshop
+ * writes inverted CMYK, so other images are inverted first and both become b = c * k / 255 and so on.
+ */
+static void
+gdip_jpeg_cmyk_to_bgra (BYTE *line, int count, BOOL adobe)
+{
+	BYTE invert = adobe ? 0 : 0xFF;
+	int x = 0;
+
+#if defined(__SSE2__) && G_BYTE_ORDER == G_LITTLE_ENDIAN
+	{
+		const __m128i zero = _mm_setzero_si128 ();
+		const __m128i inverse = _mm_set1_epi8 ((char) invert);
+		const __m128i one = _mm_set1_epi16 (1);
+		const __m128i alpha = _mm_set1_epi32 ((int) 0xFF000000);
+
+		for (; x + 4 <= count; x += 4) {
+			__m128i pixels = _mm_xor_si128 (_mm_loadu_si128 ((const __m128i *) (line + x * 4)), inverse);
+			__m128i lo = _mm_unpacklo_epi8 (pixels, zero);
+			__m128i hi = _mm_unpackhi_epi8 (pixels, zero);
+			__m128i k_lo = _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (lo, _MM_SHUFFLE (3, 3, 3, 3)), _MM_SHUFFLE (3, 3, 3, 3));
+			__m128i k_hi = _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (hi, _MM_SHUFFLE (3, 3, 3, 3)), _MM_SHUFFLE (3, 3, 3, 3));
+
+			/* t = p + 1; (t + (t >> 8)) >> 8 is exactly p / 255 for any product of two bytes */
+			lo = _mm_add_epi16 (_mm_mullo_epi16 (lo, k_lo), one);
+			hi = _mm_add_epi16 (_mm_mullo_epi16 (hi, k_hi), one);
+			lo = _mm_srli_epi16 (_mm_add_epi16 (lo, _mm_srli_epi16 (lo, 8)), 8);
+			hi = _mm_srli_epi16 (_mm_add_epi16 (hi, _mm_srli_epi16 (hi, 8)), 8);
+
+			_mm_storeu_si128 ((__m128i *) (line + x * 4), _mm_or_si128 (_mm_packus_epi16 (lo, hi), alpha));
+		}
+	}
+#elif defined(__ARM_NEON) && G_BYTE_ORDER == G_LITTLE_ENDIAN
+	{
+		const uint8x8_t inverse = vdup_n_u8 (invert);
+		const uint16x8_t one = vdupq_n_u16 (1);
+
+		for (; x + 8 <= count; x += 8) {
+			/* c, m, y and k planes of 8 pixels */
+			uint8x8x4_t pixels = vld4_u8 (line + x * 4);
+			uint8x8_t k = veor_u8 (pixels.val[3], inverse);
+
+			for (int i = 0; i < 3; i++) {
+				uint16x8_t t = vaddq_u16 (vmull_u8 (veor_u8 (pixels.val[i], inverse), k), one);
+				pixels.val[i] = vshrn_n_u16 (vaddq_u16 (t, vshrq_n_u16 (t, 8)), 8);
+			}
+			pixels.val[3] = vdup_n_u8 (0xFF);
+
+			vst4_u8 (line + x * 4, pixels);
+		}
+	}
+#endif
+
+	for (; x < count; x++) {
+		BYTE *pixel = line + x * 4;
+		int c = pixel[0] ^ invert;
+		int m = pixel[1] ^ invert;
+		int y = pixel[2] ^ invert;
+		int k = pixel[3] ^ invert;
+
+		set_pixel_bgra (pixel, 0, c * k / 255, m * k / 255, y * k / 255, 0xff);
+	}
+}
+
+#ifdef HAVE_LIBEXIF
+/* Copies the first EXIF APP1 marker libjpeg saved into the record */
 static GpStatus
-gdip_load_jpeg_image_internal (struct jpeg_source_mgr *src, GpImage **image)
+gdip_jpeg_keep_exif (j_decompress_ptr cinfo, JpegSourceRecord *record)
+{
+	jpeg_saved_marker_ptr marker;
+
+	for (marker = cinfo->marker_list; marker; marker = marker->next) {
+		if (marker->marker != JPEG_APP0 + 1 || marker->data_length < 6 || memcmp (marker->data, "Exif\0\0", 6) != 0)
+			continue;
+
+		record->exif = GdipAlloc (marker->data_length);
+		if (!record->exif)
+			return OutOfMemory;
+
+		memcpy (record->exif, marker->data, marker->data_length);
+		record->exif_size = marker->data_length;
+		break;
+	}
+
+	return Ok;
+}
+
+/* Reads the bytes long unsigned value at offset of the TIFF structure of the EXIF data, in its byte order */
+static BOOL
+gdip_jpeg_exif_read (const BYTE *tiff, size_t size, BOOL motorola, size_t offset, int bytes, guint32 *value)
+{
+	int i;
+
+	if (offset > size || (size_t) bytes > size - offset)
+		return FALSE;
+
+	*value = 0;
+	for (i = 0; i < bytes; i++)
+		*value = (*value << 8) | tiff[offset + (motorola ? i : bytes - 1 - i)];
+
+	return TRUE;
+}
+
+/* Returns the SHORT value, or the integer part of the RATIONAL value, of tag in the IFD at offset, or -1 if it has none */
+static int
+gdip_jpeg_exif_ifd_value (const BYTE *tiff, size_t size, BOOL motorola, guint32 offset, guint16 tag)
+{
+	guint32 count;
+	guint32 i;
+
+	if (!gdip_jpeg_exif_read (tiff, size, motorola, offset, 2, &count))
+		return -1;
+
+	for (i = 0; i < count; i++) {
+		size_t entry = offset + 2 + (size_t) i * 12;
+		guint32 entry_tag, type, value, numerator, denominator;
+
+		if (!gdip_jpeg_exif_read (tiff, size, motorola, entry, 2, &entry_tag) ||
+			!gdip_jpeg_exif_read (tiff, size, motorola, entry + 2, 2, &type))
+			return -1;
+
+		if (entry_tag != tag)
+			continue;
+
+		if (type == PropertyTagTypeShort && gdip_jpeg_exif_read (tiff, size, motorola, entry + 8, 2, &value))
+			return value;
+
+		if (type == PropertyTagTypeRational && gdip_jpeg_exif_read (tiff, size, motorola, entry + 8, 4, &value) &&
+			gdip_jpeg_exif_read (tiff, size, motorola, value, 4, &numerator) &&
+			gdip_jpeg_exif_read (tiff, size, motorola, (size_t) value + 4, 4, &denominator))
+			return denominator ? MIN (numerator / denominator, G_MAXINT32) : 0;
+
+		return -1;
+	}
+
+	return -1;
+}
+
+/*
+ * Sets the resolution of bitmap_data from the EXIF data, looking for the tags in IFD0 and then in IFD1.
+ * This is all that is needed of it while loading, libexif parses the rest when the properties are asked for.
+ */
+static void
+gdip_jpeg_load_exif_resolution (const BYTE *exif, unsigned int exif_size, ActiveBitmapData *bitmap_data)
+{
+	/* the TIFF structure follows the "Exif\0\0" header */
+	const BYTE *tiff = exif + 6;
+	size_t size = exif_size - 6;
+	BOOL motorola;
+	guint32 magic;
+	guint32 ifd[2];
+	guint32 count;
+	int resolution_unit = -1;
+	int x_resolution = -1;
+	int y_resolution = -1;
+	int i;
+
+	motorola = size >= 2 && tiff[0] == 'M' && tiff[1] == 'M';
+	if (!gdip_jpeg_exif_read (tiff, size, motorola, 2, 2, &magic) || magic != 42 ||
+		!gdip_jpeg_exif_read (tiff, size, motorola, 4, 4, &ifd[0]))
+		return;
+
+	if (!gdip_jpeg_exif_read (tiff, size, motorola, ifd[0], 2, &count) ||
+		!gdip_jpeg_exif_read (tiff, size, motorola, (size_t) ifd[0] + 2 + (size_t) count * 12, 4, &ifd[1]))
+		ifd[1] = 0;
+
+	for (i = 0; i < 2 && ifd[i] != 0; i++) {
+		if (resolution_unit < 0)
+			resolution_unit = gdip_jpeg_exif_ifd_value (tiff, size, motorola, ifd[i], PropertyTagResolutionUnit);
+		if (x_resolution < 0)
+			x_resolution = gdip_jpeg_exif_ifd_value (tiff, size, motorola, ifd[i], PropertyTagXResolution);
+		if (y_resolution < 0)
+			y_resolution = gdip_jpeg_exif_ifd_value (tiff, size, motorola, ifd[i], PropertyTagYResolution);
+	}
+
+	x_resolution = MAX (x_resolution, 0);
+	y_resolution = MAX (y_resolution, 0);
+
+	if (resolution_unit == 2) { /* dpi */
+		bitmap_data->dpi_horz = x_resolution;
+		bitmap_data->dpi_vert = y_resolution;
+	} else if (resolution_unit == 3) { /* dots/cm */
+		bitmap_data->dpi_horz = x_resolution * 2.54;
+		bitmap_data->dpi_vert = y_resolution * 2.54;
+	}
+
+	/* Other densities are not supported. */
+}
+#endif
+
+/* Sets the resolution of the header read by cinfo, or of its EXIF data when the header has none, on data */
+static void
+gdip_jpeg_load_resolution (j_decompress_ptr cinfo, JpegSourceRecord *record, ActiveBitmapData *data)
+{
+	if (cinfo->density_unit == 1) { /* dpi */
+		data->dpi_horz = cinfo->X_density;
+		data->dpi_vert = cinfo->Y_density;
+	} else if (cinfo->density_unit == 2) { /* dots/cm */
+		data->dpi_horz = cinfo->X_density * 2.54;
+		data->dpi_vert = cinfo->Y_density * 2.54;
+	} else { /* unknown density */
+		data->dpi_horz = 0;
+		data->dpi_vert = 0;
+	}
+
+	if (data->dpi_horz && data->dpi_vert)
+		data->image_flags |= ImageFlagsHasRealDPI;
+
+#ifdef HAVE_LIBEXIF
+	/* Get image resolution from the EXIF data if either the x-resolution or y-resolution was not set */
+	if (record && record->exif && (data->dpi_horz == 0 || data->dpi_vert == 0))
+		gdip_jpeg_load_exif_resolution (record->exif, record->exif_size, data);
+#endif
+}
+
+/*
+ * Decodes the image, scaled down (by libjpeg, which is much faster than decoding all of it) to the smallest size
+ * that is still at least width x height if both are given, or only the part of it in region if that is given.
+ * record gets the compressed data of large images.
+ */
+static GpStatus
+gdip_load_jpeg_image_internal (struct jpeg_source_mgr *src, UINT width, UINT height, GDIPCONST Rect *region,
+	JpegSourceRecord *record, GpImage **image)
 {
 	struct jpeg_decompress_struct	cinfo;
 	struct gdip_jpeg_error_mgr	jerr;
@@ -278,6 +632,10 @@ gdip_load_jpeg_image_internal (struct jpeg_source_mgr *src, GpImage **image)
 	BYTE		*lines[4] = {NULL, NULL, NULL, NULL};
 	GpStatus	status;
 	int		stride;
+	int		pixel_size;
+	int		region_x = 0;
+	JDIMENSION	first_line = 0;
+	JDIMENSION	end_line;
 	unsigned long long int size;
 
 	destbuf = NULL;
@@ -295,12 +653,38 @@ gdip_load_jpeg_image_internal (struct jpeg_source_mgr *src, GpImage **image)
 
 	jpeg_create_decompress (&cinfo);
 	cinfo.src = src;
+	cinfo.client_data = record;
+
+#ifdef HAVE_LIBEXIF
+	if (record)
+		jpeg_save_markers (&cinfo, JPEG_APP0 + 1, 0xFFFF);
+#endif
 
 	jpeg_read_header (&cinfo, TRUE);
 
+	if (record && (unsigned long long int) cinfo.image_width * cinfo.image_height < JPEG_KEEP_SOURCE_MIN_PIXELS)
+		record->enabled = FALSE;
+
+#ifdef HAVE_LIBEXIF
+	if (record) {
+		status = gdip_jpeg_keep_exif (&cinfo, record);
+		if (status != Ok)
+			goto error;
+	}
+#endif
+
 	cinfo.do_fancy_upsampling = FALSE;
 	cinfo.do_block_smoothing = FALSE;
 
+	/* the 1/2, 1/4 and 1/8 scales are available in every libjpeg version */
+	if (width && height && !region) {
+		while (cinfo.scale_denom < 8 &&
+			(cinfo.image_width + cinfo.scale_denom * 2 - 1) / (cinfo.scale_denom * 2) >= width &&
+			(cinfo.image_height + cinfo.scale_denom * 2 - 1) / (cinfo.scale_denom * 2) >= height) {
+			cinfo.scale_denom *= 2;
+		}
+	}
+
 	result = gdip_bitmap_new_with_frame (NULL, TRUE);
 	if (!result) {
 		status = OutOfMemory;
@@ -308,23 +692,9 @@ gdip_load_jpeg_image_internal (struct jpeg_source_mgr *src, GpImage **image)
 	}
 
 	result->type = ImageTypeBitmap;
-	result->active_bitmap->width = cinfo.image_width;
-	result->active_bitmap->height = cinfo.image_height;
 	result->active_bitmap->image_flags = ImageFlagsReadOnly | ImageFlagsHasRealPixelSize;
 
-	if (cinfo.density_unit == 1) { /* dpi */
-		result->active_bitmap->dpi_horz = cinfo.X_density;
-		result->active_bitmap->dpi_vert = cinfo.Y_density;
-	} else if (cinfo.density_unit == 2) { /* dots/cm */
-		result->active_bitmap->dpi_horz = cinfo.X_density * 2.54;
-		result->active_bitmap->dpi_vert = cinfo.Y_density * 2.54;
-	} else { /* unknown density */
-		result->active_bitmap->dpi_horz = 0;
-		result->active_bitmap->dpi_vert = 0;
-	}
-
-	if (result->active_bitmap->dpi_horz && result->active_bitmap->dpi_vert)
-		result->active_bitmap->image_flags |= ImageFlagsHasRealDPI;
+	gdip_jpeg_load_resolution (&cinfo, record, result->active_bitmap);
 
 	if (cinfo.num_components == 1) {
 		result->cairo_format = CAIRO_FORMAT_A8;
@@ -362,22 +732,14 @@ gdip_load_jpeg_image_internal (struct jpeg_source_mgr *src, GpImage **image)
 		break;
 	}
 
-	size *= cinfo.image_width;
-	/* stride is a (signed) _int_ and once multiplied by 4 it should hold a value that can be allocated by GdipAlloc
-	 * this effectively limits 'width' to 536870911 pixels */
-	if (size > G_MAXINT32) {
-		status = OutOfMemory;
-		goto error;
-	}
-	stride = result->active_bitmap->stride = size;
-
 	/* Request cairo-compat output */
 	/* libjpeg can do only following conversions,
 	 * YCbCr => GRAYSCALE, YCbCr => RGB
 	 * GRAYSCALE => RGB, YCCK => CMYK.
 	 * Therefore, we convert YCbCr, GRAYSCALE to RGB and
 	 * YCCK to CMYK using the libjpeg. We convert CMYK
-	 * to RGB ourself.
+	 * to RGB ourself. libjpeg-turbo can also write the
+	 * 32bpp rows we need directly, saving the expansion.
 	 */
 	switch (cinfo.jpeg_color_space) {
 	case JCS_GRAYSCALE:
@@ -391,8 +753,17 @@ gdip_load_jpeg_image_internal (struct jpeg_source_mgr *src, GpImage **image)
 		/* fall through */
 	case JCS_RGB:
 	case JCS_YCbCr:
+#if defined(JCS_EXTENSIONS)
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+		cinfo.out_color_space = JCS_EXT_BGRX;
+#else
+		cinfo.out_color_space = JCS_EXT_XRGB;
+#endif
+		cinfo.out_color_components = 4;
+#else
 		cinfo.out_color_space = JCS_RGB;
 		cinfo.out_color_components = 3;
+#endif
 		break;
 	case JCS_YCCK:
 	case JCS_CMYK:
@@ -405,10 +776,56 @@ gdip_load_jpeg_image_internal (struct jpeg_source_mgr *src, GpImage **image)
 		goto error;
 	}
 
+	jpeg_calc_output_dimensions (&cinfo);
+
+	if (region) {
+		if (region->X < 0 || region->Y < 0 || region->Width <= 0 || region->Height <= 0 ||
+			(JDIMENSION) region->X + (JDIMENSION) region->Width > cinfo.output_width ||
+			(JDIMENSION) region->Y + (JDIMENSION) region->Height > cinfo.output_height) {
+			status = InvalidParameter;
+			goto error;
+		}
+
+		result->active_bitmap->width = region->Width;
+		result->active_bitmap->height = region->Height;
+		first_line = region->Y;
+		region_x = region->X;
+	} else {
+		result->active_bitmap->width = cinfo.output_width;
+		result->active_bitmap->height = cinfo.output_height;
+	}
+	end_line = first_line + result->active_bitmap->height;
+
+	pixel_size = size;
+	size *= cinfo.output_width;
+	/* stride is a (signed) _int_ and once multiplied by 4 it should hold a value that can be allocated by GdipAlloc
+	 * this effectively limits 'width' to 536870911 pixels */
+	if (size > G_MAXINT32) {
+		status = OutOfMemory;
+		goto error;
+	}
+
 	jpeg_start_decompress (&cinfo);
 
+#ifdef HAVE_JPEG_CROP_SCANLINE
+	/* libjpeg-turbo only decodes the iMCU columns the region is in, and skips the lines above it */
+	if (region) {
+		JDIMENSION crop_x = region->X;
+		JDIMENSION crop_width = region->Width;
+
+		jpeg_crop_scanline (&cinfo, &crop_x, &crop_width);
+		region_x = region->X - crop_x;
+		if (first_line)
+			jpeg_skip_scanlines (&cinfo, first_line);
+	}
+#endif
+
+	/* the lines are decoded as wide as libjpeg outputs them, and the region's columns are moved in place afterwards */
+	size = (unsigned long long int) pixel_size * cinfo.output_width;
+	stride = size;
+
 	/* ensure total 'size' does not overflow an integer and fits inside our 2GB limit */
-	size *= cinfo.output_height;
+	size *= result->active_bitmap->height;
 	if (size > G_MAXINT32) {
 		status = OutOfMemory;
 		goto error;
@@ -418,54 +835,34 @@ gdip_load_jpeg_image_internal (struct jpeg_source_mgr *src, GpImage **image)
 		status = OutOfMemory;
 		goto error;
 	}
-	destptr = destbuf;
 
-	while (cinfo.output_scanline < cinfo.output_height) {
+	/* without jpeg_skip_scanlines the lines above the region have to be decoded, into the first line of the bitmap */
+	while (cinfo.output_scanline < first_line) {
+		lines[0] = destbuf;
+		jpeg_read_scanlines (&cinfo, lines, 1);
+	}
+
+	while (cinfo.output_scanline < end_line) {
 		int i;
 		int nlines;
-		for (i = 0; i < cinfo.rec_outbuf_height; i++) {
+		int count = MIN (cinfo.rec_outbuf_height, (int) (end_line - cinfo.output_scanline));
+
+		destptr = destbuf + (size_t) (cinfo.output_scanline - first_line) * stride;
+		for (i = 0; i < count; i++) {
 			lines[i] = destptr;
 			destptr += stride;
 		}
 
-		nlines = jpeg_read_scanlines (&cinfo, lines, cinfo.rec_outbuf_height);
+		nlines = jpeg_read_scanlines (&cinfo, lines, count);
 
 		/* If the out colorspace is not RBG, we need to convert it to RBG. */
 		if (cinfo.out_color_space == JCS_CMYK) {
-			int i, j;
-
-			for (i = 0; i < cinfo.rec_outbuf_height; i++) {
-				BYTE *lineptr = lines [i];
-
-				for (j = 0; j < cinfo.output_width; j++) {
-					JOCTET c, m, y, k;
-					JOCTET r, g, b;
-
-					c = lineptr [0];
-					m = lineptr [1];
-					y = lineptr [2];
-					k = lineptr [3];
-
-					/* Adobe photoshop seems to have a bug and inverts the CMYK data.
-					 * We might need to remove this check, if Adobe decides to fix it. */
-					if (cinfo.saw_Adobe_marker) {
-						b = (k * c) / 255;
-						g = (k * m) / 255;
-						r = (k * y) / 255;
-					}  else {
-						b = (255 - k) * (255 - c) / 255;
-						g = (255 - k) * (255 - m) / 255;
-						r = (255 - k) * (255 - y) / 255;
-					}
-
-					set_pixel_bgra(lineptr, 0, b, g, r, 0xff);
-					lineptr += 4;
-				}
-			}
-		} else if (cinfo.out_color_components == 1) {
-			/* no decoding required, we already have all we need */
+			for (i = 0; i < nlines; i++)
+				gdip_jpeg_cmyk_to_bgra (lines[i], cinfo.output_width, cinfo.saw_Adobe_marker);
+		} else if (cinfo.out_color_space != JCS_RGB) {
+			/* no decoding required for greyscale or libjpeg-turbo's 32bpp rows */
 		} else {
-			int width = result->active_bitmap->width;
+			int width = cinfo.output_width;
 			for (i = 0; i < nlines; i++) {
 				int j;
 				BYTE *inptr, *outptr;
@@ -515,9 +912,29 @@ gdip_load_jpeg_image_internal (struct jpeg_source_mgr *src, GpImage **image)
 		}
 	}
 
-	jpeg_finish_decompress (&cinfo);
+	if (region) {
+		/* the lines below the region are never decoded */
+		jpeg_abort_decompress (&cinfo);
+
+		if (region_x != 0 || cinfo.output_width != (JDIMENSION) region->Width) {
+			int region_stride = pixel_size * region->Width;
+			BYTE *shrunk;
+			int y;
+
+			for (y = 0; y < region->Height; y++)
+				memmove (destbuf + (size_t) y * region_stride, destbuf + (size_t) y * stride + region_x * pixel_size, region_stride);
+			stride = region_stride;
+
+			shrunk = gdip_realloc (destbuf, stride * region->Height);
+			if (shrunk)
+				destbuf = shrunk;
+		}
+	} else {
+		jpeg_finish_decompress (&cinfo);
+	}
 	jpeg_destroy_decompress (&cinfo);
 
+	result->active_bitmap->stride = stride;
 	result->active_bitmap->scan0 = destbuf;
 	result->active_bitmap->reserved = GBD_OWN_SCAN0;
 	
@@ -525,6 +942,8 @@ gdip_load_jpeg_image_internal (struct jpeg_source_mgr *src, GpImage **image)
 	return Ok;
 
 error:
+	jpeg_destroy_decompress (&cinfo);
+
 	/* coverity[dead_error_line] */
 	if (destbuf != NULL) {
 		GdipFree (destbuf);
@@ -537,6 +956,43 @@ error:
 	return status;
 }
 
+static GpStatus
+gdip_jpeg_decoder_load (JpegFrameDecoder *decoder, UINT width, UINT height, GpImage **image)
+{
+	struct jpeg_source_mgr src;
+
+	_gdip_source_memory_init (&src, decoder->data, decoder->size);
+	return gdip_load_jpeg_image_internal (&src, width, height, NULL, NULL, image);
+}
+
+static GpStatus
+gdip_jpeg_decoder_decode (BitmapFrameDecoder *decoder, int frame, int index, ActiveBitmapData *data)
+{
+	GpImage *image;
+	GpStatus status;
+
+	/* only keeping the EXIF data */
+	if (!((JpegFrameDecoder *) decoder)->data)
+		return OutOfMemory;
+
+	status = gdip_jpeg_decoder_load ((JpegFrameDecoder *) decoder, 0, 0, &image);
+	if (status != Ok)
+		return status;
+
+	data->scan0 = image->active_bitmap->scan0;
+	data->stride = image->active_bitmap->stride;
+	image->active_bitmap->scan0 = NULL;
+	image->active_bitmap->reserved &= ~GBD_OWN_SCAN0;
+	gdip_bitmap_dispose (image);
+	return Ok;
+}
+
+static GpStatus
+gdip_jpeg_decoder_decode_scaled (BitmapFrameDecoder *decoder, UINT width, UINT height, GpImage **image)
+{
+	return gdip_jpeg_decoder_load ((JpegFrameDecoder *) decoder, width, height, image);
+}
+
 #ifdef HAVE_LIBEXIF
 static void
 add_properties_from_entry (ExifEntry *entry, void *user_data)
@@ -552,90 +1008,131 @@ add_properties_from_content (ExifContent *content, void *user_data)
 	exif_content_foreach_entry (content, add_properties_from_entry, user_data);
 }
 
-static int
-get_exif_tag_value_as_int (ExifData* exif, ExifTag tag)
+static GpStatus
+gdip_jpeg_decoder_load_properties (BitmapFrameDecoder *decoder, int frame, int index, ActiveBitmapData *data)
 {
-	ExifEntry* entry = exif_data_get_entry (exif, tag);
+	JpegFrameDecoder *jpeg_decoder = (JpegFrameDecoder *) decoder;
+	ExifData *exif_data;
 
-	if (entry) {
-		ExifByteOrder order;
+	exif_data = exif_data_new_from_data (jpeg_decoder->exif, jpeg_decoder->exif_size);
+	if (exif_data == NULL)
+		return OutOfMemory;
 
-		order = exif_data_get_byte_order (exif);
-		return (int)exif_get_short (entry->data, order);
+	exif_data_foreach_content (exif_data, add_properties_from_content, data);
+	/* thumbnail */
+	if (exif_data->size != 0) {
+		gdip_bitmapdata_property_add (data, PropertyTagThumbnailData, exif_data->size, PropertyTagTypeByte, exif_data->data);
 	}
 
-	return -1;
+	exif_data_unref (exif_data);
+	return Ok;
 }
+#endif
 
-static int
-get_exif_tag_value_as_resolution (ExifData* exif, ExifTag tag)
+static void
+gdip_jpeg_decoder_dispose (BitmapFrameDecoder *decoder)
+{
+	JpegFrameDecoder *jpeg_decoder = (JpegFrameDecoder *) decoder;
+
+	GdipFree (jpeg_decoder->data);
+	GdipFree (jpeg_decoder->exif);
+	GdipFree (jpeg_decoder);
+}
+
+static BitmapFrameDecoder *gdip_jpeg_decoder_properties_only (BitmapFrameDecoder *decoder);
+
+/* Creates a decoder that takes data (the compressed image, or NULL) and exif */
+static JpegFrameDecoder *
+gdip_jpeg_decoder_new (BYTE *data, size_t size, BYTE *exif, unsigned int exif_size)
+{
+	JpegFrameDecoder *decoder;
+
+	decoder = GdipAlloc (sizeof (JpegFrameDecoder));
+	if (!decoder)
+		return NULL;
+
+	gdip_frame_decoder_init (&decoder->base);
+	decoder->base.decode = gdip_jpeg_decoder_decode;
+	decoder->base.decode_scaled = data ? gdip_jpeg_decoder_decode_scaled : NULL;
+#ifdef HAVE_LIBEXIF
+	decoder->base.load_properties = gdip_jpeg_decoder_load_properties;
+#else
+	decoder->base.load_properties = NULL;
+#endif
+	decoder->base.properties_only = data && exif ? gdip_jpeg_decoder_properties_only : NULL;
+	decoder->base.dispose = gdip_jpeg_decoder_dispose;
+	decoder->data = data;
+	decoder->size = size;
+	decoder->exif = exif;
+	decoder->exif_size = exif_size;
+	return decoder;
+}
+
+/* A copy of the EXIF data alone, for a bitmap whose pixels were modified before its properties were asked for */
+static BitmapFrameDecoder *
+gdip_jpeg_decoder_properties_only (BitmapFrameDecoder *decoder)
 {
-	ExifEntry* entry = exif_data_get_entry (exif, tag);
+	JpegFrameDecoder *jpeg_decoder = (JpegFrameDecoder *) decoder;
+	JpegFrameDecoder *result;
+	BYTE *exif;
 
-	if (entry) {
-		gchar buf[1024];
+	exif = GdipAlloc (jpeg_decoder->exif_size);
+	if (!exif)
+		return NULL;
 
-		exif_entry_get_value (entry, buf, 1024);
-		return (int)g_ascii_strtoll (buf, NULL, 0);
+	memcpy (exif, jpeg_decoder->exif, jpeg_decoder->exif_size);
+	result = gdip_jpeg_decoder_new (NULL, 0, exif, jpeg_decoder->exif_size);
+	if (!result) {
+		GdipFree (exif);
+		return NULL;
 	}
 
-	return 0;
+	return &result->base;
 }
 
+/* Hands the compressed data and the EXIF data the loader recorded over to a decoder of the image, which takes them */
 static void
-load_exif_data (ExifData *exif_data, GpImage *image)
+gdip_jpeg_keep_source (GpImage *image, JpegSourceRecord *record)
 {
-	ActiveBitmapData *bitmap;
+	JpegFrameDecoder *decoder;
 
-	if (exif_data == NULL)
-		return;
-
-	bitmap = image->active_bitmap;
-	exif_data_foreach_content (exif_data, add_properties_from_content, bitmap);
-	/* thumbnail */
-	if (exif_data->size != 0) {
-		gdip_bitmapdata_property_add (bitmap, PropertyTagThumbnailData, exif_data->size, PropertyTagTypeByte, exif_data->data);
+	if (!record->enabled) {
+		GdipFree (record->data);
+		record->data = NULL;
 	}
 
-	/* Get image resolution from the EXIF data if either the x-rolution or y-resolution was not set */
-	if (image->active_bitmap->dpi_horz == 0 || image->active_bitmap->dpi_vert == 0) {
-		int resolution_unit = get_exif_tag_value_as_int (exif_data, EXIF_TAG_RESOLUTION_UNIT);
+	if (!record->data && !record->exif)
+		return;
 
-		int x_resolution = get_exif_tag_value_as_resolution (exif_data, EXIF_TAG_X_RESOLUTION);
-		int y_resolution = get_exif_tag_value_as_resolution (exif_data, EXIF_TAG_Y_RESOLUTION);
+	decoder = gdip_jpeg_decoder_new (record->data, record->size, record->exif, record->exif_size);
+	if (!decoder)
+		return;
 
-		if (resolution_unit == 2) { /* dpi */
-			image->active_bitmap->dpi_horz = x_resolution;
-			image->active_bitmap->dpi_vert = y_resolution;
-		}
-		else if (resolution_unit == 3) { /* dots/cm */
-			image->active_bitmap->dpi_horz = x_resolution * 2.54;
-			image->active_bitmap->dpi_vert = y_resolution * 2.54;
-		}
+	record->data = NULL;
+	record->exif = NULL;
 
-		// Other densities are not supported. 
-	}
+	/* the properties are added the first time they are asked for */
+	if (decoder->exif)
+		image->active_bitmap->reserved |= GBD_PROPERTIES_PENDING;
 
-	exif_data_unref (exif_data);
+	gdip_bitmap_set_frame_decoder (image, &decoder->base);
 }
-#endif
 
-GpStatus 
-gdip_load_jpeg_image_from_file (FILE *fp, const char *filename, GpImage **image)
-{
-	GpStatus st;
 
+static gdip_stdio_jpeg_source_mgr_ptr
+gdip_jpeg_stdio_source_new (FILE *fp)
+{
 	gdip_stdio_jpeg_source_mgr_ptr src;
 
 	src = (gdip_stdio_jpeg_source_mgr_ptr) GdipAlloc (sizeof (struct gdip_stdio_jpeg_source_mgr));
 	if (src == NULL) {
-		return OutOfMemory;
+		return NULL;
 	}
 
 	src->buf = GdipAlloc (JPEG_BUFFER_SIZE * sizeof(JOCTET));
 	if (src->buf == NULL) {
 		GdipFree(src);
-		return OutOfMemory;
+		return NULL;
 	}
 
 	src->parent.init_source = _gdip_source_dummy_init;
@@ -647,39 +1144,23 @@ gdip_load_jpeg_image_from_file (FILE *fp, const char *filename, GpImage **image)
 	src->parent.next_input_byte = NULL;
 
 	src->infp = fp;
-
-	st = gdip_load_jpeg_image_internal ((struct jpeg_source_mgr *) src, image);
-	GdipFree (src->buf);
-	GdipFree (src);
-#ifdef HAVE_LIBEXIF
-	if (st == Ok) {
-		load_exif_data (exif_data_new_from_file (filename), *image);
-	}
-#endif
-
-	return st;
+	return src;
 }
 
-GpStatus
-gdip_load_jpeg_image_from_stream_delegate (dstream_t *loader, GpImage **image)
+static gdip_stream_jpeg_source_mgr_ptr
+gdip_jpeg_stream_source_new (dstream_t *loader)
 {
-	GpStatus st;
-#ifdef HAVE_LIBEXIF
-	unsigned int length;
-	BYTE *ptr;
-#endif
-
 	gdip_stream_jpeg_source_mgr_ptr src;
 
 	src = (gdip_stream_jpeg_source_mgr_ptr) GdipAlloc (sizeof (struct gdip_stream_jpeg_source_mgr));
 	if (!src) {
-		return OutOfMemory;
+		return NULL;
 	}
 
 	src->buf = GdipAlloc (JPEG_BUFFER_SIZE * sizeof(JOCTET));
 	if (!src->buf) {
 		GdipFree (src);
-		return OutOfMemory;
+		return NULL;
 	}
 
 	src->parent.init_source = _gdip_source_dummy_init;
@@ -691,19 +1172,213 @@ gdip_load_jpeg_image_from_stream_delegate (dstream_t *loader, GpImage **image)
 	src->parent.next_input_byte = NULL;
 
 	src->loader = loader;
+	return src;
+}
+
+/* Reads the header of the image, and its EXIF data for the resolution, but none of its pixels */
+static GpStatus
+gdip_read_jpeg_image_info_internal (struct jpeg_source_mgr *src, GpImageInfo *info)
+{
+	struct jpeg_decompress_struct	cinfo;
+	struct gdip_jpeg_error_mgr	jerr;
+	JpegSourceRecord	record = {FALSE, NULL, 0, 0, NULL, 0};
+	ActiveBitmapData	data;
+	GpStatus	status = Ok;
+
+	cinfo.err = jpeg_std_error ((struct jpeg_error_mgr *) &jerr);
+	jerr.parent.error_exit = _gdip_jpeg_error_exit;
+	jerr.parent.output_message = _gdip_jpeg_output_message;
+
+	if (sigsetjmp (jerr.setjmp_buffer, 1)) {
+		/* Error occured while reading the header */
+		status = OutOfMemory;
+		goto done;
+	}
+
+	jpeg_create_decompress (&cinfo);
+	cinfo.src = src;
+	cinfo.client_data = &record;
+
 #ifdef HAVE_LIBEXIF
-	dstream_keep_exif_buffer (loader);
+	jpeg_save_markers (&cinfo, JPEG_APP0 + 1, 0xFFFF);
 #endif
 
-	st = gdip_load_jpeg_image_internal ((struct jpeg_source_mgr *) src, image);
+	jpeg_read_header (&cinfo, TRUE);
+
+#ifdef HAVE_LIBEXIF
+	status = gdip_jpeg_keep_exif (&cinfo, &record);
+	if (status != Ok)
+		goto done;
+#endif
+
+	/* as the loader gives it to the image */
+	if (cinfo.num_components == 1) {
+		info->PixelFormat = PixelFormat8bppIndexed;
+	} else if (cinfo.num_components == 3) {
+		info->PixelFormat = PixelFormat24bppRGB;
+	} else if (cinfo.num_components == 4) {
+		info->PixelFormat = PixelFormat32bppRGB;
+	} else {
+		status = InvalidParameter;
+		goto done;
+	}
+
+	switch (cinfo.jpeg_color_space) {
+	case JCS_GRAYSCALE:
+	case JCS_RGB:
+	case JCS_YCbCr:
+	case JCS_YCCK:
+	case JCS_CMYK:
+		break;
+	default:
+		/* Unsupported JPEG color space */
+		status = InvalidParameter;
+		goto done;
+	}
+
+	memset (&data, 0, sizeof (ActiveBitmapData));
+	gdip_jpeg_load_resolution (&cinfo, &record, &data);
+
+	info->Width = cinfo.image_width;
+	info->Height = cinfo.image_height;
+	info->FrameCount = 1;
+	info->DpiX = data.dpi_horz;
+	info->DpiY = data.dpi_vert;
+
+done:
+	jpeg_destroy_decompress (&cinfo);
+	if (record.exif)
+		GdipFree (record.exif);
+	return status;
+}
+
+GpStatus
+gdip_read_jpeg_image_info_from_file (FILE *fp, GpImageInfo *info)
+{
+	GpStatus st;
+	gdip_stdio_jpeg_source_mgr_ptr src;
+
+	src = gdip_jpeg_stdio_source_new (fp);
+	if (src == NULL) {
+		return OutOfMemory;
+	}
+
+	st = gdip_read_jpeg_image_info_internal ((struct jpeg_source_mgr *) src, info);
 	GdipFree (src->buf);
 	GdipFree (src);
-#ifdef HAVE_LIBEXIF
-	if (st == Ok){
-		dstream_get_exif_buffer (loader, &ptr, &length);
-		load_exif_data (exif_data_new_from_data (ptr, length), *image);
+	return st;
+}
+
+GpStatus
+gdip_read_jpeg_image_info_from_stream_delegate (dstream_t *loader, GpImageInfo *info)
+{
+	GpStatus st;
+	gdip_stream_jpeg_source_mgr_ptr src;
+
+	src = gdip_jpeg_stream_source_new (loader);
+	if (!src) {
+		return OutOfMemory;
 	}
-#endif
+
+	st = gdip_read_jpeg_image_info_internal ((struct jpeg_source_mgr *) src, info);
+	GdipFree (src->buf);
+	GdipFree (src);
+	return st;
+}
+
+GpStatus 
+gdip_load_jpeg_image_from_file (FILE *fp, UINT width, UINT height, GDIPCONST Rect *region,
+	GpImage **image)
+{
+	GpStatus st;
+	JpegSourceRecord record = {FALSE, NULL, 0, 0, NULL, 0};
+
+	gdip_stdio_jpeg_source_mgr_ptr src;
+
+	src = gdip_jpeg_stdio_source_new (fp);
+	if (src == NULL) {
+		return OutOfMemory;
+	}
+
+	/* a scaled down image, or a part of one, is already small */
+	record.enabled = (!width || !height) && !region;
+
+	st = gdip_load_jpeg_image_internal ((struct jpeg_source_mgr *) src, width, height, region, &record, image);
+	GdipFree (src->buf);
+	GdipFree (src);
+	if (st == Ok)
+		gdip_jpeg_keep_source (*image, &record);
+	if (record.data)
+		GdipFree (record.data);
+	if (record.exif)
+		GdipFree (record.exif);
+
+	return st;
+}
+
+GpStatus
+gdip_load_jpeg_image_from_stream_delegate (dstream_t *loader, UINT width, UINT height, GDIPCONST Rect *region,
+	GpImage **image)
+{
+	GpStatus st;
+	JpegSourceRecord record = {FALSE, NULL, 0, 0, NULL, 0};
+
+	gdip_stream_jpeg_source_mgr_ptr src;
+
+	src = gdip_jpeg_stream_source_new (loader);
+	if (!src) {
+		return OutOfMemory;
+	}
+
+	/* a scaled down image, or a part of one, is already small */
+	record.enabled = (!width || !height) && !region;
+
+	st = gdip_load_jpeg_image_internal ((struct jpeg_source_mgr *) src, width, height, region, &record, image);
+	GdipFree (src->buf);
+	GdipFree (src);
+	if (st == Ok)
+		gdip_jpeg_keep_source (*image, &record);
+	if (record.data)
+		GdipFree (record.data);
+	if (record.exif)
+		GdipFree (record.exif);
+
+	return st;
+}
+
+GpStatus
+gdip_load_jpeg_image_from_memory (MemorySource *ms, UINT width, UINT height, GDIPCONST Rect *region,
+	GpImage **image)
+{
+	GpStatus st;
+	JpegSourceRecord record = {FALSE, NULL, 0, 0, NULL, 0};
+	struct jpeg_source_mgr src;
+	size_t size = ms->size - ms->pos;
+
+	_gdip_source_memory_init (&src, ms->ptr + ms->pos, size);
+
+	/* a scaled down image, or a part of one, is already small */
+	record.enabled = (!width || !height) && !region;
+
+	st = gdip_load_jpeg_image_internal (&src, width, height, region, &record, image);
+
+	/* nothing was recorded while reading from memory, the compressed data is kept in one copy instead */
+	if (st == Ok && record.enabled) {
+		record.data = GdipAlloc (size);
+		if (record.data) {
+			memcpy (record.data, ms->ptr + ms->pos, size);
+			record.size = size;
+		} else {
+			record.enabled = FALSE;
+		}
+	}
+
+	if (st == Ok)
+		gdip_jpeg_keep_source (*image, &record);
+	if (record.data)
+		GdipFree (record.data);
+	if (record.exif)
+		GdipFree (record.exif);
 
 	return st;
 }
@@ -933,12 +1608,33 @@ gdip_getcodecinfo_jpeg ()
 }
 
 GpStatus
-gdip_load_jpeg_image_from_file (FILE *fp, const char *filename, GpImage **image)
+gdip_load_jpeg_image_from_file (FILE *fp, UINT width, UINT height, GDIPCONST Rect *region,
+	GpImage **image)
+{
+	*image = NULL;
+	return UnknownImageFormat;
+}
+
+GpStatus
+gdip_load_jpeg_image_from_memory (MemorySource *ms, UINT width, UINT height, GDIPCONST Rect *region,
+	GpImage **image)
 {
 	*image = NULL;
 	return UnknownImageFormat;
 }
 
+GpStatus
+gdip_read_jpeg_image_info_from_file (FILE *fp, GpImageInfo *info)
+{
+	return UnknownImageFormat;
+}
+
+GpStatus
+gdip_read_jpeg_image_info_from_stream_delegate (dstream_t *loader, GpImageInfo *info)
+{
+	return UnknownImageFormat;
+}
+
 GpStatus 
 gdip_save_jpeg_image_to_file (FILE *fp, GpImage *image, GDIPCONST EncoderParameters *params)
 {
@@ -946,7 +1642,8 @@ gdip_save_jpeg_image_to_file (FILE *fp, GpImage *image, GDIPCONST EncoderParamet
 }
 
 GpStatus
-gdip_load_jpeg_image_from_stream_delegate (dstream_t *loader, GpImage **image)
+gdip_load_jpeg_image_from_stream_delegate (dstream_t *loader, UINT width, UINT height, GDIPCONST Rect *region,
+	GpImage **image)
 {
 	*image = NULL;
 	return UnknownImageFormat;
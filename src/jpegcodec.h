@@ -14,9 +14,24 @@
 #include "bitmap-private.h"
 #include "bmpcodec.h"
 
-GpStatus gdip_load_jpeg_image_from_file (FILE *fp, const char *filename, GpImage **image) GDIP_INTERNAL;
+/*
+ * width and height, when not 0, let the image be decoded at a reduced size that is at least that large.
+ * region, when not NULL, is the only part of the full size image that is decoded.
+ */
+GpStatus gdip_load_jpeg_image_from_file (FILE *fp, UINT width, UINT height, GDIPCONST Rect *region,
+	GpImage **image) GDIP_INTERNAL;
+
+GpStatus gdip_load_jpeg_image_from_stream_delegate (dstream_t *loader, UINT width, UINT height, GDIPCONST Rect *region,
+	GpImage **image) GDIP_INTERNAL;
+
+GpStatus gdip_load_jpeg_image_from_memory (MemorySource *ms, UINT width, UINT height, GDIPCONST Rect *region,
+	GpImage **image) GDIP_INTERNAL;
+
+/* whether large images loaded from now on keep their compressed data, to be decoded again scaled down */
+
+GpStatus gdip_read_jpeg_image_info_from_file (FILE *fp, GpImageInfo *info) GDIP_INTERNAL;
 
-GpStatus gdip_load_jpeg_image_from_stream_delegate (dstream_t *loader, GpImage **image) GDIP_INTERNAL;
+GpStatus gdip_read_jpeg_image_info_from_stream_delegate (dstream_t *loader, GpImageInfo *info) GDIP_INTERNAL;
 
 GpStatus gdip_save_jpeg_image_to_file (FILE *fp, GpImage *image, GDIPCONST EncoderParameters *params) GDIP_INTERNAL;
 
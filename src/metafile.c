@@ -1663,7 +1663,7 @@ GpStatus GdipCreateMetafileFromDelegate_linux (GetHeaderDelegate getHeaderFunc,
 	if (!metafile)
 		return InvalidParameter;
 
-	loader = dstream_input_new (getBytesFunc, seekFunc);
+	loader = dstream_input_new (getBytesFunc, seekFunc, sizeFunc);
 	if (loader) {
 		status = gdip_get_metafile_from (loader, metafile, DStream);
 		dstream_free (loader);
@@ -1829,7 +1829,7 @@ GdipGetMetafileHeaderFromDelegate_linux (GetHeaderDelegate getHeaderFunc, GetByt
 	if (!header)
 		return status;
 
-	loader = dstream_input_new (getBytesFunc, seekFunc);
+	loader = dstream_input_new (getBytesFunc, seekFunc, NULL);
 	if (loader) {
 		status = gdip_get_metafileheader_from (loader, header, DStream);
 		/* if EMF check for additional header record */
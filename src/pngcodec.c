@@ -33,6 +33,7 @@ GUID gdip_png_image_format_guid = {0xb96b3cafU, 0x0728U, 0x11d3U, {0x9d, 0x7b, 0
 #ifdef HAVE_LIBPNG
 
 #include <png.h>
+#include <zlib.h>
 #include "codecs-private.h"
 #include "pngcodec.h"
 #include <setjmp.h>
@@ -93,6 +94,20 @@ _gdip_png_stream_read_data (png_structp png_ptr, png_bytep data, png_size_t leng
 	}
 }
 
+static void
+_gdip_png_memory_read_data (png_structp png_ptr, png_bytep data, png_size_t length)
+{
+	MemorySource *ms = (MemorySource *) png_get_io_ptr (png_ptr);
+
+	/* In png parlance, it is an error to read less than length */
+	if (length > (png_size_t) (ms->size - ms->pos)) {
+		png_error(png_ptr, "Read failed");
+	}
+
+	memcpy (data, ms->ptr + ms->pos, length);
+	ms->pos += length;
+}
+
 static void
 _gdip_png_stream_write_data (png_structp png_ptr, png_bytep data, png_size_t length)
 {
@@ -106,8 +121,8 @@ _gdip_png_stream_flush_data (png_structp png_ptr)
 	/* nothing */
 }
 
-static GpStatus
-gdip_load_png_properties (png_structp png_ptr, png_infop info_ptr, png_infop end_ptr, ActiveBitmapData *bitmap_data)
+static void
+gdip_load_png_resolution (png_structp png_ptr, png_infop info_ptr, ActiveBitmapData *bitmap_data)
 {
 #if defined(PNG_INCH_CONVERSIONS) && defined(PNG_FLOATING_POINT_SUPPORTED)
 	bitmap_data->image_flags |= ImageFlagsHasRealDPI;
@@ -130,6 +145,12 @@ gdip_load_png_properties (png_structp png_ptr, png_infop info_ptr, png_infop end
 	if (bitmap_data->dpi_horz == 0 || bitmap_data->dpi_vert == 0) {
 		 bitmap_data->dpi_horz = bitmap_data->dpi_vert = gdip_get_display_dpi ();
 	}
+}
+
+static GpStatus
+gdip_load_png_properties (png_structp png_ptr, png_infop info_ptr, png_infop end_ptr, ActiveBitmapData *bitmap_data)
+{
+	gdip_load_png_resolution (png_ptr, info_ptr, bitmap_data);
 
 #if defined(PNG_iCCP_SUPPORTED)
 	{
@@ -241,8 +262,88 @@ gdip_load_png_properties (png_structp png_ptr, png_infop info_ptr, png_infop end
 	return Ok;
 }
 
+/*
+ * Sets up the transformations that give the rows libgdiplus stores, once png_read_info was called, and returns
+ * the number of channels the pixel format is chosen from.
+ */
+static int
+gdip_png_set_transformations (png_structp png_ptr, png_infop info_ptr)
+{
+	int	bit_depth;
+	int	channels;
+	BYTE	original_color_type;
+
+	bit_depth = png_get_bit_depth(png_ptr, info_ptr);
+	original_color_type = png_get_color_type(png_ptr, info_ptr);
+	channels = png_get_channels(png_ptr, info_ptr);
+
+	/* Apply png_set_strip_16, which basically reduces the color palette from 16-bits to 8-bits
+	 * for 16-bit color depths. The current implementation of libgdiplus doesn't handle bit depths > 8,
+	 * so this acts as a workaround. Net impact is that the quality of the image is slightly reduced instead
+	 * of refusing to process the image (and potentially crashing the application) altogether;
+	 * proper support would mean supporting 16-bit color channels.
+	 * Partially fixes http://bugzilla.ximian.com/show_bug.cgi?id=80693 */
+	if (bit_depth == 16) {
+		png_set_strip_16 (png_ptr);
+		png_set_gray_to_rgb (png_ptr);
+		png_set_bgr (png_ptr);
+		png_set_add_alpha (png_ptr, 0xFF, PNG_FILLER_AFTER);
+		channels = 4;
+	}
+
+	if (bit_depth == 2
+		|| (bit_depth == 4 && original_color_type != PNG_COLOR_TYPE_PALETTE)
+		|| (bit_depth == 8 && original_color_type != PNG_COLOR_TYPE_PALETTE)) {
+		png_set_expand (png_ptr);
+		png_set_gray_to_rgb (png_ptr);
+		png_set_bgr (png_ptr);
+		png_set_add_alpha (png_ptr, 0xFF, PNG_FILLER_AFTER);
+	}
+
+	if (bit_depth == 8 && !(channels == 1 && (original_color_type == PNG_COLOR_TYPE_PALETTE || original_color_type == PNG_COLOR_TYPE_GRAY))) {
+		png_set_bgr (png_ptr);
+		png_set_add_alpha (png_ptr, 0xFF, PNG_FILLER_AFTER);
+	}
+
+	// Update the image properties after the transformations have been applied.
+	// The channels property is not refreshed; the original value will be used
+	// later to set the pixel format.
+	png_read_update_info (png_ptr, info_ptr);
+
+	return channels;
+}
+
+/* The pixel format gdip_load_png_image_from_file_or_stream gives the image, or PixelFormatUndefined if it can't load it */
+static PixelFormat
+gdip_png_get_pixel_format (int bit_depth, int color_type, int channels)
+{
+	/* 2bpp is a special case (promoted to 32bpp ARGB by MS GDI+) */
+	if ((bit_depth <= 8) && (bit_depth != 2) && (channels == 1) &&
+		((color_type == PNG_COLOR_TYPE_PALETTE)	|| (color_type == PNG_COLOR_TYPE_GRAY))) {
+		switch (bit_depth) {
+		case 1:
+			return PixelFormat1bppIndexed;
+		case 4:
+			return PixelFormat4bppIndexed;
+		case 8:
+			return PixelFormat8bppIndexed;
+		}
+		return PixelFormatUndefined;
+	}
+
+	if (bit_depth == 8 && (color_type == PNG_COLOR_TYPE_RGBA || color_type == PNG_COLOR_TYPE_RGB)) {
+		if (channels == 3)
+			return PixelFormat24bppRGB;
+		if ((channels == 1) && (color_type == PNG_COLOR_TYPE_GRAY))
+			return PixelFormat8bppIndexed;
+		return PixelFormat32bppARGB;
+	}
+
+	return PixelFormatUndefined;
+}
+
 static GpStatus 
-gdip_load_png_image_from_file_or_stream (FILE *fp, GetBytesDelegate getBytesFunc, GpImage **image)
+gdip_load_png_image_from_file_or_stream (FILE *fp, GetBytesDelegate getBytesFunc, MemorySource *ms, GpImage **image)
 {
 	png_structp	png_ptr = NULL;
 	png_infop	info_ptr = NULL;
@@ -256,6 +357,7 @@ gdip_load_png_image_from_file_or_stream (FILE *fp, GetBytesDelegate getBytesFunc
 	BYTE		original_color_type;
 	int 	num_palette = 0;
 	png_colorp	png_palette = NULL;
+	PixelFormat	format;
 
 	png_ptr = png_create_read_struct (PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
 
@@ -280,56 +382,23 @@ gdip_load_png_image_from_file_or_stream (FILE *fp, GetBytesDelegate getBytesFunc
 
 	if (fp != NULL) {
 		png_init_io (png_ptr, fp);
+	} else if (ms != NULL) {
+		png_set_read_fn (png_ptr, (void *) ms, _gdip_png_memory_read_data);
 	} else {
 		png_set_read_fn (png_ptr, (void *) getBytesFunc, _gdip_png_stream_read_data);
 	}
 
 	png_read_info(png_ptr, info_ptr);
 
-	bit_depth = png_get_bit_depth(png_ptr, info_ptr);
 	original_color_type = png_get_color_type(png_ptr, info_ptr);
-	channels = png_get_channels(png_ptr, info_ptr);
-
-	/* Apply png_set_strip_16, which basically reduces the color palette from 16-bits to 8-bits
-	 * for 16-bit color depths. The current implementation of libgdiplus doesn't handle bit depths > 8,
-	 * so this acts as a workaround. Net impact is that the quality of the image is slightly reduced instead
-	 * of refusing to process the image (and potentially crashing the application) altogether;
-	 * proper support would mean supporting 16-bit color channels.
-	 * Partially fixes http://bugzilla.ximian.com/show_bug.cgi?id=80693 */
-	if (bit_depth == 16) {
-		png_set_strip_16 (png_ptr);
-		png_set_gray_to_rgb (png_ptr);
-		png_set_bgr (png_ptr);
-		png_set_add_alpha (png_ptr, 0xFF, PNG_FILLER_AFTER);
-		channels = 4;
-	}
-
-	if (bit_depth == 2
-		|| (bit_depth == 4 && original_color_type != PNG_COLOR_TYPE_PALETTE)
-		|| (bit_depth == 8 && original_color_type != PNG_COLOR_TYPE_PALETTE)) {
-		png_set_expand (png_ptr);
-		png_set_gray_to_rgb (png_ptr);
-		png_set_bgr (png_ptr);
-		png_set_add_alpha (png_ptr, 0xFF, PNG_FILLER_AFTER);
-	}
-
-	if (bit_depth == 8 && !(channels == 1 && (original_color_type == PNG_COLOR_TYPE_PALETTE || original_color_type == PNG_COLOR_TYPE_GRAY))) {
-		png_set_bgr (png_ptr);
-		png_set_add_alpha (png_ptr, 0xFF, PNG_FILLER_AFTER);
-	}
-
-	// Update the image properties after the transformations have been applied.
-	// The channels property is not refreshed; the original value will be used
-	// later to set the pixel format.
-	png_read_update_info (png_ptr, info_ptr);
+	channels = gdip_png_set_transformations (png_ptr, info_ptr);
 
 	bit_depth = png_get_bit_depth (png_ptr, info_ptr);
 	color_type = png_get_color_type (png_ptr, info_ptr);
 	png_get_PLTE( png_ptr, info_ptr, &png_palette, &num_palette );
 
-	/* 2bpp is a special case (promoted to 32bpp ARGB by MS GDI+) */
-	if ((bit_depth <= 8) && (bit_depth != 2) && (channels == 1) &&
-		((color_type == PNG_COLOR_TYPE_PALETTE)	|| (color_type == PNG_COLOR_TYPE_GRAY))) {
+	format = gdip_png_get_pixel_format (bit_depth, color_type, channels);
+	if (gdip_is_an_indexed_pixelformat (format)) {
 		int		width;
 		int		height;
 		int		source_stride;
@@ -462,31 +531,16 @@ gdip_load_png_image_from_file_or_stream (FILE *fp, GetBytesDelegate getBytesFunc
 		result->active_bitmap->scan0 = rawdata;
 		result->active_bitmap->reserved = GBD_OWN_SCAN0;
 
-		switch (bit_depth) {
-		case 1:
-			result->active_bitmap->pixel_format = PixelFormat1bppIndexed;
-			result->cairo_format = CAIRO_FORMAT_A1;
-			break;
-		// note: 2bpp is a special case as the format is "promoted" to PixelFormat32bppARGB / CAIRO_FORMAT_ARGB32
-		//       we deal with this later...
-		case 4:
-			result->active_bitmap->pixel_format = PixelFormat4bppIndexed;
-			result->cairo_format = CAIRO_FORMAT_A8;
-			break;
-		case 8:
-			result->active_bitmap->pixel_format = PixelFormat8bppIndexed;
-			result->cairo_format = CAIRO_FORMAT_A8;
-			break;
-		}
+		result->active_bitmap->pixel_format = format;
+		result->cairo_format = format == PixelFormat1bppIndexed ? CAIRO_FORMAT_A1 : CAIRO_FORMAT_A8;
 
 		result->active_bitmap->image_flags = ImageFlagsReadOnly | ImageFlagsHasRealPixelSize | colourspace_flag; /* assigned when the palette is loaded */
 		result->active_bitmap->dpi_horz = 0;
 		result->active_bitmap->dpi_vert = 0;
 		result->active_bitmap->palette = palette;
-	} else if (bit_depth == 8 && (color_type == PNG_COLOR_TYPE_RGBA || color_type == PNG_COLOR_TYPE_RGB)) {
+	} else if (format != PixelFormatUndefined) {
 		int		width;
 		int		height;
-		BYTE		bit_depth;
 		int		stride;
 		png_bytep *row_pointers;
 		int i;
@@ -494,14 +548,6 @@ gdip_load_png_image_from_file_or_stream (FILE *fp, GetBytesDelegate getBytesFunc
 		width = png_get_image_width (png_ptr, info_ptr);
 		height = png_get_image_height (png_ptr, info_ptr);
 
-		/* 24 and 32bpp are supported, 48, 64bpp aren't, see http://bugzilla.ximian.com/show_bug.cgi?id=80693 */
-		bit_depth = png_get_bit_depth (png_ptr, info_ptr);
-		if (bit_depth > 8) {
-			g_warning ("PNG images with %dbpp aren't supported by libgdiplus.", channels * bit_depth);
-			status = UnknownImageFormat;
-			goto error;
-		}
-
 		stride = (width * 4);
 		gdip_align_stride (stride);
 
@@ -543,21 +589,16 @@ gdip_load_png_image_from_file_or_stream (FILE *fp, GetBytesDelegate getBytesFunc
 
 		result->cairo_format = CAIRO_FORMAT_ARGB32;
 		result->active_bitmap->stride = stride;
-		result->active_bitmap->pixel_format = PixelFormat32bppARGB;
+		result->active_bitmap->pixel_format = format;
 		result->active_bitmap->width = width;
 		result->active_bitmap->height = height;
 		result->active_bitmap->scan0 = rawdata;
 		result->active_bitmap->reserved = GBD_OWN_SCAN0;
 
-		if (channels == 3) {
-			result->active_bitmap->pixel_format = PixelFormat24bppRGB;
-			result->active_bitmap->image_flags = ImageFlagsColorSpaceRGB;
-		} else if (channels == 4) {
-			result->active_bitmap->pixel_format = PixelFormat32bppARGB;
+		if (channels == 3 || channels == 4) {
 			result->active_bitmap->image_flags = ImageFlagsColorSpaceRGB;
 		} else if ((channels == 1) && (color_type == PNG_COLOR_TYPE_GRAY)) {
 			// doesn't apply to 2bpp images
-			result->active_bitmap->pixel_format = PixelFormat8bppIndexed;
 			result->active_bitmap->image_flags = ImageFlagsColorSpaceGRAY;
 		} else if ((channels == 1) && (color_type == PNG_COLOR_TYPE_PALETTE)) {
 			// does apply to (what were) 2bpp images
@@ -613,13 +654,514 @@ error:
 GpStatus 
 gdip_load_png_image_from_file (FILE *fp, GpImage **image)
 {
-	return gdip_load_png_image_from_file_or_stream (fp, NULL, image);
+	return gdip_load_png_image_from_file_or_stream (fp, NULL, NULL, image);
 }
 
 GpStatus
 gdip_load_png_image_from_stream_delegate (GetBytesDelegate getBytesFunc, SeekDelegate seeknFunc, GpImage **image)
 {
-	return gdip_load_png_image_from_file_or_stream (NULL, getBytesFunc, image);
+	return gdip_load_png_image_from_file_or_stream (NULL, getBytesFunc, NULL, image);
+}
+
+GpStatus
+gdip_load_png_image_from_memory (MemorySource *ms, GpImage **image)
+{
+	return gdip_load_png_image_from_file_or_stream (NULL, NULL, ms, image);
+}
+
+/* Reads the header of the image, up to the first row, without reading (or allocating) its rows */
+static GpStatus
+gdip_read_png_image_info_from_file_or_stream (FILE *fp, GetBytesDelegate getBytesFunc, GpImageInfo *info)
+{
+	png_structp	png_ptr = NULL;
+	png_infop	info_ptr = NULL;
+	ActiveBitmapData	data;
+	GpStatus	status = OutOfMemory;
+	int		channels;
+
+	png_ptr = png_create_read_struct (PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+
+	if (!png_ptr) {
+		goto error;
+	}
+
+	if (setjmp(png_jmpbuf(png_ptr))) {
+		/* png detected error occured */
+		goto error;
+	}
+
+	info_ptr = png_create_info_struct (png_ptr);
+	if (info_ptr == NULL) {
+		goto error;
+	}
+
+	if (fp != NULL) {
+		png_init_io (png_ptr, fp);
+	} else {
+		png_set_read_fn (png_ptr, (void *) getBytesFunc, _gdip_png_stream_read_data);
+	}
+
+	png_read_info (png_ptr, info_ptr);
+	channels = gdip_png_set_transformations (png_ptr, info_ptr);
+
+	info->PixelFormat = gdip_png_get_pixel_format (png_get_bit_depth (png_ptr, info_ptr), png_get_color_type (png_ptr, info_ptr), channels);
+	if (info->PixelFormat == PixelFormatUndefined) {
+		status = InvalidParameter;
+		goto error;
+	}
+
+	memset (&data, 0, sizeof (ActiveBitmapData));
+	gdip_load_png_resolution (png_ptr, info_ptr, &data);
+
+	info->Width = png_get_image_width (png_ptr, info_ptr);
+	info->Height = png_get_image_height (png_ptr, info_ptr);
+	info->FrameCount = 1;
+	info->DpiX = data.dpi_horz;
+	info->DpiY = data.dpi_vert;
+	status = Ok;
+
+error:
+	if (png_ptr) {
+		png_destroy_read_struct (&png_ptr, info_ptr ? &info_ptr : (png_infopp) NULL, (png_infopp) NULL);
+	}
+
+	return status;
+}
+
+GpStatus
+gdip_read_png_image_info_from_file (FILE *fp, GpImageInfo *info)
+{
+	return gdip_read_png_image_info_from_file_or_stream (fp, NULL, info);
+}
+
+GpStatus
+gdip_read_png_image_info_from_stream_delegate (GetBytesDelegate getBytesFunc, SeekDelegate seeknFunc, GpImageInfo *info)
+{
+	return gdip_read_png_image_info_from_file_or_stream (NULL, getBytesFunc, info);
+}
+
+/* Reads the value of a (single valued) encoder parameter, if present */
+static GpStatus
+gdip_png_get_encoder_parameter (GDIPCONST EncoderParameters *params, const GUID *guid, int *value)
+{
+	const EncoderParameter *param = gdip_find_encoder_parameter (params, guid);
+
+	if (!param)
+		return Ok;
+
+	if (param->NumberOfValues != 1 || !param->Value)
+		return InvalidParameter;
+
+	switch (param->Type) {
+	case EncoderParameterValueTypeLong:
+		*value = *(LONG *) param->Value;
+		return Ok;
+	case EncoderParameterValueTypeShort:
+		*value = *(short *) param->Value;
+		return Ok;
+	case EncoderParameterValueTypeByte:
+		*value = *(BYTE *) param->Value;
+		return Ok;
+	default:
+		return InvalidParameter;
+	}
+}
+
+/* Gets the zlib level and strategy, the (libpng) filters and the number of threads to use, from the encoder parameters */
+static GpStatus
+gdip_png_get_encoder_settings (GDIPCONST EncoderParameters *params, int *level, int *strategy, int *filters, int *threads)
+{
+	GpStatus status;
+	int preset = PngEncoderPresetDefault;
+
+	/* keep the defaults we always used: libpng's, and a single thread */
+	*level = -1;
+	*strategy = -1;
+	*filters = PNG_NO_FILTERS;
+	*threads = 1;
+
+	if (!params)
+		return Ok;
+
+	status = gdip_png_get_encoder_parameter (params, &GdipEncoderPngPreset, &preset);
+	if (status != Ok)
+		return status;
+
+	switch (preset) {
+	case PngEncoderPresetDefault:
+		break;
+	case PngEncoderPresetFast:
+		*level = 1;
+		*filters = PNG_FILTER_SUB | PNG_FILTER_UP;
+		break;
+	case PngEncoderPresetSmallest:
+		*level = 9;
+		*filters = PNG_ALL_FILTERS;
+		break;
+	default:
+		return InvalidParameter;
+	}
+
+	status = gdip_png_get_encoder_parameter (params, &GdipEncoderPngCompressionLevel, level);
+	if (status != Ok)
+		return status;
+	if (*level < -1 || *level > 9)
+		return InvalidParameter;
+
+	status = gdip_png_get_encoder_parameter (params, &GdipEncoderPngCompressionStrategy, strategy);
+	if (status != Ok)
+		return status;
+	if (*strategy < -1 || *strategy > PngStrategyFixed)
+		return InvalidParameter;
+
+	status = gdip_png_get_encoder_parameter (params, &GdipEncoderPngFilter, filters);
+	if (status != Ok)
+		return status;
+	if ((*filters & ~PNG_ALL_FILTERS) != 0)
+		return InvalidParameter;
+
+	status = gdip_png_get_encoder_parameter (params, &GdipEncoderPngThreads, threads);
+	if (status != Ok)
+		return status;
+	if (*threads < 0 || *threads > GDIP_MAX_WORKERS)
+		return InvalidParameter;
+
+	return Ok;
+}
+
+/* With several threads, the rows are compressed in chunks of (at least) this many bytes... */
+#define PNG_PARALLEL_CHUNK_SIZE		(256 * 1024)
+/* ...each primed with (up to) this many bytes before it, so that matches can reach back into the previous chunk */
+#define PNG_PARALLEL_DICTIONARY_SIZE	(32 * 1024)
+/* ...and this many chunks per thread are kept in memory before they are written */
+#define PNG_PARALLEL_BATCH		4
+
+typedef struct {
+	BYTE		*data;
+	size_t		size;
+	uLong		adler;
+	uLong		length;		/* of the filtered rows that were compressed */
+} PngCompressedChunk;
+
+typedef struct {
+	ActiveBitmapData	*bitmap_data;
+	size_t			row_bytes;
+	int			pixel_bytes;
+	int			rows_per_chunk;
+	int			chunks;
+	int			first_chunk;	/* of the current batch */
+	int			level;
+	int			strategy;
+	int			filters;
+	PngCompressedChunk	*compressed;	/* one per chunk of the current batch */
+} PngParallelEncoder;
+
+/* Gets a row the way it's stored in the PNG file, i.e. RGB(A) instead of our native endian ARGB words */
+static void
+gdip_png_get_row (ActiveBitmapData *bitmap_data, int y, size_t row_bytes, BYTE *row)
+{
+	BYTE *scan = bitmap_data->scan0 + bitmap_data->stride * y;
+	ARGB color;
+	int x;
+
+	switch (bitmap_data->pixel_format) {
+	case PixelFormat24bppRGB:
+		for (x = 0; x < bitmap_data->width; x++) {
+			color = ((ARGB *) scan)[x];
+			*row++ = (color >> 16) & 0xFF;
+			*row++ = (color >> 8) & 0xFF;
+			*row++ = color & 0xFF;
+		}
+		break;
+	case PixelFormat32bppARGB:
+	case PixelFormat32bppPARGB:
+	case PixelFormat32bppRGB:
+		for (x = 0; x < bitmap_data->width; x++) {
+			color = ((ARGB *) scan)[x];
+			*row++ = (color >> 16) & 0xFF;
+			*row++ = (color >> 8) & 0xFF;
+			*row++ = color & 0xFF;
+			*row++ = color >> 24;
+		}
+		break;
+	default:
+		memcpy (row, scan, row_bytes);
+		break;
+	}
+}
+
+/* Applies one of the PNG filters to row, given the (unfiltered) row above it. out gets the filter type and the filtered row */
+static void
+gdip_png_apply_filter (int type, const BYTE *row, const BYTE *prior, size_t row_bytes, int pixel_bytes, BYTE *out)
+{
+	size_t i;
+	int left;
+	int up_left;
+	int p;
+	int pa;
+	int pb;
+	int pc;
+
+	*out++ = type;
+
+	switch (type) {
+	case PNG_FILTER_VALUE_SUB:
+		for (i = 0; i < row_bytes; i++)
+			out[i] = row[i] - (i >= pixel_bytes ? row[i - pixel_bytes] : 0);
+		break;
+	case PNG_FILTER_VALUE_UP:
+		for (i = 0; i < row_bytes; i++)
+			out[i] = row[i] - prior[i];
+		break;
+	case PNG_FILTER_VALUE_AVG:
+		for (i = 0; i < row_bytes; i++) {
+			left = i >= pixel_bytes ? row[i - pixel_bytes] : 0;
+			out[i] = row[i] - ((left + prior[i]) >> 1);
+		}
+		break;
+	case PNG_FILTER_VALUE_PAETH:
+		for (i = 0; i < row_bytes; i++) {
+			left = i >= pixel_bytes ? row[i - pixel_bytes] : 0;
+			up_left = i >= pixel_bytes ? prior[i - pixel_bytes] : 0;
+			p = left + prior[i] - up_left;
+			pa = abs (p - left);
+			pb = abs (p - prior[i]);
+			pc = abs (p - up_left);
+			if (pa <= pb && pa <= pc)
+				out[i] = row[i] - left;
+			else if (pb <= pc)
+				out[i] = row[i] - prior[i];
+			else
+				out[i] = row[i] - up_left;
+		}
+		break;
+	default:
+		memcpy (out, row, row_bytes);
+		break;
+	}
+}
+
+/* Filters a row with the allowed filter that gives the smallest sum of (signed) differences, like libpng does */
+static void
+gdip_png_filter_row (int filters, const BYTE *row, const BYTE *prior, size_t row_bytes, int pixel_bytes, BYTE *out, BYTE *scratch)
+{
+	static const int types[] = { PNG_FILTER_VALUE_NONE, PNG_FILTER_VALUE_SUB, PNG_FILTER_VALUE_UP, PNG_FILTER_VALUE_AVG, PNG_FILTER_VALUE_PAETH };
+	static const int masks[] = { PNG_FILTER_NONE, PNG_FILTER_SUB, PNG_FILTER_UP, PNG_FILTER_AVG, PNG_FILTER_PAETH };
+	unsigned long best = ULONG_MAX;
+	unsigned long sum;
+	size_t i;
+	int t;
+
+	for (t = 0; t < sizeof (types) / sizeof (types[0]); t++) {
+		if (!(filters & masks[t]))
+			continue;
+
+		if (filters == masks[t]) {
+			gdip_png_apply_filter (types[t], row, prior, row_bytes, pixel_bytes, out);
+			return;
+		}
+
+		gdip_png_apply_filter (types[t], row, prior, row_bytes, pixel_bytes, scratch);
+		sum = 0;
+		for (i = 1; i <= row_bytes && sum < best; i++)
+			sum += scratch[i] < 128 ? scratch[i] : 256 - scratch[i];
+
+		if (sum < best) {
+			best = sum;
+			memcpy (out, scratch, row_bytes + 1);
+		}
+	}
+}
+
+/* Filters and compresses one chunk of rows into a raw deflate stream, which ends with a sync flush unless it's the last chunk */
+static GpStatus
+gdip_png_compress_chunk (int worker, int index, void *data)
+{
+	PngParallelEncoder *encoder = (PngParallelEncoder *) data;
+	PngCompressedChunk *compressed = &encoder->compressed[index];
+	ActiveBitmapData *bitmap_data = encoder->bitmap_data;
+	int chunk = encoder->first_chunk + index;
+	BOOL last = chunk == encoder->chunks - 1;
+	size_t filtered_bytes = encoder->row_bytes + 1;
+	int first_row = chunk * encoder->rows_per_chunk;
+	int end_row = MIN (first_row + encoder->rows_per_chunk, bitmap_data->height);
+	int dictionary_rows = 0;
+	size_t dictionary_size;
+	size_t header = 0;
+	size_t trailer = 0;
+	size_t length;
+	BYTE *filtered = NULL;
+	BYTE *rows = NULL;
+	BYTE *row;
+	BYTE *prior;
+	BYTE *tmp;
+	BYTE *out;
+	uLong bound;
+	z_stream stream;
+	GpStatus status = OutOfMemory;
+	int result;
+	int y;
+
+	/* the rows at the end of the previous chunk are filtered again, as they prime the compressor */
+	if (first_row > 0)
+		dictionary_rows = MIN (first_row, (PNG_PARALLEL_DICTIONARY_SIZE + filtered_bytes - 1) / filtered_bytes);
+
+	filtered = GdipAlloc ((end_row - first_row + dictionary_rows) * filtered_bytes);
+	rows = gdip_calloc (3, filtered_bytes);
+	if (!filtered || !rows)
+		goto cleanup;
+
+	prior = rows;
+	row = rows + filtered_bytes;
+	if (first_row - dictionary_rows > 0)
+		gdip_png_get_row (bitmap_data, first_row - dictionary_rows - 1, encoder->row_bytes, prior);
+
+	out = filtered;
+	for (y = first_row - dictionary_rows; y < end_row; y++) {
+		gdip_png_get_row (bitmap_data, y, encoder->row_bytes, row);
+		gdip_png_filter_row (encoder->filters, row, prior, encoder->row_bytes, encoder->pixel_bytes, out, rows + 2 * filtered_bytes);
+		out += filtered_bytes;
+
+		tmp = prior;
+		prior = row;
+		row = tmp;
+	}
+
+	memset (&stream, 0, sizeof (z_stream));
+	if (deflateInit2 (&stream, encoder->level, Z_DEFLATED, -MAX_WBITS, 8, encoder->strategy) != Z_OK)
+		goto cleanup;
+
+	dictionary_size = MIN (dictionary_rows * filtered_bytes, PNG_PARALLEL_DICTIONARY_SIZE);
+	if (dictionary_size > 0)
+		deflateSetDictionary (&stream, filtered + dictionary_rows * filtered_bytes - dictionary_size, dictionary_size);
+
+	/* the first chunk starts with the zlib header and the last one ends with the checksum, which is only known later */
+	if (chunk == 0)
+		header = 2;
+	if (last)
+		trailer = 4;
+
+	length = (end_row - first_row) * filtered_bytes;
+	/* the sync flush adds up to a few bytes more than deflateBound allows for */
+	bound = deflateBound (&stream, length) + 16;
+	compressed->data = GdipAlloc (header + bound + trailer);
+	if (!compressed->data) {
+		deflateEnd (&stream);
+		goto cleanup;
+	}
+
+	stream.next_in = filtered + dictionary_rows * filtered_bytes;
+	stream.avail_in = length;
+	stream.next_out = compressed->data + header;
+	stream.avail_out = bound;
+	result = deflate (&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+	if (result != (last ? Z_STREAM_END : Z_OK) || stream.avail_in != 0 || stream.avail_out == 0) {
+		deflateEnd (&stream);
+		status = GenericError;
+		goto cleanup;
+	}
+
+	compressed->size = header + stream.total_out + trailer;
+	compressed->length = length;
+	compressed->adler = adler32 (adler32 (0, NULL, 0), filtered + dictionary_rows * filtered_bytes, length);
+	deflateEnd (&stream);
+
+	if (chunk == 0) {
+		/* CMF: deflate with a 32KiB window, and FLG: the level with the check bits */
+		int level = encoder->level == -1 ? 6 : encoder->level;
+		int flags = (level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3) << 6;
+
+		compressed->data[0] = 0x78;
+		compressed->data[1] = flags + 31 - (0x78 * 256 + flags) % 31;
+	}
+
+	status = Ok;
+
+cleanup:
+	if (filtered)
+		GdipFree (filtered);
+	if (rows)
+		GdipFree (rows);
+	return status;
+}
+
+/*
+ * Writes the image data (after png_write_info) as a single zlib stream, compressed by several threads in
+ * independent chunks. Every chunk gets its own IDAT chunk and the IEND chunk follows, so png_write_end
+ * must not be called.
+ */
+static GpStatus
+gdip_save_png_rows_parallel (png_structp png_ptr, ActiveBitmapData *bitmap_data, int bits_per_pixel, int level, int strategy, int filters, int workers)
+{
+	PngParallelEncoder encoder;
+	jmp_buf saved_jmpbuf;
+	uLong adler = adler32 (0, NULL, 0);
+	GpStatus status = Ok;
+	BYTE *trailer;
+	int batch;
+	int count;
+	int i;
+
+	encoder.bitmap_data = bitmap_data;
+	encoder.row_bytes = ((size_t) bitmap_data->width * bits_per_pixel + 7) / 8;
+	encoder.pixel_bytes = MAX (1, bits_per_pixel / 8);
+	encoder.rows_per_chunk = MAX (1, PNG_PARALLEL_CHUNK_SIZE / (encoder.row_bytes + 1));
+	encoder.chunks = (bitmap_data->height + encoder.rows_per_chunk - 1) / encoder.rows_per_chunk;
+	encoder.level = level;
+	encoder.strategy = strategy;
+	encoder.filters = filters;
+
+	batch = workers * PNG_PARALLEL_BATCH;
+	encoder.compressed = gdip_calloc (batch, sizeof (PngCompressedChunk));
+	if (!encoder.compressed)
+		return OutOfMemory;
+
+	/* png_write_chunk longjmps on errors, so free the chunks here before going on to the caller's handler */
+	memcpy (saved_jmpbuf, png_jmpbuf (png_ptr), sizeof (jmp_buf));
+	if (setjmp (png_jmpbuf (png_ptr))) {
+		for (i = 0; i < batch; i++) {
+			if (encoder.compressed[i].data)
+				GdipFree (encoder.compressed[i].data);
+		}
+		GdipFree (encoder.compressed);
+
+		memcpy (png_jmpbuf (png_ptr), saved_jmpbuf, sizeof (jmp_buf));
+		return GenericError;
+	}
+
+	for (encoder.first_chunk = 0; encoder.first_chunk < encoder.chunks && status == Ok; encoder.first_chunk += batch) {
+		count = MIN (batch, encoder.chunks - encoder.first_chunk);
+		status = gdip_parallel_for (count, workers, gdip_png_compress_chunk, &encoder);
+
+		for (i = 0; i < count; i++) {
+			PngCompressedChunk *compressed = &encoder.compressed[i];
+
+			if (status == Ok) {
+				adler = adler32_combine (adler, compressed->adler, compressed->length);
+				if (encoder.first_chunk + i == encoder.chunks - 1) {
+					trailer = compressed->data + compressed->size - 4;
+					trailer[0] = (adler >> 24) & 0xFF;
+					trailer[1] = (adler >> 16) & 0xFF;
+					trailer[2] = (adler >> 8) & 0xFF;
+					trailer[3] = adler & 0xFF;
+				}
+				png_write_chunk (png_ptr, (png_bytep) "IDAT", compressed->data, compressed->size);
+			}
+
+			if (compressed->data) {
+				GdipFree (compressed->data);
+				compressed->data = NULL;
+			}
+		}
+	}
+
+	GdipFree (encoder.compressed);
+	memcpy (png_jmpbuf (png_ptr), saved_jmpbuf, sizeof (jmp_buf));
+
+	if (status == Ok)
+		png_write_chunk (png_ptr, (png_bytep) "IEND", NULL, 0);
+
+	return status;
 }
 
 static GpStatus 
@@ -631,6 +1173,16 @@ gdip_save_png_image_to_file_or_stream (FILE *fp, PutBytesDelegate putBytesFunc,
 	int		i;
 	int		bit_depth;
 	int		color_type;
+	int		level;
+	int		strategy;
+	int		filters;
+	int		threads;
+
+	status = gdip_png_get_encoder_settings (params, &level, &strategy, &filters, &threads);
+	if (status != Ok)
+		return status;
+	if (threads == 0)
+		threads = gdip_get_worker_count ();
 
 	png_ptr = png_create_write_struct (PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
 	if (!png_ptr) {
@@ -726,10 +1278,31 @@ gdip_save_png_image_to_file_or_stream (FILE *fp, PutBytesDelegate putBytesFunc,
 		}
 	}
 
-	png_set_filter (png_ptr, 0, PNG_NO_FILTERS);
+	/* libpng takes PNG_NO_FILTERS as no choice made, and picks these; spell them out so that the parallel encoder
+	 * writes what libpng would */
+	if (filters == PNG_NO_FILTERS)
+		filters = color_type == PNG_COLOR_TYPE_PALETTE || bit_depth < 8 ? PNG_FILTER_NONE : PNG_ALL_FILTERS;
+	if (strategy == -1)
+		strategy = filters == PNG_FILTER_NONE ? Z_DEFAULT_STRATEGY : Z_FILTERED;
+
+	png_set_filter (png_ptr, 0, filters);
+	if (level != -1)
+		png_set_compression_level (png_ptr, level);
+	png_set_compression_strategy (png_ptr, strategy);
 	png_set_sRGB_gAMA_and_cHRM (png_ptr, info_ptr, PNG_sRGB_INTENT_PERCEPTUAL);
 	png_write_info (png_ptr, info_ptr);
 
+	/* only worth it when there are several chunks to compress */
+	if (threads > 1 && (png_get_rowbytes (png_ptr, info_ptr) + 1) * image->active_bitmap->height > PNG_PARALLEL_CHUNK_SIZE) {
+		status = gdip_save_png_rows_parallel (png_ptr, image->active_bitmap, bit_depth * png_get_channels (png_ptr, info_ptr),
+			level, strategy, filters, threads);
+		if (status != Ok)
+			goto error;
+
+		png_destroy_write_struct (&png_ptr, &info_ptr);
+		return Ok;
+	}
+
 	png_set_bgr(png_ptr);
 
 	if (gdip_is_an_indexed_pixelformat (image->active_bitmap->pixel_format)) {
@@ -829,6 +1402,26 @@ gdip_load_png_image_from_stream_delegate (GetBytesDelegate getBytesFunc, SeekDel
 	return UnknownImageFormat;
 }
 
+GpStatus
+gdip_load_png_image_from_memory (MemorySource *ms, GpImage **image)
+{
+	*image = NULL;
+	return UnknownImageFormat;
+}
+
+
+GpStatus
+gdip_read_png_image_info_from_file (FILE *fp, GpImageInfo *info)
+{
+	return UnknownImageFormat;
+}
+
+GpStatus
+gdip_read_png_image_info_from_stream_delegate (GetBytesDelegate getBytesFunc, SeekDelegate seeknFunc, GpImageInfo *info)
+{
+	return UnknownImageFormat;
+}
+
 
 GpStatus 
 gdip_save_png_image_to_file (FILE *fp, GpImage *image, GDIPCONST EncoderParameters *params)
@@ -860,12 +1453,54 @@ gdip_fill_encoder_parameter_list_png (EncoderParameters *buffer, UINT size)
 	if (!buffer || size != sizeof (PngEncoderParameters))
 		return InvalidParameter;
 	
-	pngBuffer->count = 1;
+	pngBuffer->count = 6;
 
 	pngBuffer->imageItems.Guid = GdipEncoderImageItems;
 	pngBuffer->imageItems.NumberOfValues = 0;
 	pngBuffer->imageItems.Type = 9; // Undocumented type.
 	pngBuffer->imageItems.Value = NULL;
 
+	pngBuffer->compressionLevel.Guid = GdipEncoderPngCompressionLevel;
+	pngBuffer->compressionLevel.NumberOfValues = 1;
+	pngBuffer->compressionLevel.Type = EncoderParameterValueTypeLongRange;
+	pngBuffer->compressionLevelRange[0] = 0;
+	pngBuffer->compressionLevelRange[1] = 9;
+	pngBuffer->compressionLevel.Value = &pngBuffer->compressionLevelRange;
+
+	pngBuffer->compressionStrategy.Guid = GdipEncoderPngCompressionStrategy;
+	pngBuffer->compressionStrategy.NumberOfValues = 5;
+	pngBuffer->compressionStrategy.Type = EncoderParameterValueTypeLong;
+	pngBuffer->compressionStrategyData[0] = PngStrategyDefault;
+	pngBuffer->compressionStrategyData[1] = PngStrategyFiltered;
+	pngBuffer->compressionStrategyData[2] = PngStrategyHuffmanOnly;
+	pngBuffer->compressionStrategyData[3] = PngStrategyRle;
+	pngBuffer->compressionStrategyData[4] = PngStrategyFixed;
+	pngBuffer->compressionStrategy.Value = &pngBuffer->compressionStrategyData;
+
+	pngBuffer->filter.Guid = GdipEncoderPngFilter;
+	pngBuffer->filter.NumberOfValues = 5;
+	pngBuffer->filter.Type = EncoderParameterValueTypeLong;
+	pngBuffer->filterData[0] = PngFilterNone;
+	pngBuffer->filterData[1] = PngFilterSub;
+	pngBuffer->filterData[2] = PngFilterUp;
+	pngBuffer->filterData[3] = PngFilterAverage;
+	pngBuffer->filterData[4] = PngFilterPaeth;
+	pngBuffer->filter.Value = &pngBuffer->filterData;
+
+	pngBuffer->preset.Guid = GdipEncoderPngPreset;
+	pngBuffer->preset.NumberOfValues = 3;
+	pngBuffer->preset.Type = EncoderParameterValueTypeLong;
+	pngBuffer->presetData[0] = PngEncoderPresetDefault;
+	pngBuffer->presetData[1] = PngEncoderPresetFast;
+	pngBuffer->presetData[2] = PngEncoderPresetSmallest;
+	pngBuffer->preset.Value = &pngBuffer->presetData;
+
+	pngBuffer->threads.Guid = GdipEncoderPngThreads;
+	pngBuffer->threads.NumberOfValues = 1;
+	pngBuffer->threads.Type = EncoderParameterValueTypeLongRange;
+	pngBuffer->threadsRange[0] = 0;
+	pngBuffer->threadsRange[1] = GDIP_MAX_WORKERS;
+	pngBuffer->threads.Value = &pngBuffer->threadsRange;
+
 	return Ok;
 }
@@ -19,6 +19,13 @@ GpStatus gdip_load_png_image_from_file (FILE *fp, GpImage **image) GDIP_INTERNAL
 GpStatus gdip_load_png_image_from_stream_delegate (GetBytesDelegate getBytesFunc, SeekDelegate seeknFunc, 
 	GpImage **image) GDIP_INTERNAL;
 
+GpStatus gdip_load_png_image_from_memory (MemorySource *ms, GpImage **image) GDIP_INTERNAL;
+
+GpStatus gdip_read_png_image_info_from_file (FILE *fp, GpImageInfo *info) GDIP_INTERNAL;
+
+GpStatus gdip_read_png_image_info_from_stream_delegate (GetBytesDelegate getBytesFunc, SeekDelegate seeknFunc,
+	GpImageInfo *info) GDIP_INTERNAL;
+
 GpStatus gdip_save_png_image_to_file (FILE *fp, GpImage *image, GDIPCONST EncoderParameters *params) GDIP_INTERNAL;
 
 GpStatus gdip_save_png_image_to_stream_delegate (PutBytesDelegate putBytesFunc, GpImage *image,
@@ -32,6 +39,16 @@ typedef struct
 {
   UINT count;
   EncoderParameter imageItems;
+  EncoderParameter compressionLevel;
+  EncoderParameter compressionStrategy;
+  EncoderParameter filter;
+  EncoderParameter preset;
+  EncoderParameter threads;
+  LONG compressionLevelRange[2];
+  LONG compressionStrategyData[5];
+  LONG filterData[5];
+  LONG presetData[3];
+  LONG threadsRange[2];
 } PngEncoderParameters;
 
 #endif /* _PNGCODEC_H */
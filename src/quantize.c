@@ -0,0 +1,802 @@
+/*
+ * quantize.c
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+ * and associated documentation files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+ * NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ * OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "quantize-private.h"
+#include "general-private.h"
+
+/*
+ * Color quantization, for GdipInitializePalette, GdipBitmapConvertFormat and the GIF encoder.
+ *
+ * The colors are counted in a histogram with 5 bits per channel, in parallel over bands of rows. The
+ * cells of the histogram are split into boxes, always splitting the box with the largest error at its
+ * median, until there is one per palette entry; a few k-means passes then move every entry to the mean
+ * of the colors that are closest to it. To map the pixels to a palette, every cell of the histogram gets
+ * the list of the entries that can be the closest one to a color in that cell, so pixels only search a
+ * few entries (and colors that are in the palette are found exactly). That is done in parallel over
+ * bands of rows too, except with error diffusion, whose errors are carried down through all the rows.
+ */
+
+#define QUANTIZE_CELLS		32768
+#define QUANTIZE_CELL(r, g, b)	((((r) >> 3) << 10) | (((g) >> 3) << 5) | ((b) >> 3))
+#define QUANTIZE_BAND_ROWS	64
+#define QUANTIZE_CELL_CHUNK	1024
+#define QUANTIZE_KMEANS_PASSES	6
+
+typedef struct {
+	guint64	count;
+	guint64	sum [3];
+} QuantizeCell;
+
+typedef struct {
+	guint64	count;
+	guint64	sum [3];
+	float	mean [3];
+} QuantizeColor;
+
+typedef struct {
+	int	start;
+	int	end;
+	double	error;		/* weighted sum of the squared distances to the mean of the box */
+	int	axis;		/* channel with the largest variance */
+} QuantizeBox;
+
+typedef struct {
+	const BYTE	*pixels;
+	int		width;
+	int		height;
+	int		stride;
+	BOOL		skip_transparent;
+	QuantizeCell	*histograms [GDIP_MAX_WORKERS];
+} QuantizeHistogramJob;
+
+typedef struct {
+	const QuantizeColor	*colors;
+	int		count;
+	int		palette_count;
+	int		palette [256][3];
+	guint64		(*sums) [256][4];	/* per chunk, so the sums don't depend on which worker did what */
+} QuantizeKMeansJob;
+
+typedef struct {
+	const BYTE	*pixels;
+	int		width;
+	int		height;
+	int		stride;
+	BYTE		*dest;
+	int		dest_stride;
+	int		depth;
+	int		rgb [256][3];
+	BYTE		opaque [256];		/* the entries pixels can be mapped to */
+	int		opaque_count;
+	int		transparent_index;	/* -1 if there is none */
+	int		alpha_threshold;	/* pixels with less alpha get the transparent entry */
+	int		fallback;		/* for palettes without opaque entries */
+	guint32		*offsets;		/* the candidates of every cell, QUANTIZE_CELLS + 1 of them */
+	BYTE		*candidates;
+	DitherType	dither;
+	int		ordered_size;
+	int		ordered [16 * 16];
+	int		*errors [GDIP_MAX_WORKERS];
+} QuantizeMapJob;
+
+static GpStatus
+gdip_quantize_histogram_band (int worker, int band, void *data)
+{
+	QuantizeHistogramJob *job = (QuantizeHistogramJob *) data;
+	QuantizeCell *histogram = job->histograms [worker];
+	QuantizeCell *cell;
+	const ARGB *row;
+	ARGB pixel;
+	int last;
+	int x, y;
+
+	if (!histogram) {
+		histogram = gdip_calloc (QUANTIZE_CELLS, sizeof (QuantizeCell));
+		if (!histogram)
+			return OutOfMemory;
+		job->histograms [worker] = histogram;
+	}
+
+	last = MIN ((band + 1) * QUANTIZE_BAND_ROWS, job->height);
+	for (y = band * QUANTIZE_BAND_ROWS; y < last; y++) {
+		row = (const ARGB *) (job->pixels + (size_t) y * job->stride);
+		for (x = 0; x < job->width; x++) {
+			pixel = row [x];
+			if (job->skip_transparent && (pixel >> 24) == 0)
+				continue;
+
+			cell = &histogram [QUANTIZE_CELL ((pixel >> 16) & 0xFF, (pixel >> 8) & 0xFF, pixel & 0xFF)];
+			cell->count++;
+			cell->sum [0] += (pixel >> 16) & 0xFF;
+			cell->sum [1] += (pixel >> 8) & 0xFF;
+			cell->sum [2] += pixel & 0xFF;
+		}
+	}
+
+	return Ok;
+}
+
+static int
+gdip_quantize_compare_channel (const void *a, const void *b, int channel)
+{
+	float difference = ((const QuantizeColor *) a)->mean [channel] - ((const QuantizeColor *) b)->mean [channel];
+
+	return (difference > 0) - (difference < 0);
+}
+
+static int
+gdip_quantize_compare_red (const void *a, const void *b)
+{
+	return gdip_quantize_compare_channel (a, b, 0);
+}
+
+static int
+gdip_quantize_compare_green (const void *a, const void *b)
+{
+	return gdip_quantize_compare_channel (a, b, 1);
+}
+
+static int
+gdip_quantize_compare_blue (const void *a, const void *b)
+{
+	return gdip_quantize_compare_channel (a, b, 2);
+}
+
+static void
+gdip_quantize_measure_box (const QuantizeColor *colors, QuantizeBox *box)
+{
+	double weight = 0;
+	double sum [3] = { 0, 0, 0 };
+	double squares [3] = { 0, 0, 0 };
+	double variance;
+	double largest = -1;
+	int i, c;
+
+	for (i = box->start; i < box->end; i++) {
+		weight += colors [i].count;
+		for (c = 0; c < 3; c++) {
+			sum [c] += colors [i].count * (double) colors [i].mean [c];
+			squares [c] += colors [i].count * (double) colors [i].mean [c] * colors [i].mean [c];
+		}
+	}
+
+	box->error = 0;
+	box->axis = 0;
+	for (c = 0; c < 3; c++) {
+		variance = squares [c] - sum [c] * sum [c] / weight;
+		box->error += variance;
+		if (variance > largest) {
+			largest = variance;
+			box->axis = c;
+		}
+	}
+}
+
+/* Splits the colors into count boxes (there are more colors than that), and sets the palette to their means */
+static void
+gdip_quantize_median_cut (QuantizeColor *colors, int colors_count, QuantizeBox *boxes, int count, int palette [256][3])
+{
+	static int (* const comparers [3]) (const void *, const void *) = {
+		gdip_quantize_compare_red, gdip_quantize_compare_green, gdip_quantize_compare_blue
+	};
+	QuantizeBox *box;
+	guint64 total;
+	guint64 half;
+	guint64 sum [3];
+	int boxes_count;
+	int split;
+	int i, c;
+
+	boxes [0].start = 0;
+	boxes [0].end = colors_count;
+	gdip_quantize_measure_box (colors, &boxes [0]);
+	boxes_count = 1;
+
+	while (boxes_count < count) {
+		box = NULL;
+		for (i = 0; i < boxes_count; i++) {
+			if (boxes [i].end - boxes [i].start > 1 && (!box || boxes [i].error > box->error))
+				box = &boxes [i];
+		}
+		if (!box)
+			break;
+
+		qsort (colors + box->start, box->end - box->start, sizeof (QuantizeColor), comparers [box->axis]);
+
+		total = 0;
+		for (i = box->start; i < box->end; i++)
+			total += colors [i].count;
+
+		half = 0;
+		for (split = box->start; split < box->end - 2; split++) {
+			half += colors [split].count;
+			if (half >= total / 2)
+				break;
+		}
+		split++;
+
+		boxes [boxes_count].start = split;
+		boxes [boxes_count].end = box->end;
+		box->end = split;
+		gdip_quantize_measure_box (colors, box);
+		gdip_quantize_measure_box (colors, &boxes [boxes_count]);
+		boxes_count++;
+	}
+
+	for (i = 0; i < count; i++) {
+		total = 0;
+		sum [0] = sum [1] = sum [2] = 0;
+		if (i < boxes_count) {
+			for (split = boxes [i].start; split < boxes [i].end; split++) {
+				total += colors [split].count;
+				for (c = 0; c < 3; c++)
+					sum [c] += colors [split].sum [c];
+			}
+		}
+
+		for (c = 0; c < 3; c++)
+			palette [i][c] = total ? (int) ((sum [c] + total / 2) / total) : 0;
+	}
+}
+
+static int
+gdip_quantize_nearest (const int palette [256][3], int count, const float color [3])
+{
+	float distance, best_distance = FLT_MAX;
+	float d;
+	int best = 0;
+	int i, c;
+
+	for (i = 0; i < count; i++) {
+		distance = 0;
+		for (c = 0; c < 3; c++) {
+			d = color [c] - palette [i][c];
+			distance += d * d;
+		}
+		if (distance < best_distance) {
+			best_distance = distance;
+			best = i;
+		}
+	}
+
+	return best;
+}
+
+static GpStatus
+gdip_quantize_kmeans_chunk (int worker, int chunk, void *data)
+{
+	QuantizeKMeansJob *job = (QuantizeKMeansJob *) data;
+	guint64 (*sums) [4] = job->sums [chunk];
+	const QuantizeColor *color;
+	int last = MIN ((chunk + 1) * QUANTIZE_CELL_CHUNK, job->count);
+	int nearest;
+	int i, c;
+
+	memset (sums, 0, sizeof (job->sums [chunk]));
+	for (i = chunk * QUANTIZE_CELL_CHUNK; i < last; i++) {
+		color = &job->colors [i];
+		nearest = gdip_quantize_nearest (job->palette, job->palette_count, color->mean);
+		sums [nearest][3] += color->count;
+		for (c = 0; c < 3; c++)
+			sums [nearest][c] += color->sum [c];
+	}
+
+	return Ok;
+}
+
+/* Moves every palette entry to the mean of the colors closest to it, until they stop moving */
+static GpStatus
+gdip_quantize_kmeans (const QuantizeColor *colors, int colors_count, int palette [256][3], int count)
+{
+	QuantizeKMeansJob job;
+	GpStatus status;
+	guint64 sum [4];
+	BOOL moved;
+	int chunks = (colors_count + QUANTIZE_CELL_CHUNK - 1) / QUANTIZE_CELL_CHUNK;
+	int pass;
+	int value;
+	int i, j, c;
+
+	job.colors = colors;
+	job.count = colors_count;
+	job.palette_count = count;
+	memcpy (job.palette, palette, sizeof (job.palette));
+	job.sums = GdipAlloc (sizeof (*job.sums) * chunks);
+	if (!job.sums)
+		return OutOfMemory;
+
+	for (pass = 0; pass < QUANTIZE_KMEANS_PASSES; pass++) {
+		status = gdip_parallel_for (chunks, gdip_get_worker_count (), gdip_quantize_kmeans_chunk, &job);
+		if (status != Ok) {
+			GdipFree (job.sums);
+			return status;
+		}
+
+		moved = FALSE;
+		for (i = 0; i < count; i++) {
+			memset (sum, 0, sizeof (sum));
+			for (j = 0; j < chunks; j++) {
+				for (c = 0; c < 4; c++)
+					sum [c] += job.sums [j][i][c];
+			}
+
+			/* an entry nothing is closest to stays where it is */
+			if (sum [3] == 0)
+				continue;
+
+			for (c = 0; c < 3; c++) {
+				value = (int) ((sum [c] + sum [3] / 2) / sum [3]);
+				if (value != job.palette [i][c]) {
+					job.palette [i][c] = value;
+					moved = TRUE;
+				}
+			}
+		}
+
+		if (!moved)
+			break;
+	}
+
+	memcpy (palette, job.palette, sizeof (job.palette));
+	GdipFree (job.sums);
+	return Ok;
+}
+
+/*
+ * Sets palette (which has room for max_colors entries) to (up to) max_colors colors to draw the width x height
+ * ARGB pixels with. With transparent, the first entry is transparent and pixels without alpha aren't counted.
+ */
+GpStatus
+gdip_quantize_palette (const BYTE *pixels, int width, int height, int stride, int max_colors, BOOL transparent, ColorPalette *palette)
+{
+	QuantizeHistogramJob job;
+	QuantizeCell *histogram;
+	QuantizeColor *colors;
+	QuantizeBox *boxes;
+	GpStatus status;
+	int entries [256][3];
+	int colors_count;
+	int count;
+	int first;
+	int i, j, c;
+
+	if (max_colors < (transparent ? 2 : 1) || max_colors > 256)
+		return InvalidParameter;
+
+	count = transparent ? max_colors - 1 : max_colors;
+
+	memset (&job, 0, sizeof (job));
+	job.pixels = pixels;
+	job.width = width;
+	job.height = height;
+	job.stride = stride;
+	job.skip_transparent = transparent;
+
+	status = gdip_parallel_for ((height + QUANTIZE_BAND_ROWS - 1) / QUANTIZE_BAND_ROWS, gdip_get_worker_count (),
+		gdip_quantize_histogram_band, &job);
+
+	/* sum the histograms of the workers */
+	histogram = NULL;
+	for (i = 0; i < GDIP_MAX_WORKERS; i++) {
+		if (!job.histograms [i])
+			continue;
+
+		if (!histogram) {
+			histogram = job.histograms [i];
+			continue;
+		}
+
+		if (status == Ok) {
+			for (j = 0; j < QUANTIZE_CELLS; j++) {
+				histogram [j].count += job.histograms [i][j].count;
+				for (c = 0; c < 3; c++)
+					histogram [j].sum [c] += job.histograms [i][j].sum [c];
+			}
+		}
+		GdipFree (job.histograms [i]);
+	}
+
+	if (status != Ok) {
+		GdipFree (histogram);
+		return status;
+	}
+
+	colors_count = 0;
+	colors = NULL;
+	if (histogram) {
+		for (j = 0; j < QUANTIZE_CELLS; j++) {
+			if (histogram [j].count)
+				colors_count++;
+		}
+
+		colors = GdipAlloc (sizeof (QuantizeColor) * MAX (colors_count, 1));
+		if (!colors) {
+			GdipFree (histogram);
+			return OutOfMemory;
+		}
+
+		for (i = 0, j = 0; j < QUANTIZE_CELLS; j++) {
+			if (!histogram [j].count)
+				continue;
+
+			colors [i].count = histogram [j].count;
+			for (c = 0; c < 3; c++) {
+				colors [i].sum [c] = histogram [j].sum [c];
+				colors [i].mean [c] = (float) histogram [j].sum [c] / histogram [j].count;
+			}
+			i++;
+		}
+		GdipFree (histogram);
+	}
+
+	if (colors_count <= count) {
+		/* every color gets its own entry */
+		count = MAX (colors_count, transparent ? 0 : 1);
+		for (i = 0; i < count; i++) {
+			for (c = 0; c < 3; c++)
+				entries [i][c] = i < colors_count ? (int) ((colors [i].sum [c] + colors [i].count / 2) / colors [i].count) : 0;
+		}
+	} else {
+		boxes = GdipAlloc (sizeof (QuantizeBox) * count);
+		if (!boxes) {
+			GdipFree (colors);
+			return OutOfMemory;
+		}
+
+		gdip_quantize_median_cut (colors, colors_count, boxes, count, entries);
+		GdipFree (boxes);
+
+		status = gdip_quantize_kmeans (colors, colors_count, entries, count);
+		if (status != Ok) {
+			GdipFree (colors);
+			return status;
+		}
+	}
+	GdipFree (colors);
+
+	first = 0;
+	palette->Flags = 0;
+	if (transparent) {
+		palette->Entries [0] = 0x00000000;
+		palette->Flags = PaletteFlagsHasAlpha;
+		first = 1;
+	}
+
+	for (i = 0; i < count; i++)
+		palette->Entries [first + i] = 0xFF000000 | (entries [i][0] << 16) | (entries [i][1] << 8) | entries [i][2];
+	palette->Count = first + count;
+
+	return Ok;
+}
+
+/* Lists the entries that may be the closest one to some color of the cell, in out (if not NULL), and counts them */
+static int
+gdip_quantize_cell_candidates (const QuantizeMapJob *job, int cell, BYTE *out)
+{
+	int low [3] = { (cell >> 10) << 3, ((cell >> 5) & 0x1F) << 3, (cell & 0x1F) << 3 };
+	int limit = INT_MAX;
+	int distance;
+	int count = 0;
+	int value;
+	int d;
+	int i, c;
+
+	/* no color of the cell is further than limit from the entry with the closest farthest corner... */
+	for (i = 0; i < job->opaque_count; i++) {
+		distance = 0;
+		for (c = 0; c < 3; c++) {
+			value = job->rgb [job->opaque [i]][c];
+			d = MAX (value - low [c], low [c] + 7 - value);
+			distance += d * d;
+		}
+		limit = MIN (limit, distance);
+	}
+
+	/* ...so entries that are further than that from the whole cell are never the closest */
+	for (i = 0; i < job->opaque_count; i++) {
+		distance = 0;
+		for (c = 0; c < 3; c++) {
+			value = job->rgb [job->opaque [i]][c];
+			d = value < low [c] ? low [c] - value : (value > low [c] + 7 ? value - low [c] - 7 : 0);
+			distance += d * d;
+		}
+
+		if (distance <= limit) {
+			if (out)
+				out [count] = job->opaque [i];
+			count++;
+		}
+	}
+
+	return count;
+}
+
+static GpStatus
+gdip_quantize_count_candidates (int worker, int chunk, void *data)
+{
+	QuantizeMapJob *job = (QuantizeMapJob *) data;
+	int cell;
+
+	for (cell = chunk * QUANTIZE_CELL_CHUNK; cell < (chunk + 1) * QUANTIZE_CELL_CHUNK; cell++)
+		job->offsets [cell + 1] = gdip_quantize_cell_candidates (job, cell, NULL);
+
+	return Ok;
+}
+
+static GpStatus
+gdip_quantize_list_candidates (int worker, int chunk, void *data)
+{
+	QuantizeMapJob *job = (QuantizeMapJob *) data;
+	int cell;
+
+	for (cell = chunk * QUANTIZE_CELL_CHUNK; cell < (chunk + 1) * QUANTIZE_CELL_CHUNK; cell++)
+		gdip_quantize_cell_candidates (job, cell, job->candidates + job->offsets [cell]);
+
+	return Ok;
+}
+
+static int
+gdip_quantize_lookup (const QuantizeMapJob *job, int red, int green, int blue)
+{
+	int cell = QUANTIZE_CELL (red, green, blue);
+	const BYTE *candidate = job->candidates + job->offsets [cell];
+	const BYTE *end = job->candidates + job->offsets [cell + 1];
+	const int *rgb;
+	int distance, best_distance = INT_MAX;
+	int best = job->fallback;
+	int dr, dg, db;
+
+	for (; candidate < end; candidate++) {
+		rgb = job->rgb [*candidate];
+		dr = red - rgb [0];
+		dg = green - rgb [1];
+		db = blue - rgb [2];
+		distance = dr * dr + dg * dg + db * db;
+		if (distance < best_distance) {
+			best_distance = distance;
+			best = *candidate;
+		}
+	}
+
+	return best;
+}
+
+static GpStatus
+gdip_quantize_map_band (int worker, int band, void *data)
+{
+	QuantizeMapJob *job = (QuantizeMapJob *) data;
+	int *errors = NULL;
+	int *current = NULL;
+	int *next = NULL;
+	int *swap;
+	const ARGB *row;
+	BYTE *dest;
+	ARGB pixel;
+	int color [3];
+	int index;
+	int offset;
+	int error;
+	int last;
+	int x, y, c;
+
+	if (job->dither == DitherTypeErrorDiffusion) {
+		errors = job->errors [worker];
+		if (!errors) {
+			errors = GdipAlloc (sizeof (int) * 6 * (job->width + 2));
+			if (!errors)
+				return OutOfMemory;
+			job->errors [worker] = errors;
+		}
+
+		/* the bands are mapped in order by a single worker, so a band starts from the errors the previous one left */
+		current = errors;
+		next = errors + 3 * (job->width + 2);
+		if (band == 0)
+			memset (current, 0, sizeof (int) * 3 * (job->width + 2));
+	}
+
+	last = MIN ((band + 1) * QUANTIZE_BAND_ROWS, job->height);
+	for (y = band * QUANTIZE_BAND_ROWS; y < last; y++) {
+		row = (const ARGB *) (job->pixels + (size_t) y * job->stride);
+		dest = job->dest + (size_t) y * job->dest_stride;
+		if (errors)
+			memset (next, 0, sizeof (int) * 3 * (job->width + 2));
+
+		for (x = 0; x < job->width; x++) {
+			pixel = row [x];
+			if (job->transparent_index >= 0 && (int) (pixel >> 24) < job->alpha_threshold) {
+				index = job->transparent_index;
+			} else {
+				color [0] = (pixel >> 16) & 0xFF;
+				color [1] = (pixel >> 8) & 0xFF;
+				color [2] = pixel & 0xFF;
+
+				if (job->ordered_size) {
+					offset = job->ordered [(y % job->ordered_size) * job->ordered_size + x % job->ordered_size];
+					for (c = 0; c < 3; c++)
+						color [c] = CLAMP (color [c] + offset, 0, 255);
+				} else if (errors) {
+					/* the errors are kept in 1/16ths */
+					for (c = 0; c < 3; c++)
+						color [c] = CLAMP (color [c] + current [3 * (x + 1) + c] / 16, 0, 255);
+				}
+
+				index = gdip_quantize_lookup (job, color [0], color [1], color [2]);
+
+				if (errors) {
+					for (c = 0; c < 3; c++) {
+						error = color [c] - job->rgb [index][c];
+						current [3 * (x + 2) + c] += error * 7;
+						next [3 * x + c] += error * 3;
+						next [3 * (x + 1) + c] += error * 5;
+						next [3 * (x + 2) + c] += error;
+					}
+				}
+			}
+
+			switch (job->depth) {
+			case 1:
+				dest [x >> 3] |= index << (7 - (x & 7));
+				break;
+			case 4:
+				dest [x >> 1] |= index << ((x & 1) ? 0 : 4);
+				break;
+			default:
+				dest [x] = index;
+				break;
+			}
+		}
+
+		if (errors) {
+			swap = current;
+			current = next;
+			next = swap;
+		}
+	}
+
+	if (errors && current != errors)
+		memcpy (errors, current, sizeof (int) * 3 * (job->width + 2));
+
+	return Ok;
+}
+
+/*
+ * Writes the index of the palette entry for each of the width x height ARGB pixels to dest, with depth (1, 4 or 8)
+ * bits per pixel; rows of less than 8 bits per pixel must be zeroed. With a transparent entry in the palette, the
+ * pixels with less than alpha_threshold alpha get it.
+ */
+GpStatus
+gdip_quantize_pixels (const BYTE *pixels, int width, int height, int stride, const ColorPalette *palette, DitherType dither,
+	int alpha_threshold, BYTE *dest, int dest_stride, int depth)
+{
+	QuantizeMapJob *job;
+	GpStatus status;
+	ARGB entry;
+	int levels;
+	int size;
+	int spread;
+	int i, n;
+
+	if (palette->Count == 0 || palette->Count > (1U << depth))
+		return InvalidParameter;
+
+	job = GdipAlloc (sizeof (QuantizeMapJob));
+	if (!job)
+		return OutOfMemory;
+
+	memset (job, 0, sizeof (QuantizeMapJob));
+	job->pixels = pixels;
+	job->width = width;
+	job->height = height;
+	job->stride = stride;
+	job->dest = dest;
+	job->dest_stride = dest_stride;
+	job->depth = depth;
+	job->dither = dither;
+	job->alpha_threshold = alpha_threshold;
+	job->transparent_index = -1;
+
+	for (i = 0; i < palette->Count; i++) {
+		entry = palette->Entries [i];
+		job->rgb [i][0] = (entry >> 16) & 0xFF;
+		job->rgb [i][1] = (entry >> 8) & 0xFF;
+		job->rgb [i][2] = entry & 0xFF;
+
+		if ((entry >> 24) != 0)
+			job->opaque [job->opaque_count++] = i;
+		else if (job->transparent_index == -1)
+			job->transparent_index = i;
+	}
+	job->fallback = job->transparent_index == -1 ? 0 : job->transparent_index;
+
+	switch (dither) {
+	case DitherTypeOrdered4x4:
+	case DitherTypeSpiral4x4:
+	case DitherTypeDualSpiral4x4:
+		size = 4;
+		break;
+	case DitherTypeOrdered8x8:
+	case DitherTypeSpiral8x8:
+	case DitherTypeDualSpiral8x8:
+		size = 8;
+		break;
+	case DitherTypeOrdered16x16:
+		size = 16;
+		break;
+	default:
+		size = 0;
+		break;
+	}
+
+	if (size) {
+		/* the spirals are only approximated by Bayer matrices */
+		job->ordered [0] = 0;
+		for (n = 1; n < size; n *= 2) {
+			for (i = 0; i < n * n; i++) {
+				int x = i % n, y = i / n;
+				int value = job->ordered [y * size + x] * 4;
+
+				job->ordered [y * size + x] = value;
+				job->ordered [y * size + x + n] = value + 2;
+				job->ordered [(y + n) * size + x] = value + 3;
+				job->ordered [(y + n) * size + x + n] = value + 1;
+			}
+		}
+
+		/* spread the thresholds over the distance between two levels of a color cube with as many entries */
+		for (levels = 2; levels * levels * levels < job->opaque_count; levels++)
+			;
+		spread = 255 / (levels - 1);
+		for (i = 0; i < size * size; i++)
+			job->ordered [i] = (2 * job->ordered [i] + 1) * spread / (2 * size * size) - spread / 2;
+		job->ordered_size = size;
+	}
+
+	job->offsets = GdipAlloc (sizeof (guint32) * (QUANTIZE_CELLS + 1));
+	if (!job->offsets) {
+		GdipFree (job);
+		return OutOfMemory;
+	}
+
+	status = gdip_parallel_for (QUANTIZE_CELLS / QUANTIZE_CELL_CHUNK, gdip_get_worker_count (), gdip_quantize_count_candidates, job);
+	if (status == Ok) {
+		job->offsets [0] = 0;
+		for (i = 0; i < QUANTIZE_CELLS; i++)
+			job->offsets [i + 1] += job->offsets [i];
+
+		job->candidates = GdipAlloc (MAX (job->offsets [QUANTIZE_CELLS], 1));
+		if (!job->candidates)
+			status = OutOfMemory;
+	}
+
+	if (status == Ok)
+		status = gdip_parallel_for (QUANTIZE_CELLS / QUANTIZE_CELL_CHUNK, gdip_get_worker_count (), gdip_quantize_list_candidates, job);
+
+	/* the errors are diffused down from one band to the next, so those bands can't be mapped in parallel */
+	if (status == Ok)
+		status = gdip_parallel_for ((height + QUANTIZE_BAND_ROWS - 1) / QUANTIZE_BAND_ROWS,
+			dither == DitherTypeErrorDiffusion ? 1 : gdip_get_worker_count (), gdip_quantize_map_band, job);
+
+	for (i = 0; i < GDIP_MAX_WORKERS; i++)
+		GdipFree (job->errors [i]);
+	GdipFree (job->candidates);
+	GdipFree (job->offsets);
+	GdipFree (job);
+	return status;
+}
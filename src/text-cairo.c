@@ -1031,6 +1031,7 @@ cairo_DrawString (GpGraphics *graphics, GDIPCONST WCHAR *stringUnicode, INT leng
 	status = MeasureString (graphics, stringUnicode, &StringLen, font, rc, fmt, brush, NULL, NULL, NULL, CleanString, StringDetails, &data);
 	if ((status == Ok) && (StringLen > 0)) {
 		status = DrawString (graphics, stringUnicode, StringLen, font, rc, fmt, brush, CleanString, StringDetails, &data);
+		gdip_graphics_image_modified (graphics);
 	}
 
 	/* Restore matrix to original values */
@@ -554,6 +554,7 @@ pango_DrawString (GpGraphics *graphics, GDIPCONST WCHAR *stringUnicode, INT leng
 
 	gdip_cairo_move_to (graphics, rc->X + box_offset.X, rc->Y + box_offset.Y, FALSE, TRUE);
 	pango_cairo_show_layout (graphics->ct, layout);
+	gdip_graphics_image_modified (graphics);
 
 	g_object_unref (layout);
 	cairo_restore (graphics->ct);
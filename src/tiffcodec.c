@@ -946,6 +946,35 @@ gdip_save_tiff_properties (TIFF *tiff, ActiveBitmapData *bitmap_data, int sample
 }
 
 /*TODO Handle TIFF Encoder Parameters*/
+/* Writes palette as the colormap of the current page, returns FALSE if it can't */
+static BOOL
+gdip_save_tiff_colormap (TIFF *tiff, ColorPalette *palette, int bits_per_sample)
+{
+	int		count;
+	int		i;
+	uint16		*colormap;
+	ARGB		color;
+
+	/* TIFF wants an entry for every possible value, and 16 bits per sample */
+	count = 1 << bits_per_sample;
+	colormap = GdipAlloc (3 * count * sizeof (uint16));
+	if (colormap == NULL) {
+		return FALSE;
+	}
+
+	for (i = 0; i < count; i++) {
+		color = (i < palette->Count) ? palette->Entries[i] : 0;
+		colormap[i] = ((color >> 16) & 0xff) * 257;
+		colormap[count + i] = ((color >> 8) & 0xff) * 257;
+		colormap[2 * count + i] = (color & 0xff) * 257;
+	}
+
+	TIFFSetField (tiff, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_PALETTE);
+	TIFFSetField (tiff, TIFFTAG_COLORMAP, colormap, colormap + count, colormap + 2 * count);
+	GdipFree (colormap);
+	return TRUE;
+}
+
 static GpStatus 
 gdip_save_tiff_image (TIFF* tiff, GpImage *image, GDIPCONST EncoderParameters *params)
 {
@@ -959,6 +988,7 @@ gdip_save_tiff_image (TIFF* tiff, GpImage *image, GDIPCONST EncoderParameters *p
 	BYTE		*pixbuf;
 	int		samples_per_pixel;
 	int		bits_per_sample;
+	BOOL		was_decoded;
 	unsigned long long int size;
 
 	if (tiff == NULL) {
@@ -969,17 +999,18 @@ gdip_save_tiff_image (TIFF* tiff, GpImage *image, GDIPCONST EncoderParameters *p
 	num_of_pages = 0;
 	for (frame = 0; frame < image->num_of_frames; frame++) {
 		num_of_pages += image->frames[frame].count;
-		for (i = 0; i < image->frames[frame].count; i++) {
-			if (gdip_is_an_indexed_pixelformat (image->frames[frame].bitmap[i].pixel_format)) {
-				return NotImplemented; /* FIXME? */
-			}
-		}
 	}
 
 	page = 0;
 	for (frame = 0; frame < image->num_of_frames; frame++) {
 		for (i = 0; i < image->frames[frame].count; i++) {
+			/* pages decoded only to be saved are dropped once written */
+			was_decoded = image->frames[frame].bitmap[i].scan0 != NULL;
+			if (gdip_bitmap_decode_frame (image, frame, i) != Ok) {
+				goto error;
+			}
 			bitmap_data = &image->frames[frame].bitmap[i];
+			gdip_bitmap_load_properties (image, bitmap_data);
 
 			if (num_of_pages > 1) {
 				if ((frame > 0) && (i > 0)) {
@@ -990,7 +1021,13 @@ gdip_save_tiff_image (TIFF* tiff, GpImage *image, GDIPCONST EncoderParameters *p
 				TIFFSetField (tiff, TIFFTAG_PAGENUMBER, page, num_of_pages);
 			}
 
-			if (((bitmap_data->pixel_format & PixelFormatAlpha) != 0) || (bitmap_data->pixel_format == PixelFormat32bppRGB)) {
+			if (gdip_is_an_indexed_pixelformat (bitmap_data->pixel_format)) {
+				if (bitmap_data->palette == NULL) {
+					goto error;
+				}
+				samples_per_pixel = 1;
+				bits_per_sample = gdip_get_pixel_format_bpp (bitmap_data->pixel_format);
+			} else if (((bitmap_data->pixel_format & PixelFormatAlpha) != 0) || (bitmap_data->pixel_format == PixelFormat32bppRGB)) {
 				samples_per_pixel = 4;
 				bits_per_sample = 8;
 			} else {
@@ -1004,12 +1041,18 @@ gdip_save_tiff_image (TIFF* tiff, GpImage *image, GDIPCONST EncoderParameters *p
 			TIFFSetField (tiff, TIFFTAG_IMAGELENGTH, bitmap_data->height);
 			TIFFSetField (tiff, TIFFTAG_BITSPERSAMPLE, bits_per_sample);
 			TIFFSetField (tiff, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
-			TIFFSetField (tiff, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+			if (samples_per_pixel == 1) {
+				if (!gdip_save_tiff_colormap (tiff, bitmap_data->palette, bits_per_sample)) {
+					goto error;
+				}
+			} else {
+				TIFFSetField (tiff, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+			}
 			TIFFSetField (tiff, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
 			TIFFSetField (tiff, TIFFTAG_ROWSPERSTRIP, TIFFDefaultStripSize (tiff, bitmap_data->stride));
 			TIFFSetField (tiff, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
 
-			size = (unsigned long long int)bitmap_data->width * samples_per_pixel;
+			size = ((unsigned long long int)bitmap_data->width * samples_per_pixel * bits_per_sample + 7) / 8;
 			if (size > G_MAXINT32) {
 				goto error;
 			}
@@ -1018,7 +1061,13 @@ gdip_save_tiff_image (TIFF* tiff, GpImage *image, GDIPCONST EncoderParameters *p
 			if (pixbuf == NULL) {
 				goto error;
 			}
-			if (samples_per_pixel == 4) {
+			if (samples_per_pixel == 1) {
+				/* indexed pixels are laid out like in the file already */
+				for (y = 0; y < bitmap_data->height; y++) {
+					memcpy (pixbuf, (BYTE*)bitmap_data->scan0 + (bitmap_data->stride * y), size);
+					TIFFWriteScanline (tiff, pixbuf, y, 0);
+				}
+			} else if (samples_per_pixel == 4) {
 				for (y = 0; y < bitmap_data->height; y++) {
 					for (x = 0; x < bitmap_data->width; x++) {
 #ifdef WORDS_BIGENDIAN
@@ -1053,6 +1102,7 @@ gdip_save_tiff_image (TIFF* tiff, GpImage *image, GDIPCONST EncoderParameters *p
 			}
 			GdipFree(pixbuf);
 			TIFFWriteDirectory (tiff);
+			gdip_bitmap_release_frame (image, frame, i, was_decoded);
 			page++;
 		}	
 	}
@@ -1065,22 +1115,685 @@ error:
 }
 
 
-static GpStatus 
-gdip_load_tiff_image (TIFF *tiff, GpImage **image)
+/* A file read in memory, several TIFF handles (each with its own stream) can read it at the same time */
+typedef struct {
+	BYTE			*data;
+	toff_t			size;
+	toff_t			position;
+} TiffMemoryStream;
+
+/* Multi-page images keep their (still compressed) file in memory, and only decode the pixels
+ * of a page once it gets selected, see gdip_bitmap_decode_frame */
+typedef struct {
+	BitmapFrameDecoder	base;
+	TIFF			*tiff;
+	TiffMemoryStream	stream;
+} TiffFrameDecoder;
+
+static tsize_t 
+gdip_tiff_memread (thandle_t clientData, tdata_t buffer, tsize_t size)
+{
+	TiffMemoryStream *stream = (TiffMemoryStream *) clientData;
+
+	if (size <= 0 || stream->position >= stream->size)
+		return 0;
+
+	if ((toff_t) size > stream->size - stream->position)
+		size = stream->size - stream->position;
+
+	memcpy (buffer, stream->data + stream->position, size);
+	stream->position += size;
+	return size;
+}
+
+static toff_t 
+gdip_tiff_memseek (thandle_t clientData, toff_t offSet, int whence)
+{
+	TiffMemoryStream *stream = (TiffMemoryStream *) clientData;
+	toff_t position;
+
+	switch (whence) {
+	case SEEK_SET:
+		position = offSet;
+		break;
+	case SEEK_CUR:
+		position = stream->position + offSet;
+		break;
+	case SEEK_END:
+		position = stream->size + offSet;
+		break;
+	default:
+		return -1;
+	}
+
+	if (position > stream->size)
+		return -1;
+
+	stream->position = position;
+	return position;
+}
+
+static int 
+gdip_tiff_memclose (thandle_t clientData)
+{
+	/* the data is freed by the owner of the stream */
+	return 0;
+}
+
+static toff_t 
+gdip_tiff_memsize (thandle_t clientData)
+{
+	return ((TiffMemoryStream *) clientData)->size;
+}
+
+static int
+gdip_tiff_memmap (thandle_t clientData, tdata_t *phase, toff_t* size)
+{
+	TiffMemoryStream *stream = (TiffMemoryStream *) clientData;
+
+	*phase = stream->data;
+	*size = stream->size;
+	return 1;
+}
+
+/* Reads the whole file using the procs tiff was opened with */
+static BYTE *
+gdip_tiff_read_all (TIFF *tiff, toff_t *size)
+{
+	thandle_t	handle = TIFFClientdata (tiff);
+	TIFFReadWriteProc	read_proc = TIFFGetReadProc (tiff);
+	TIFFSeekProc	seek_proc = TIFFGetSeekProc (tiff);
+	TIFFSizeProc	size_proc = TIFFGetSizeProc (tiff);
+	BYTE		*data;
+	toff_t		total;
+	toff_t		done;
+	tsize_t		count;
+
+	/* libtiff uses signed int as offsets, so we limit ourselves to 2GB (like for the pixels) */
+	total = size_proc (handle);
+	if (total == 0 || total > G_MAXINT32)
+		return NULL;
+
+	if (seek_proc (handle, 0, SEEK_SET) != 0)
+		return NULL;
+
+	data = GdipAlloc (total);
+	if (data == NULL)
+		return NULL;
+
+	for (done = 0; done < total; done += count) {
+		count = read_proc (handle, data + done, total - done);
+		if (count <= 0) {
+			GdipFree (data);
+			return NULL;
+		}
+	}
+
+	*size = total;
+	return data;
+}
+
+/* Opens a (read only) TIFF handle on stream */
+static TIFF *
+gdip_tiff_open_memory (TiffMemoryStream *stream)
+{
+	stream->position = 0;
+	return TIFFClientOpen("<memory>", "r", (thandle_t) stream, gdip_tiff_memread, 
+				gdip_tiff_read_none, gdip_tiff_memseek, gdip_tiff_memclose, 
+				gdip_tiff_memsize, gdip_tiff_memmap, gdip_tiff_dummy_unmap);
+}
+
+/* Returns the pixel format a page can be read into as is (the samples only being rearranged in place), or 0
+ * if it has to go through TIFFRGBAImage, which always produces 32bpp pixels */
+static PixelFormat
+gdip_tiff_native_format (TIFF *tiff)
+{
+	uint16	photometric;
+	uint16	bits_per_sample;
+	uint16	samples_per_pixel;
+	uint16	planar_configuration;
+	uint16	orientation;
+	uint16	compression;
+	uint16	sample_format;
+
+	if (!TIFFGetField(tiff, TIFFTAG_PHOTOMETRIC, &photometric)) {
+		return 0;
+	}
+
+	TIFFGetFieldDefaulted(tiff, TIFFTAG_BITSPERSAMPLE, &bits_per_sample);
+	TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLESPERPIXEL, &samples_per_pixel);
+	TIFFGetFieldDefaulted(tiff, TIFFTAG_PLANARCONFIG, &planar_configuration);
+	TIFFGetFieldDefaulted(tiff, TIFFTAG_ORIENTATION, &orientation);
+	TIFFGetFieldDefaulted(tiff, TIFFTAG_COMPRESSION, &compression);
+	TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLEFORMAT, &sample_format);
+
+	/* TIFFRGBAImage takes care of the other orientations, of old-style JPEG, and of signed or floating point samples */
+	if (orientation != ORIENTATION_TOPLEFT || compression == COMPRESSION_OJPEG || sample_format != SAMPLEFORMAT_UINT) {
+		return 0;
+	}
+
+	switch (photometric) {
+	case PHOTOMETRIC_MINISWHITE:
+	case PHOTOMETRIC_MINISBLACK:
+	case PHOTOMETRIC_PALETTE:
+		if (samples_per_pixel != 1) {
+			return 0;
+		}
+
+		switch (bits_per_sample) {
+		case 1:
+			return PixelFormat1bppIndexed;
+		case 4:
+			return PixelFormat4bppIndexed;
+		case 8:
+			return PixelFormat8bppIndexed;
+		default:
+			return 0;
+		}
+	case PHOTOMETRIC_RGB:
+		if (samples_per_pixel == 3 && bits_per_sample == 8 && planar_configuration == PLANARCONFIG_CONTIG) {
+			return PixelFormat24bppRGB;
+		}
+		return 0;
+	default:
+		return 0;
+	}
+}
+
+/* Builds the palette of a page read as indexed pixels: its colormap, or the shades of gray */
+static ColorPalette *
+gdip_load_tiff_palette (TIFF *tiff, PixelFormat pixel_format)
+{
+	ColorPalette	*palette;
+	int		count;
+	int		shift;
+	int		i;
+	uint16		photometric;
+	uint16		*rmap;
+	uint16		*gmap;
+	uint16		*bmap;
+
+	count = 1 << gdip_get_pixel_format_bpp (pixel_format);
+	palette = GdipAlloc (sizeof(ColorPalette) + sizeof(ARGB) * count);
+	if (palette == NULL) {
+		return NULL;
+	}
+	palette->Count = count;
+
+	TIFFGetField(tiff, TIFFTAG_PHOTOMETRIC, &photometric);
+	if (photometric == PHOTOMETRIC_PALETTE) {
+		if (!TIFFGetField(tiff, TIFFTAG_COLORMAP, &rmap, &gmap, &bmap)) {
+			GdipFree (palette);
+			return NULL;
+		}
+
+		/* like TIFFRGBAImage, assume a 8 bits colormap (written by old software) if no entry needs 16 bits */
+		shift = 0;
+		for (i = 0; i < count; i++) {
+			if (rmap[i] >= 256 || gmap[i] >= 256 || bmap[i] >= 256) {
+				shift = 8;
+				break;
+			}
+		}
+
+		palette->Flags = 0;
+		for (i = 0; i < count; i++) {
+			palette->Entries[i] = 0xFF000000 | ((rmap[i] >> shift) << 16) | ((gmap[i] >> shift) << 8) | (bmap[i] >> shift);
+		}
+	} else {
+		palette->Flags = PaletteFlagsGrayScale;
+		for (i = 0; i < count; i++) {
+			BYTE gray = i * 255 / (count - 1);
+
+			if (photometric == PHOTOMETRIC_MINISWHITE) {
+				gray = 255 - gray;
+			}
+			palette->Entries[i] = 0xFF000000 | (gray << 16) | (gray << 8) | gray;
+		}
+	}
+
+	return palette;
+}
+
+/* pages with fewer pixels than this are read on the calling thread only */
+#define TIFF_PARALLEL_MIN_PIXELS	(1024 * 1024)
+
+/* Reading the strips (or tiles) of a page, possibly from several threads (workers) */
+typedef struct {
+	ActiveBitmapData	*bitmap_data;
+	BYTE			*pixels;
+	int			page;
+	int			bpp;		/* bits per pixel in the file */
+	BOOL			tiled;
+	BOOL			direct;		/* strips can be decoded straight into pixels */
+	guint32			block_width;	/* of a tile, or of the image for strips */
+	guint32			block_length;	/* of a tile, or the rows per strip */
+	guint32			blocks_across;
+	tsize_t			block_size;
+	tsize_t			block_row_size;
+	BYTE			*data;		/* the file, for the workers to open their own handle on */
+	toff_t			size;
+	TIFF			**handles;	/* one per worker, the first one being the handle of the page */
+	TiffMemoryStream	*streams;
+	BYTE			**buffers;	/* one (decoded) strip or tile per worker */
+} TiffBlockReader;
+
+/* Copies count pixels read from the file to row, starting at pixel x */
+static void
+gdip_tiff_store_pixels (TiffBlockReader *reader, BYTE *row, guint32 x, BYTE *src, guint32 count)
+{
+	guint32 i;
+
+	if (reader->bitmap_data->pixel_format == PixelFormat24bppRGB) {
+		/* Spread the RGB samples into BGRA pixels */
+		for (i = 0; i < count; i++, src += 3) {
+			set_pixel_bgra (row, (x + i) * 4, src[2], src[1], src[0], 0xFF);
+		}
+	} else {
+		/* tiles are a multiple of 16 pixels wide, so they all start on a byte boundary */
+		memcpy (row + (gsize) x * reader->bpp / 8, src, ((gsize) count * reader->bpp + 7) / 8);
+	}
+}
+
+static GpStatus
+gdip_tiff_read_block (int worker, int index, void *data)
+{
+	TiffBlockReader	*reader = (TiffBlockReader *) data;
+	ActiveBitmapData	*bitmap_data = reader->bitmap_data;
+	TIFF		*tiff;
+	BYTE		*buffer;
+	guint32		x;
+	guint32		y;
+	guint32		rows;
+	guint32		columns;
+	guint32		i;
+	tsize_t		read;
+
+	if (reader->handles[worker] == NULL) {
+		reader->streams[worker].data = reader->data;
+		reader->streams[worker].size = reader->size;
+		reader->handles[worker] = gdip_tiff_open_memory (&reader->streams[worker]);
+		if (reader->handles[worker] == NULL || !TIFFSetDirectory (reader->handles[worker], reader->page)) {
+			return OutOfMemory;
+		}
+	}
+	tiff = reader->handles[worker];
+
+	x = (index % reader->blocks_across) * reader->block_width;
+	y = (index / reader->blocks_across) * reader->block_length;
+	rows = MIN (reader->block_length, bitmap_data->height - y);
+	columns = MIN (reader->block_width, bitmap_data->width - x);
+
+	if (reader->direct) {
+		read = TIFFReadEncodedStrip (tiff, index, reader->pixels + (gsize) bitmap_data->stride * y, (tsize_t) bitmap_data->stride * rows);
+		return (read < 0) ? OutOfMemory : Ok;
+	}
+
+	if (reader->buffers[worker] == NULL) {
+		reader->buffers[worker] = GdipAlloc (reader->block_size);
+		if (reader->buffers[worker] == NULL) {
+			return OutOfMemory;
+		}
+	}
+	buffer = reader->buffers[worker];
+
+	if (reader->tiled) {
+		read = TIFFReadEncodedTile (tiff, index, buffer, reader->block_size);
+	} else {
+		read = TIFFReadEncodedStrip (tiff, index, buffer, reader->block_size);
+	}
+	if (read < 0) {
+		return OutOfMemory;
+	}
+
+	for (i = 0; i < rows; i++) {
+		gdip_tiff_store_pixels (reader, reader->pixels + (gsize) bitmap_data->stride * (y + i), x, buffer + (gsize) reader->block_row_size * i, columns);
+	}
+
+	return Ok;
+}
+
+/* Reads the strips (or tiles) of a page directly into pixels, see gdip_tiff_native_format. They are compressed
+ * independently, so large pages are read by several workers, each with its own handle on the file in memory */
+static GpStatus
+gdip_load_tiff_pixels_native (TIFF *tiff, ActiveBitmapData *bitmap_data, BYTE *pixels)
 {
+	TiffBlockReader	reader;
+	GpStatus	status;
+	int		count;
+	int		workers;
 	int		i;
+	BOOL		own_data;
+
+	memset (&reader, 0, sizeof (TiffBlockReader));
+	reader.bitmap_data = bitmap_data;
+	reader.pixels = pixels;
+	reader.page = TIFFCurrentDirectory (tiff);
+	/* as stored in the file, 24bpp pixels are only padded to 32 bits in pixels */
+	reader.bpp = (bitmap_data->pixel_format == PixelFormat24bppRGB) ? 24 : gdip_get_pixel_format_bpp (bitmap_data->pixel_format);
+	reader.tiled = TIFFIsTiled (tiff);
+
+	if (reader.tiled) {
+		if (!TIFFGetField(tiff, TIFFTAG_TILEWIDTH, &reader.block_width) || !TIFFGetField(tiff, TIFFTAG_TILELENGTH, &reader.block_length)) {
+			return OutOfMemory;
+		}
+		reader.blocks_across = (bitmap_data->width + reader.block_width - 1) / reader.block_width;
+		reader.block_size = TIFFTileSize (tiff);
+		reader.block_row_size = TIFFTileRowSize (tiff);
+		count = TIFFNumberOfTiles (tiff);
+	} else {
+		TIFFGetFieldDefaulted(tiff, TIFFTAG_ROWSPERSTRIP, &reader.block_length);
+		reader.block_width = bitmap_data->width;
+		reader.blocks_across = 1;
+		reader.block_size = TIFFStripSize (tiff);
+		reader.block_row_size = TIFFScanlineSize (tiff);
+		reader.direct = (reader.bpp != 24) && (reader.block_row_size == bitmap_data->stride);
+		count = TIFFNumberOfStrips (tiff);
+	}
+
+	if (reader.block_width == 0 || reader.block_length == 0 || reader.block_size <= 0 || reader.block_row_size <= 0) {
+		return OutOfMemory;
+	}
+
+	workers = 1;
+	if ((unsigned long long int) bitmap_data->width * bitmap_data->height >= TIFF_PARALLEL_MIN_PIXELS) {
+		workers = MIN (gdip_get_worker_count (), count);
+	}
+
+	/* the other workers need their own handle, so the file in memory */
+	own_data = FALSE;
+	if (workers > 1) {
+		if (TIFFGetReadProc (tiff) == gdip_tiff_memread) {
+			reader.data = ((TiffMemoryStream *) TIFFClientdata (tiff))->data;
+			reader.size = ((TiffMemoryStream *) TIFFClientdata (tiff))->size;
+		} else {
+			reader.data = gdip_tiff_read_all (tiff, &reader.size);
+			own_data = (reader.data != NULL);
+		}
+
+		if (reader.data == NULL) {
+			workers = 1;
+		}
+	}
+
+	reader.handles = GdipAlloc (sizeof (TIFF *) * workers);
+	reader.streams = GdipAlloc (sizeof (TiffMemoryStream) * workers);
+	reader.buffers = GdipAlloc (sizeof (BYTE *) * workers);
+	if (reader.handles == NULL || reader.streams == NULL || reader.buffers == NULL) {
+		status = OutOfMemory;
+		goto cleanup;
+	}
+	memset (reader.handles, 0, sizeof (TIFF *) * workers);
+	memset (reader.buffers, 0, sizeof (BYTE *) * workers);
+	reader.handles[0] = tiff;
+
+	status = gdip_parallel_for (count, workers, gdip_tiff_read_block, &reader);
+
+cleanup:
+	for (i = 0; i < workers; i++) {
+		if (reader.handles != NULL && i > 0 && reader.handles[i] != NULL) {
+			TIFFClose (reader.handles[i]);
+		}
+		if (reader.buffers != NULL && reader.buffers[i] != NULL) {
+			GdipFree (reader.buffers[i]);
+		}
+	}
+
+	if (reader.handles != NULL) {
+		GdipFree (reader.handles);
+	}
+	if (reader.streams != NULL) {
+		GdipFree (reader.streams);
+	}
+	if (reader.buffers != NULL) {
+		GdipFree (reader.buffers);
+	}
+	if (own_data) {
+		GdipFree (reader.data);
+	}
+
+	return status;
+}
+
+/* Reads a page through TIFFRGBAImage, for the layouts gdip_load_tiff_pixels_native doesn't handle */
+static GpStatus
+gdip_load_tiff_pixels_rgba (TIFF *tiff, ActiveBitmapData *bitmap_data, BYTE *pixels)
+{
+	int		i;
+	char		error_message[1024];
+	TIFFRGBAImage	tiff_image;
+	BYTE		*pixbuf_row;
+	guint32		*pixbuf_ptr;
+	unsigned long long int size;
+
+	if (!TIFFRGBAImageBegin (&tiff_image, tiff, 0, error_message)) {
+		return OutOfMemory;
+	}
+
+	/* Flip the image. TIFF has its origin at bottom left, and is in ARGB instead of ABGR */
+	if (!TIFFRGBAImageGet(&tiff_image, (uint32 *)pixels, tiff_image.width, tiff_image.height)) {
+		TIFFRGBAImageEnd (&tiff_image);
+		return OutOfMemory;
+	}
+
+	pixbuf_row = GdipAlloc(bitmap_data->stride);
+	if (pixbuf_row == NULL) {
+		TIFFRGBAImageEnd (&tiff_image);
+		return OutOfMemory;
+	}
+
+	/* First, flip rows */
+	for (i = 0; i < tiff_image.height / 2; i++) {
+		memcpy(pixbuf_row, pixels + (bitmap_data->stride * i), bitmap_data->stride);
+		memcpy(pixels + (bitmap_data->stride * i), pixels + (bitmap_data->stride * (tiff_image.height - i - 1)), bitmap_data->stride);
+		memcpy(pixels + (bitmap_data->stride * (tiff_image.height - i - 1)), pixbuf_row, bitmap_data->stride);
+	}
+
+	/* Now flip from ARGB to ABGR processing one pixel (4 bytes) at the time */
+	size = (unsigned long long int)bitmap_data->stride * bitmap_data->height;
+	pixbuf_ptr = (guint32 *)pixels;
+	for (i = 0; i < (size >> 2); i++) {
+		*pixbuf_ptr =	(*pixbuf_ptr & 0xff000000) | 
+				((*pixbuf_ptr & 0x00ff0000) >> 16) |
+				(*pixbuf_ptr & 0x0000ff00) | 
+				((*pixbuf_ptr & 0x000000ff) << 16);
+		pixbuf_ptr++;
+	}
+	GdipFree(pixbuf_row);
+
+	TIFFRGBAImageEnd (&tiff_image);
+	return Ok;
+}
+
+/* Decodes the pixels of a page, whose metadata was read by gdip_load_tiff_page_info */
+static GpStatus
+gdip_load_tiff_page (TIFF *tiff, int page, ActiveBitmapData *bitmap_data)
+{
+	BYTE		*pixbuf;
+	GpStatus	status;
+
+	if (TIFFCurrentDirectory (tiff) != page && !TIFFSetDirectory (tiff, page)) {
+		return OutOfMemory;
+	}
+
+	pixbuf = GdipAlloc ((unsigned long long int)bitmap_data->stride * bitmap_data->height);
+	if (pixbuf == NULL) {
+		return OutOfMemory;
+	}
+
+	if (gdip_tiff_native_format (tiff) == bitmap_data->pixel_format) {
+		status = gdip_load_tiff_pixels_native (tiff, bitmap_data, pixbuf);
+	} else {
+		status = gdip_load_tiff_pixels_rgba (tiff, bitmap_data, pixbuf);
+	}
+
+	if (status != Ok) {
+		GdipFree (pixbuf);
+		return status;
+	}
+
+	bitmap_data->scan0 = pixbuf;
+	bitmap_data->reserved |= GBD_OWN_SCAN0;
+	return Ok;
+}
+
+/* Reads everything but the pixels and the properties of a page */
+static GpStatus
+gdip_load_tiff_page_info (TIFF *tiff, int page, ActiveBitmapData *bitmap_data)
+{
 	char		error_message[1024];
+	guint32		width;
+	guint32		height;
+	uint16		samples_per_pixel;
+	uint16		photometric;
+	float		dpi;
+	PixelFormat	native_format;
+	unsigned long long int size;
+
+	if (!TIFFSetDirectory(tiff, page)) {
+		return OutOfMemory;
+	}
+
+	/* fail now rather than when the page gets selected */
+	if (!TIFFRGBAImageOK (tiff, error_message)) {
+		return OutOfMemory;
+	}
+
+	native_format = gdip_tiff_native_format (tiff);
+	if (native_format != 0) {
+		bitmap_data->pixel_format = native_format;
+	} else if (TIFFGetField(tiff, TIFFTAG_SAMPLESPERPIXEL, &samples_per_pixel)) {
+		if (samples_per_pixel != 4) {
+			bitmap_data->pixel_format = PixelFormat24bppRGB;
+		} else {
+			bitmap_data->pixel_format = PixelFormat32bppARGB;
+			bitmap_data->image_flags |= ImageFlagsHasAlpha;
+		}
+	}
+
+	if (gdip_is_an_indexed_pixelformat (native_format)) {
+		bitmap_data->palette = gdip_load_tiff_palette (tiff, native_format);
+		if (bitmap_data->palette == NULL) {
+			return OutOfMemory;
+		}
+	}
+
+	if (TIFFGetField(tiff, TIFFTAG_XRESOLUTION, &dpi)) {
+		bitmap_data->dpi_horz = dpi;
+	} else {
+		bitmap_data->dpi_horz = 0;
+	}
+
+	if (TIFFGetField(tiff, TIFFTAG_YRESOLUTION, &dpi)) {
+		bitmap_data->dpi_vert = dpi;
+	} else {
+		bitmap_data->dpi_vert = 0;
+	}
+
+	if (bitmap_data->dpi_horz && bitmap_data->dpi_vert)
+		bitmap_data->image_flags |= ImageFlagsHasRealDPI;
+
+	if (!TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &width) || !TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &height)) {
+		return OutOfMemory;
+	}
+
+	/* width and height are uint32, but TIFF uses 32 bits offsets (so it's real size limit is 4GB),
+	 * however libtiff uses signed int (int32 not uint32) as offsets so we limit ourselves to 2GB */
+	size = width;
+	/* stride is a (signed) _int_ and once multiplied by 4 (for 32bpp pixels) it should hold a value that can be
+	 * allocated by GdipAlloc, this effectively limits 'width' to 536870911 pixels */
+	size = (size * gdip_get_pixel_format_bpp (bitmap_data->pixel_format) + 7) / 8;
+	gdip_align_stride (size);
+	if (size > G_MAXINT32)
+		return OutOfMemory;
+	bitmap_data->stride = size;
+	bitmap_data->width = width;
+	bitmap_data->height = height;
+	bitmap_data->image_flags |= ImageFlagsHasRealPixelSize | ImageFlagsReadOnly;
+
+	if (native_format != 0 && TIFFGetField(tiff, TIFFTAG_PHOTOMETRIC, &photometric) && photometric != PHOTOMETRIC_PALETTE && photometric != PHOTOMETRIC_RGB) {
+		bitmap_data->image_flags |= ImageFlagsColorSpaceGRAY;
+	} else {
+		bitmap_data->image_flags |= ImageFlagsColorSpaceRGB;
+	}
+
+	/* ensure total 'size' does not overflow an integer and fits inside our 2GB limit */
+	size *= height;
+	if (size > G_MAXINT32)
+		return OutOfMemory;
+
+	return Ok;
+}
+
+static GpStatus
+gdip_tiff_decoder_decode (BitmapFrameDecoder *decoder, int frame, int index, ActiveBitmapData *data)
+{
+	return gdip_load_tiff_page (((TiffFrameDecoder *) decoder)->tiff, index, data);
+}
+
+static GpStatus
+gdip_tiff_decoder_load_properties (BitmapFrameDecoder *decoder, int frame, int index, ActiveBitmapData *data)
+{
+	TIFF *tiff = ((TiffFrameDecoder *) decoder)->tiff;
+
+	if (TIFFCurrentDirectory (tiff) != index && !TIFFSetDirectory (tiff, index)) {
+		return OutOfMemory;
+	}
+
+	return gdip_load_tiff_properties (tiff, data);
+}
+
+static void
+gdip_tiff_decoder_dispose (BitmapFrameDecoder *decoder)
+{
+	TiffFrameDecoder *tiff_decoder = (TiffFrameDecoder *) decoder;
+
+	TIFFClose (tiff_decoder->tiff);
+	GdipFree (tiff_decoder->stream.data);
+	GdipFree (tiff_decoder);
+}
+
+/* Copies the file behind tiff in memory and reopens it from there, or returns NULL if it can't */
+static TiffFrameDecoder *
+gdip_tiff_decoder_new (TIFF *tiff)
+{
+	TiffFrameDecoder *decoder;
+
+	decoder = GdipAlloc (sizeof (TiffFrameDecoder));
+	if (decoder == NULL)
+		return NULL;
+
+	decoder->stream.data = gdip_tiff_read_all (tiff, &decoder->stream.size);
+	if (decoder->stream.data == NULL) {
+		GdipFree (decoder);
+		return NULL;
+	}
+
+	decoder->tiff = gdip_tiff_open_memory (&decoder->stream);
+	if (decoder->tiff == NULL) {
+		GdipFree (decoder->stream.data);
+		GdipFree (decoder);
+		return NULL;
+	}
+
+	gdip_frame_decoder_init (&decoder->base);
+	decoder->base.decode = gdip_tiff_decoder_decode;
+	decoder->base.decode_scaled = NULL;
+	decoder->base.load_properties = gdip_tiff_decoder_load_properties;
+	decoder->base.properties_only = NULL;
+	decoder->base.dispose = gdip_tiff_decoder_dispose;
+	return decoder;
+}
+
+static GpStatus 
+gdip_load_tiff_image (TIFF *tiff, GpImage **image)
+{
 	int		num_of_pages;
 	GpImage		*result;
 	int		page;
-	TIFFRGBAImage	tiff_image;
 	FrameData	*frame;
 	ActiveBitmapData	*bitmap_data;
-	char		*pixbuf;
-	char		*pixbuf_row;
-	guint32		*pixbuf_ptr;
-	guint16		samples_per_pixel;
-	float		dpi;
+	TiffFrameDecoder	*decoder;
 
 	if (tiff == NULL) {
 		*image = NULL;
@@ -1089,9 +1802,7 @@ gdip_load_tiff_image (TIFF *tiff, GpImage **image)
 	}
 
 	result = NULL;
-	pixbuf_row = NULL;
-	pixbuf = NULL;
-	memset (&tiff_image, 0, sizeof (TIFFRGBAImage));
+	decoder = NULL;
 
 	num_of_pages = TIFFNumberOfDirectories(tiff);
 
@@ -1109,130 +1820,136 @@ gdip_load_tiff_image (TIFF *tiff, GpImage **image)
 	if (!frame)
 		goto error;
 
-	for (page = 0; page < num_of_pages; page++) {
-		unsigned long long int size;
+	/* Only decode pages when they get selected. If the file can't be kept around, decode them all now */
+	if (num_of_pages > 1) {
+		decoder = gdip_tiff_decoder_new (tiff);
+		if (decoder != NULL) {
+			/* from now on the decoder owns the (in-memory) tiff */
+			TIFFClose (tiff);
+			tiff = decoder->tiff;
+			gdip_bitmap_set_frame_decoder (result, &decoder->base);
+		}
+	}
 
+	for (page = 0; page < num_of_pages; page++) {
 		bitmap_data = gdip_frame_add_bitmapdata(frame);
 		if (bitmap_data == NULL) {
 			goto error;
 		}
 
-		if (!TIFFSetDirectory(tiff, page)) {
+		if (gdip_load_tiff_page_info (tiff, page, bitmap_data) != Ok) {
 			goto error;
 		}
 
-		gdip_load_tiff_properties(tiff, bitmap_data);
+		if (decoder != NULL) {
+			/* the properties are read from the decoder when they are first asked for */
+			bitmap_data->reserved |= GBD_PROPERTIES_PENDING;
+			continue;
+		}
+
+		gdip_load_tiff_properties (tiff, bitmap_data);
 
-		if (!TIFFRGBAImageBegin (&tiff_image, tiff, 0, error_message)) {
+		if (gdip_load_tiff_page (tiff, page, bitmap_data) != Ok) {
 			goto error;
 		}
+	}
 
-		if (TIFFGetField(tiff, TIFFTAG_SAMPLESPERPIXEL, &samples_per_pixel)) {
-			if (samples_per_pixel != 4) {
-				bitmap_data->pixel_format = PixelFormat24bppRGB;
-			} else {
-				bitmap_data->pixel_format = PixelFormat32bppARGB;
-				bitmap_data->image_flags |= ImageFlagsHasAlpha;
-			}
-		}
+	/* this decodes the first page */
+	if (gdip_bitmap_setactive(result, &gdip_image_frameDimension_page_guid, 0) != Ok) {
+		goto error;
+	}
 
-		if (TIFFGetField(tiff, TIFFTAG_XRESOLUTION, &dpi)) {
-			bitmap_data->dpi_horz = dpi;
-		} else {
-			bitmap_data->dpi_horz = 0;
-		}
+	if (decoder == NULL) {
+		TIFFClose(tiff);
+	}
 
-		if (TIFFGetField(tiff, TIFFTAG_YRESOLUTION, &dpi)) {
-			bitmap_data->dpi_vert = dpi;
-		} else {
-			bitmap_data->dpi_vert = 0;
-		}
+	*image = result;
+	return Ok;
 
-		if (bitmap_data->dpi_horz && bitmap_data->dpi_vert)
-			bitmap_data->image_flags |= ImageFlagsHasRealDPI;
+error:
+	/* disposing the bitmap also disposes the decoder, and the tiff it owns */
+	if (decoder == NULL) {
+		TIFFClose(tiff);
+	}
 
-		/* width and height are uint32, but TIFF uses 32 bits offsets (so it's real size limit is 4GB),
-		 * however libtiff uses signed int (int32 not uint32) as offsets so we limit ourselves to 2GB */
-		size = tiff_image.width;
-		/* stride is a (signed) _int_ and once multiplied by 4 it should hold a value that can be allocated by GdipAlloc
-		 * this effectively limits 'width' to 536870911 pixels */
-		size *= sizeof (guint32);
-		if (size > G_MAXINT32)
-			goto error;
-		bitmap_data->stride = size;
-		bitmap_data->width = tiff_image.width;
-		bitmap_data->height = tiff_image.height;
-		bitmap_data->reserved = GBD_OWN_SCAN0;
-		bitmap_data->image_flags |= ImageFlagsColorSpaceRGB | ImageFlagsHasRealPixelSize | ImageFlagsReadOnly;
-
-		/* ensure total 'size' does not overflow an integer and fits inside our 2GB limit */
-		size *= tiff_image.height;
-		if (size > G_MAXINT32)
-			goto error;
-		pixbuf = GdipAlloc (size);
-		if (pixbuf == NULL) {
-			goto error;
-		}
+	if (result != NULL) {
+		gdip_bitmap_dispose(result);
+	}
 
-		/* Flip the image. TIFF has its origin at bottom left, and is in ARGB instead of ABGR */
-		if (!TIFFRGBAImageGet(&tiff_image, (uint32 *)pixbuf, tiff_image.width, tiff_image.height)) {
-			goto error;
-		}
+	return OutOfMemory;
+}
 
-		pixbuf_row = GdipAlloc(bitmap_data->stride);
-		if (pixbuf_row == NULL) {
-			goto error;
-		}
+/* Counts the pages and reads the directory of the first one, which is what the image reports once loaded */
+static GpStatus
+gdip_read_tiff_image_info (TIFF *tiff, GpImageInfo *info)
+{
+	int		num_of_pages;
+	ActiveBitmapData	bitmap_data;
+	GpStatus	status;
 
-		/* First, flip rows */
-		for (i = 0; i < tiff_image.height / 2; i++) {
-			memcpy(pixbuf_row, pixbuf + (bitmap_data->stride * i), bitmap_data->stride);
-			memcpy(pixbuf + (bitmap_data->stride * i), pixbuf + (bitmap_data->stride * (tiff_image.height - i - 1)), bitmap_data->stride);
-			memcpy(pixbuf + (bitmap_data->stride * (tiff_image.height - i - 1)), pixbuf_row, bitmap_data->stride);
-		}
+	if (tiff == NULL) {
+		/* we cannot call TIFFClose(tiff); with a NULL value since it will crash - bnc #569940 */
+		return OutOfMemory;
+	}
 
-		/* Now flip from ARGB to ABGR processing one pixel (4 bytes) at the time */
-		pixbuf_ptr = (guint32 *)pixbuf;
-		for (i = 0; i < (size >> 2); i++) {
-			*pixbuf_ptr =	(*pixbuf_ptr & 0xff000000) | 
-					((*pixbuf_ptr & 0x00ff0000) >> 16) |
-					(*pixbuf_ptr & 0x0000ff00) | 
-					((*pixbuf_ptr & 0x000000ff) << 16);
-			pixbuf_ptr++;
-		}
-		GdipFree(pixbuf_row);
-		bitmap_data->scan0 = (BYTE*) pixbuf;
-		pixbuf_row = NULL;
-		pixbuf = NULL;
+	num_of_pages = TIFFNumberOfDirectories(tiff);
 
-		TIFFRGBAImageEnd (&tiff_image);
+	/* see gdip_load_tiff_image */
+	if (num_of_pages >= 65535) {
+		TIFFClose (tiff);
+		return OutOfMemory;
 	}
 
-	gdip_bitmap_setactive(result, &gdip_image_frameDimension_page_guid, 0);
+	memset (&bitmap_data, 0, sizeof (ActiveBitmapData));
+	status = gdip_load_tiff_page_info (tiff, 0, &bitmap_data);
+	if (status == Ok) {
+		info->Width = bitmap_data.width;
+		info->Height = bitmap_data.height;
+		info->PixelFormat = bitmap_data.pixel_format;
+		info->FrameCount = num_of_pages;
+		info->DpiX = bitmap_data.dpi_horz;
+		info->DpiY = bitmap_data.dpi_vert;
+	}
 
-	TIFFClose(tiff);
+	if (bitmap_data.palette != NULL)
+		GdipFree (bitmap_data.palette);
+	TIFFClose (tiff);
+	return status;
+}
 
-	*image = result;
-	return Ok;
+GpStatus
+gdip_read_tiff_image_info_from_file (FILE *fp, GpImageInfo *info)
+{
+	TIFF *tif = NULL;
 
-error:
-	/* coverity[dead_error_line] */
-	if (pixbuf_row != NULL) {
-		GdipFree(pixbuf_row);
-	}
+	tif = TIFFClientOpen("<stream>", "r", (thandle_t) fp, gdip_tiff_fileread, 
+				gdip_tiff_filewrite, gdip_tiff_fileseek, gdip_tiff_fileclose, 
+				gdip_tiff_filesize, gdip_tiff_filedummy_map, gdip_tiff_filedummy_unmap);
+	return gdip_read_tiff_image_info (tif, info);
+}
 
-	if (pixbuf != NULL) {
-		GdipFree(pixbuf);
-	}
+GpStatus
+gdip_read_tiff_image_info_from_stream_delegate (GetBytesDelegate getBytesFunc,
+					PutBytesDelegate putBytesFunc,
+					SeekDelegate seekFunc,
+					CloseDelegate closeFunc,
+					SizeDelegate sizeFunc,
+					GpImageInfo *info)
+{
+	TIFF *tif = NULL;
+	gdip_tiff_clientData clientData;
 
-	if (result != NULL) {
-		gdip_bitmap_dispose(result);
-	}
+	clientData.getBytesFunc = getBytesFunc;
+	clientData.putBytesFunc = putBytesFunc;
+	clientData.seekFunc = seekFunc;
+	clientData.closeFunc = closeFunc;
+	clientData.sizeFunc = sizeFunc;
 
-	TIFFRGBAImageEnd (&tiff_image);
-	TIFFClose(tiff);
+	tif = TIFFClientOpen("<stream>", "r", (thandle_t) &clientData, gdip_tiff_read, 
+				gdip_tiff_write, gdip_tiff_seek, gdip_tiff_close, 
+				gdip_tiff_size, gdip_tiff_dummy_map, gdip_tiff_dummy_unmap);
 
-	return OutOfMemory;
+	return gdip_read_tiff_image_info (tif, info);
 }
 
 GpStatus 
@@ -1246,6 +1963,17 @@ gdip_load_tiff_image_from_file (FILE *fp, GpImage **image)
 	return gdip_load_tiff_image (tif, image);
 }
 
+/* libtiff reads the strips straight from ms (see gdip_tiff_memmap), and so do the workers of gdip_load_tiff_pixels_native */
+GpStatus
+gdip_load_tiff_image_from_memory (MemorySource *ms, GpImage **image)
+{
+	TiffMemoryStream stream;
+
+	stream.data = ms->ptr + ms->pos;
+	stream.size = ms->size - ms->pos;
+	return gdip_load_tiff_image (gdip_tiff_open_memory (&stream), image);
+}
+
 GpStatus 
 gdip_save_tiff_image_to_file (BYTE *filename, GpImage *image, GDIPCONST EncoderParameters *params)
 {	
@@ -1329,6 +2057,13 @@ gdip_load_tiff_image_from_file (FILE *fp, GpImage **image)
 	return UnknownImageFormat;
 }
 
+GpStatus
+gdip_load_tiff_image_from_memory (MemorySource *ms, GpImage **image)
+{
+	*image = NULL;
+	return UnknownImageFormat;
+}
+
 GpStatus
 gdip_load_tiff_image_from_stream_delegate (GetBytesDelegate getBytesFunc,
 					PutBytesDelegate putBytesFunc,
@@ -1341,6 +2076,23 @@ gdip_load_tiff_image_from_stream_delegate (GetBytesDelegate getBytesFunc,
 	return UnknownImageFormat;
 }
 
+GpStatus
+gdip_read_tiff_image_info_from_file (FILE *fp, GpImageInfo *info)
+{
+	return UnknownImageFormat;
+}
+
+GpStatus
+gdip_read_tiff_image_info_from_stream_delegate (GetBytesDelegate getBytesFunc,
+					PutBytesDelegate putBytesFunc,
+					SeekDelegate seekFunc,
+					CloseDelegate closeFunc,
+					SizeDelegate sizeFunc,
+					GpImageInfo *info)
+{
+	return UnknownImageFormat;
+}
+
 GpStatus 
 gdip_save_tiff_image_to_file (BYTE *filename, GpImage *image, GDIPCONST EncoderParameters *params)
 {
@@ -19,6 +19,13 @@ GpStatus gdip_load_tiff_image_from_file (FILE *fp, GpImage **image) GDIP_INTERNA
 GpStatus gdip_load_tiff_image_from_stream_delegate (GetBytesDelegate getBytesFunc, PutBytesDelegate putBytesFunc,
 	SeekDelegate seekFunc, CloseDelegate closeFunc, SizeDelegate sizeFunc, GpImage **image) GDIP_INTERNAL;
 
+GpStatus gdip_load_tiff_image_from_memory (MemorySource *ms, GpImage **image) GDIP_INTERNAL;
+
+GpStatus gdip_read_tiff_image_info_from_file (FILE *fp, GpImageInfo *info) GDIP_INTERNAL;
+
+GpStatus gdip_read_tiff_image_info_from_stream_delegate (GetBytesDelegate getBytesFunc, PutBytesDelegate putBytesFunc,
+	SeekDelegate seekFunc, CloseDelegate closeFunc, SizeDelegate sizeFunc, GpImageInfo *info) GDIP_INTERNAL;
+
 GpStatus gdip_save_tiff_image_to_file (unsigned char *filename, GpImage *image, GDIPCONST EncoderParameters *params) GDIP_INTERNAL;
 
 GpStatus gdip_save_tiff_image_to_stream_delegate (GetBytesDelegate getBytesFunc, PutBytesDelegate putBytesFunc,
@@ -1042,6 +1042,85 @@ static void test_bitmapGetPixel ()
 	GdipDisposeImage ((GpImage *) indexedImage);
 }
 
+#if !defined(USE_WINDOWS_GDIPLUS)
+static void test_bitmapGetSetPixels ()
+{
+	GpStatus status;
+	GpBitmap *image;
+	GpBitmap *indexedImage;
+	ARGB pixels[6];
+	ARGB pixel;
+	Rect rect = {1, 1, 2, 2};
+	Rect outsideRect = {4, 2, 2, 1};
+	ARGB source[] = {
+		0xFF0000FF, 0x80FF0000, 0xCCCCCCCC,
+		0x00000000, 0xFF00FF00, 0xCCCCCCCC
+	};
+
+	GdipCreateBitmapFromScan0 (5, 3, 0, PixelFormat32bppARGB, NULL, &image);
+	GdipCreateBitmapFromScan0 (5, 3, 0, PixelFormat8bppIndexed, NULL, &indexedImage);
+
+	// Rows are read and written with the given stride, like the matching GetPixel and SetPixel calls.
+	status = GdipBitmapSetPixels_linux (image, &rect, 3 * sizeof (ARGB), source);
+	assertEqualInt (status, Ok);
+
+	GdipBitmapGetPixel (image, 2, 1, &pixel);
+	assertEqualARGB (pixel, 0x80FF0000);
+	GdipBitmapGetPixel (image, 1, 2, &pixel);
+	assertEqualARGB (pixel, 0x00000000);
+	GdipBitmapGetPixel (image, 3, 1, &pixel);
+	assertEqualARGB (pixel, 0x00000000);
+
+	memset (pixels, 0, sizeof (pixels));
+	status = GdipBitmapGetPixels_linux (image, &rect, 3 * sizeof (ARGB), pixels);
+	assertEqualInt (status, Ok);
+	assertEqualARGB (pixels[0], 0xFF0000FF);
+	assertEqualARGB (pixels[1], 0x80FF0000);
+	assertEqualARGB (pixels[2], 0x00000000);
+	assertEqualARGB (pixels[4], 0xFF00FF00);
+
+	// Indexed images are read through the palette.
+	status = GdipBitmapGetPixels_linux (indexedImage, &rect, 2 * sizeof (ARGB), pixels);
+	assertEqualInt (status, Ok);
+	assertEqualARGB (pixels[0], 0xFF000000);
+	assertEqualARGB (pixels[3], 0xFF000000);
+
+	// Negative tests.
+	status = GdipBitmapGetPixels_linux (NULL, &rect, 2 * sizeof (ARGB), pixels);
+	assertEqualInt (status, InvalidParameter);
+
+	status = GdipBitmapGetPixels_linux (image, &rect, 2 * sizeof (ARGB), NULL);
+	assertEqualInt (status, InvalidParameter);
+
+	status = GdipBitmapGetPixels_linux (image, &outsideRect, 2 * sizeof (ARGB), pixels);
+	assertEqualInt (status, InvalidParameter);
+
+	status = GdipBitmapGetPixels_linux (image, &rect, sizeof (ARGB), pixels);
+	assertEqualInt (status, InvalidParameter);
+
+	status = GdipBitmapSetPixels_linux (indexedImage, &rect, 2 * sizeof (ARGB), source);
+	assertEqualInt (status, InvalidParameter);
+
+	status = GdipBitmapSetPixels_linux (image, &outsideRect, 2 * sizeof (ARGB), source);
+	assertEqualInt (status, InvalidParameter);
+
+	// Locked.
+	BitmapData data;
+	memset (&data, 0, sizeof (data));
+	GdipBitmapLockBits (image, NULL, 0, PixelFormat32bppARGB, &data);
+
+	status = GdipBitmapGetPixels_linux (image, &rect, 2 * sizeof (ARGB), pixels);
+	assertEqualInt (status, WrongState);
+
+	status = GdipBitmapSetPixels_linux (image, &rect, 2 * sizeof (ARGB), source);
+	assertEqualInt (status, WrongState);
+
+	GdipBitmapUnlockBits (image, &data);
+	GdipDisposeImage ((GpImage *) image);
+	GdipDisposeImage ((GpImage *) indexedImage);
+}
+#endif
+
 static void test_bitmapLockBits ()
 {
 	GpStatus status;
@@ -1210,6 +1289,438 @@ static void test_bitmapUnlockBits ()
 	GdipDisposeImage ((GpImage *) image);
 }
 
+static void test_bitmapLockBitsConversion ()
+{
+	GpStatus status;
+	GpBitmap *image;
+	GpBitmap *clone;
+	BitmapData data;
+	PixelFormat format;
+	ARGB pixel;
+	BYTE *scan;
+
+	GdipCreateBitmapFromScan0 (2, 1, 0, PixelFormat32bppARGB, NULL, &image);
+	GdipBitmapSetPixel (image, 0, 0, 0x80FF0000);
+	GdipBitmapSetPixel (image, 1, 0, 0xFF00FF00);
+
+	// ARGB -> PARGB premultiplies the pixels.
+	memset (&data, 0, sizeof (data));
+	status = GdipBitmapLockBits (image, NULL, ImageLockModeRead, PixelFormat32bppPARGB, &data);
+	assertEqualInt (status, Ok);
+	assertEqualARGB (((ARGB *) data.Scan0)[0], 0x80800000);
+	assertEqualARGB (((ARGB *) data.Scan0)[1], 0xFF00FF00);
+	GdipBitmapUnlockBits (image, &data);
+
+	// ARGB -> 24bpp RGB uses 3 bytes per pixel, and the written pixels come back opaque.
+	memset (&data, 0, sizeof (data));
+	status = GdipBitmapLockBits (image, NULL, ImageLockModeRead | ImageLockModeWrite, PixelFormat24bppRGB, &data);
+	assertEqualInt (status, Ok);
+	scan = (BYTE *) data.Scan0;
+	assertEqualInt (scan[3], 0x00);
+	assertEqualInt (scan[4], 0xFF);
+	assertEqualInt (scan[5], 0x00);
+	scan[0] = 0x11;
+	scan[1] = 0x22;
+	scan[2] = 0x33;
+	GdipBitmapUnlockBits (image, &data);
+
+	GdipBitmapGetPixel (image, 0, 0, &pixel);
+	assertEqualARGB (pixel, 0xFF332211);
+
+	// Cloning an area converts it to the requested format.
+	GdipBitmapSetPixel (image, 0, 0, 0x80FF0000);
+	status = GdipCloneBitmapAreaI (0, 0, 2, 1, PixelFormat32bppPARGB, image, &clone);
+	assertEqualInt (status, Ok);
+
+	GdipGetImagePixelFormat ((GpImage *) clone, &format);
+	assertEqualInt (format, PixelFormat32bppPARGB);
+	GdipBitmapGetPixel (clone, 0, 0, &pixel);
+	assertEqualARGB (pixel, 0x80FF0000);
+	GdipBitmapGetPixel (clone, 1, 0, &pixel);
+	assertEqualARGB (pixel, 0xFF00FF00);
+
+	GdipDisposeImage ((GpImage *) clone);
+	GdipDisposeImage ((GpImage *) image);
+}
+
+#if !defined(USE_WINDOWS_GDIPLUS)
+static void test_bitmapLockBitsPremultiply ()
+{
+	GpStatus status;
+	GpBitmap *image;
+	BitmapData data;
+	ARGB *pixels = (ARGB *) malloc (256 * 256 * sizeof (ARGB));
+	ARGB pixel;
+	int x;
+	int y;
+
+	// Every color value against every alpha value, in rows long enough for the vectorized code paths.
+	GdipCreateBitmapFromScan0 (256, 256, 0, PixelFormat32bppARGB, NULL, &image);
+	memset (&data, 0, sizeof (data));
+	GdipBitmapLockBits (image, NULL, ImageLockModeWrite, PixelFormat32bppARGB, &data);
+	for (y = 0; y < 256; y++) {
+		ARGB *row = (ARGB *) ((BYTE *) data.Scan0 + y * data.Stride);
+		for (x = 0; x < 256; x++)
+			row[x] = (y << 24) | (x << 16) | ((255 - x) << 8) | ((x + y) & 0xFF);
+	}
+	GdipBitmapUnlockBits (image, &data);
+
+	memset (&data, 0, sizeof (data));
+	status = GdipBitmapLockBits (image, NULL, ImageLockModeRead, PixelFormat32bppPARGB, &data);
+	assertEqualInt (status, Ok);
+	for (y = 0; y < 256; y++) {
+		ARGB *row = (ARGB *) ((BYTE *) data.Scan0 + y * data.Stride);
+		for (x = 0; x < 256; x++) {
+			ARGB expected = (y << 24) | (((x * y + 127) / 255) << 16) | ((((255 - x) * y + 127) / 255) << 8) | ((((x + y) & 0xFF) * y + 127) / 255);
+			if (row[x] != expected)
+				assertEqualARGB (row[x], expected);
+		}
+	}
+	GdipBitmapUnlockBits (image, &data);
+	GdipDisposeImage ((GpImage *) image);
+
+	// Unpremultiplied rows match the pixels read one at a time.
+	GdipCreateBitmapFromScan0 (256, 256, 0, PixelFormat32bppPARGB, NULL, &image);
+	memset (&data, 0, sizeof (data));
+	GdipBitmapLockBits (image, NULL, ImageLockModeWrite, PixelFormat32bppPARGB, &data);
+	for (y = 0; y < 256; y++) {
+		ARGB *row = (ARGB *) ((BYTE *) data.Scan0 + y * data.Stride);
+		for (x = 0; x < 256; x++)
+			row[x] = ((x & 3) == 0 ? 0xFF000000 : (y << 24)) | (x << 16) | ((255 - x) << 8) | y;
+	}
+	GdipBitmapUnlockBits (image, &data);
+
+	memset (&data, 0, sizeof (data));
+	data.Stride = 256 * sizeof (ARGB);
+	data.Scan0 = pixels;
+	status = GdipBitmapLockBits (image, NULL, ImageLockModeRead | ImageLockModeUserInputBuf, PixelFormat32bppARGB, &data);
+	assertEqualInt (status, Ok);
+	GdipBitmapUnlockBits (image, &data);
+
+	for (y = 0; y < 256; y++) {
+		for (x = 0; x < 256; x++) {
+			GdipBitmapGetPixel (image, x, y, &pixel);
+			if (pixels[y * 256 + x] != pixel)
+				assertEqualARGB (pixels[y * 256 + x], pixel);
+		}
+	}
+
+	free (pixels);
+	GdipDisposeImage ((GpImage *) image);
+}
+
+static void test_bitmapLockBitsInPlace ()
+{
+	GpStatus status;
+	GpBitmap *image;
+	BitmapData data;
+	Rect rect = { 2, 3, 4, 4 };
+	BOOL inPlace;
+	ARGB pixel;
+
+	// Locking pixels in the format they are stored in hands out the bitmap's own pixels.
+	GdipCreateBitmapFromScan0 (10, 10, 0, PixelFormat32bppARGB, NULL, &image);
+	GdipBitmapSetPixel (image, 0, 0, 0xFF112233);
+	GdipBitmapSetPixel (image, 2, 3, 0xFF445566);
+
+	memset (&data, 0, sizeof (data));
+	status = GdipBitmapLockBits (image, &rect, ImageLockModeRead | ImageLockModeWrite, PixelFormat32bppARGB, &data);
+	assertEqualInt (status, Ok);
+	assertEqualInt (GdipBitmapIsLockedInPlace_linux (&data, &inPlace), Ok);
+	assertEqualInt (inPlace, TRUE);
+	assertEqualInt (data.Stride, 40);
+	assertEqualARGB (*(ARGB *) data.Scan0, 0xFF445566);
+	*(ARGB *) data.Scan0 = 0x80FF0000;
+	assertEqualInt (GdipBitmapUnlockBits (image, &data), Ok);
+	assertEqualInt (GdipBitmapIsLockedInPlace_linux (&data, &inPlace), WrongState);
+
+	GdipBitmapGetPixel (image, 2, 3, &pixel);
+	assertEqualARGB (pixel, 0x80FF0000);
+	GdipBitmapGetPixel (image, 0, 0, &pixel);
+	assertEqualARGB (pixel, 0xFF112233);
+
+	// Other formats are converted into a copy.
+	memset (&data, 0, sizeof (data));
+	status = GdipBitmapLockBits (image, &rect, ImageLockModeRead, PixelFormat32bppPARGB, &data);
+	assertEqualInt (status, Ok);
+	assertEqualInt (GdipBitmapIsLockedInPlace_linux (&data, &inPlace), Ok);
+	assertEqualInt (inPlace, FALSE);
+	GdipBitmapUnlockBits (image, &data);
+	GdipDisposeImage ((GpImage *) image);
+
+	// 32bppRGB pixels written in place are opaque once unlocked, whatever alpha they were written with.
+	GdipCreateBitmapFromScan0 (10, 10, 0, PixelFormat32bppRGB, NULL, &image);
+	memset (&data, 0, sizeof (data));
+	status = GdipBitmapLockBits (image, &rect, ImageLockModeWrite, PixelFormat32bppRGB, &data);
+	assertEqualInt (status, Ok);
+	assertEqualInt (GdipBitmapIsLockedInPlace_linux (&data, &inPlace), Ok);
+	assertEqualInt (inPlace, TRUE);
+	*(ARGB *) data.Scan0 = 0x00FF0000;
+	GdipBitmapUnlockBits (image, &data);
+
+	memset (&data, 0, sizeof (data));
+	GdipBitmapLockBits (image, &rect, ImageLockModeRead, PixelFormat32bppRGB, &data);
+	assertEqualARGB (*(ARGB *) data.Scan0, 0xFFFF0000);
+	GdipBitmapUnlockBits (image, &data);
+	GdipDisposeImage ((GpImage *) image);
+
+	// 24bpp bitmaps are stored with 4 bytes per pixel, so they are always copied.
+	GdipCreateBitmapFromScan0 (10, 10, 0, PixelFormat24bppRGB, NULL, &image);
+	memset (&data, 0, sizeof (data));
+	status = GdipBitmapLockBits (image, NULL, ImageLockModeRead, PixelFormat24bppRGB, &data);
+	assertEqualInt (status, Ok);
+	assertEqualInt (GdipBitmapIsLockedInPlace_linux (&data, &inPlace), Ok);
+	assertEqualInt (inPlace, FALSE);
+	GdipBitmapUnlockBits (image, &data);
+	GdipDisposeImage ((GpImage *) image);
+
+	assertEqualInt (GdipBitmapIsLockedInPlace_linux (NULL, &inPlace), InvalidParameter);
+	assertEqualInt (GdipBitmapIsLockedInPlace_linux (&data, NULL), InvalidParameter);
+}
+#endif
+
+static void test_bitmapDrawPreservesPixels ()
+{
+	GpStatus status;
+	GpBitmap *image;
+	GpGraphics *graphics;
+	GpSolidFill *brush;
+	BitmapData data;
+	Rect rect = { 60, 60, 1, 1 };
+	ARGB *row;
+
+	// Nearly transparent pixels lose their color when premultiplied, so drawing must not touch pixels outside of what was drawn.
+	GdipCreateBitmapFromScan0 (100, 100, 0, PixelFormat32bppARGB, NULL, &image);
+	GdipBitmapSetPixel (image, 50, 50, 0x01123456);
+	GdipBitmapSetPixel (image, 60, 60, 0x01123456);
+
+	GdipGetImageGraphicsContext ((GpImage *) image, &graphics);
+	GdipCreateSolidFill (0xFF0000FF, &brush);
+	GdipFillRectangleI (graphics, (GpBrush *) brush, 10, 10, 5, 5);
+
+	memset (&data, 0, sizeof (data));
+	status = GdipBitmapLockBits (image, NULL, ImageLockModeRead, PixelFormat32bppARGB, &data);
+	assertEqualInt (status, Ok);
+	assertEqualARGB (((ARGB *) ((BYTE *) data.Scan0 + 12 * data.Stride))[12], 0xFF0000FF);
+	assertEqualARGB (((ARGB *) ((BYTE *) data.Scan0 + 50 * data.Stride))[50], 0x01123456);
+	GdipBitmapUnlockBits (image, &data);
+
+	// Pixels written through LockBits are seen by later drawing, and survive it.
+	memset (&data, 0, sizeof (data));
+	status = GdipBitmapLockBits (image, &rect, ImageLockModeWrite, PixelFormat32bppARGB, &data);
+	assertEqualInt (status, Ok);
+	*(ARGB *) data.Scan0 = 0xFF00FF00;
+	GdipBitmapUnlockBits (image, &data);
+
+	GdipFillRectangleI (graphics, (GpBrush *) brush, 80, 80, 5, 5);
+	GdipDeleteGraphics (graphics);
+
+	memset (&data, 0, sizeof (data));
+	status = GdipBitmapLockBits (image, NULL, ImageLockModeRead, PixelFormat32bppARGB, &data);
+	assertEqualInt (status, Ok);
+	row = (ARGB *) ((BYTE *) data.Scan0 + 60 * data.Stride);
+	assertEqualARGB (row[60], 0xFF00FF00);
+	row = (ARGB *) ((BYTE *) data.Scan0 + 82 * data.Stride);
+	assertEqualARGB (row[82], 0xFF0000FF);
+	row = (ARGB *) ((BYTE *) data.Scan0 + 50 * data.Stride);
+	assertEqualARGB (row[50], 0x01123456);
+	GdipBitmapUnlockBits (image, &data);
+
+	GdipDeleteBrush ((GpBrush *) brush);
+	GdipDisposeImage ((GpImage *) image);
+}
+
+static void test_bitmapCloneIsIndependent ()
+{
+	GpStatus status;
+	GpBitmap *image;
+	GpImage *clone;
+	GpImage *secondClone;
+	GpGraphics *graphics;
+	GpSolidFill *brush;
+	BitmapData data;
+	ARGB pixel;
+
+	GdipCreateBitmapFromScan0 (10, 10, 0, PixelFormat32bppARGB, NULL, &image);
+	GdipBitmapSetPixel (image, 1, 1, 0xFF112233);
+	assertEqualInt (GdipCloneImage ((GpImage *) image, &clone), Ok);
+	assertEqualInt (GdipCloneImage (clone, &secondClone), Ok);
+
+	// Writing to the original doesn't change the clones.
+	GdipBitmapSetPixel (image, 1, 1, 0xFF445566);
+	GdipBitmapGetPixel ((GpBitmap *) clone, 1, 1, &pixel);
+	assertEqualARGB (pixel, 0xFF112233);
+
+	// Nor does writing to a clone change the original or the other clone.
+	memset (&data, 0, sizeof (data));
+	status = GdipBitmapLockBits ((GpBitmap *) clone, NULL, ImageLockModeWrite, PixelFormat32bppARGB, &data);
+	assertEqualInt (status, Ok);
+	((ARGB *) ((BYTE *) data.Scan0 + data.Stride))[1] = 0xFF778899;
+	GdipBitmapUnlockBits ((GpBitmap *) clone, &data);
+
+	GdipGetImageGraphicsContext (secondClone, &graphics);
+	GdipCreateSolidFill (0xFF0000FF, &brush);
+	GdipFillRectangleI (graphics, (GpBrush *) brush, 0, 0, 5, 5);
+	GdipDeleteGraphics (graphics);
+	GdipDeleteBrush ((GpBrush *) brush);
+
+	GdipBitmapGetPixel (image, 1, 1, &pixel);
+	assertEqualARGB (pixel, 0xFF445566);
+	GdipBitmapGetPixel ((GpBitmap *) clone, 1, 1, &pixel);
+	assertEqualARGB (pixel, 0xFF778899);
+	GdipBitmapGetPixel ((GpBitmap *) secondClone, 1, 1, &pixel);
+	assertEqualARGB (pixel, 0xFF0000FF);
+
+	// Each of them can go away first.
+	GdipDisposeImage (clone);
+	GdipBitmapGetPixel ((GpBitmap *) secondClone, 1, 1, &pixel);
+	assertEqualARGB (pixel, 0xFF0000FF);
+	GdipDisposeImage ((GpImage *) image);
+	GdipDisposeImage (secondClone);
+}
+
+static void test_bitmapReadOnlyLockOfClone ()
+{
+	GpStatus status;
+	GpBitmap *image;
+	GpImage *clone;
+	BitmapData data;
+	ARGB pixel;
+
+	GdipCreateBitmapFromScan0 (10, 10, 0, PixelFormat32bppARGB, NULL, &image);
+	GdipBitmapSetPixel (image, 1, 1, 0xFF112233);
+	assertEqualInt (GdipCloneImage ((GpImage *) image, &clone), Ok);
+
+	// Writing through a read only lock doesn't change the clone.
+	memset (&data, 0, sizeof (data));
+	status = GdipBitmapLockBits (image, NULL, ImageLockModeRead, PixelFormat32bppARGB, &data);
+	assertEqualInt (status, Ok);
+	((ARGB *) ((BYTE *) data.Scan0 + data.Stride))[1] = 0xFF778899;
+	GdipBitmapUnlockBits (image, &data);
+
+	GdipBitmapGetPixel ((GpBitmap *) clone, 1, 1, &pixel);
+	assertEqualARGB (pixel, 0xFF112233);
+
+	GdipDisposeImage ((GpImage *) image);
+	GdipDisposeImage (clone);
+}
+
+#if !defined(USE_WINDOWS_GDIPLUS)
+static void test_bitmapConvertFormat ()
+{
+	static const ARGB colors[] = { 0xFF000000, 0xFFFF0000, 0xFF00FF00, 0xFF123456, 0xFFFFFFFF };
+	GpBitmap *image;
+	PixelFormat format;
+	ColorPalette *palette;
+	ARGB pixel;
+	INT x, y;
+
+	GdipCreateBitmapFromScan0 (16, 16, 0, PixelFormat32bppARGB, NULL, &image);
+	for (y = 0; y < 16; y++) {
+		for (x = 0; x < 16; x++)
+			GdipBitmapSetPixel (image, x, y, colors[(x + y) % 5]);
+	}
+
+	// An optimal palette keeps the colors of an image that has few of them.
+	assertEqualInt (GdipBitmapConvertFormat (image, PixelFormat8bppIndexed, DitherTypeErrorDiffusion, PaletteTypeOptimal, NULL, 0), Ok);
+	GdipGetImagePixelFormat ((GpImage *) image, &format);
+	assertEqualInt (format, PixelFormat8bppIndexed);
+	for (y = 0; y < 16; y++) {
+		for (x = 0; x < 16; x++) {
+			GdipBitmapGetPixel (image, x, y, &pixel);
+			assertEqualARGB (pixel, colors[(x + y) % 5]);
+		}
+	}
+
+	assertEqualInt (GdipBitmapConvertFormat (image, PixelFormat32bppARGB, DitherTypeNone, PaletteTypeCustom, NULL, 0), Ok);
+	GdipGetImagePixelFormat ((GpImage *) image, &format);
+	assertEqualInt (format, PixelFormat32bppARGB);
+	GdipBitmapGetPixel (image, 3, 0, &pixel);
+	assertEqualARGB (pixel, 0xFF123456);
+
+	// Fixed palettes.
+	palette = (ColorPalette *) malloc (sizeof (ColorPalette) + 255 * sizeof (ARGB));
+	palette->Count = 2;
+	assertEqualInt (GdipInitializePalette (palette, PaletteTypeFixedBW, 0, FALSE, NULL), Ok);
+	assertEqualInt (palette->Count, 2);
+	assertEqualARGB (palette->Entries[0], 0xFF000000);
+	assertEqualARGB (palette->Entries[1], 0xFFFFFFFF);
+
+	assertEqualInt (GdipBitmapConvertFormat (image, PixelFormat1bppIndexed, DitherTypeNone, PaletteTypeCustom, palette, 0), Ok);
+	GdipBitmapGetPixel (image, 4, 0, &pixel);
+	assertEqualARGB (pixel, 0xFFFFFFFF);
+	GdipBitmapGetPixel (image, 3, 0, &pixel);
+	assertEqualARGB (pixel, 0xFF000000);
+
+	palette->Count = 2;
+	assertEqualInt (GdipInitializePalette (palette, PaletteTypeFixedHalftone8, 0, FALSE, NULL), InsufficientBuffer);
+	palette->Count = 256;
+	assertEqualInt (GdipInitializePalette (palette, PaletteTypeFixedHalftone8, 0, FALSE, NULL), Ok);
+	assertEqualInt (palette->Count, 8);
+
+	// Negative tests.
+	assertEqualInt (GdipBitmapConvertFormat (NULL, PixelFormat8bppIndexed, DitherTypeNone, PaletteTypeOptimal, NULL, 0), InvalidParameter);
+	assertEqualInt (GdipBitmapConvertFormat (image, PixelFormat8bppIndexed, DitherTypeNone, PaletteTypeCustom, NULL, 0), InvalidParameter);
+	assertEqualInt (GdipBitmapConvertFormat (image, PixelFormat8bppIndexed, DitherTypeNone, PaletteTypeOptimal, NULL, 101), InvalidParameter);
+	assertEqualInt (GdipInitializePalette (NULL, PaletteTypeFixedBW, 0, FALSE, NULL), InvalidParameter);
+	assertEqualInt (GdipInitializePalette (palette, PaletteTypeOptimal, 16, FALSE, NULL), InvalidParameter);
+
+	free (palette);
+	GdipDisposeImage ((GpImage *) image);
+}
+
+static void test_bitmapConvertFormatErrorDiffusion ()
+{
+	GpBitmap *image;
+	ColorPalette *palette;
+	BitmapData data;
+	Rect rect = {0, 0, 200, 130};
+	ARGB *row;
+	ARGB pixel;
+	ARGB first;
+	INT white[2] = {0, 0};
+	BOOL restarted = TRUE;
+	INT x, y;
+
+	// A gradient from black on the left to white on the right, in every row.
+	GdipCreateBitmapFromScan0 (rect.Width, rect.Height, 0, PixelFormat32bppARGB, NULL, &image);
+	assertEqualInt (GdipBitmapLockBits (image, &rect, ImageLockModeWrite, PixelFormat32bppARGB, &data), Ok);
+	for (y = 0; y < rect.Height; y++) {
+		row = (ARGB *) ((BYTE *) data.Scan0 + data.Stride * y);
+		for (x = 0; x < rect.Width; x++)
+			row[x] = 0xFF000000 | (x * 255 / (rect.Width - 1)) * 0x010101;
+	}
+	assertEqualInt (GdipBitmapUnlockBits (image, &data), Ok);
+
+	palette = (ColorPalette *) malloc (sizeof (ColorPalette) + sizeof (ARGB));
+	palette->Count = 2;
+	assertEqualInt (GdipInitializePalette (palette, PaletteTypeFixedBW, 0, FALSE, NULL), Ok);
+	assertEqualInt (GdipBitmapConvertFormat (image, PixelFormat1bppIndexed, DitherTypeErrorDiffusion, PaletteTypeCustom, palette, 0), Ok);
+
+	// The errors are carried down past row 64 (where the rows are split to be mapped in parallel otherwise), so it
+	// doesn't start over like the first row, and the rows around it are as light as each other.
+	for (x = 0; x < rect.Width; x++) {
+		GdipBitmapGetPixel (image, x, 0, &first);
+		GdipBitmapGetPixel (image, x, 64, &pixel);
+		if (pixel != first)
+			restarted = FALSE;
+	}
+	assertEqualInt (restarted, FALSE);
+
+	for (y = 56; y < 72; y++) {
+		for (x = 0; x < rect.Width; x++) {
+			GdipBitmapGetPixel (image, x, y, &pixel);
+			if (pixel == 0xFFFFFFFF)
+				white[y / 64]++;
+		}
+	}
+	assertSimilarFloat ((REAL) white[0], (REAL) white[1], rect.Width * 8 / 50);
+
+	free (palette);
+	GdipDisposeImage ((GpImage *) image);
+}
+#endif
+
 static void test_readExifResolution ()
 {
 	REAL resolution;
@@ -1228,6 +1739,45 @@ static void test_readExifResolution ()
 	freeWchar (bitmapFile);
 }
 
+static void test_readExifPropertiesAfterClone ()
+{
+	GpBitmap *bitmap;
+	GpImage *clone;
+	GpBitmap *written;
+	UINT count;
+	UINT cloneCount;
+	UINT size;
+	PropertyItem *item;
+	WCHAR *bitmapFile = createWchar ("test-exif.jpg");
+
+	// The EXIF data is only parsed when the properties are first asked for; clones taken before get them as well.
+	assertEqualInt (GdipCreateBitmapFromFile (bitmapFile, &bitmap), Ok);
+	assertEqualInt (GdipCloneImage ((GpImage *) bitmap, &clone), Ok);
+	assertEqualInt (GdipCloneImage ((GpImage *) bitmap, (GpImage **) &written), Ok);
+
+	assertEqualInt (GdipGetPropertyCount ((GpImage *) bitmap, &count), Ok);
+	GdipDisposeImage ((GpImage *) bitmap);
+
+	assertEqualInt (GdipGetPropertyCount (clone, &cloneCount), Ok);
+	assertEqualInt (cloneCount, count);
+
+	if (GdipGetPropertyItemSize (clone, PropertyTagXResolution, &size) == Ok) {
+		item = (PropertyItem *) malloc (size);
+		assertEqualInt (GdipGetPropertyItem (clone, PropertyTagXResolution, size, item), Ok);
+		assertEqualInt (item->type, PropertyTagTypeRational);
+		assertEqualInt (item->length, 8);
+		free (item);
+	}
+
+	// Writing to the pixels before doesn't lose them either.
+	assertEqualInt (GdipBitmapSetPixel (written, 0, 0, 0xFF00FF00), Ok);
+	assertEqualInt (GdipGetPropertyCount ((GpImage *) written, &cloneCount), Ok);
+	assertEqualInt (cloneCount, count);
+
+	GdipDisposeImage ((GpImage *) written);
+	GdipDisposeImage (clone);
+	freeWchar (bitmapFile);
+}
 
 int
 main(int argc, char**argv)
@@ -1242,9 +1792,25 @@ main(int argc, char**argv)
 	test_createBitmapFromGraphics ();
 	test_bitmapSetPixel ();
 	test_bitmapGetPixel ();
+#if !defined(USE_WINDOWS_GDIPLUS)
+	test_bitmapGetSetPixels ();
+#endif
 	test_bitmapLockBits ();
 	test_bitmapUnlockBits ();
+	test_bitmapLockBitsConversion ();
+#if !defined(USE_WINDOWS_GDIPLUS)
+	test_bitmapLockBitsPremultiply ();
+	test_bitmapLockBitsInPlace ();
+#endif
+	test_bitmapDrawPreservesPixels ();
+	test_bitmapCloneIsIndependent ();
+	test_bitmapReadOnlyLockOfClone ();
+#if !defined(USE_WINDOWS_GDIPLUS)
+	test_bitmapConvertFormat ();
+	test_bitmapConvertFormatErrorDiffusion ();
+#endif
 	test_readExifResolution ();
+	test_readExifPropertiesAfterClone ();
 
 	SHUTDOWN;
 	return 0;
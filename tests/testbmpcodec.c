@@ -5275,6 +5275,69 @@ static void test_invalidImageData ()
 	createFile (missingFinalLine, OutOfMemory);
 }
 
+static void test_largeImage ()
+{
+	// Large enough for the file to be read through a mapping of it, where that is supported.
+	const INT width = 300;
+	const INT height = 100;
+	const INT stride = width * 3 + 3 - (width * 3 + 3) % 4;
+	const INT size = 54 + stride * height;
+	for (int topDown = 0; topDown < 2; topDown++)
+	{
+		const INT fileHeight = topDown ? -height : height;
+		BYTE *buffer = (BYTE *) calloc (size, 1);
+		BYTE header[] = {
+			/* Signature */ 0x42, 0x4D,
+			/* File Size */ (BYTE) size, (BYTE) (size >> 8), (BYTE) (size >> 16), 0x00,
+			/* Reserved */  0x00, 0x00, 0x00, 0x00,
+			/* Offset */    0x36, 0x00, 0x00, 0x00,
+			/* Header Size */      0x28, 0x00, 0x00, 0x00,
+			/* Width */            (BYTE) width, (BYTE) (width >> 8), 0x00, 0x00,
+			/* Height */           (BYTE) fileHeight, (BYTE) (fileHeight >> 8), (BYTE) (fileHeight >> 16), (BYTE) (fileHeight >> 24),
+			/* Planes */           0x01, 0x00,
+			/* Bit Count */        0x18, 0x00,
+			/* Compression */      0x00, 0x00, 0x00, 0x00,
+			/* Image Size */       0x00, 0x00, 0x00, 0x00,
+			/* Horizontal */       0x00, 0x00, 0x00, 0x00,
+			/* Vertical */         0x00, 0x00, 0x00, 0x00,
+			/* Colors Used */      0x00, 0x00, 0x00, 0x00,
+			/* Important Colors */ 0x00, 0x00, 0x00, 0x00
+		};
+		memcpy (buffer, header, sizeof (header));
+		for (int y = 0; y < height; y++)
+		{
+			BYTE *row = buffer + 54 + (topDown ? y : height - y - 1) * stride;
+			for (int x = 0; x < width; x++)
+			{
+				row[x * 3] = (BYTE) x;
+				row[x * 3 + 1] = (BYTE) y;
+				row[x * 3 + 2] = (BYTE) (x + y);
+			}
+		}
+
+		FILE *f = fopen (file, "wb+");
+		assert (f);
+		fwrite ((void *) buffer, sizeof (BYTE), size, f);
+		fclose (f);
+		free (buffer);
+
+		assertEqualInt (GdipLoadImageFromFile (wFile, &image), Ok);
+		verifyBitmap (image, bmpRawFormat, PixelFormat24bppRGB, width, height, bmpFlags, 0, TRUE);
+
+		ARGB pixel;
+		GdipBitmapGetPixel ((GpBitmap *) image, 0, 0, &pixel);
+		assertEqualARGB (pixel, 0xFF000000);
+		GdipBitmapGetPixel ((GpBitmap *) image, 299, 0, &pixel);
+		assertEqualARGB (pixel, 0xFF2B002B);
+		GdipBitmapGetPixel ((GpBitmap *) image, 17, 99, &pixel);
+		assertEqualARGB (pixel, 0xFF746311);
+		GdipBitmapGetPixel ((GpBitmap *) image, 299, 99, &pixel);
+		assertEqualARGB (pixel, 0xFF8E632B);
+
+		GdipDisposeImage (image);
+	}
+}
+
 int
 main (int argc, char**argv)
 {
@@ -5319,6 +5382,7 @@ main (int argc, char**argv)
 	test_invalidHeaderSize ();
 	test_invalidImageData ();
 	test_valid ();
+	test_largeImage ();
 
 	deleteFile (file);
 
@@ -97,6 +97,168 @@ static void test_validData ()
   createFileSuccess (commentControlBlock, 3, 5);
 }
 
+static void test_animatedFrames ()
+{
+  GpStatus status;
+  GUID dimension;
+  UINT frameCount;
+
+  // 4x4 animation: a red frame, two green pixels drawn over it, then a blue pixel drawn over that.
+  BYTE animation[] = {
+    'G', 'I', 'F', '8', '9', 'a', 4, 0, 4, 0, B8(10000001), 0, 0, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255,
+    '!', 0xFF, 0x0B, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0', 0x03, 0x01, 0x00, 0x00, 0x00,
+    '!', 0xF9, 0x04, 0x04, 0x0A, 0x00, 0x00, 0x00, ',', 0, 0, 0, 0, 4, 0, 4, 0, 0,
+    0x02, 0x0A, 0x4C, 0x98, 0x30, 0x61, 0xC2, 0x84, 0x09, 0x13, 0x26, 0x05, 0x00,
+    '!', 0xF9, 0x04, 0x05, 0x0A, 0x00, 0x00, 0x00, ',', 1, 0, 1, 0, 2, 0, 2, 0, 0,
+    0x02, 0x03, 0x14, 0x08, 0x15, 0x00,
+    '!', 0xF9, 0x04, 0x01, 0x0A, 0x00, 0x00, 0x00, ',', 0, 0, 0, 0, 1, 0, 1, 0, 0,
+    0x02, 0x02, 0x5C, 0x01, 0x00,
+    ';'
+  };
+  ARGB frame0[] = {
+    0xFFFF0000, 0xFFFF0000, 0xFFFF0000, 0xFFFF0000,
+    0xFFFF0000, 0xFFFF0000, 0xFFFF0000, 0xFFFF0000,
+    0xFFFF0000, 0xFFFF0000, 0xFFFF0000, 0xFFFF0000,
+    0xFFFF0000, 0xFFFF0000, 0xFFFF0000, 0xFFFF0000
+  };
+  ARGB frame1[] = {
+    0xFFFF0000, 0xFFFF0000, 0xFFFF0000, 0xFFFF0000,
+    0xFFFF0000, 0xFF00FF00, 0xFFFF0000, 0xFFFF0000,
+    0xFFFF0000, 0xFFFF0000, 0xFF00FF00, 0xFFFF0000,
+    0xFFFF0000, 0xFFFF0000, 0xFFFF0000, 0xFFFF0000
+  };
+  ARGB frame2[] = {
+    0xFF0000FF, 0xFFFF0000, 0xFFFF0000, 0xFFFF0000,
+    0xFFFF0000, 0xFF00FF00, 0xFFFF0000, 0xFFFF0000,
+    0xFFFF0000, 0xFFFF0000, 0xFF00FF00, 0xFFFF0000,
+    0xFFFF0000, 0xFFFF0000, 0xFFFF0000, 0xFFFF0000
+  };
+
+  createFile (animation, Ok);
+
+  status = GdipImageGetFrameDimensionsList (image, &dimension, 1);
+  assertEqualInt (status, Ok);
+  status = GdipImageGetFrameCount (image, &dimension, &frameCount);
+  assertEqualInt (status, Ok);
+  assertEqualInt (frameCount, 3);
+
+  // Frames are composed over the previous ones in whatever order they get selected.
+  status = GdipImageSelectActiveFrame (image, &dimension, 2);
+  assertEqualInt (status, Ok);
+  verifyPixels (image, frame2);
+
+  status = GdipImageSelectActiveFrame (image, &dimension, 0);
+  assertEqualInt (status, Ok);
+  verifyPixels (image, frame0);
+
+  status = GdipImageSelectActiveFrame (image, &dimension, 1);
+  assertEqualInt (status, Ok);
+  verifyPixels (image, frame1);
+
+  status = GdipImageSelectActiveFrame (image, &dimension, 2);
+  assertEqualInt (status, Ok);
+  verifyPixels (image, frame2);
+
+#if !defined(USE_WINDOWS_GDIPLUS)
+  // libgdiplus extension: saving only the changed rectangles gives the same frames.
+  GUID deltaFrames = {0x4FB3682B, 0x756D, 0x49B6, {0xBC, 0x79, 0x2A, 0x5A, 0x26, 0x58, 0x68, 0x63}};
+  LONG delta = 1;
+  EncoderParameters parameters;
+
+  parameters.Count = 1;
+  parameters.Parameter[0].Guid = deltaFrames;
+  parameters.Parameter[0].NumberOfValues = 1;
+  parameters.Parameter[0].Type = EncoderParameterValueTypeLong;
+  parameters.Parameter[0].Value = &delta;
+
+  status = GdipSaveImageToFile (image, wFile, &gifEncoderClsid, &parameters);
+  assertEqualInt (status, Ok);
+  GdipDisposeImage (image);
+
+  status = GdipLoadImageFromFile (wFile, &image);
+  assertEqualInt (status, Ok);
+  status = GdipImageGetFrameCount (image, &dimension, &frameCount);
+  assertEqualInt (status, Ok);
+  assertEqualInt (frameCount, 3);
+
+  status = GdipImageSelectActiveFrame (image, &dimension, 0);
+  assertEqualInt (status, Ok);
+  verifyPixels (image, frame0);
+
+  status = GdipImageSelectActiveFrame (image, &dimension, 1);
+  assertEqualInt (status, Ok);
+  verifyPixels (image, frame1);
+
+  // Frame 1 was at Left=1, Top=1: its changed rectangle is saved there, not offset by that once more.
+  ARGB pixel;
+  status = GdipBitmapGetPixel ((GpBitmap *) image, 1, 1, &pixel);
+  assertEqualInt (status, Ok);
+  assertEqualARGB (pixel, 0xFF00FF00);
+  status = GdipBitmapGetPixel ((GpBitmap *) image, 2, 2, &pixel);
+  assertEqualInt (status, Ok);
+  assertEqualARGB (pixel, 0xFF00FF00);
+  status = GdipBitmapGetPixel ((GpBitmap *) image, 3, 3, &pixel);
+  assertEqualInt (status, Ok);
+  assertEqualARGB (pixel, 0xFFFF0000);
+
+  status = GdipImageSelectActiveFrame (image, &dimension, 2);
+  assertEqualInt (status, Ok);
+  verifyPixels (image, frame2);
+#endif
+
+  GdipDisposeImage (image);
+}
+
+static void test_saveQuantized ()
+{
+#if !defined(USE_WINDOWS_GDIPLUS)
+  // libgdiplus extension: the k-means quantizer and the dithering are selected with encoder parameters.
+  GpStatus status;
+  GpBitmap *bitmap;
+  PixelFormat format;
+  GUID quantizerGuid = {0xDBDDF270, 0xE1AA, 0x42F2, {0xAD, 0x64, 0xB6, 0x14, 0xA1, 0x85, 0x54, 0xB9}};
+  GUID ditherGuid = {0xB15738A4, 0xEB0D, 0x49E6, {0xB9, 0x56, 0x4B, 0x0C, 0x42, 0xFD, 0xD7, 0x71}};
+  LONG quantizer = 1;
+  LONG dither = DitherTypeErrorDiffusion;
+  BYTE buffer[sizeof (EncoderParameters) + sizeof (EncoderParameter)];
+  EncoderParameters *parameters = (EncoderParameters *) buffer;
+
+  // Fewer colors than palette entries: every one of them gets its own entry, so dithering changes nothing.
+  ARGB pixels[] = {
+    0xFFFF0000, 0xFFFF0000, 0xFF00FF00, 0xFF00FF00,
+    0xFFFF0000, 0xFFFF0000, 0xFF00FF00, 0xFF00FF00,
+    0xFF0000FF, 0xFF0000FF, 0xFFFFFFFF, 0xFFFFFFFF,
+    0xFF0000FF, 0xFF0000FF, 0xFFFFFFFF, 0xFF808080
+  };
+
+  status = GdipCreateBitmapFromScan0 (4, 4, 4 * sizeof (ARGB), PixelFormat32bppARGB, (BYTE *) pixels, &bitmap);
+  assertEqualInt (status, Ok);
+
+  parameters->Count = 2;
+  parameters->Parameter[0].Guid = quantizerGuid;
+  parameters->Parameter[0].NumberOfValues = 1;
+  parameters->Parameter[0].Type = EncoderParameterValueTypeLong;
+  parameters->Parameter[0].Value = &quantizer;
+  parameters->Parameter[1].Guid = ditherGuid;
+  parameters->Parameter[1].NumberOfValues = 1;
+  parameters->Parameter[1].Type = EncoderParameterValueTypeLong;
+  parameters->Parameter[1].Value = &dither;
+
+  status = GdipSaveImageToFile ((GpImage *) bitmap, wFile, &gifEncoderClsid, parameters);
+  assertEqualInt (status, Ok);
+  GdipDisposeImage ((GpImage *) bitmap);
+
+  status = GdipLoadImageFromFile (wFile, &image);
+  assertEqualInt (status, Ok);
+  status = GdipGetImagePixelFormat (image, &format);
+  assertEqualInt (status, Ok);
+  assertEqualInt (format, PixelFormat8bppIndexed);
+  verifyPixels (image, pixels);
+
+  GdipDisposeImage (image);
+#endif
+}
+
 static void test_invalidHeader ()
 {
   BYTE noScreenWidth87[]        = {'G', 'I', 'F', '8', '7', 'a'};
@@ -234,6 +396,8 @@ main (int argc, char**argv)
 	STARTUP;
 
   test_validData ();
+  test_animatedFrames ();
+  test_saveQuantized ();
   test_invalidHeader ();
   test_invalidImageRecord ();
   test_invalidExtensionRecord ();
@@ -187,6 +187,75 @@ static void test_loadImageFromFileEmf ()
 	GdipDisposeImage (image);
 }
 
+#if !defined(USE_WINDOWS_GDIPLUS)
+static void verifyImageInfo (const char *fileName)
+{
+	GpStatus status;
+	WCHAR *wFileName = wcharFromChar (fileName);
+	GpImageInfo info;
+	GpImage *image = getImage (fileName);
+	GUID rawFormat;
+	GUID dimension;
+	UINT width;
+	UINT height;
+	PixelFormat pixelFormat;
+	REAL dpiX;
+	REAL dpiY;
+	UINT frameCount;
+
+	status = GdipGetImageInfoFromFile_linux (wFileName, &info);
+	assertEqualInt (status, Ok);
+
+	GdipGetImageRawFormat (image, &rawFormat);
+	GdipGetImageWidth (image, &width);
+	GdipGetImageHeight (image, &height);
+	GdipGetImagePixelFormat (image, &pixelFormat);
+	GdipGetImageHorizontalResolution (image, &dpiX);
+	GdipGetImageVerticalResolution (image, &dpiY);
+	GdipImageGetFrameDimensionsList (image, &dimension, 1);
+	GdipImageGetFrameCount (image, &dimension, &frameCount);
+
+	assert (memcmp (&info.RawFormat, &rawFormat, sizeof (GUID)) == 0);
+	assertEqualInt (info.Width, width);
+	assertEqualInt (info.Height, height);
+	assertEqualInt (info.PixelFormat, pixelFormat);
+	assertEqualFloat (info.DpiX, dpiX);
+	assertEqualFloat (info.DpiY, dpiY);
+	assertEqualInt (info.FrameCount, frameCount);
+
+	GdipDisposeImage (image);
+	freeWchar (wFileName);
+}
+
+static void test_getImageInfoFromFile ()
+{
+	GpStatus status;
+	WCHAR *noSuchFile = createWchar ("noSuchFile.bmp");
+	WCHAR *bmpFile = createWchar ("test.bmp");
+	GpImageInfo info;
+
+	verifyImageInfo ("test.bmp");
+	verifyImageInfo ("test.tif");
+	verifyImageInfo ("test.gif");
+	verifyImageInfo ("test.png");
+	verifyImageInfo ("test.jpg");
+	verifyImageInfo ("test.ico");
+
+	// Negative tests.
+	status = GdipGetImageInfoFromFile_linux (NULL, &info);
+	assertEqualInt (status, InvalidParameter);
+
+	status = GdipGetImageInfoFromFile_linux (bmpFile, NULL);
+	assertEqualInt (status, InvalidParameter);
+
+	status = GdipGetImageInfoFromFile_linux (noSuchFile, &info);
+	assertEqualInt (status, OutOfMemory);
+
+	freeWchar (noSuchFile);
+	freeWchar (bmpFile);
+}
+#endif
+
 static void test_cloneImage ()
 {
 	GpStatus status;
@@ -581,11 +650,21 @@ static void test_getEncoderParameterListSize ()
 
 	status = GdipGetEncoderParameterListSize (image, &gifEncoderClsid, &size);
 	assertEqualInt (status, Ok);
+#if defined(USE_WINDOWS_GDIPLUS)
 	assertEqualInt (size, (is_32bit() ? 64 : 80));
+#else
+	// libgdiplus has additional GIF parameters.
+	assertEqualInt (size, (is_32bit() ? 180 : 208));
+#endif
 
 	status = GdipGetEncoderParameterListSize (image, &pngEncoderClsid, &size);
 	assertEqualInt (status, Ok);
+#if defined(USE_WINDOWS_GDIPLUS)
 	assertEqualInt (size, (is_32bit() ? 32 : 40));
+#else
+	// libgdiplus has additional PNG parameters.
+	assertEqualInt (size, (is_32bit() ? 240 : 272));
+#endif
 
 	status = GdipGetEncoderParameterListSize (image, &jpegEncoderClsid, &size);
 	assertEqualInt (status, Ok);
@@ -635,6 +714,16 @@ static void test_getEncoderParameterList ()
 	GUID quality = {0x1D5BE4B5, 0x0FA4A, 0x452D, {0x9C, 0x0DD, 0x5D, 0x0B3, 0x51, 0x5, 0x0E7, 0x0EB}};
 	GUID luminanceTable = {0x0EDB33BCE, 0x266, 0x4A77, {0x0B9, 0x4, 0x27, 0x21, 0x60, 0x99, 0x0E7, 0x17}};
 	GUID chrominanceTable = {0x0F2E455DC, 0x9B3, 0x4316, {0x82, 0x60, 0x67, 0x6A, 0x0DA, 0x32, 0x48, 0x1C}};
+#if !defined(USE_WINDOWS_GDIPLUS)
+	GUID pngCompressionLevel = {0x9F7B053E, 0x77BB, 0x40F6, {0x91, 0x5B, 0xA6, 0x71, 0xEF, 0x1F, 0x8F, 0x06}};
+	GUID pngCompressionStrategy = {0xAD698DD9, 0x4BA5, 0x476C, {0x9D, 0x92, 0x17, 0xAB, 0x8B, 0x70, 0x39, 0x68}};
+	GUID pngFilter = {0x044E4F64, 0xB6EA, 0x479E, {0xA7, 0x3F, 0xE6, 0x5D, 0x50, 0xD3, 0xFA, 0x1F}};
+	GUID pngPreset = {0x6D26E9D1, 0x3F28, 0x49F7, {0x95, 0x6C, 0xCF, 0x65, 0xAE, 0x2A, 0xA5, 0x32}};
+	GUID pngThreads = {0xEC8EBA92, 0x579A, 0x4282, {0x8D, 0xE1, 0x89, 0x73, 0xEC, 0x6C, 0x5F, 0xF5}};
+	GUID gifQuantizer = {0xDBDDF270, 0xE1AA, 0x42F2, {0xAD, 0x64, 0xB6, 0x14, 0xA1, 0x85, 0x54, 0xB9}};
+	GUID gifDither = {0xB15738A4, 0xEB0D, 0x49E6, {0xB9, 0x56, 0x4B, 0x0C, 0x42, 0xFD, 0xD7, 0x71}};
+	GUID gifDeltaFrames = {0x4FB3682B, 0x756D, 0x49B6, {0xBC, 0x79, 0x2A, 0x5A, 0x26, 0x58, 0x68, 0x63}};
+#endif
 
 	// TIFF encoder.
 	GdipGetEncoderParameterListSize (image, &tifEncoderClsid, &tiffSize);
@@ -680,7 +769,11 @@ static void test_getEncoderParameterList ()
 
 	status = GdipGetEncoderParameterList (image, &gifEncoderClsid, gifSize, parameters);
 	assertEqualInt (status, Ok);
+#if defined(USE_WINDOWS_GDIPLUS)
 	assertEqualInt (parameters->Count, 2);
+#else
+	assertEqualInt (parameters->Count, 5);
+#endif
 
 	assert (memcmp ((void *) &parameters->Parameter[0].Guid, (void *) &imageItems, sizeof (GUID)) == 0);
 	assertEqualInt (parameters->Parameter[0].NumberOfValues, 0);
@@ -692,6 +785,25 @@ static void test_getEncoderParameterList ()
 	assertEqualInt (parameters->Parameter[1].Type, EncoderParameterValueTypeLong);
 	assertEqualInt (((LONG *) parameters->Parameter[1].Value)[0], EncoderValueMultiFrame);
 
+#if !defined(USE_WINDOWS_GDIPLUS)
+	assert (memcmp ((void *) &parameters->Parameter[2].Guid, (void *) &gifQuantizer, sizeof (GUID)) == 0);
+	assertEqualInt (parameters->Parameter[2].NumberOfValues, 2);
+	assertEqualInt (parameters->Parameter[2].Type, EncoderParameterValueTypeLong);
+	assertEqualInt (((LONG *) parameters->Parameter[2].Value)[0], GifQuantizerMedianCut);
+	assertEqualInt (((LONG *) parameters->Parameter[2].Value)[1], GifQuantizerKMeans);
+
+	assert (memcmp ((void *) &parameters->Parameter[3].Guid, (void *) &gifDither, sizeof (GUID)) == 0);
+	assertEqualInt (parameters->Parameter[3].NumberOfValues, 5);
+	assertEqualInt (parameters->Parameter[3].Type, EncoderParameterValueTypeLong);
+	assertEqualInt (((LONG *) parameters->Parameter[3].Value)[0], DitherTypeNone);
+	assertEqualInt (((LONG *) parameters->Parameter[3].Value)[4], DitherTypeErrorDiffusion);
+
+	assert (memcmp ((void *) &parameters->Parameter[4].Guid, (void *) &gifDeltaFrames, sizeof (GUID)) == 0);
+	assertEqualInt (parameters->Parameter[4].NumberOfValues, 1);
+	assertEqualInt (parameters->Parameter[4].Type, EncoderParameterValueTypeLong);
+	assertEqualInt (((LONG *) parameters->Parameter[4].Value)[0], 1);
+#endif
+
 	free (parameters);
 
 	// PNG encoder.
@@ -700,13 +812,50 @@ static void test_getEncoderParameterList ()
 
 	status = GdipGetEncoderParameterList (image, &pngEncoderClsid, pngSize, parameters);
 	assertEqualInt (status, Ok);
+#if defined(USE_WINDOWS_GDIPLUS)
 	assertEqualInt (parameters->Count, 1);
+#else
+	assertEqualInt (parameters->Count, 6);
+#endif
 
 	assert (memcmp ((void *) &parameters->Parameter[0].Guid, (void *) &imageItems, sizeof (GUID)) == 0);
 	assertEqualInt (parameters->Parameter[0].NumberOfValues, 0);
 	assertEqualInt (parameters->Parameter[0].Type, (EncoderParameterValueType) 9);
 	assert (!parameters->Parameter[0].Value);
 
+#if !defined(USE_WINDOWS_GDIPLUS)
+	assert (memcmp ((void *) &parameters->Parameter[1].Guid, (void *) &pngCompressionLevel, sizeof (GUID)) == 0);
+	assertEqualInt (parameters->Parameter[1].NumberOfValues, 1);
+	assertEqualInt (parameters->Parameter[1].Type, EncoderParameterValueTypeLongRange);
+	assertEqualInt (((LONG *) parameters->Parameter[1].Value)[0], 0);
+	assertEqualInt (((LONG *) parameters->Parameter[1].Value)[1], 9);
+
+	assert (memcmp ((void *) &parameters->Parameter[2].Guid, (void *) &pngCompressionStrategy, sizeof (GUID)) == 0);
+	assertEqualInt (parameters->Parameter[2].NumberOfValues, 5);
+	assertEqualInt (parameters->Parameter[2].Type, EncoderParameterValueTypeLong);
+	assertEqualInt (((LONG *) parameters->Parameter[2].Value)[0], PngStrategyDefault);
+	assertEqualInt (((LONG *) parameters->Parameter[2].Value)[4], PngStrategyFixed);
+
+	assert (memcmp ((void *) &parameters->Parameter[3].Guid, (void *) &pngFilter, sizeof (GUID)) == 0);
+	assertEqualInt (parameters->Parameter[3].NumberOfValues, 5);
+	assertEqualInt (parameters->Parameter[3].Type, EncoderParameterValueTypeLong);
+	assertEqualInt (((LONG *) parameters->Parameter[3].Value)[0], PngFilterNone);
+	assertEqualInt (((LONG *) parameters->Parameter[3].Value)[4], PngFilterPaeth);
+
+	assert (memcmp ((void *) &parameters->Parameter[4].Guid, (void *) &pngPreset, sizeof (GUID)) == 0);
+	assertEqualInt (parameters->Parameter[4].NumberOfValues, 3);
+	assertEqualInt (parameters->Parameter[4].Type, EncoderParameterValueTypeLong);
+	assertEqualInt (((LONG *) parameters->Parameter[4].Value)[0], PngEncoderPresetDefault);
+	assertEqualInt (((LONG *) parameters->Parameter[4].Value)[1], PngEncoderPresetFast);
+	assertEqualInt (((LONG *) parameters->Parameter[4].Value)[2], PngEncoderPresetSmallest);
+
+	assert (memcmp ((void *) &parameters->Parameter[5].Guid, (void *) &pngThreads, sizeof (GUID)) == 0);
+	assertEqualInt (parameters->Parameter[5].NumberOfValues, 1);
+	assertEqualInt (parameters->Parameter[5].Type, EncoderParameterValueTypeLongRange);
+	assertEqualInt (((LONG *) parameters->Parameter[5].Value)[0], 0);
+	assertEqualInt (((LONG *) parameters->Parameter[5].Value)[1], 16);
+#endif
+
 	free (parameters);
 
 	// JPEG encoder.
@@ -1634,6 +1783,9 @@ main (int argc, char**argv)
 	test_loadImageFromFileIcon ();
 	test_loadImageFromFileWmf ();
 	test_loadImageFromFileEmf ();
+#if !defined(USE_WINDOWS_GDIPLUS)
+	test_getImageInfoFromFile ();
+#endif
 	test_cloneImage ();
 	test_disposeImage ();
 	test_getImageGraphicsContext ();
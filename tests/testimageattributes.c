@@ -882,6 +882,223 @@ static void test_setImageAttributesCachedBackground()
 	GdipDisposeImageAttributes (attributes);
 }
 
+static void test_drawImageWithAttributes ()
+{
+	GpStatus status;
+	GpImageAttributes *attributes;
+	GpBitmap *source;
+	GpBitmap *destination;
+	GpGraphics *graphics;
+	ARGB color;
+	ColorMap remapTable[1] = {
+		{ {0xFF102030}, {0xFF80FF00} }
+	};
+	const ARGB sourcePixels[5] = { 0xFF102030, 0xFFF0E0D0, 0xFF818080, 0xFF000000, 0xFF7F90FF };
+	const ARGB expectedPixels[5] = { 0xFF00FF00, 0xFFFFFFFF, 0xFFFF0000, 0xFF000000, 0xFF00FFFF };
+
+	GdipCreateBitmapFromScan0 (5, 1, 0, PixelFormat32bppARGB, NULL, &source);
+	GdipCreateBitmapFromScan0 (5, 1, 0, PixelFormat32bppARGB, NULL, &destination);
+	for (int x = 0; x < 5; x++)
+		GdipBitmapSetPixel (source, x, 0, sourcePixels[x]);
+
+	GdipCreateImageAttributes (&attributes);
+	GdipSetImageAttributesRemapTable (attributes, ColorAdjustTypeBitmap, TRUE, 1, remapTable);
+	GdipSetImageAttributesThreshold (attributes, ColorAdjustTypeBitmap, TRUE, 0.5f);
+
+	GdipGetImageGraphicsContext (destination, &graphics);
+	status = GdipDrawImageRectRectI (graphics, source, 0, 0, 5, 1, 0, 0, 5, 1, UnitPixel, attributes, NULL, NULL);
+	assertEqualInt (status, Ok);
+
+	// The remap table is applied before the threshold, which leaves the alpha channel untouched.
+	for (int x = 0; x < 5; x++) {
+		GdipBitmapGetPixel (destination, x, 0, &color);
+		assertEqualInt (color, expectedPixels[x]);
+	}
+
+	// The source bitmap is not modified.
+	GdipBitmapGetPixel (source, 0, 0, &color);
+	assertEqualInt (color, 0xFF102030);
+
+	GdipDeleteGraphics (graphics);
+	GdipDisposeImage ((GpImage *) source);
+	GdipDisposeImage ((GpImage *) destination);
+	GdipDisposeImageAttributes (attributes);
+}
+
+static void test_drawImageWithGamma ()
+{
+	GpStatus status;
+	GpImageAttributes *attributes;
+	GpImageAttributes *clonedAttributes;
+	GpBitmap *source;
+	GpBitmap *destination;
+	GpGraphics *graphics;
+	ARGB color;
+
+	GdipCreateBitmapFromScan0 (1, 1, 0, PixelFormat32bppARGB, NULL, &source);
+	GdipCreateBitmapFromScan0 (1, 1, 0, PixelFormat32bppARGB, NULL, &destination);
+	GdipBitmapSetPixel (source, 0, 0, 0xFF80FF00);
+
+	GdipCreateImageAttributes (&attributes);
+	GdipSetImageAttributesGamma (attributes, ColorAdjustTypeBitmap, TRUE, 2.0f);
+
+	// The gamma table is part of the cloned attributes.
+	GdipCloneImageAttributes (attributes, &clonedAttributes);
+	GdipDisposeImageAttributes (attributes);
+
+	GdipGetImageGraphicsContext (destination, &graphics);
+	status = GdipDrawImageRectRectI (graphics, source, 0, 0, 1, 1, 0, 0, 1, 1, UnitPixel, clonedAttributes, NULL, NULL);
+	assertEqualInt (status, Ok);
+
+	GdipBitmapGetPixel (destination, 0, 0, &color);
+	assertEqualInt (color, 0xFF40FF00);
+
+	GdipDeleteGraphics (graphics);
+	GdipDisposeImage ((GpImage *) source);
+	GdipDisposeImage ((GpImage *) destination);
+	GdipDisposeImageAttributes (clonedAttributes);
+}
+
+static void test_drawImageWithRemapTable ()
+{
+	GpStatus status;
+	GpImageAttributes *attributes;
+	GpBitmap *source;
+	GpBitmap *destination;
+	GpGraphics *graphics;
+	ARGB color;
+	ColorMap remapTable[3] = {
+		{ {0xFF0000FF}, {0xFF00FF00} },
+		{ {0xFF0000FF}, {0xFFFF0000} },
+		{ {0xFFFFFFFF}, {0xFF000000} }
+	};
+	const ARGB sourcePixels[4] = { 0xFF0000FF, 0xFFFFFFFF, 0xFFFF0000, 0xFF0000FF };
+	const ARGB expectedPixels[4] = { 0xFF00FF00, 0xFF000000, 0xFFFF0000, 0xFF00FF00 };
+
+	GdipCreateBitmapFromScan0 (4, 1, 0, PixelFormat32bppARGB, NULL, &source);
+	GdipCreateBitmapFromScan0 (4, 1, 0, PixelFormat32bppARGB, NULL, &destination);
+	for (int x = 0; x < 4; x++)
+		GdipBitmapSetPixel (source, x, 0, sourcePixels[x]);
+
+	GdipCreateImageAttributes (&attributes);
+	GdipSetImageAttributesRemapTable (attributes, ColorAdjustTypeBitmap, TRUE, 3, remapTable);
+
+	GdipGetImageGraphicsContext (destination, &graphics);
+	status = GdipDrawImageRectRectI (graphics, source, 0, 0, 4, 1, 0, 0, 4, 1, UnitPixel, attributes, NULL, NULL);
+	assertEqualInt (status, Ok);
+
+	// The first entry for a color wins, unmapped colors are unchanged.
+	for (int x = 0; x < 4; x++) {
+		GdipBitmapGetPixel (destination, x, 0, &color);
+		assertEqualInt (color, expectedPixels[x]);
+	}
+
+	GdipDeleteGraphics (graphics);
+	GdipDisposeImage ((GpImage *) source);
+	GdipDisposeImage ((GpImage *) destination);
+	GdipDisposeImageAttributes (attributes);
+}
+
+#if !defined(USE_WINDOWS_GDIPLUS)
+static void test_drawImageWithAttributesCache ()
+{
+	GpStatus status;
+	GpImageAttributes *attributes;
+	GpBitmap *source;
+	GpBitmap *destination;
+	GpGraphics *graphics;
+	ARGB color;
+	UINT size;
+	UINT hits;
+	UINT misses;
+	UINT count;
+	UINT bytes;
+	UINT initialHits;
+	UINT initialMisses;
+
+	GdipCreateBitmapFromScan0 (1, 1, 0, PixelFormat32bppARGB, NULL, &source);
+	GdipCreateBitmapFromScan0 (1, 1, 0, PixelFormat32bppARGB, NULL, &destination);
+	GdipBitmapSetPixel (source, 0, 0, 0xFF80FF00);
+	GdipCreateImageAttributes (&attributes);
+	GdipSetImageAttributesGamma (attributes, ColorAdjustTypeBitmap, TRUE, 2.0f);
+	GdipGetImageGraphicsContext (destination, &graphics);
+
+	status = GdipGetImageAttributesCacheSize_linux (&size);
+	assertEqualInt (status, Ok);
+	assertEqualInt (size > 0, TRUE);
+
+	GdipGetImageAttributesCacheStatistics_linux (&initialHits, &initialMisses, &count, &bytes);
+
+	// The second draw reuses the processed bitmap.
+	GdipDrawImageRectRectI (graphics, source, 0, 0, 1, 1, 0, 0, 1, 1, UnitPixel, attributes, NULL, NULL);
+	GdipDrawImageRectRectI (graphics, source, 0, 0, 1, 1, 0, 0, 1, 1, UnitPixel, attributes, NULL, NULL);
+	GdipGetImageAttributesCacheStatistics_linux (&hits, &misses, &count, &bytes);
+	assertEqualInt (hits - initialHits, 1);
+	assertEqualInt (misses - initialMisses, 1);
+	assertEqualInt (count, 1);
+	assertEqualInt (bytes, 4);
+
+	// Changing the source invalidates the processed bitmap.
+	GdipBitmapSetPixel (source, 0, 0, 0xFF0000FF);
+	GdipDrawImageRectRectI (graphics, source, 0, 0, 1, 1, 0, 0, 1, 1, UnitPixel, attributes, NULL, NULL);
+	GdipBitmapGetPixel (destination, 0, 0, &color);
+	assertEqualInt (color, 0xFF0000FF);
+
+	// Changing the attributes invalidates the processed bitmap.
+	GdipSetImageAttributesGamma (attributes, ColorAdjustTypeBitmap, TRUE, 0.5f);
+	GdipDrawImageRectRectI (graphics, source, 0, 0, 1, 1, 0, 0, 1, 1, UnitPixel, attributes, NULL, NULL);
+	GdipGetImageAttributesCacheStatistics_linux (&hits, &misses, &count, &bytes);
+	assertEqualInt (hits - initialHits, 1);
+	assertEqualInt (misses - initialMisses, 3);
+
+	// Disposing the source drops its entries.
+	GdipDeleteGraphics (graphics);
+	GdipDisposeImage ((GpImage *) source);
+	GdipGetImageAttributesCacheStatistics_linux (&hits, &misses, &count, &bytes);
+	assertEqualInt (count, 0);
+	assertEqualInt (bytes, 0);
+
+	// A zero budget disables the cache.
+	status = GdipSetImageAttributesCacheSize_linux (0);
+	assertEqualInt (status, Ok);
+	GdipCreateBitmapFromScan0 (1, 1, 0, PixelFormat32bppARGB, NULL, &source);
+	GdipGetImageGraphicsContext (destination, &graphics);
+	GdipDrawImageRectRectI (graphics, source, 0, 0, 1, 1, 0, 0, 1, 1, UnitPixel, attributes, NULL, NULL);
+	GdipGetImageAttributesCacheStatistics_linux (&hits, &misses, &count, &bytes);
+	assertEqualInt (count, 0);
+
+	GdipSetImageAttributesCacheSize_linux (size);
+
+	// Pixels owned by the caller can change without GDI+ knowing, so they are never cached.
+	ARGB pixels[1] = { 0xFF00FF00 };
+	GpBitmap *callerSource;
+	GdipCreateBitmapFromScan0 (1, 1, 4, PixelFormat32bppARGB, (BYTE *) pixels, &callerSource);
+	GdipDrawImageRectRectI (graphics, callerSource, 0, 0, 1, 1, 0, 0, 1, 1, UnitPixel, attributes, NULL, NULL);
+	GdipBitmapGetPixel (destination, 0, 0, &color);
+	assertEqualInt (color, 0xFF00FF00);
+
+	pixels[0] = 0xFF0000FF;
+	GdipDrawImageRectRectI (graphics, callerSource, 0, 0, 1, 1, 0, 0, 1, 1, UnitPixel, attributes, NULL, NULL);
+	GdipBitmapGetPixel (destination, 0, 0, &color);
+	assertEqualInt (color, 0xFF0000FF);
+	GdipGetImageAttributesCacheStatistics_linux (&hits, &misses, &count, &bytes);
+	assertEqualInt (count, 0);
+	GdipDisposeImage ((GpImage *) callerSource);
+
+	// Negative tests.
+	status = GdipGetImageAttributesCacheSize_linux (NULL);
+	assertEqualInt (status, InvalidParameter);
+
+	status = GdipGetImageAttributesCacheStatistics_linux (NULL, &misses, &count, &bytes);
+	assertEqualInt (status, InvalidParameter);
+
+	GdipDeleteGraphics (graphics);
+	GdipDisposeImage ((GpImage *) source);
+	GdipDisposeImage ((GpImage *) destination);
+	GdipDisposeImageAttributes (attributes);
+}
+#endif
+
 int
 main (int argc, char**argv)
 {
@@ -904,6 +1121,12 @@ main (int argc, char**argv)
 	test_setImageAttributesICMMode ();
 	test_getImageAttributesAdjustedPalette ();
 	test_setImageAttributesCachedBackground ();
+	test_drawImageWithAttributes ();
+	test_drawImageWithGamma ();
+	test_drawImageWithRemapTable ();
+#if !defined(USE_WINDOWS_GDIPLUS)
+	test_drawImageWithAttributesCache ();
+#endif
 
 	SHUTDOWN;
 	return 0;
@@ -407,6 +407,392 @@ static void test_units ()
     createFileSuccess (unknownUnit, PixelFormat24bppRGB, 1, 1, ImageFlagsColorSpaceRGB | ImageFlagsHasRealPixelSize | ImageFlagsReadOnly, 2);
 }
 
+#if !defined(USE_WINDOWS_GDIPLUS)
+// Saves a width x height JPEG, red on the left half and blue on the right one.
+static void createHalvesFile (INT width, INT height)
+{
+    GpStatus status;
+    GpBitmap *bitmap;
+    BitmapData data;
+    Rect rect = {0, 0, width, height};
+    ARGB *row;
+    INT x;
+    INT y;
+
+    status = GdipCreateBitmapFromScan0 (width, height, 0, PixelFormat24bppRGB, NULL, &bitmap);
+    assertEqualInt (status, Ok);
+
+    status = GdipBitmapLockBits (bitmap, &rect, ImageLockModeWrite, PixelFormat32bppARGB, &data);
+    assertEqualInt (status, Ok);
+    for (y = 0; y < height; y++) {
+        row = (ARGB *) ((BYTE *) data.Scan0 + data.Stride * y);
+        for (x = 0; x < width; x++)
+            row[x] = x < width / 2 ? 0xFFFF0000 : 0xFF0000FF;
+    }
+    status = GdipBitmapUnlockBits (bitmap, &data);
+    assertEqualInt (status, Ok);
+
+    status = GdipSaveImageToFile ((GpImage *) bitmap, wFile, &jpegEncoderClsid, NULL);
+    assertEqualInt (status, Ok);
+    GdipDisposeImage ((GpImage *) bitmap);
+}
+
+static void assertSimilarColor (GpImage *image, INT x, INT y, ARGB expected)
+{
+    ARGB color;
+    GpStatus status = GdipBitmapGetPixel ((GpBitmap *) image, x, y, &color);
+    assertEqualInt (status, Ok);
+
+    assertSimilarFloat ((REAL) ((color >> 16) & 0xFF), (REAL) ((expected >> 16) & 0xFF), 16);
+    assertSimilarFloat ((REAL) ((color >> 8) & 0xFF), (REAL) ((expected >> 8) & 0xFF), 16);
+    assertSimilarFloat ((REAL) (color & 0xFF), (REAL) (expected & 0xFF), 16);
+}
+
+static void test_loadScaled ()
+{
+    GpStatus status;
+    UINT width;
+    UINT height;
+
+    createHalvesFile (1024, 768);
+
+    // The smallest of the 1/2, 1/4 and 1/8 scales that is still large enough.
+    status = GdipLoadImageFromFileScaled_linux (wFile, 200, 100, &image);
+    assertEqualInt (status, Ok);
+    GdipGetImageWidth (image, &width);
+    GdipGetImageHeight (image, &height);
+    assertEqualInt (width, 256);
+    assertEqualInt (height, 192);
+    assertSimilarColor (image, 10, 96, 0xFFFF0000);
+    assertSimilarColor (image, 245, 96, 0xFF0000FF);
+    GdipDisposeImage (image);
+
+    status = GdipLoadImageFromFileScaled_linux (wFile, 1, 1, &image);
+    assertEqualInt (status, Ok);
+    GdipGetImageWidth (image, &width);
+    assertEqualInt (width, 128);
+    GdipDisposeImage (image);
+
+    // Not scaled up.
+    status = GdipLoadImageFromFileScaled_linux (wFile, 2000, 2000, &image);
+    assertEqualInt (status, Ok);
+    GdipGetImageWidth (image, &width);
+    assertEqualInt (width, 1024);
+    GdipDisposeImage (image);
+
+    status = GdipLoadImageFromFileScaled_linux (wFile, 0, 100, &image);
+    assertEqualInt (status, InvalidParameter);
+}
+
+static void test_thumbnail ()
+{
+    GpStatus status;
+    GpImage *thumbnail;
+    BitmapData data;
+    Rect rect = {0, 0, 1536, 1024};
+    ARGB *row;
+    UINT width;
+    INT x;
+    INT y;
+
+    // Large enough to keep its compressed data, to be decoded again, scaled down, for the thumbnail.
+    createHalvesFile (1536, 1024);
+
+    status = GdipLoadImageFromFile (wFile, &image);
+    assertEqualInt (status, Ok);
+
+    status = GdipGetImageThumbnail (image, 64, 48, &thumbnail, NULL, NULL);
+    assertEqualInt (status, Ok);
+    GdipGetImageWidth (thumbnail, &width);
+    assertEqualInt (width, 64);
+    assertSimilarColor (thumbnail, 4, 24, 0xFFFF0000);
+    assertSimilarColor (thumbnail, 60, 24, 0xFF0000FF);
+    GdipDisposeImage (thumbnail);
+
+    // Once modified, the thumbnail shows the modified pixels.
+    status = GdipBitmapLockBits ((GpBitmap *) image, &rect, ImageLockModeWrite, PixelFormat32bppARGB, &data);
+    assertEqualInt (status, Ok);
+    for (y = 0; y < rect.Height; y++) {
+        row = (ARGB *) ((BYTE *) data.Scan0 + data.Stride * y);
+        for (x = 0; x < rect.Width; x++)
+            row[x] = 0xFF00FF00;
+    }
+    status = GdipBitmapUnlockBits ((GpBitmap *) image, &data);
+    assertEqualInt (status, Ok);
+
+    status = GdipGetImageThumbnail (image, 64, 48, &thumbnail, NULL, NULL);
+    assertEqualInt (status, Ok);
+    assertSimilarColor (thumbnail, 4, 24, 0xFF00FF00);
+    GdipDisposeImage (thumbnail);
+
+    GdipDisposeImage (image);
+}
+
+static void test_loadRegion ()
+{
+    GpStatus status;
+    GpImage *full;
+    Rect region = {490, 100, 44, 30};
+    Rect outside = {1000, 0, 25, 1};
+    Rect negative = {-1, 0, 2, 2};
+    ARGB expected;
+    ARGB color;
+    UINT width;
+    UINT height;
+    INT x;
+    INT y;
+
+    createHalvesFile (1024, 768);
+
+    status = GdipLoadImageFromFile (wFile, &full);
+    assertEqualInt (status, Ok);
+
+    // The region has the same pixels as the whole image.
+    status = GdipLoadImageFromFileRegion_linux (wFile, &region, &image);
+    assertEqualInt (status, Ok);
+    GdipGetImageWidth (image, &width);
+    GdipGetImageHeight (image, &height);
+    assertEqualInt (width, 44);
+    assertEqualInt (height, 30);
+    for (y = 0; y < region.Height; y++) {
+        for (x = 0; x < region.Width; x++) {
+            GdipBitmapGetPixel ((GpBitmap *) full, region.X + x, region.Y + y, &expected);
+            GdipBitmapGetPixel ((GpBitmap *) image, x, y, &color);
+            assertEqualInt (color, expected);
+        }
+    }
+    assertSimilarColor (image, 2, 15, 0xFFFF0000);
+    assertSimilarColor (image, 41, 15, 0xFF0000FF);
+    GdipDisposeImage (image);
+    GdipDisposeImage (full);
+
+    status = GdipLoadImageFromFileRegion_linux (wFile, &outside, &image);
+    assertEqualInt (status, InvalidParameter);
+
+    status = GdipLoadImageFromFileRegion_linux (wFile, &negative, &image);
+    assertEqualInt (status, InvalidParameter);
+
+    status = GdipLoadImageFromFileRegion_linux (wFile, NULL, &image);
+    assertEqualInt (status, InvalidParameter);
+}
+
+// An in-memory stream for the delegates, which can claim not to be seekable and not to know its size.
+static BYTE *delegateData;
+static int delegateLength;
+static int delegatePosition;
+static BOOL delegateSeekFails;
+static int delegateReads;
+
+static int getDelegateHeader (BYTE *buffer, int size)
+{
+    size = size < delegateLength ? size : delegateLength;
+    memcpy (buffer, delegateData, size);
+    return size;
+}
+
+static int getDelegateBytes (BYTE *buffer, int size, BOOL peek)
+{
+    size = size < delegateLength - delegatePosition ? size : delegateLength - delegatePosition;
+    if (buffer)
+        memcpy (buffer, delegateData + delegatePosition, size);
+    if (!peek)
+        delegatePosition += size;
+    delegateReads++;
+    return size;
+}
+
+static long seekDelegate (int offset, int whence)
+{
+    long position;
+
+    if (delegateSeekFails)
+        return -1;
+
+    position = whence == SEEK_SET ? offset : whence == SEEK_CUR ? delegatePosition + offset : delegateLength + offset;
+    if (position < 0 || position > delegateLength)
+        return -1;
+
+    delegatePosition = (int) position;
+    return position;
+}
+
+static long getDelegateSize ()
+{
+    return delegateLength;
+}
+
+static void loadFromDelegate (GpImage *expected, SeekDelegate seek, SizeDelegate size, BOOL seekFails)
+{
+    GpStatus status;
+    ARGB expectedColor;
+    ARGB color;
+    UINT width;
+    UINT height;
+    UINT x;
+    UINT y;
+
+    delegatePosition = 0;
+    delegateSeekFails = seekFails;
+    delegateReads = 0;
+
+    status = GdipLoadImageFromDelegate_linux (getDelegateHeader, getDelegateBytes, NULL, seek, NULL, size, &image);
+    assertEqualInt (status, Ok);
+    assert (delegateReads > 0);
+
+    GdipGetImageWidth (image, &width);
+    GdipGetImageHeight (image, &height);
+    assertEqualInt (width, 256);
+    assertEqualInt (height, 64);
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            GdipBitmapGetPixel ((GpBitmap *) expected, x, y, &expectedColor);
+            GdipBitmapGetPixel ((GpBitmap *) image, x, y, &color);
+            assertEqualInt (color, expectedColor);
+        }
+    }
+    assertSimilarColor (image, 10, 32, 0xFFFF0000);
+    assertSimilarColor (image, 245, 32, 0xFF0000FF);
+    GdipDisposeImage (image);
+}
+
+static void test_loadFromDelegate ()
+{
+    GpStatus status;
+    GpImage *expected;
+    FILE *f;
+    BYTE *original;
+    long originalLength;
+    size_t bytesRead;
+    int offset;
+    int i;
+
+    createHalvesFile (256, 64);
+
+    f = fopen (file, "rb");
+    assert (f);
+    fseek (f, 0, SEEK_END);
+    originalLength = ftell (f);
+    fseek (f, 0, SEEK_SET);
+    original = (BYTE *) malloc (originalLength);
+    assert (original);
+    bytesRead = fread (original, 1, originalLength, f);
+    assertEqualInt ((int) bytesRead, (int) originalLength);
+    fclose (f);
+
+    // Largest APP15 segments after the SOI marker: libjpeg skips them, from inside the delegate stream's
+    // buffer to past its end, and back into the buffer when the stream isn't seekable.
+    delegateLength = (int) originalLength + 5 * (2 + 65535);
+    delegateData = (BYTE *) malloc (delegateLength);
+    assert (delegateData);
+    memcpy (delegateData, original, 2);
+    offset = 2;
+    for (i = 0; i < 5; i++) {
+        delegateData[offset++] = 0xFF;
+        delegateData[offset++] = 0xEF;
+        delegateData[offset++] = 0xFF;
+        delegateData[offset++] = 0xFF;
+        memset (delegateData + offset, i, 65533);
+        offset += 65533;
+    }
+    memcpy (delegateData + offset, original + 2, originalLength - 2);
+    free (original);
+
+    f = fopen (file, "wb");
+    assert (f);
+    fwrite (delegateData, 1, delegateLength, f);
+    fclose (f);
+
+    status = GdipLoadImageFromFile (wFile, &expected);
+    assertEqualInt (status, Ok);
+
+    // Buffered as a whole, since the size is known and small.
+    loadFromDelegate (expected, seekDelegate, getDelegateSize, FALSE);
+    // Buffered in chunks, skipping with the seek delegate.
+    loadFromDelegate (expected, seekDelegate, NULL, FALSE);
+    // Buffered in chunks, skipping by reading once seeking fails.
+    loadFromDelegate (expected, seekDelegate, NULL, TRUE);
+    // No seek delegate at all.
+    loadFromDelegate (expected, NULL, NULL, FALSE);
+
+    GdipDisposeImage (expected);
+    free (delegateData);
+    delegateData = NULL;
+}
+
+// Every pixel of these 7x1 images has C = 0x40, M = 0x80, Y = 0xC0 and K = 0xE0, which is
+// inverted when there is an Adobe marker. 7 pixels covers both the vectorized and the scalar
+// conversion.
+static void test_cmykColors ()
+{
+    BYTE adobeCmykData[] = {
+        /* -- Start of Image -- */
+        0xFF, 0xD8,
+
+        /* -- Adobe APP14 -- */
+        /* APP14 */          0xFF, 0xEE,
+        /* Length */         0x00, 0x0E,
+        /* Identifier */     0x41, 0x64, 0x6F, 0x62, 0x65,
+        /* Version */        0x00, 0x64,
+        /* Flags0 */         0x00, 0x00,
+        /* Flags1 */         0x00, 0x00,
+        /* ColorTransform */ 0x00,
+
+        /* -- Define Quantization Table -- */
+        /* DQT */  0xFF, 0xDB,
+        /* Data */ 0x00, 0x43, 0x00, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+
+        /* -- Start of Frame, 7x1 with 4 components -- */
+        /* SOF0 */ 0xFF, 0xC0,
+        /* Data */ 0x00, 0x14, 0x08, 0x00, 0x01, 0x00, 0x07, 0x04, 0x43, 0x11, 0x00, 0x4D, 0x11, 0x00, 0x59, 0x11, 0x00, 0x4B, 0x11, 0x00,
+
+        /* -- Define Huffman Tables -- */
+        /* DHT */  0xFF, 0xC4,
+        /* Data */ 0x00, 0x15, 0x00, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0A, 0x00, 0xFF, 0xC4, 0x00, 0x14, 0x10, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+
+        /* -- Scan -- */
+        /* SOS */             0xFF, 0xDA,
+        /* Compressed Data */ 0x00, 0x0E, 0x04, 0x43, 0x00, 0x4D, 0x00, 0x59, 0x00, 0x4B, 0x00, 0x00, 0x3F, 0x00, 0x3F, 0xE8, 0x80, 0x0C, 0x01,
+
+        /* -- End of Image -- */
+        0xFF, 0xD9
+    };
+    BYTE cmykData[] = {
+        /* -- Start of Image -- */
+        0xFF, 0xD8,
+
+        /* -- Define Quantization Table -- */
+        /* DQT */  0xFF, 0xDB,
+        /* Data */ 0x00, 0x43, 0x00, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+
+        /* -- Start of Frame, 7x1 with 4 components -- */
+        /* SOF0 */ 0xFF, 0xC0,
+        /* Data */ 0x00, 0x14, 0x08, 0x00, 0x01, 0x00, 0x07, 0x04, 0x43, 0x11, 0x00, 0x4D, 0x11, 0x00, 0x59, 0x11, 0x00, 0x4B, 0x11, 0x00,
+
+        /* -- Define Huffman Tables -- */
+        /* DHT */  0xFF, 0xC4,
+        /* Data */ 0x00, 0x15, 0x00, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0A, 0x00, 0xFF, 0xC4, 0x00, 0x14, 0x10, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+
+        /* -- Scan -- */
+        /* SOS */             0xFF, 0xDA,
+        /* Compressed Data */ 0x00, 0x0E, 0x04, 0x43, 0x00, 0x4D, 0x00, 0x59, 0x00, 0x4B, 0x00, 0x00, 0x3F, 0x00, 0x3F, 0xE8, 0x80, 0x0C, 0x01,
+
+        /* -- End of Image -- */
+        0xFF, 0xD9
+    };
+    INT x;
+
+    createFile (adobeCmykData, Ok);
+    for (x = 0; x < 7; x++)
+        assertSimilarColor (image, x, 0, 0xFFA87038);
+    GdipDisposeImage (image);
+
+    createFile (cmykData, Ok);
+    for (x = 0; x < 7; x++)
+        assertSimilarColor (image, x, 0, 0xFF070F17);
+    GdipDisposeImage (image);
+}
+#endif
+
 int
 main (int argc, char**argv)
 {
@@ -414,6 +800,13 @@ main (int argc, char**argv)
 
   test_valid ();
   test_units ();
+#if !defined(USE_WINDOWS_GDIPLUS)
+  test_loadScaled ();
+  test_thumbnail ();
+  test_loadRegion ();
+  test_loadFromDelegate ();
+  test_cmykColors ();
+#endif
 
   deleteFile (file);
 
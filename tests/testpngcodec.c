@@ -817,6 +817,151 @@ static void test_invalidImageFormat()
 	createFile (indexed16bpp, OutOfMemory);
 }
 
+#if !defined(USE_WINDOWS_GDIPLUS)
+static GUID pngCompressionLevel = {0x9F7B053E, 0x77BB, 0x40F6, {0x91, 0x5B, 0xA6, 0x71, 0xEF, 0x1F, 0x8F, 0x06}};
+static GUID pngFilter = {0x044E4F64, 0xB6EA, 0x479E, {0xA7, 0x3F, 0xE6, 0x5D, 0x50, 0xD3, 0xFA, 0x1F}};
+static GUID pngPreset = {0x6D26E9D1, 0x3F28, 0x49F7, {0x95, 0x6C, 0xCF, 0x65, 0xAE, 0x2A, 0xA5, 0x32}};
+static GUID pngThreads = {0xEC8EBA92, 0x579A, 0x4282, {0x8D, 0xE1, 0x89, 0x73, 0xEC, 0x6C, 0x5F, 0xF5}};
+
+static void saveWithParameters (GpBitmap *bitmap, EncoderParameters *parameters)
+{
+	GpStatus status;
+	ARGB color;
+	INT x;
+	INT y;
+
+	status = GdipSaveImageToFile ((GpImage *) bitmap, wFile, &pngEncoderClsid, parameters);
+	assertEqualInt (status, Ok);
+
+	status = GdipLoadImageFromFile (wFile, &image);
+	assertEqualInt (status, Ok);
+	for (y = 0; y < 16; y++) {
+		for (x = 0; x < 16; x++) {
+			status = GdipBitmapGetPixel ((GpBitmap *) image, x, y, &color);
+			assertEqualInt (status, Ok);
+			assertEqualInt (color, 0xFF000000 | (x * 16) << 16 | (y * 16) << 8 | ((x + y) & 0xFF));
+		}
+	}
+	GdipDisposeImage (image);
+}
+
+static void test_encoderParameters ()
+{
+	GpStatus status;
+	GpBitmap *bitmap;
+	EncoderParameters *parameters;
+	LONG preset = PngEncoderPresetFast;
+	LONG level = 9;
+	LONG filter = PngFilterNone | PngFilterSub | PngFilterUp | PngFilterAverage | PngFilterPaeth;
+	LONG invalid = 10;
+	INT x;
+	INT y;
+
+	status = GdipCreateBitmapFromScan0 (16, 16, 0, PixelFormat32bppRGB, NULL, &bitmap);
+	assertEqualInt (status, Ok);
+	for (y = 0; y < 16; y++) {
+		for (x = 0; x < 16; x++)
+			GdipBitmapSetPixel (bitmap, x, y, 0xFF000000 | (x * 16) << 16 | (y * 16) << 8 | ((x + y) & 0xFF));
+	}
+
+	parameters = (EncoderParameters *) malloc (sizeof (EncoderParameters) + sizeof (EncoderParameter));
+
+	parameters->Count = 1;
+	parameters->Parameter[0].Guid = pngPreset;
+	parameters->Parameter[0].NumberOfValues = 1;
+	parameters->Parameter[0].Type = EncoderParameterValueTypeLong;
+	parameters->Parameter[0].Value = &preset;
+	saveWithParameters (bitmap, parameters);
+
+	parameters->Count = 2;
+	parameters->Parameter[0].Guid = pngCompressionLevel;
+	parameters->Parameter[0].Value = &level;
+	parameters->Parameter[1].Guid = pngFilter;
+	parameters->Parameter[1].NumberOfValues = 1;
+	parameters->Parameter[1].Type = EncoderParameterValueTypeLong;
+	parameters->Parameter[1].Value = &filter;
+	saveWithParameters (bitmap, parameters);
+
+	// Out of range values are rejected.
+	parameters->Count = 1;
+	parameters->Parameter[0].Value = &invalid;
+	status = GdipSaveImageToFile ((GpImage *) bitmap, wFile, &pngEncoderClsid, parameters);
+	assertEqualInt (status, InvalidParameter);
+
+	free (parameters);
+	GdipDisposeImage ((GpImage *) bitmap);
+}
+
+static void test_saveWithThreads ()
+{
+	GpStatus status;
+	GpBitmap *bitmap;
+	BitmapData data;
+	EncoderParameters parameters;
+	LONG threads = 4;
+	PixelFormat formats[] = {PixelFormat32bppARGB, PixelFormat24bppRGB};
+	Rect rect = {0, 0, 600, 400};
+	ARGB *row;
+	ARGB expected;
+	int i;
+	INT x;
+	INT y;
+
+	parameters.Count = 1;
+	parameters.Parameter[0].Guid = pngThreads;
+	parameters.Parameter[0].NumberOfValues = 1;
+	parameters.Parameter[0].Type = EncoderParameterValueTypeLong;
+	parameters.Parameter[0].Value = &threads;
+
+	// Large enough to be compressed in several chunks.
+	for (i = 0; i < sizeof (formats) / sizeof (formats[0]); i++) {
+		status = GdipCreateBitmapFromScan0 (rect.Width, rect.Height, 0, formats[i], NULL, &bitmap);
+		assertEqualInt (status, Ok);
+
+		status = GdipBitmapLockBits (bitmap, &rect, ImageLockModeWrite, PixelFormat32bppARGB, &data);
+		assertEqualInt (status, Ok);
+		for (y = 0; y < rect.Height; y++) {
+			row = (ARGB *) ((BYTE *) data.Scan0 + data.Stride * y);
+			for (x = 0; x < rect.Width; x++)
+				row[x] = 0xFF000000 | (x & 0xFF) << 16 | (y & 0xFF) << 8 | ((x * y) & 0xFF);
+		}
+		status = GdipBitmapUnlockBits (bitmap, &data);
+		assertEqualInt (status, Ok);
+
+		status = GdipSaveImageToFile ((GpImage *) bitmap, wFile, &pngEncoderClsid, &parameters);
+		assertEqualInt (status, Ok);
+		GdipDisposeImage ((GpImage *) bitmap);
+
+		status = GdipLoadImageFromFile (wFile, &image);
+		assertEqualInt (status, Ok);
+
+		status = GdipBitmapLockBits ((GpBitmap *) image, &rect, ImageLockModeRead, PixelFormat32bppARGB, &data);
+		assertEqualInt (status, Ok);
+		for (y = 0; y < rect.Height; y++) {
+			row = (ARGB *) ((BYTE *) data.Scan0 + data.Stride * y);
+			for (x = 0; x < rect.Width; x++) {
+				expected = 0xFF000000 | (x & 0xFF) << 16 | (y & 0xFF) << 8 | ((x * y) & 0xFF);
+				if (row[x] != expected) {
+					printf ("Pixel (%d, %d) is 0x%08X, expected 0x%08X\n", x, y, row[x], expected);
+					assert (FALSE);
+				}
+			}
+		}
+		status = GdipBitmapUnlockBits ((GpBitmap *) image, &data);
+		assertEqualInt (status, Ok);
+		GdipDisposeImage (image);
+	}
+
+	// Out of range values are rejected.
+	threads = 17;
+	status = GdipCreateBitmapFromScan0 (1, 1, 0, PixelFormat32bppARGB, NULL, &bitmap);
+	assertEqualInt (status, Ok);
+	status = GdipSaveImageToFile ((GpImage *) bitmap, wFile, &pngEncoderClsid, &parameters);
+	assertEqualInt (status, InvalidParameter);
+	GdipDisposeImage ((GpImage *) bitmap);
+}
+#endif
+
 int
 main (int argc, char**argv)
 {
@@ -832,6 +977,10 @@ main (int argc, char**argv)
 	test_invalidHeaderChunk ();
 	test_invalidImageData ();
 	test_invalidImageFormat ();
+#if !defined(USE_WINDOWS_GDIPLUS)
+	test_encoderParameters ();
+	test_saveWithThreads ();
+#endif
 
 	deleteFile (file);
 
@@ -949,6 +949,238 @@ static void test_invalidSpecificTag ()
 	createFile (largeImageWidthAndHeight, OutOfMemory);
 }
 
+static void test_multiplePages ()
+{
+	GpStatus status;
+	UINT count;
+	UINT cloneCount;
+	UINT size;
+	GpImage *clone;
+	ARGB color;
+	PixelFormat pixelFormat;
+	Rect rect = {0, 0, 1, 1};
+	BitmapData data;
+	GUID pageDimension = {0x7462dc86, 0x6180, 0x4c7e, {0x8e, 0x3f, 0xee, 0x73, 0x33, 0xa7, 0xa4, 0x83}};
+	/* two 1x1 grayscale pages */
+	BYTE twoPages[] = {
+		/* Header */                    0x49, 0x49, 0x2A, 0x00, 0x08, 0x00, 0x00, 0x00,
+		/* Page 1 Tags */               0x09, 0x00,
+		/* ImageWidth */                0x00, 0x01, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+		/* ImageHeight */               0x01, 0x01, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+		/* BitsPerSample */             0x02, 0x01, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00,
+		/* Compression */               0x03, 0x01, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+		/* PhotometricInterpretation */ 0x06, 0x01, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+		/* StripOffsets */              0x11, 0x01, 0x04, 0x00, 0x01, 0x00, 0x00, 0x00, 0x7A, 0x00, 0x00, 0x00,
+		/* SamplesPerPixel */           0x15, 0x01, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+		/* RowsPerStrip */              0x16, 0x01, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+		/* StripByteCounts */           0x17, 0x01, 0x04, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+		/* NextIFD */                   0x7C, 0x00, 0x00, 0x00,
+		/* Page 1 Pixels */             0x40, 0x00,
+		/* Page 2 Tags */               0x09, 0x00,
+		/* ImageWidth */                0x00, 0x01, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+		/* ImageHeight */               0x01, 0x01, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+		/* BitsPerSample */             0x02, 0x01, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00,
+		/* Compression */               0x03, 0x01, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+		/* PhotometricInterpretation */ 0x06, 0x01, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+		/* StripOffsets */              0x11, 0x01, 0x04, 0x00, 0x01, 0x00, 0x00, 0x00, 0xEE, 0x00, 0x00, 0x00,
+		/* SamplesPerPixel */           0x15, 0x01, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+		/* RowsPerStrip */              0x16, 0x01, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+		/* StripByteCounts */           0x17, 0x01, 0x04, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+		/* NextIFD */                   0x00, 0x00, 0x00, 0x00,
+		/* Page 2 Pixels */             0xC0
+	};
+
+	createFile (twoPages, Ok);
+
+	status = GdipImageGetFrameCount (image, &pageDimension, &count);
+	assertEqualInt (status, Ok);
+	assertEqualInt (count, 2);
+
+	status = GdipGetImagePixelFormat (image, &pixelFormat);
+	assertEqualInt (status, Ok);
+	assertEqualInt (pixelFormat, PixelFormat8bppIndexed);
+
+	status = GdipBitmapGetPixel ((GpBitmap *) image, 0, 0, &color);
+	assertEqualInt (status, Ok);
+	assertEqualInt (color, 0xFF404040);
+
+	status = GdipImageSelectActiveFrame (image, &pageDimension, 1);
+	assertEqualInt (status, Ok);
+	status = GdipBitmapGetPixel ((GpBitmap *) image, 0, 0, &color);
+	assertEqualInt (status, Ok);
+	assertEqualInt (color, 0xFFC0C0C0);
+
+	/* Each page has its own properties, also in clones. */
+	status = GdipGetPropertyItemSize (image, PropertyTagImageWidth, &size);
+	assertEqualInt (status, Ok);
+	status = GdipGetPropertyCount (image, &count);
+	assertEqualInt (status, Ok);
+	status = GdipCloneImage (image, &clone);
+	assertEqualInt (status, Ok);
+	status = GdipGetPropertyCount (clone, &cloneCount);
+	assertEqualInt (status, Ok);
+	assertEqualInt (cloneCount, count);
+	GdipDisposeImage (clone);
+
+#if !defined(USE_WINDOWS_GDIPLUS)
+	/* Evicted pages are decoded again when selected. */
+	status = GdipImageSetFrameEviction_linux (image, TRUE);
+	assertEqualInt (status, Ok);
+
+	status = GdipImageSelectActiveFrame (image, &pageDimension, 0);
+	assertEqualInt (status, Ok);
+	status = GdipBitmapGetPixel ((GpBitmap *) image, 0, 0, &color);
+	assertEqualInt (status, Ok);
+	assertEqualInt (color, 0xFF404040);
+
+	status = GdipImageSelectActiveFrame (image, &pageDimension, 1);
+	assertEqualInt (status, Ok);
+	status = GdipBitmapGetPixel ((GpBitmap *) image, 0, 0, &color);
+	assertEqualInt (status, Ok);
+	assertEqualInt (color, 0xFFC0C0C0);
+
+	/* Modified pages are not evicted. */
+	status = GdipBitmapLockBits ((GpBitmap *) image, &rect, ImageLockModeWrite, PixelFormat8bppIndexed, &data);
+	assertEqualInt (status, Ok);
+	*(BYTE *) data.Scan0 = 0x80;
+	status = GdipBitmapUnlockBits ((GpBitmap *) image, &data);
+	assertEqualInt (status, Ok);
+	status = GdipImageSelectActiveFrame (image, &pageDimension, 0);
+	assertEqualInt (status, Ok);
+	status = GdipImageSelectActiveFrame (image, &pageDimension, 1);
+	assertEqualInt (status, Ok);
+	status = GdipBitmapGetPixel ((GpBitmap *) image, 0, 0, &color);
+	assertEqualInt (status, Ok);
+	assertEqualInt (color, 0xFF808080);
+
+	/* Locked pages are not evicted either. */
+	status = GdipImageSelectActiveFrame (image, &pageDimension, 0);
+	assertEqualInt (status, Ok);
+	status = GdipBitmapLockBits ((GpBitmap *) image, &rect, ImageLockModeRead, PixelFormat8bppIndexed, &data);
+	assertEqualInt (status, Ok);
+	BYTE lockedPixel = *(BYTE *) data.Scan0;
+	status = GdipImageSelectActiveFrame (image, &pageDimension, 1);
+	assertEqualInt (status, Ok);
+	assertEqualInt (*(BYTE *) data.Scan0, lockedPixel);
+	status = GdipImageSelectActiveFrame (image, &pageDimension, 0);
+	assertEqualInt (status, Ok);
+	status = GdipBitmapUnlockBits ((GpBitmap *) image, &data);
+	assertEqualInt (status, Ok);
+
+	status = GdipImageSetFrameEviction_linux (NULL, TRUE);
+	assertEqualInt (status, InvalidParameter);
+#endif
+
+	GdipDisposeImage (image);
+}
+
+static void test_bilevel ()
+{
+	GpStatus status;
+	ARGB color;
+	PixelFormat pixelFormat;
+	INT x;
+	/* 8x1, the first half black (photometric interpretation is WhiteIsZero) */
+	BYTE bilevel[] = {
+		/* Header */                    0x49, 0x49, 0x2A, 0x00, 0x08, 0x00, 0x00, 0x00,
+		/* Number of Tags */            0x09, 0x00,
+		/* ImageWidth */                0x00, 0x01, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00,
+		/* ImageHeight */               0x01, 0x01, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+		/* BitsPerSample */             0x02, 0x01, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+		/* Compression */               0x03, 0x01, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+		/* PhotometricInterpretation */ 0x06, 0x01, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		/* StripOffsets */              0x11, 0x01, 0x04, 0x00, 0x01, 0x00, 0x00, 0x00, 0x7A, 0x00, 0x00, 0x00,
+		/* SamplesPerPixel */           0x15, 0x01, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+		/* RowsPerStrip */              0x16, 0x01, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+		/* StripByteCounts */           0x17, 0x01, 0x04, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+		/* NextIFD */                   0x00, 0x00, 0x00, 0x00,
+		/* Pixels */                    0xF0
+	};
+
+	createFile (bilevel, Ok);
+
+	status = GdipGetImagePixelFormat (image, &pixelFormat);
+	assertEqualInt (status, Ok);
+	assertEqualInt (pixelFormat, PixelFormat1bppIndexed);
+
+	for (x = 0; x < 8; x++) {
+		status = GdipBitmapGetPixel ((GpBitmap *) image, x, 0, &color);
+		assertEqualInt (status, Ok);
+		assertEqualInt (color, x < 4 ? 0xFF000000 : 0xFFFFFFFF);
+	}
+
+	/* Indexed bitmaps are saved as is. */
+	status = GdipSaveImageToFile (image, wFile, &tifEncoderClsid, NULL);
+	assertEqualInt (status, Ok);
+	GdipDisposeImage (image);
+
+	status = GdipLoadImageFromFile (wFile, &image);
+	assertEqualInt (status, Ok);
+
+	status = GdipGetImagePixelFormat (image, &pixelFormat);
+	assertEqualInt (status, Ok);
+	assertEqualInt (pixelFormat, PixelFormat1bppIndexed);
+
+	for (x = 0; x < 8; x++) {
+		status = GdipBitmapGetPixel ((GpBitmap *) image, x, 0, &color);
+		assertEqualInt (status, Ok);
+		assertEqualInt (color, x < 4 ? 0xFF000000 : 0xFFFFFFFF);
+	}
+
+	GdipDisposeImage (image);
+}
+
+static void test_largeImage ()
+{
+	GpStatus status;
+	GpBitmap *bitmap;
+	BitmapData data;
+	Rect rect = {0, 0, 1200, 1000};
+	INT x;
+	INT y;
+	BYTE *row;
+
+	/* Large enough to be read by several threads. */
+	status = GdipCreateBitmapFromScan0 (rect.Width, rect.Height, 0, PixelFormat24bppRGB, NULL, &bitmap);
+	assertEqualInt (status, Ok);
+
+	status = GdipBitmapLockBits (bitmap, &rect, ImageLockModeWrite, PixelFormat24bppRGB, &data);
+	assertEqualInt (status, Ok);
+	for (y = 0; y < rect.Height; y++) {
+		row = (BYTE *) data.Scan0 + data.Stride * y;
+		for (x = 0; x < rect.Width; x++) {
+			row[x * 3] = (BYTE) x;
+			row[x * 3 + 1] = (BYTE) y;
+			row[x * 3 + 2] = (BYTE) (x + y);
+		}
+	}
+	status = GdipBitmapUnlockBits (bitmap, &data);
+	assertEqualInt (status, Ok);
+
+	status = GdipSaveImageToFile ((GpImage *) bitmap, wFile, &tifEncoderClsid, NULL);
+	assertEqualInt (status, Ok);
+	GdipDisposeImage ((GpImage *) bitmap);
+
+	status = GdipLoadImageFromFile (wFile, &image);
+	assertEqualInt (status, Ok);
+
+	status = GdipBitmapLockBits ((GpBitmap *) image, &rect, ImageLockModeRead, PixelFormat24bppRGB, &data);
+	assertEqualInt (status, Ok);
+	for (y = 0; y < rect.Height; y++) {
+		row = (BYTE *) data.Scan0 + data.Stride * y;
+		for (x = 0; x < rect.Width; x++) {
+			if (row[x * 3] != (BYTE) x || row[x * 3 + 1] != (BYTE) y || row[x * 3 + 2] != (BYTE) (x + y)) {
+				printf ("Pixel (%d, %d) differs\n", x, y);
+				assert (FALSE);
+			}
+		}
+	}
+	status = GdipBitmapUnlockBits ((GpBitmap *) image, &data);
+	assertEqualInt (status, Ok);
+
+	GdipDisposeImage (image);
+}
+
 int
 main (int argc, char**argv)
 {
@@ -962,6 +1194,9 @@ main (int argc, char**argv)
 	test_invalidTag ();
 	test_missingTag ();
 	test_invalidSpecificTag ();
+	test_multiplePages ();
+	test_bilevel ();
+	test_largeImage ();
 
 	deleteFile (file);
 